@@ -1,110 +1,386 @@
 #include "BatteryTestingService.h"
 #include "ChannelService.h"
+#include "ControlRoutines.h"
+#include "RpmsgChannelCtrlService.h"
+#include "SimulatedChannelService.h"
 #include "Task.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
+
+// Number of tasks of each per-sample type that can be in flight without heap allocation
+#define TASK_POOL_CAPACITY 4096
+
+// Default number of channels per batch data task, one cache line of a table column
+#define DEFAULT_DATA_TASK_BLOCK_SIZE 16
+
+// Number of commands that can be waiting for an ingest thread
+#define INGEST_COMMAND_CAPACITY 256
+
+// Number of control tasks that can be waiting in the control lane, and pooled per type
+#define CONTROL_COMMAND_CAPACITY 1024
+
+// Window over which the ingest threads measure their frame rate, in nanoseconds
+#define FRAME_RATE_WINDOW_NS 1000000000ULL
+
+/**
+ * @brief Constructor for the BatteryTestingService class, for a single M4 endpoint.
+ *
+ * @param numWorkerThreads The initial number of worker threads to create.
+ */
+BatteryTestingService::BatteryTestingService(size_t numWorkerThreads) :
+    BatteryTestingService(ChannelTopology::singleEndpoint(), numWorkerThreads) {}
 
 /**
  * @brief Constructor for the BatteryTestingService class.
  *
- * Initializes the worker threads, M4 data reception thread,
- * and the low-level services.
+ * Sizes the channel table and the per-channel engines for all endpoints of
+ * the topology, creates the worker threads, then one ingest lane per
+ * endpoint with its M4 endpoint, control service and thread. With the
+ * simulation of the topology enabled, each endpoint is a SimulatedM4Endpoint
+ * and a SimulatedChannelCtrlService sharing one ChannelSimulator. With a
+ * checkpoint file, the channels it holds are resumed before the ingest
+ * threads start.
  *
+ * @param topology The boards and M4 cores of the rack.
  * @param numWorkerThreads The initial number of worker threads to create.
  */
-BatteryTestingService::BatteryTestingService(size_t numWorkerThreads) :
+BatteryTestingService::BatteryTestingService(const ChannelTopology& topology, size_t numWorkerThreads) :
+    topology(topology),
+    taskScheduler(topology.getChannelCount()),
+    workerCount(0),
     stopThreads(false),
-    m4DataThread(&BatteryTestingService::m4DataThreadFunction, this) {
-    
-    // Initialize channel control service
-    channelCtrlService = new DummyChannelCtrlService();
+    stopAutoscaler(false),
+    dataTaskBlockSize(DEFAULT_DATA_TASK_BLOCK_SIZE),
+    taskCoalescer(topology.getChannelCount()),
+    stopErrorReporter(false),
+    filterEngine(topology.getChannelCount()),
+    fittingEngine(topology.getChannelCount()),
+    stepEngine(topology.getChannelCount()),
+    controlRoutines(topology.getChannelCount()),
+    filteringTaskPool(TASK_POOL_CAPACITY),
+    fittingTaskPool(TASK_POOL_CAPACITY),
+    callbackTaskPool(TASK_POOL_CAPACITY),
+    ccTaskPool(CONTROL_COMMAND_CAPACITY),
+    cvTaskPool(CONTROL_COMMAND_CAPACITY),
+    restTaskPool(CONTROL_COMMAND_CAPACITY),
+    batchTaskPool(CONTROL_COMMAND_CAPACITY),
+    profileTaskPool(CONTROL_COMMAND_CAPACITY),
+    controlExecutor(CONTROL_COMMAND_CAPACITY),
+    telemetryRecorder(topology.getEndpointCount(), topology.getChannelCount()),
+    callbackCounts(new std::atomic<uint64_t>[topology.getChannelCount()]) {
+    for (uint32_t channel = 0; channel < topology.getChannelCount(); ++channel) {
+        callbackCounts[channel].store(0, std::memory_order_relaxed);
+    }
+    TaskOverloadConfig overload;
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        overloadPolicies[priority].store(overload.policies[priority], std::memory_order_relaxed);
+        droppedTasks[priority].store(0, std::memory_order_relaxed);
+        blockedTasks[priority].store(0, std::memory_order_relaxed);
+    }
 
-    // Initialize channel data service
-    channelDataService = new DummyChannelDataService();
+    // Report the errors of the threads started below
+    errorReporterThread = std::thread(&BatteryTestingService::errorReporterThreadFunction, this);
     
-    // Create worker threads
-    for (size_t i = 0; i < numWorkerThreads; ++i) {
-        workerThreads.emplace_back(&BatteryTestingService::workerThreadFunction, this);
+    // Place the global channel table in shared memory if it is published to other processes
+    void* tableMemory = nullptr;
+    if (!topology.getSharedTable().name.empty()) {
+        std::string error;
+        if (sharedTable.create(topology.getSharedTable(), topology.getChannelCount(), error)) {
+            tableMemory = sharedTable.getTableMemory();
+        } else {
+            std::cerr << "Cannot publish the channel table: " << error << std::endl;
+        }
+    }
+
+    // Initialize the channel data service with the global channel table
+    const ChannelSimulationConfig& simulation = topology.getSimulation();
+    if (simulation.enabled) {
+        channelDataService = new SimulatedChannelDataService(topology.getChannelCount(), tableMemory);
+    } else {
+        channelDataService = new TableChannelDataService(topology.getChannelCount(), tableMemory);
+    }
+    sharedTable.markLive();
+
+    // Map the checkpoint and move the filter and fitting state into it before any sample is processed
+    const CheckpointConfig& checkpointConfig = topology.getCheckpoint();
+    if (!checkpointConfig.path.empty()) {
+        std::string error;
+        size_t filterStateSize = checkpointConfig.engineState ? filterEngine.getStateSize() : 0;
+        size_t fittingStateSize = checkpointConfig.engineState ? fittingEngine.getStateSize() : 0;
+        if (checkpoint.open(checkpointConfig, topology.getChannelCount(), filterStateSize, fittingStateSize, error)) {
+            if (void* state = checkpoint.getFilterState()) {
+                filterEngine.moveState(state, checkpoint.isRestored());
+            }
+            if (void* state = checkpoint.getFittingState()) {
+                fittingEngine.moveState(state, checkpoint.isRestored());
+            }
+        } else {
+            std::cerr << "Cannot open the checkpoint: " << error << std::endl;
+        }
+    }
+
+    // Create worker threads, each owning a range of channel shards
+    setWorkerThreadCount(numWorkerThreads);
+
+    // Create the M4 endpoint and channel control service of every endpoint
+    for (size_t i = 0; i < topology.getEndpointCount(); ++i) {
+        const ChannelEndpointConfig& config = topology.getEndpoint(i);
+        M4Endpoint* endpoint = nullptr;
+        ChannelCtrlService* ctrlService = nullptr;
+        if (simulation.enabled) {
+            auto simulator = std::make_shared<ChannelSimulator>(config.channelCount, simulation.battery,
+                topology.getFirstChannel(i) + 1);
+            endpoint = new SimulatedM4Endpoint(simulator, simulation.sampleRate);
+            ctrlService = new SimulatedChannelCtrlService(simulator);
+        } else {
+            endpoint = new RpmsgM4Endpoint(config.dataDevice);
+            if (config.controlDevice.empty()) {
+                ctrlService = new DummyChannelCtrlService(config.board, config.core);
+            } else {
+                ctrlService = new RpmsgChannelCtrlService(config.controlDevice);
+            }
+        }
+        ingestLanes.push_back(std::make_unique<IngestLane>(topology.getFirstChannel(i), config.channelCount,
+            endpoint, ctrlService));
+        ingestLanes.back()->frameParser.setRecorder(&telemetryRecorder, i);
+    }
+
+    // Resume the checkpointed channels while no ingest thread owns their state yet
+    if (checkpoint.isRestored()) {
+        uint64_t start = monotonicNanoseconds();
+        size_t resumed = 0;
+        for (auto& lane : ingestLanes) {
+            resumed += resumeLane(*lane);
+        }
+        std::cout << "Resumed " << resumed << " channels from " << checkpoint.getPath() << " in "
+                  << (monotonicNanoseconds() - start) / 1000 << " us" << std::endl;
+    }
+
+    // Start receiving M4 data last, once the services and task pools exist
+    for (auto& lane : ingestLanes) {
+        lane->thread = std::thread(&BatteryTestingService::m4DataThreadFunction, this, std::ref(*lane));
     }
 }
 
+/**
+ * @brief Constructor for the IngestLane struct.
+ *
+ * @param firstChannel The global channel of local channel 0 of the endpoint.
+ * @param channelCount The number of channels of the endpoint.
+ * @param endpoint The source of the endpoint's frames; ownership passes to the lane.
+ * @param ctrlService The control service of the endpoint; ownership passes to the lane.
+ */
+BatteryTestingService::IngestLane::IngestLane(uint32_t firstChannel, uint32_t channelCount,
+    M4Endpoint* endpoint, ChannelCtrlService* ctrlService) :
+    firstChannel(firstChannel),
+    channelCount(channelCount),
+    endpoint(endpoint),
+    ctrlService(ctrlService),
+    frameParser(firstChannel, channelCount),
+    commands(INGEST_COMMAND_CAPACITY),
+    timers(channelCount * TIMERS_PER_CHANNEL, monotonicNanoseconds()),
+    checkpoints(channelCount) {}
+
 /**
  * @brief Destructor for the BatteryTestingService class.
  *
  * Cleans up the threads and low-level services.
  */
 BatteryTestingService::~BatteryTestingService() {
+    // Stop serving metrics and resizing the pool before tearing it down
+    stopMetricsExporter();
+    disableAutoscaler();
+
     // Signal all threads to stop
     stopThreads = true;
+    size_t count = workerCount.load();
+    for (size_t i = 0; i < count; ++i) {
+        workers[i].retire = true;
+    }
     
-    // Notify all worker threads to check the stop flag
-    taskQueueCV.notify_all();
+    // Wake all parked worker threads and the ingest threads to check the stop flag
+    taskScheduler.wakeAll();
+    for (auto& lane : ingestLanes) {
+        lane->endpoint->wake();
+    }
     
     // Join all worker threads
-    for (auto& thread : workerThreads) {
-        if (thread.joinable()) {
-            thread.join();
+    for (size_t i = 0; i < count; ++i) {
+        if (workers[i].thread.joinable()) {
+            workers[i].thread.join();
         }
     }
     
-    // Join m4DataThread
-    if (m4DataThread.joinable()) {
-        m4DataThread.join();
+    // Join the ingest threads
+    for (auto& lane : ingestLanes) {
+        if (lane->thread.joinable()) {
+            lane->thread.join();
+        }
+    }
+
+    // Run the remaining control commands while the services still exist
+    controlExecutor.shutdown();
+
+    // Report the errors of the stopped threads
+    {
+        std::lock_guard<std::mutex> lock(errorReporterMutex);
+        stopErrorReporter = true;
+    }
+    errorReporterCV.notify_all();
+    if (errorReporterThread.joinable()) {
+        errorReporterThread.join();
     }
     
     // Clean up services
-    delete channelCtrlService;
+    for (auto& lane : ingestLanes) {
+        delete lane->endpoint;
+        delete lane->ctrlService;
+    }
     delete channelDataService;
+    sharedTable.close();
     
     // Clean up any remaining tasks in the queue
-    std::lock_guard<std::mutex> lock(taskQueueMutex);
-    while (!taskQueue.empty()) {
-        Task* task = taskQueue.top();
-        taskQueue.pop();
-        delete task;
+    uint32_t shard;
+    while (Task* task = taskScheduler.tryPop(0, shard)) {
+        TaskHandle(task).reset();
+        taskScheduler.finish(shard);
     }
 }
 
 
 /**
- * @brief Adds a task to the task queue.
+ * @brief Adds a task to the lane of its priority in the task scheduler.
  *
- * @param task The task to add.
+ * Never takes a lock. If the lane is full, a task of a Drop priority is
+ * dropped, otherwise the caller yields until a worker makes room. The
+ * callers are the ingest threads, so the wait is bounded: after
+ * blockTimeoutNs, or at once when the service stops, the task is dropped
+ * and counted instead.
+ *
+ * @param task The task to add. Ownership passes to the scheduler.
+ * @param coalesceSlot The slot claimed for the task from taskCoalescer, or nullptr.
  */
-void BatteryTestingService::addTask(Task* task) {
-    std::lock_guard<std::mutex> lock(taskQueueMutex);
-    taskQueue.push(task);
-    taskQueueCV.notify_one();
+void BatteryTestingService::addTask(TaskHandle task, std::atomic<uint32_t>* coalesceSlot) {
+    task->coalesceSlot = coalesceSlot;
+    task->enqueueTime = monotonicNanoseconds();
+    if (taskScheduler.push(task.get())) {
+        task.release();
+        return;
+    }
+
+    size_t priority = static_cast<size_t>(task->priority);
+    if (overloadPolicies[priority].load(std::memory_order_relaxed) == OverloadPolicy::Drop) {
+        droppedTasks[priority].fetch_add(1, std::memory_order_relaxed);
+        TaskCoalescer::release(*task);
+        return;
+    }
+    blockedTasks[priority].fetch_add(1, std::memory_order_relaxed);
+    uint64_t deadline = task->enqueueTime + blockTimeoutNs.load(std::memory_order_relaxed);
+    while (!taskScheduler.push(task.get())) {
+        bool stopping = stopThreads.load(std::memory_order_relaxed);
+        if (stopping || monotonicNanoseconds() >= deadline) {
+            droppedTasks[priority].fetch_add(1, std::memory_order_relaxed);
+            if (!stopping) {
+                ErrorEventRing::instance().report(ErrorLogging::ErrorCode::TASK_TIMEOUT,
+                    "Task dropped on a full lane after blocking", task->affinity, taskTypeName(task->getType()));
+            }
+            TaskCoalescer::release(*task);
+            return;
+        }
+        std::this_thread::yield();
+    }
+    task.release();
 }
 
 /**
- * @brief Worker thread function that processes tasks from the queue.
+ * @brief Claims the coalescing slot of new data or callback tasks.
+ *
+ * @param channel The first channel of the tasks.
+ * @param channelCount The number of channels the tasks cover.
+ * @param type The type of the tasks.
+ * @param taskCount The number of tasks.
+ * @param slot Receives the slot to pass to addTask(), nullptr if coalescing is off.
+ * @return True to queue the tasks, false if pending tasks already cover them.
  */
-void BatteryTestingService::workerThreadFunction() {
-    while (!stopThreads) {
-        Task* task = nullptr;
-        
-        {
-            std::unique_lock<std::mutex> lock(taskQueueMutex);
-            taskQueueCV.wait(lock, [this] {
-                return !taskQueue.empty() || stopThreads;
-            });
-            
-            // Check if we should exit
-            if (stopThreads && taskQueue.empty()) {
-                break;
-            }
-            
-            // Get the next task
-            if (!taskQueue.empty()) {
-                task = taskQueue.top();
-                taskQueue.pop();
-            }
+bool BatteryTestingService::claimCoalescingSlot(uint32_t channel, uint32_t channelCount, TaskType type,
+    uint32_t taskCount, std::atomic<uint32_t>*& slot) {
+    if (!coalescingEnabled.load(std::memory_order_relaxed)) {
+        slot = nullptr;
+        return true;
+    }
+    return taskCoalescer.claim(channel, channelCount, type, taskCount, slot);
+}
+
+/**
+ * @brief Adds a control task to the real-time control lane.
+ *
+ * Never takes a lock. If the ring is full the caller yields until the
+ * executor makes room.
+ *
+ * @param task The task to add. Ownership passes to the control executor.
+ */
+void BatteryTestingService::addControlTask(TaskHandle task) {
+    while (!controlExecutor.push(task)) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Worker thread function that processes tasks from the scheduler.
+ *
+ * Serves the shards of the channels this worker owns, HIGH before NORMAL
+ * before LOW, steals from other workers when they are empty and parks only
+ * when there is nothing to run. Exits when its retire token is set, after
+ * finishing the task in progress.
+ *
+ * While the worker stays busy, the clock read that ends a task also starts
+ * the next one, so the instrumentation costs one clock read per task. The
+ * next task's queue wait then also covers finishing the previous task and
+ * dequeuing the next. After parking, or for a task queued after that read,
+ * the clock is read again.
+ *
+ * @param workerIndex The index of the worker, which selects its shards.
+ */
+void BatteryTestingService::workerThreadFunction(size_t workerIndex) {
+    WorkerSlot& slot = workers[workerIndex];
+    TaskMetricsShard& taskMetrics = *slot.taskMetrics;
+    uint64_t end = 0;   // Clock read that ended the previous task, 0 if the worker may have parked since
+
+    while (!slot.retire.load(std::memory_order_relaxed)) {
+        uint32_t shard;
+        Task* next = end != 0 ? taskScheduler.tryPop(workerIndex, shard) : nullptr;
+        if (!next) {
+            end = 0;
+            next = taskScheduler.waitPop(workerIndex, slot.retire, shard);
         }
+        TaskHandle task(next);
         
-        // Execute the task if we got one
+        // Execute the task if we got one; the handle returns it to its pool
         if (task) {
-            task->execute();
-            delete task;
+            uint64_t start = end;
+            if (start == 0 || start < task->enqueueTime) {
+                start = monotonicNanoseconds();
+            }
+            // Only this worker raises its maximum; the autoscaler resets it
+            uint64_t latency = task->enqueueTime != 0 ? start - task->enqueueTime : 0;
+            if (latency > slot.maxQueueLatency.load(std::memory_order_relaxed)) {
+                slot.maxQueueLatency.store(latency, std::memory_order_relaxed);
+            }
+
+            // Samples arriving from now on are not covered by this task, so they queue a new one
+            TaskCoalescer::release(*task);
+            ErrorLogging::Status status = task->execute();
+            end = monotonicNanoseconds();
+            taskMetrics.record(task->getType(), task->priority, latency, end - start);
+            if (!status) {
+                taskMetrics.recordFailure(task->getType());
+                ErrorEventRing::instance().report(status.error(), "Task failed", task->affinity,
+                    taskTypeName(task->getType()));
+            }
+            task.reset();
+            taskScheduler.finish(shard);
         }
     }
 }
@@ -112,39 +388,44 @@ void BatteryTestingService::workerThreadFunction() {
 /**
  * @brief Dynamically adjusts the number of worker threads.
  *
- * @param numThreads The new total number of worker threads.
+ * Grows by starting new workers, then hands them their channel shards.
+ * Shrinks by first moving the shards away from the highest workers, then
+ * retiring those workers one at a time through their retire tokens; the
+ * other workers and the M4 data thread keep running throughout.
+ *
+ * @param numThreads The new total number of worker threads, at most MAX_WORKER_THREADS.
  */
 void BatteryTestingService::setWorkerThreadCount(size_t numThreads) {
-    size_t currentThreadCount = workerThreads.size();
+    std::lock_guard<std::mutex> lock(workerResizeMutex);
+    numThreads = std::min<size_t>(numThreads, MAX_WORKER_THREADS);
+    size_t currentThreadCount = workerCount.load();
     
     if (numThreads > currentThreadCount) {
-        // Add more threads
+        // Add more threads, then hand them their shards
         for (size_t i = currentThreadCount; i < numThreads; ++i) {
-            workerThreads.emplace_back(&BatteryTestingService::workerThreadFunction, this);
+            workers[i].retire = false;
+            workers[i].maxQueueLatency = 0;
+            if (!workers[i].taskMetrics) {
+                workers[i].taskMetrics = std::make_unique<TaskMetricsShard>();
+            }
+            workers[i].thread = std::thread(&BatteryTestingService::workerThreadFunction, this, i);
         }
+        workerCount = numThreads;
+        taskScheduler.setWorkerCount(numThreads);
     }
     else if (numThreads < currentThreadCount) {
-        // Signal threads to stop
-        stopThreads = true;
-        taskQueueCV.notify_all();
-        
-        // Wait for threads to finish
-        for (auto& thread : workerThreads) {
-            if (thread.joinable()) {
-                thread.join();
+        // Hand the shards of the retiring workers to the remaining ones
+        workerCount = numThreads;
+        taskScheduler.setWorkerCount(numThreads);
+
+        // Retire the highest workers one at a time
+        for (size_t i = currentThreadCount; i-- > numThreads;) {
+            workers[i].retire = true;
+            taskScheduler.wakeWorker(i);
+            if (workers[i].thread.joinable()) {
+                workers[i].thread.join();
             }
         }
-        
-        // Clear the thread vector
-        workerThreads.clear();
-        
-        // Reset stop flag
-        stopThreads = false;
-        
-        // Create new threads
-        for (size_t i = 0; i < numThreads; ++i) {
-            workerThreads.emplace_back(&BatteryTestingService::workerThreadFunction, this);
-        }
     }
 }
 
@@ -154,241 +435,1727 @@ void BatteryTestingService::setWorkerThreadCount(size_t numThreads) {
  * @return The number of worker threads.
  */
 size_t BatteryTestingService::getWorkerThreadCount() const {
-    return workerThreads.size();
+    return workerCount.load();
 }
 
 /**
- * @brief Runs a Constant Current Constant Voltage (CCCV) test on a channel.
+ * @brief Starts resizing the worker pool automatically from queue depth and task latency.
  *
- * @param channel The channel number.
- * @param current The target current value.
- * @param targetVoltage The target voltage value.
- * @param steplimit The step limit for the test.
+ * @param config The bounds and thresholds of the autoscaler.
  */
-void BatteryTestingService::runCCCV(uint32_t channel, float current, float targetVoltage,
-    const std::vector<StepLimit>& steplimit) {
-    std::cout << "Running CCCV on channel " << channel << ", current: " << current << ", target voltage: " << targetVoltage << std::endl;
+void BatteryTestingService::enableAutoscaler(const WorkerAutoscalerConfig& config) {
+    disableAutoscaler();
+    stopAutoscaler = false;
+    autoscalerThread = std::thread(&BatteryTestingService::autoscalerThreadFunction, this, config);
+}
 
-    // 1. Subscribe to the channel data
-    channelDataService->subscribeChannel(channel);
-    
-    // 2. Create and add a task to do constant current
-    addTask(new CCTask(channel, current, channelCtrlService));
+/**
+ * @brief Stops the autoscaler; the worker count stays as it is.
+ */
+void BatteryTestingService::disableAutoscaler() {
+    {
+        std::lock_guard<std::mutex> lock(autoscalerMutex);
+        stopAutoscaler = true;
+    }
+    autoscalerCV.notify_all();
+    if (autoscalerThread.joinable()) {
+        autoscalerThread.join();
+    }
+}
 
-    // 3. Register a callback to check voltage and switch to CV
-    registerCallback(channel, [this, channel, targetVoltage](uint32_t ch, const std::map<std::string, float>& data) {
-        if (data.count("voltage") > 0 && data.at("voltage") >= targetVoltage) {
-            std::cout << "Target voltage reached on channel " << channel << ", switching to CV" << std::endl;
+/**
+ * @brief Autoscaler thread function.
+ *
+ * Once per interval, reads the queue depth and the worst queueing latency
+ * seen by the workers, and applies the worker count decided by the
+ * WorkerAutoscaler.
+ *
+ * @param config The bounds and thresholds of the autoscaler.
+ */
+void BatteryTestingService::autoscalerThreadFunction(WorkerAutoscalerConfig config) {
+    WorkerAutoscaler autoscaler(config);
+    std::unique_lock<std::mutex> lock(autoscalerMutex);
 
-            // Create and add a CV task
-            addTask(new CVTask(channel, targetVoltage, channelCtrlService));
-            
-            // Unregister the callback once we've switched to CV
-            unregisterCallback(channel, 0);
+    while (!autoscalerCV.wait_for(lock, std::chrono::milliseconds(config.intervalMs),
+        [this] { return stopAutoscaler; })) {
+        size_t queueDepth = 0;
+        for (size_t lane = 0; lane < TASK_PRIORITY_COUNT; ++lane) {
+            queueDepth += taskScheduler.getQueueDepth(static_cast<TaskPriority>(lane));
+        }
 
-            registerCallback(channel, [this, channel](uint32_t ch, const std::map<std::string, float>& data) {
-                // Implement CV check logic here
-            });
+        size_t current = workerCount.load();
+        uint64_t maxLatency = 0;
+        for (size_t i = 0; i < current; ++i) {
+            maxLatency = std::max(maxLatency, workers[i].maxQueueLatency.exchange(0, std::memory_order_relaxed));
         }
-    });
 
-    // 4. Register a callback to check step limits and end the test
-    registerCallback(channel, [this, channel, steplimit](uint32_t ch, const std::map<std::string, float>& data) {
-        //Implement limit check logic here
-        if (isLimitReached(data, steplimit)) {
-            std::cout << "Step limit reached on channel " << channel << ", ending test" << std::endl;
-            unregisterCallback(channel, -1);
-            channelDataService->unsubscribeChannel(channel);
-            terminateTest(channel);
+        size_t target = autoscaler.decide(current, queueDepth, maxLatency);
+        if (target != current) {
+            lock.unlock();
+            setWorkerThreadCount(target);
+            lock.lock();
         }
-    });
+    }
 }
 
 /**
- * @brief Runs a Current Ramp test on a channel.
+ * @brief Gets the worker thread that owns a channel.
  *
  * @param channel The channel number.
- * @param current The target current value.
+ * @return The index of the worker thread.
  */
-void BatteryTestingService::runCurrentRamp(uint32_t channel, float current) {
-    std::cout << "Running Current Ramp on channel " << channel << ", current: " << current << std::endl;
-    // Implementation goes here
+size_t BatteryTestingService::getChannelWorker(uint32_t channel) const {
+    return taskScheduler.getChannelWorker(channel);
 }
 
 /**
- * @brief Sets the channel to a rest state (open circuit).
+ * @brief Sets how many channels each batch data task covers.
  *
- * @param channel The channel number.
+ * @param numChannels The block size, clamped to [1, MAX_BLOCK_CHANNELS].
  */
-void BatteryTestingService::runRest(uint32_t channel) {
-    std::cout << "Running Rest on channel " << channel << std::endl;
-    // Implementation would go here
+void BatteryTestingService::setDataTaskBlockSize(size_t numChannels) {
+    dataTaskBlockSize = static_cast<uint32_t>(std::clamp<size_t>(numChannels, 1, MAX_BLOCK_CHANNELS));
 }
 
 /**
- * @brief Registers a callback function for a specific channel.
+ * @brief Gets how many channels each batch data task covers.
  *
- * @param channel The channel number.
- * @param callback The callback function to register.
+ * @return The block size.
  */
-void BatteryTestingService::registerCallback(uint32_t channel, std::function<void(uint32_t, const std::map<std::string, float>&)> callback) {
-    std::cout << "Registering callback for channel " << channel << std::endl;
-    
-    // Create vector for the channel if it doesn't exist
-    if (callbackMap.find(channel) == callbackMap.end()) {
-        callbackMap[channel] = std::vector<std::function<void(uint32_t, const std::map<std::string, float>&)>>();
+size_t BatteryTestingService::getDataTaskBlockSize() const {
+    return dataTaskBlockSize;
+}
+
+/**
+ * @brief Sets the real-time priority, CPU pinning and latency budget of the control lane.
+ *
+ * @param config The configuration, e.g. {80, 1} for SCHED_FIFO 80 on CPU 1.
+ * @return True if the priority and pinning could be applied.
+ */
+bool BatteryTestingService::configureControlExecutor(const ControlExecutorConfig& config) {
+    return controlExecutor.configure(config);
+}
+
+/**
+ * @brief Sets the coalescing of data and callback tasks and the policy of each full scheduler lane.
+ *
+ * Tasks already queued keep their slots, so turning coalescing off never
+ * leaves a slot pending.
+ *
+ * @param config The configuration; HIGH tasks are only dropped after blocking for blockTimeoutNs.
+ * @return True if applied, false if it drops HIGH tasks.
+ */
+bool BatteryTestingService::configureTaskOverload(const TaskOverloadConfig& config) {
+    if (config.policies[static_cast<size_t>(TaskPriority::HIGH)] == OverloadPolicy::Drop) {
+        std::cerr << "HIGH priority tasks cannot be dropped" << std::endl;
+        return false;
     }
-    
-    // Add the callback to the vector
-    callbackMap[channel].push_back(callback);
+    coalescingEnabled.store(config.coalescing, std::memory_order_relaxed);
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        overloadPolicies[priority].store(config.policies[priority], std::memory_order_relaxed);
+    }
+    blockTimeoutNs.store(config.blockTimeoutNs, std::memory_order_relaxed);
+    return true;
 }
 
 /**
- * @brief Handles notifications of new data from the data plane.
- * Creates and adds a CallbackControlTask to execute the registered callbacks.
+ * @brief Gets the counters of the coalesced, dropped and blocked tasks.
  *
- * @param channel The channel number with new data.
+ * @return A copy of the counters.
  */
-void BatteryTestingService::handleCallbacks(uint32_t channel) {
-    std::cout << "Handling new data notification for channel " << channel << std::endl;
-    
-    // Check if there are callbacks registered for this channel
-    if (callbackMap.find(channel) != callbackMap.end() && !callbackMap[channel].empty()) {
-        // Create a CallbackControlTask for each callback and add it to the task queue
-        for (const auto& callback : callbackMap[channel]) {
-            CallbackControlTask* task = new CallbackControlTask(channel, callback, channelDataService);
-            addTask(task);
-        }
+TaskOverloadStatistics BatteryTestingService::getTaskOverloadStatistics() const {
+    TaskOverloadStatistics statistics;
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        statistics.coalesced[type] = taskCoalescer.getCoalescedCount(static_cast<TaskType>(type));
     }
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        statistics.dropped[priority] = droppedTasks[priority].load(std::memory_order_relaxed);
+        statistics.blocked[priority] = blockedTasks[priority].load(std::memory_order_relaxed);
+    }
+    return statistics;
 }
 
 /**
- * @brief Unregisters a callback function for a specific channel.
+ * @brief Gets the dispatch latency counters of the control lane.
  *
- * @param channel The channel number.
- * @param callbackIndex Optional index of the specific callback to unregister.
- *                     If negative, all callbacks for the channel will be unregistered.
+ * @return A copy of the counters.
  */
-void BatteryTestingService::unregisterCallback(uint32_t channel, int callbackIndex) {
-    std::cout << "Unregistering callback(s) for channel " << channel << std::endl;
-    
-    // Check if there are callbacks registered for this channel
-    auto it = callbackMap.find(channel);
-    if (it != callbackMap.end()) {
-        if (callbackIndex < 0) {
-            // Remove all callbacks for this channel
-            callbackMap.erase(channel);
-        } else if (callbackIndex < static_cast<int>(it->second.size())) {
-            // Remove the specific callback at the given index
-            it->second.erase(it->second.begin() + callbackIndex);
-            
-            // If no callbacks remain, remove the channel entry
-            if (it->second.empty()) {
-                callbackMap.erase(channel);
-            }
-        }
+ControlExecutorStatistics BatteryTestingService::getControlExecutorStatistics() const {
+    return controlExecutor.getStatistics();
+}
+
+/**
+ * @brief Gets the counters of the M4 frame parsers (parsed, dropped and rejected frames).
+ *
+ * @return The sum of the counters of all endpoints.
+ */
+M4FrameStatistics BatteryTestingService::getM4FrameStatistics() const {
+    M4FrameStatistics total;
+    for (const auto& lane : ingestLanes) {
+        M4FrameStatistics statistics = lane->frameParser.getStatistics();
+        total.framesParsed += statistics.framesParsed;
+        total.framesDropped += statistics.framesDropped;
+        total.framesRejected += statistics.framesRejected;
+        total.framesOutOfOrder += statistics.framesOutOfOrder;
     }
+    return total;
 }
 
 /**
- * @brief Thread function for continuously receiving M4 data.
+ * @brief Gets the counters of the M4 frame parser of one endpoint.
  *
- * This thread continuously receives data from the M4 core and processes it.
- * Worker threads handle data processing (filtering, fitting, etc.) and callbacks.
+ * @param endpoint The index of the endpoint in the topology.
+ * @return A copy of the counters, all zero for an unknown endpoint.
  */
-void BatteryTestingService::m4DataThreadFunction() {
-    // Example data for demonstration purposes
-    std::map<std::string, float> sampleData[MAX_CHAN_NUM];
-    
-    while (!stopThreads) {
-        // In a real implementation, we would read from the M4 core
-        // Something like:
-        ReadFromM4("/dev/ttyRPMSG0", &sampleData);
-        
-        // For simulation purposes, iterate over all channels
-        for (uint32_t channel = 0; channel < MAX_CHAN_NUM; channel++) {
-            // Create data processing tasks (filtering, fitting, etc.)
-            channelDataService->receiveM4Data(channel, sampleData[channel]);
-            addTask(new FilteringDataTask(channel, sampleData[channel]));
-            addTask(new FittingDataTask(channel, sampleData[channel]));
-            
-            if (channelDataService->isChannelSubscribed(channel)) {
-                // Execute callbacks for subscribed channels
-                handleCallbacks(channel);
+M4FrameStatistics BatteryTestingService::getM4FrameStatistics(size_t endpoint) const {
+    if (endpoint >= ingestLanes.size()) {
+        return M4FrameStatistics();
+    }
+    return ingestLanes[endpoint]->frameParser.getStatistics();
+}
+
+/**
+ * @brief Gets the boards and M4 cores of the rack.
+ *
+ * @return The topology given at construction.
+ */
+const ChannelTopology& BatteryTestingService::getTopology() const {
+    return topology;
+}
+
+/**
+ * @brief Starts recording every sample of every channel to telemetry files.
+ *
+ * The ingest threads queue each sample they publish to the recorder
+ * without blocking; see TelemetryRecorder.
+ *
+ * @param config The files and chunking.
+ * @param error Receives the reason if the recording cannot be started.
+ * @return True if the recording started.
+ */
+bool BatteryTestingService::startTelemetryRecording(const TelemetryRecorderConfig& config, std::string& error) {
+    return telemetryRecorder.start(config, error);
+}
+
+/**
+ * @brief Stops the telemetry recording and closes its file.
+ */
+void BatteryTestingService::stopTelemetryRecording() {
+    telemetryRecorder.stop();
+}
+
+/**
+ * @brief Gets the counters of the telemetry recorder.
+ *
+ * @return A copy of the counters.
+ */
+TelemetryStatistics BatteryTestingService::getTelemetryStatistics() const {
+    return telemetryRecorder.getStatistics();
+}
+
+/**
+ * @brief Gets a snapshot of the runtime metrics.
+ *
+ * The histograms of a worker slot stay after its worker retires, so the
+ * latencies cover every task run since construction. The frame rate of a
+ * lane that has received no frame for two windows reads as 0.
+ *
+ * @return The metrics.
+ */
+ServiceMetrics BatteryTestingService::getMetrics() const {
+    ServiceMetrics metrics;
+    metrics.timestampNs = monotonicNanoseconds();
+
+    auto snapshot = std::make_unique<TaskMetricsSnapshot>();
+    snapshot->add(controlExecutor.getTaskMetrics());
+    {
+        std::lock_guard<std::mutex> lock(workerResizeMutex);
+        for (const WorkerSlot& slot : workers) {
+            if (slot.taskMetrics) {
+                snapshot->add(*slot.taskMetrics);
             }
         }
-        
-        // Sleep to avoid excessive CPU usage
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-}
+    snapshot->summarize(metrics);
+
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        metrics.queueDepth[priority] = taskScheduler.getQueueDepth(static_cast<TaskPriority>(priority));
+    }
+    metrics.controlQueueDepth = controlExecutor.getQueueDepth();
+    metrics.workerCount = workerCount.load();
+    metrics.control = controlExecutor.getStatistics();
+    metrics.overload = getTaskOverloadStatistics();
+    metrics.errorEvents = ErrorEventRing::instance().getReportedCount();
+    metrics.errorEventsDropped = ErrorEventRing::instance().getDroppedCount();
+    uint64_t counts[LATENCY_HISTOGRAM_BUCKETS] = {};
+    uint64_t total = 0;
+    controlExecutor.getReactionLatency().addTo(counts, total);
+    metrics.controlReaction = LatencyHistogram::summarize(counts, total);
 
-// Helper function to check if a step limit has been reached
-// This would need to be properly implemented in a real application
-bool isLimitReached(const std::map<std::string, float>& data, const std::vector<StepLimit>& limits) {
-    // Example implementation
-    for (const auto& limit : limits) {
-        if (data.count(limit.var_type) > 0 && data.at(limit.var_type) >= limit.target_value) {
-            return true;
+    for (const auto& lane : ingestLanes) {
+        IngestMetrics ingest;
+        ingest.frames = lane->frameParser.getStatistics();
+        uint64_t windowStart = lane->rateWindowStart.load(std::memory_order_relaxed);
+        if (windowStart != 0 && metrics.timestampNs - windowStart < 2 * FRAME_RATE_WINDOW_NS) {
+            ingest.frameRate = lane->frameRate.load(std::memory_order_relaxed);
         }
+        ingest.cvSwitches = lane->cvSwitches.load(std::memory_order_relaxed);
+        ingest.stepsCompleted = lane->stepsCompleted.load(std::memory_order_relaxed);
+        std::fill(std::begin(counts), std::end(counts), 0);
+        total = 0;
+        lane->batchLatency.addTo(counts, total);
+        ingest.batchLatency = LatencyHistogram::summarize(counts, total);
+        metrics.ingest.push_back(ingest);
+    }
+
+    metrics.callbacksSuppressed = channelDataService->getSuppressedSampleCount();
+    metrics.callbackCounts.resize(topology.getChannelCount());
+    for (size_t channel = 0; channel < metrics.callbackCounts.size(); ++channel) {
+        metrics.callbackCounts[channel] = callbackCounts[channel].load(std::memory_order_relaxed);
     }
-    return false;
+    return metrics;
 }
 
-// Helper function to terminate a test
-// This would need to be properly implemented in a real application
-void terminateTest(uint32_t channel) {
-    std::cout << "Terminating test on channel " << channel << std::endl;
-    // Implementation would go here
+/**
+ * @brief Starts serving getMetrics() in the Prometheus text format over HTTP.
+ *
+ * @param config The address and port to listen on.
+ * @param error Receives the reason if the exporter cannot be started.
+ * @return True if the exporter is listening.
+ */
+bool BatteryTestingService::startMetricsExporter(const MetricsExporterConfig& config, std::string& error) {
+    return metricsExporter.start(config, [this] { return formatPrometheusMetrics(getMetrics()); }, error);
 }
 
 /**
- * @brief Executes the constant current task.
+ * @brief Stops the metrics exporter.
  */
-void CCTask::execute() {
-    ctrlService->doConstantCurrent(channel, current);
+void BatteryTestingService::stopMetricsExporter() {
+    metricsExporter.stop();
 }
 
 /**
- * @brief Executes the constant voltage task.
+ * @brief Sets where the errors of the ingest, worker and control threads are reported.
+ *
+ * @param handler Called on the reporter thread for each event; nullptr restores the default.
  */
-void CVTask::execute() {
-    ctrlService->doConstantVoltage(channel, targetVoltage);
+void BatteryTestingService::setErrorHandler(std::function<void(const ErrorEvent&)> handler) {
+    std::lock_guard<std::mutex> lock(errorReporterMutex);
+    errorHandler = std::move(handler);
 }
 
 /**
- * @brief Executes the generic control task.
+ * @brief Error reporter thread function.
+ *
+ * Every ERROR_REPORT_INTERVAL_MS, hands the events queued to the
+ * ErrorEventRing to the error handler, then reports how many events were
+ * dropped on a full ring since the last round. Drains the ring once more
+ * when stopped, so the errors of the other threads' last moments are kept.
  */
-void GenericControlTask::execute() {
-    while (!ctrlServices.empty()) {
-        ChannelCtrlService* service = ctrlServices.front();
-        ctrlServices.pop();
-        // Clean up the service after execution
-        delete service;
+void BatteryTestingService::errorReporterThreadFunction() {
+    ErrorEventRing& ring = ErrorEventRing::instance();
+    uint64_t dropped = ring.getDroppedCount();
+    auto report = [this](const ErrorEvent& event) {
+        if (errorHandler) {
+            errorHandler(event);
+            return;
+        }
+        char line[256];
+        ErrorEventRing::format(event, line, sizeof(line));
+        std::cerr << line << std::endl;
+    };
+
+    std::unique_lock<std::mutex> lock(errorReporterMutex);
+    bool stopping = false;
+    while (!stopping) {
+        stopping = errorReporterCV.wait_for(lock, std::chrono::milliseconds(ERROR_REPORT_INTERVAL_MS),
+            [this] { return stopErrorReporter; });
+        ErrorEvent event;
+        while (ring.pop(event)) {
+            report(event);
+        }
+        uint64_t total = ring.getDroppedCount();
+        if (total != dropped) {
+            ErrorEvent lost;
+            lost.code = ErrorLogging::ErrorCode::SYSTEM_ERROR;
+            lost.value = static_cast<float>(total - dropped);
+            lost.time = realtimeNanoseconds();
+            lost.message = "Error ring full; events dropped";
+            report(lost);
+            dropped = total;
+        }
     }
 }
 
 /**
- * @brief Adds a ChannelCtrlService to the queue.
+ * @brief Runs a Constant Current Constant Voltage (CCCV) test on a channel.
  *
- * @param service The ChannelCtrlService to add.
+ * Runs cccvRoutine(): the channel is set to CC, switched to CV when the
+ * target voltage is reached and set to rest when the step limits are met.
+ * Control tasks are created on these transitions only.
+ *
+ * @param channel The channel number.
+ * @param current The target current value.
+ * @param targetVoltage The target voltage value.
+ * @param steplimit The step limit for the test.
  */
-void GenericControlTask::addCtrlService(ChannelCtrlService* service) {
-    ctrlServices.push(service);
+void BatteryTestingService::runCCCV(uint32_t channel, float current, float targetVoltage,
+    const std::vector<StepLimit>& steplimit) {
+    std::cout << "Running CCCV on channel " << channel << ", current: " << current << ", target voltage: " << targetVoltage << std::endl;
+
+    StepLimitEvaluator limits;
+    if (compileLimits(channel, steplimit, limits)) {
+        CheckpointRecord record = describeRoutine(CheckpointKind::CCCV, current, targetVoltage, 0.0f, 0.0, limits);
+        startControlRoutine(channel, cccvRoutine(channel, current, targetVoltage, std::move(limits)), record);
+    }
 }
 
 /**
- * @brief Executes the callback control task.
+ * @brief Runs a Current Ramp test on a channel.
+ *
+ * Runs currentRampRoutine(): the ramp from 0 at rampRate is uploaded to the
+ * M4 as a setpoint profile, then the current is held until the step limits are met.
+ *
+ * @param channel The channel number.
+ * @param current The target current value.
+ * @param rampRate The ramp slope in A per second of step time.
+ * @param steplimit The step limit for the test.
+ */
+void BatteryTestingService::runCurrentRamp(uint32_t channel, float current, float rampRate,
+    const std::vector<StepLimit>& steplimit) {
+    std::cout << "Running Current Ramp on channel " << channel << ", current: " << current << std::endl;
+
+    StepLimitEvaluator limits;
+    if (compileLimits(channel, steplimit, limits)) {
+        CheckpointRecord record = describeRoutine(CheckpointKind::CurrentRamp, current, 0.0f, rampRate, 0.0, limits);
+        startControlRoutine(channel, currentRampRoutine(channel, current, rampRate, std::move(limits)), record);
+    }
+}
+
+/**
+ * @brief Sets the channel to a rest state (open circuit).
+ *
+ * Runs restRoutine(). A rest duration is armed on the timer wheel of the
+ * channel's lane; if it is the only limit, the rest costs nothing per sample.
+ *
+ * @param channel The channel number.
+ * @param steplimit The step limit ending the rest, e.g. a rest duration.
+ */
+void BatteryTestingService::runRest(uint32_t channel, const std::vector<StepLimit>& steplimit) {
+    std::cout << "Running Rest on channel " << channel << std::endl;
+
+    std::vector<StepLimit> sampleLimits;
+    double duration = splitRestDuration(steplimit, sampleLimits);
+    StepLimitEvaluator limits;
+    if (compileLimits(channel, sampleLimits, limits)) {
+        CheckpointRecord record = describeRoutine(CheckpointKind::Rest, 0.0f, 0.0f, 0.0f, duration, limits);
+        startControlRoutine(channel, restRoutine(channel, std::move(limits), duration), record);
+    }
+}
+
+/**
+ * @brief Runs a setpoint profile on a channel, executed by the M4 at its control rate.
+ *
+ * Runs profileRoutine(): the profile is uploaded once and the routine is
+ * only resumed when the M4 ends it, or when the step limits are met.
+ *
+ * @param channel The channel number.
+ * @param profile The profile, can be shared between channels.
+ * @param steplimit The step limit ending the profile early.
+ */
+void BatteryTestingService::runProfile(uint32_t channel, std::shared_ptr<const SetpointProfile> profile,
+    const std::vector<StepLimit>& steplimit) {
+    std::string error;
+    if (!profile || !profile->validate(error)) {
+        std::cerr << "Invalid setpoint profile on channel " << channel << ": "
+                  << (profile ? error : "no profile") << std::endl;
+        return;
+    }
+    std::cout << "Running profile on channel " << channel << ", " << profile->points.size()
+              << " points over " << profile->duration() << " s" << std::endl;
+
+    StepLimitEvaluator limits;
+    if (compileLimits(channel, steplimit, limits)) {
+        CheckpointRecord record = describeRoutine(CheckpointKind::Profile, 0.0f, 0.0f, 0.0f, 0.0, limits);
+        startControlRoutine(channel, profileRoutine(channel, std::move(profile), std::move(limits)), record);
+    }
+}
+
+/**
+ * @brief Runs a coroutine control routine on a channel, replacing its step or routine.
+ *
+ * The routine is started on the ingest thread of the channel, which runs it
+ * to its first wait and sends its first commands as one batch. A custom
+ * routine cannot be checkpointed; a resumed service sets the channel to rest.
+ *
+ * @param channel The channel number.
+ * @param routine The routine, which must address this channel only.
+ */
+void BatteryTestingService::runControlRoutine(uint32_t channel, ControlRoutine routine) {
+    // The state of the coroutine frame cannot be checkpointed
+    CheckpointRecord record;
+    record.kind = CheckpointKind::Opaque;
+    startControlRoutine(channel, std::move(routine), record);
+}
+
+/**
+ * @brief Runs a control routine on a channel and checkpoints it with its descriptor.
+ *
+ * The routine is started on the ingest thread of the channel, which runs it
+ * to its first wait and sends its first commands as one batch.
+ *
+ * @param channel The channel number.
+ * @param routine The routine, which must address this channel only.
+ * @param record The kind, setpoints and limits of the routine, to resume it from.
+ */
+void BatteryTestingService::startControlRoutine(uint32_t channel, ControlRoutine routine,
+    const CheckpointRecord& record) {
+    IngestLane* lane = getLane(channel);
+    if (!lane) {
+        std::cerr << "Unknown channel " << channel << std::endl;
+        return;
+    }
+    // postToIngest takes copyable commands, the routine itself is move-only
+    auto shared = std::make_shared<ControlRoutine>(std::move(routine));
+    postToIngest(*lane, [this, lane, channel, shared, record] {
+        stepEngine.stop(channel);
+        ChannelCommandBatch batch;
+        ProfileCommand profile;
+        if (controlRoutines.start(channel, std::move(*shared), channel - lane->firstChannel, batch,
+                getStepTime(channel))) {
+            IngestLane::count(lane->stepsCompleted);
+        }
+        beginCheckpoint(*lane, channel, record);
+        collectRoutineProfile(*lane, channel, profile);
+        addCommandBatch(*lane, batch);
+        addProfileCommand(*lane, profile);
+    });
+}
+
+/**
+ * @brief Runs a compiled recipe (a multi-step schedule) on a channel.
+ *
+ * The ingest thread of the channel walks the recipe: when the limits of a
+ * step are met, the next step's control task is queued from the same frame.
+ *
+ * @param channel The channel number.
+ * @param program The recipe compiled by RecipeProgram::compile(), can be shared between channels.
+ */
+void BatteryTestingService::runRecipe(uint32_t channel, std::shared_ptr<const RecipeProgram> program) {
+    std::cout << "Running recipe on channel " << channel << std::endl;
+
+    IngestLane* lane = getLane(channel);
+    if (!lane) {
+        std::cerr << "Unknown channel " << channel << std::endl;
+        return;
+    }
+    postToIngest(*lane, [this, lane, channel, program] {
+        controlRoutines.stop(channel);
+        StepTransition transition;
+        if (stepEngine.startRecipe(channel, program, transition, getStepTime(channel))) {
+            applyStepTransition(*lane, channel, transition);
+        }
+        beginCheckpoint(*lane, channel, CheckpointRecord());
+    });
+}
+
+/**
+ * @brief Runs the same CCCV test on a group of channels, starting them at the same tick.
+ *
+ * The channels of each endpoint are started together on its ingest thread
+ * and their CC setpoints go out as one command batch. Endpoints are
+ * separate M4 cores, so channels of different endpoints are not synchronized.
+ *
+ * @param channels The global channel numbers.
+ * @param current The target current value.
+ * @param targetVoltage The target voltage value.
+ * @param steplimit The step limit for the test.
+ */
+void BatteryTestingService::runCCCVGroup(const std::vector<uint32_t>& channels, float current, float targetVoltage,
+    const std::vector<StepLimit>& steplimit) {
+    std::cout << "Running CCCV on " << channels.size() << " channels, current: " << current
+              << ", target voltage: " << targetVoltage << std::endl;
+
+    StepDefinition step;
+    step.type = StepType::CCCV;
+    step.current = current;
+    step.targetVoltage = targetVoltage;
+    step.limits = steplimit;
+    startStepGroup(channels, step);
+}
+
+/**
+ * @brief Runs a compiled recipe on a group of channels, starting them at the same tick.
+ *
+ * @param channels The global channel numbers.
+ * @param program The recipe compiled by RecipeProgram::compile().
+ */
+void BatteryTestingService::runRecipeGroup(const std::vector<uint32_t>& channels,
+    std::shared_ptr<const RecipeProgram> program) {
+    std::cout << "Running recipe on " << channels.size() << " channels" << std::endl;
+
+    std::vector<uint64_t> laneMasks = getLaneMasks(channels);
+    for (size_t i = 0; i < ingestLanes.size(); ++i) {
+        if (laneMasks[i] == 0) {
+            continue;
+        }
+        IngestLane* lane = ingestLanes[i].get();
+        uint64_t mask = laneMasks[i];
+        postToIngest(*lane, [this, lane, mask, program] {
+            ChannelCommandBatch batch;
+            for (uint64_t bits = mask; bits != 0; bits &= bits - 1) {
+                uint32_t channel = lane->firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+                controlRoutines.stop(channel);
+                StepTransition transition;
+                if (stepEngine.startRecipe(channel, program, transition, getStepTime(channel))) {
+                    addStepTransition(*lane, batch, channel, transition);
+                }
+                beginCheckpoint(*lane, channel, CheckpointRecord());
+            }
+            addCommandBatch(*lane, batch);
+        });
+    }
+}
+
+/**
+ * @brief Runs the same setpoint profile on a group of channels, starting them at the same tick.
+ *
+ * Each channel runs its own profileRoutine(), but the routines of an
+ * endpoint are started together on its ingest thread and their profile
+ * goes out as one upload for all of them.
+ *
+ * @param channels The global channel numbers.
+ * @param profile The profile.
+ * @param steplimit The step limit ending the profile early, evaluated per channel.
+ */
+void BatteryTestingService::runProfileGroup(const std::vector<uint32_t>& channels,
+    std::shared_ptr<const SetpointProfile> profile, const std::vector<StepLimit>& steplimit) {
+    std::string error;
+    if (!profile || !profile->validate(error)) {
+        std::cerr << "Invalid setpoint profile: " << (profile ? error : "no profile") << std::endl;
+        return;
+    }
+    std::cout << "Running profile on " << channels.size() << " channels, " << profile->points.size()
+              << " points over " << profile->duration() << " s" << std::endl;
+
+    StepLimitEvaluator limits;
+    if (!compileLimits(ERROR_EVENT_NO_CHANNEL, steplimit, limits)) {
+        return;
+    }
+
+    CheckpointRecord record = describeRoutine(CheckpointKind::Profile, 0.0f, 0.0f, 0.0f, 0.0, limits);
+    std::vector<uint64_t> laneMasks = getLaneMasks(channels);
+    for (size_t i = 0; i < ingestLanes.size(); ++i) {
+        if (laneMasks[i] == 0) {
+            continue;
+        }
+        IngestLane* lane = ingestLanes[i].get();
+        uint64_t mask = laneMasks[i];
+        postToIngest(*lane, [this, lane, mask, profile, limits, record] {
+            ChannelCommandBatch batch;
+            ProfileCommand command;
+            for (uint64_t bits = mask; bits != 0; bits &= bits - 1) {
+                uint32_t channel = lane->firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+                stepEngine.stop(channel);
+                if (controlRoutines.start(channel, profileRoutine(channel, profile, limits),
+                        channel - lane->firstChannel, batch, getStepTime(channel))) {
+                    IngestLane::count(lane->stepsCompleted);
+                }
+                beginCheckpoint(*lane, channel, record);
+                collectRoutineProfile(*lane, channel, command);
+            }
+            addCommandBatch(*lane, batch);
+            addProfileCommand(*lane, command);
+        });
+    }
+}
+
+/**
+ * @brief Turns off a group of channels and aborts their steps.
+ *
+ * The OFF batch of each endpoint is sent at once from the calling thread,
+ * without waiting for the ingest thread. The steps are then aborted on the
+ * ingest thread and the OFF batch is sent again, so a step transition
+ * queued in between cannot leave a channel powered.
+ *
+ * @param channels The global channel numbers.
+ */
+void BatteryTestingService::emergencyStop(const std::vector<uint32_t>& channels) {
+    std::cout << "Emergency stop on " << channels.size() << " channels" << std::endl;
+
+    std::vector<uint64_t> laneMasks = getLaneMasks(channels);
+    for (size_t i = 0; i < ingestLanes.size(); ++i) {
+        if (laneMasks[i] == 0) {
+            continue;
+        }
+        IngestLane* lane = ingestLanes[i].get();
+        ChannelCommandBatch batch;
+        for (uint64_t bits = laneMasks[i]; bits != 0; bits &= bits - 1) {
+            batch.set(static_cast<uint32_t>(__builtin_ctzll(bits)), ChannelCommandMode::Off);
+        }
+        addControlTask(batchTaskPool.acquire(batch, lane->ctrlService));
+
+        postToIngest(*lane, [this, lane, batch] {
+            for (uint64_t bits = batch.channelMask; bits != 0; bits &= bits - 1) {
+                uint32_t channel = lane->firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+                stepEngine.stop(channel);
+                controlRoutines.stop(channel);
+                saveCheckpoint(*lane, channel, nullptr);
+            }
+            addControlTask(batchTaskPool.acquire(batch, lane->ctrlService));
+        });
+    }
+}
+
+/**
+ * @brief Aborts the step or control routine running on a channel and sets it to rest.
+ *
+ * @param channel The channel number.
+ */
+void BatteryTestingService::stopStep(uint32_t channel) {
+    IngestLane* lane = getLane(channel);
+    if (!lane) {
+        return;
+    }
+    postToIngest(*lane, [this, lane, channel] {
+        StepTransition transition = stepEngine.stop(channel);
+        if (controlRoutines.stop(channel)) {
+            transition.action = StepAction::SetRest;
+        }
+        saveCheckpoint(*lane, channel, nullptr);
+        applyStepTransition(*lane, channel, transition);
+    });
+}
+
+/**
+ * @brief Gets the phase of the step running on a channel.
+ *
+ * @param channel The channel number.
+ * @return The phase of the channel's control routine or step state machine.
+ */
+StepPhase BatteryTestingService::getStepPhase(uint32_t channel) const {
+    return controlRoutines.isActive(channel) ? controlRoutines.getPhase(channel) : stepEngine.getPhase(channel);
+}
+
+/**
+ * @brief Sets the data watchdog of the channels running a step or routine.
+ *
+ * Each lane applies the timeout on its thread and re-arms the watchdogs of
+ * its running channels from now.
+ *
+ * @param milliseconds The timeout, 0 to disable the watchdog.
+ */
+void BatteryTestingService::setDataWatchdogTimeout(uint32_t milliseconds) {
+    dataWatchdogMs.store(milliseconds, std::memory_order_relaxed);
+    uint64_t timeoutNs = milliseconds * 1000000ULL;
+    for (const std::unique_ptr<IngestLane>& lane : ingestLanes) {
+        IngestLane* target = lane.get();
+        postToIngest(*target, [target, timeoutNs] {
+            target->watchdogNs = timeoutNs;
+            for (uint32_t local = 0; local < target->channelCount; ++local) {
+                target->timers.cancel(local * TIMERS_PER_CHANNEL + WATCHDOG_TIMER);
+            }
+        });
+    }
+}
+
+/**
+ * @brief Gets the timeout of the data watchdog.
+ *
+ * @return The timeout in milliseconds, 0 if disabled.
+ */
+uint32_t BatteryTestingService::getDataWatchdogTimeout() const {
+    return dataWatchdogMs.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the index of the recipe step a channel runs or ran last.
+ *
+ * @param channel The channel number.
+ * @return The index of the step in the recipe, counting steps only.
+ */
+uint32_t BatteryTestingService::getRecipeStep(uint32_t channel) const {
+    return stepEngine.getRecipeStep(channel);
+}
+
+/**
+ * @brief Gets the checkpointed execution state of a channel.
+ *
+ * @param channel The channel number.
+ * @param record Receives the record, with the capacity and energy of the completed steps.
+ * @return True on success, false if there is no checkpoint or the channel is unknown.
+ */
+bool BatteryTestingService::getChannelCheckpoint(uint32_t channel, CheckpointRecord& record) const {
+    return checkpoint.read(channel, record);
+}
+
+/**
+ * @brief Compiles the step limits of a control type, on the calling thread.
+ *
+ * Called before anything is posted to an ingest thread, so an unknown
+ * field is reported to the ErrorEventRing, with the field as its source,
+ * and nothing is started.
+ *
+ * @param channel The channel number, or ERROR_EVENT_NO_CHANNEL for a group.
+ * @param steplimit The step limits.
+ * @param limits Receives the compiled limits.
+ * @return True on success, false if a limit names an unknown field.
+ */
+bool BatteryTestingService::compileLimits(uint32_t channel, const std::vector<StepLimit>& steplimit, StepLimitEvaluator& limits) {
+    std::string unknownField;
+    if (!StepLimitEvaluator::compile(steplimit, limits, unknownField)) {
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::INVALID_ARGUMENT, "Unknown step limit field",
+            channel, unknownField.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Takes the rest duration out of the step limits of a rest.
+ *
+ * A "time" limit with a GreaterOrEqual or CrossingUp comparison that is the
+ * only limit of its group ends the rest when the step time reaches it, so
+ * the host can measure it with a timer started with the rest command.
+ *
+ * @param steplimit The step limits.
+ * @param sampleLimits Receives the limits that still need the samples.
+ * @return The shortest such duration in seconds, 0 if there is none.
+ */
+double BatteryTestingService::splitRestDuration(const std::vector<StepLimit>& steplimit,
+    std::vector<StepLimit>& sampleLimits) {
+    double duration = 0.0;
+    sampleLimits.clear();
+    for (const StepLimit& limit : steplimit) {
+        bool alone = std::count_if(steplimit.begin(), steplimit.end(),
+            [&limit](const StepLimit& other) { return other.group == limit.group; }) == 1;
+        bool rising = limit.comparison == LimitComparison::GreaterOrEqual ||
+            limit.comparison == LimitComparison::CrossingUp;
+        if (alone && rising && limit.var_type == "time") {
+            // The shortest duration ends the rest; a duration of 0 still ends it on the next tick
+            double seconds = std::max(static_cast<double>(limit.target_value), 1e-9);
+            duration = duration == 0.0 ? seconds : std::min(duration, seconds);
+        } else {
+            sampleLimits.push_back(limit);
+        }
+    }
+    return duration;
+}
+
+/**
+ * @brief Starts a step on the step engines of a group of channels.
+ *
+ * The limits are compiled here, so an unknown field is reported before
+ * anything reaches the ingest threads.
+ *
+ * @param channels The global channel numbers.
+ * @param step The step to run.
+ */
+void BatteryTestingService::startStepGroup(const std::vector<uint32_t>& channels, const StepDefinition& step) {
+    StepLimitEvaluator limits;
+    if (!compileLimits(ERROR_EVENT_NO_CHANNEL, step.limits, limits)) {
+        return;
+    }
+
+    std::vector<uint64_t> laneMasks = getLaneMasks(channels);
+    for (size_t i = 0; i < ingestLanes.size(); ++i) {
+        if (laneMasks[i] == 0) {
+            continue;
+        }
+        IngestLane* lane = ingestLanes[i].get();
+        uint64_t mask = laneMasks[i];
+        postToIngest(*lane, [this, lane, mask, step, limits] {
+            ChannelCommandBatch batch;
+            for (uint64_t bits = mask; bits != 0; bits &= bits - 1) {
+                uint32_t channel = lane->firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+                controlRoutines.stop(channel);
+                StepTransition transition;
+                if (stepEngine.start(channel, step, limits, transition, getStepTime(channel))) {
+                    addStepTransition(*lane, batch, channel, transition);
+                }
+                beginCheckpoint(*lane, channel, CheckpointRecord());
+            }
+            addCommandBatch(*lane, batch);
+        });
+    }
+}
+
+/**
+ * @brief Gets the step time of the latest sample of a channel.
+ *
+ * Passed to the engines when a step starts, so they hold the limits off
+ * until the M4 restarts the step time.
+ *
+ * @param channel The global channel number.
+ * @return The StepTime field of the data table.
+ */
+float BatteryTestingService::getStepTime(uint32_t channel) const {
+    return channelDataService->getDataTable().get(channel, ChannelField::StepTime);
+}
+
+/**
+ * @brief Gets the ingest lane of a channel.
+ *
+ * @param channel The global channel number.
+ * @return The lane, or nullptr if the channel is not in the topology.
+ */
+BatteryTestingService::IngestLane* BatteryTestingService::getLane(uint32_t channel) const {
+    ChannelLocation location;
+    if (!topology.locate(channel, location)) {
+        return nullptr;
+    }
+    return ingestLanes[location.endpoint].get();
+}
+
+/**
+ * @brief Splits a list of channels by ingest lane.
+ *
+ * @param channels The global channel numbers; unknown channels are ignored.
+ * @return Bit n of entry i is set if local channel n of lane i is in the list.
+ */
+std::vector<uint64_t> BatteryTestingService::getLaneMasks(const std::vector<uint32_t>& channels) const {
+    std::vector<uint64_t> laneMasks(ingestLanes.size(), 0);
+    for (uint32_t channel : channels) {
+        ChannelLocation location;
+        if (topology.locate(channel, location)) {
+            laneMasks[location.endpoint] |= 1ULL << location.localChannel;
+        }
+    }
+    return laneMasks;
+}
+
+/**
+ * @brief Registers a callback function for a specific channel.
+ *
+ * @param channel The channel number.
+ * @param callback The callback function to register.
+ */
+void BatteryTestingService::registerCallback(uint32_t channel, CallbackControlTask::CallbackFunction callback) {
+    std::cout << "Registering callback for channel " << channel << std::endl;
+
+    IngestLane* lane = getLane(channel);
+    if (!lane) {
+        return;
+    }
+    
+    // Tasks share the callback instead of copying it
+    CallbackControlTask::CallbackPtr shared =
+        std::make_shared<const CallbackControlTask::CallbackFunction>(std::move(callback));
+
+    postToIngest(*lane, [lane, channel, shared] {
+        lane->callbackMap[channel].push_back(shared);
+    });
+}
+
+/**
+ * @brief Handles notifications of new data from the data plane.
+ * Creates and adds a CallbackControlTask to execute the registered callbacks.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number with new data.
+ */
+void BatteryTestingService::handleCallbacks(IngestLane& lane, uint32_t channel) {
+    // Check if there are callbacks registered for this channel
+    auto it = lane.callbackMap.find(channel);
+    std::atomic<uint32_t>* slot;
+    // Callbacks still pending read this sample too, unless some have already started
+    if (it != lane.callbackMap.end() &&
+        claimCoalescingSlot(channel, 1, TaskType::Callback, static_cast<uint32_t>(it->second.size()), slot)) {
+        // Create a CallbackControlTask for each callback and add it to the task queue
+        for (const auto& callback : it->second) {
+            addTask(callbackTaskPool.acquire(channel, callback, channelDataService), slot);
+        }
+        std::atomic<uint64_t>& count = callbackCounts[channel];
+        count.store(count.load(std::memory_order_relaxed) + it->second.size(), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Unregisters a callback function for a specific channel.
+ *
+ * @param channel The channel number.
+ * @param callbackIndex Optional index of the specific callback to unregister.
+ *                     If negative, all callbacks for the channel will be unregistered.
+ */
+void BatteryTestingService::unregisterCallback(uint32_t channel, int callbackIndex) {
+    std::cout << "Unregistering callback(s) for channel " << channel << std::endl;
+
+    IngestLane* lane = getLane(channel);
+    if (!lane) {
+        return;
+    }
+    
+    postToIngest(*lane, [lane, channel, callbackIndex] {
+        // Check if there are callbacks registered for this channel
+        auto it = lane->callbackMap.find(channel);
+        if (it == lane->callbackMap.end()) {
+            return;
+        }
+        if (callbackIndex < 0) {
+            // Remove all callbacks for this channel
+            lane->callbackMap.erase(it);
+        } else if (callbackIndex < static_cast<int>(it->second.size())) {
+            // Remove the specific callback at the given index
+            it->second.erase(it->second.begin() + callbackIndex);
+            
+            // If no callbacks remain, remove the channel entry
+            if (it->second.empty()) {
+                lane->callbackMap.erase(it);
+            }
+        }
+    });
+}
+
+/**
+ * @brief Runs a command on the ingest thread of a lane, between two batches of frames.
+ *
+ * Wakes the ingest thread so the command runs even while no frames arrive.
+ *
+ * @param lane The ingest lane.
+ * @param command The command to run.
+ */
+void BatteryTestingService::postToIngest(IngestLane& lane, std::function<void()> command) {
+    while (!lane.commands.push(command)) {
+        std::this_thread::yield();
+    }
+    lane.endpoint->wake();
+}
+
+/**
+ * @brief Advances the step state machines of the channels updated by a frame.
+ *
+ * Samples that do not change the control mode or setpoint create no work.
+ * The commands of all channels changing mode on the same frame go out as
+ * one command batch.
+ *
+ * @param lane The ingest lane that received the frame.
+ * @param updatedMask Bit n is set if local channel n of the lane received new data.
+ */
+void BatteryTestingService::advanceSteps(IngestLane& lane, uint64_t updatedMask) {
+    const ChannelDataTable& table = channelDataService->getDataTable();
+    ChannelCommandBatch batch;
+    ProfileCommand profile;
+    uint64_t triggerTime = 0;
+
+    for (uint64_t bits = updatedMask; bits != 0; bits &= bits - 1) {
+        uint32_t channel = lane.firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+        bool stepRunning = stepEngine.isRunning(channel);
+        if (!stepRunning && !controlRoutines.isWaitingForSamples(channel)) {
+            continue;
+        }
+        ChannelSnapshot snapshot = table.read(channel);
+        bool changed;
+        if (stepRunning) {
+            StepTransition transition = stepEngine.advance(channel, snapshot.sample);
+            changed = transition.action != StepAction::None || transition.completed;
+            if (changed) {
+                addStepTransition(lane, batch, channel, transition);
+            }
+        } else {
+            uint64_t commandMask = batch.channelMask;
+            if (controlRoutines.advance(channel, snapshot.sample, channel - lane.firstChannel, batch)) {
+                IngestLane::count(lane.stepsCompleted);
+            }
+            changed = batch.channelMask != commandMask || controlRoutines.hasProfile(channel);
+            collectRoutineProfile(lane, channel, profile);
+            syncRoutineTimer(lane, channel, snapshot.receiveTime);
+        }
+        if (changed && (triggerTime == 0 || snapshot.receiveTime < triggerTime)) {
+            triggerTime = snapshot.receiveTime;
+        }
+        if (checkpoint.isOpen() &&
+            (changed || lane.checkpoints[channel - lane.firstChannel].state.phase != getStepPhase(channel))) {
+            saveCheckpoint(lane, channel, &snapshot.sample);
+        }
+    }
+    addCommandBatch(lane, batch, triggerTime);
+    addProfileCommand(lane, profile, triggerTime);
+}
+
+/**
+ * @brief Fires the timers of a lane that are due and sends the resulting commands.
+ *
+ * A routine timer resumes the routine's timed-out wait. A data watchdog
+ * re-arms itself from the reception time of the channel's latest sample,
+ * so samples never touch the wheel; only when that sample is older than
+ * the timeout is the step stopped and the channel set to rest. The
+ * commands of all timers firing together go out as one batch.
+ *
+ * @param lane The ingest lane.
+ * @param now Monotonic time in nanoseconds.
+ */
+void BatteryTestingService::expireTimers(IngestLane& lane, uint64_t now) {
+    const ChannelDataTable& table = channelDataService->getDataTable();
+    ChannelCommandBatch batch;
+    ProfileCommand profile;
+
+    lane.timers.advance(now, [&](uint32_t timer) {
+        uint32_t local = timer / TIMERS_PER_CHANNEL;
+        uint32_t channel = lane.firstChannel + local;
+        if (timer % TIMERS_PER_CHANNEL == ROUTINE_TIMER) {
+            ChannelSample sample = table.read(channel).sample;
+            if (controlRoutines.expire(channel, sample, local, batch)) {
+                IngestLane::count(lane.stepsCompleted);
+            }
+            collectRoutineProfile(lane, channel, profile);
+            syncRoutineTimer(lane, channel, now);
+            saveCheckpoint(lane, channel, &sample);
+            return;
+        }
+
+        if (lane.watchdogNs == 0 || !(stepEngine.isRunning(channel) || controlRoutines.isWaiting(channel))) {
+            return;
+        }
+        uint64_t deadline = table.getReceiveTime(channel) + lane.watchdogNs;
+        if (deadline > now) {
+            lane.timers.arm(timer, deadline);
+            return;
+        }
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::OPERATION_TIMEOUT,
+            "No data, stopping the step; watchdog ms", channel, nullptr, 0,
+            static_cast<float>(lane.watchdogNs / 1000000));
+        stepEngine.stop(channel);
+        controlRoutines.stop(channel);
+        syncRoutineTimer(lane, channel, now);
+        saveCheckpoint(lane, channel, nullptr);
+        batch.set(local, ChannelCommandMode::Rest);
+    });
+    addCommandBatch(lane, batch);
+    addProfileCommand(lane, profile);
+}
+
+/**
+ * @brief Arms or cancels the timer of a channel's routine after it entered a new wait.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param now Monotonic time in nanoseconds the wait started at.
+ */
+void BatteryTestingService::syncRoutineTimer(IngestLane& lane, uint32_t channel, uint64_t now) {
+    uint64_t timeoutNs;
+    if (!controlRoutines.takeTimer(channel, timeoutNs)) {
+        return;
+    }
+    uint32_t timer = (channel - lane.firstChannel) * TIMERS_PER_CHANNEL + ROUTINE_TIMER;
+    if (timeoutNs != 0) {
+        lane.timers.arm(timer, now + timeoutNs);
+    } else {
+        lane.timers.cancel(timer);
+    }
+}
+
+/**
+ * @brief Updates the routine timers and data watchdogs of a lane after posted commands ran.
+ *
+ * Steps and routines are started and stopped by posted commands only, so
+ * this is the one place their timers have to follow, and the ingest path
+ * of the samples stays free of it.
+ *
+ * @param lane The ingest lane.
+ * @param now Monotonic time in nanoseconds.
+ */
+void BatteryTestingService::syncLaneTimers(IngestLane& lane, uint64_t now) {
+    for (uint32_t local = 0; local < lane.channelCount; ++local) {
+        uint32_t channel = lane.firstChannel + local;
+        syncRoutineTimer(lane, channel, now);
+
+        uint32_t watchdog = local * TIMERS_PER_CHANNEL + WATCHDOG_TIMER;
+        bool running = stepEngine.isRunning(channel) || controlRoutines.isWaiting(channel);
+        if (lane.watchdogNs == 0 || !running) {
+            lane.timers.cancel(watchdog);
+        } else if (!lane.timers.isArmed(watchdog)) {
+            lane.timers.arm(watchdog, now + lane.watchdogNs);
+        }
+    }
+}
+
+/**
+ * @brief Describes a routine of a single-channel control type for its checkpoint.
+ *
+ * @param kind The control type.
+ * @param current The current setpoint.
+ * @param targetVoltage The CV voltage.
+ * @param rampRate The ramp slope.
+ * @param duration The rest duration in seconds.
+ * @param limits The compiled step limits of the routine.
+ * @return The record; Opaque if the limits do not fit in it.
+ */
+CheckpointRecord BatteryTestingService::describeRoutine(CheckpointKind kind, float current, float targetVoltage,
+    float rampRate, double duration, const StepLimitEvaluator& limits) {
+    CheckpointRecord record;
+    record.kind = kind;
+    record.duration = duration;
+    record.state.current = current;
+    record.state.targetVoltage = targetVoltage;
+    record.state.rampRate = rampRate;
+    if (!limits.save(record.state.limits, STEP_SNAPSHOT_MAX_LIMITS, record.state.limitCount)) {
+        record.kind = CheckpointKind::Opaque;
+        record.state.limitCount = 0;
+    }
+    return record;
+}
+
+/**
+ * @brief Starts the checkpoint record of a channel that began a step, recipe or routine.
+ *
+ * Clears the counters of the previous control type.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param record The descriptor of a routine, or an empty record for the step engine.
+ */
+void BatteryTestingService::beginCheckpoint(IngestLane& lane, uint32_t channel, const CheckpointRecord& record) {
+    if (!checkpoint.isOpen()) {
+        return;
+    }
+    CheckpointRecord& current = lane.checkpoints[channel - lane.firstChannel];
+    current = record;
+    current.startedAt = realtimeNanoseconds();
+    saveCheckpoint(lane, channel, nullptr);
+}
+
+/**
+ * @brief Writes the checkpoint record of a channel after a transition.
+ *
+ * A routine keeps the descriptor it was started with and only updates its
+ * phase; the step engine state is copied in full. A step ending on the
+ * sample adds its capacity and energy to the completed totals. Never
+ * allocates, so transitions on the ingest path stay allocation-free.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param sample The sample of the transition, nullptr for a command.
+ */
+void BatteryTestingService::saveCheckpoint(IngestLane& lane, uint32_t channel, const ChannelSample* sample) {
+    if (!checkpoint.isOpen()) {
+        return;
+    }
+    CheckpointRecord& record = lane.checkpoints[channel - lane.firstChannel];
+    bool stepEnded = false;
+    if (controlRoutines.isWaiting(channel)) {
+        record.state.phase = controlRoutines.getPhase(channel);
+    } else if (stepEngine.isRunning(channel)) {
+        bool wasRunning = record.kind == CheckpointKind::Step || record.kind == CheckpointKind::Recipe;
+        if (stepEngine.save(channel, record.state)) {
+            record.kind = record.state.programFingerprint != 0 ? CheckpointKind::Recipe : CheckpointKind::Step;
+        } else {
+            record.kind = CheckpointKind::Opaque;
+        }
+        // A recipe that moved to its next step on this sample holds off the limits until the M4 restarts the step
+        stepEnded = sample && wasRunning && record.state.awaitingRestart && record.state.restartSamples == 0;
+    } else {
+        stepEnded = sample && record.kind != CheckpointKind::None;
+        record.kind = CheckpointKind::None;
+        record.state.phase = getStepPhase(channel);
+    }
+
+    if (sample) {
+        record.stepCapacity = (*sample)[ChannelField::Capacity];
+        record.stepEnergy = (*sample)[ChannelField::Energy];
+        record.stepTime = (*sample)[ChannelField::StepTime];
+        if (stepEnded) {
+            record.completedCapacity += record.stepCapacity;
+            record.completedEnergy += record.stepEnergy;
+        }
+    }
+    record.updatedAt = realtimeNanoseconds();
+    checkpoint.write(channel, record);
+}
+
+/**
+ * @brief Resumes the checkpointed channels of a lane before its thread starts.
+ *
+ * A record whose write did not finish, or that cannot be resumed, sets
+ * its channel to rest: the M4 would otherwise keep running the last
+ * command without the host watching its limits. The timers of the resumed
+ * routines and the data watchdogs are then armed.
+ *
+ * @param lane The ingest lane.
+ * @return The number of channels resumed.
+ */
+size_t BatteryTestingService::resumeLane(IngestLane& lane) {
+    ChannelCommandBatch batch;
+    size_t resumed = 0;
+    for (uint32_t local = 0; local < lane.channelCount; ++local) {
+        uint32_t channel = lane.firstChannel + local;
+        CheckpointRecord record;
+        std::string error;
+        if (!checkpoint.read(channel, record)) {
+            error = "its record was being written";
+        } else if (record.kind == CheckpointKind::None) {
+            lane.checkpoints[local] = record;
+            continue;
+        } else if (resumeChannel(lane, channel, record, error)) {
+            ++record.resumeCount;
+            lane.checkpoints[local] = record;
+            checkpoint.write(channel, record);
+            ++resumed;
+            continue;
+        }
+        std::cerr << "Cannot resume channel " << channel << ": " << error << ", setting it to rest" << std::endl;
+        batch.set(local, ChannelCommandMode::Rest);
+        lane.checkpoints[local] = CheckpointRecord();
+        checkpoint.write(channel, lane.checkpoints[local]);
+    }
+    addCommandBatch(lane, batch);
+    syncLaneTimers(lane, monotonicNanoseconds());
+    return resumed;
+}
+
+/**
+ * @brief Resumes one checkpointed channel on the step engine or as a routine.
+ *
+ * Steps and recipes get their step engine state back; a recipe must be in
+ * the CheckpointConfig of the topology. Routines of the single-channel
+ * control types are started again at the phase they reached, without a
+ * command, and with their limits; a rest keeps the time it had left.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param record The checkpoint record of the channel.
+ * @param error Receives the reason on failure.
+ * @return True if the channel runs again.
+ */
+bool BatteryTestingService::resumeChannel(IngestLane& lane, uint32_t channel, const CheckpointRecord& record,
+    std::string& error) {
+    const StepSnapshot& state = record.state;
+    if (record.kind == CheckpointKind::Step) {
+        return stepEngine.restore(channel, state, nullptr, error);
+    }
+    if (record.kind == CheckpointKind::Recipe) {
+        for (const std::shared_ptr<const RecipeProgram>& program : topology.getCheckpoint().programs) {
+            if (program && program->fingerprint == state.programFingerprint) {
+                return stepEngine.restore(channel, state, program, error);
+            }
+        }
+        error = "its recipe is not in the checkpoint configuration";
+        return false;
+    }
+    if (record.kind == CheckpointKind::Opaque) {
+        error = "it ran a state that cannot be checkpointed, e.g. a custom routine";
+        return false;
+    }
+
+    StepLimitEvaluator limits;
+    if (state.limitCount > STEP_SNAPSHOT_MAX_LIMITS || !limits.restore(state.limits, state.limitCount)) {
+        error = "its step limits are corrupt";
+        return false;
+    }
+    StepPhase phase = state.phase;
+    bool validPhase = false;
+    ControlRoutine routine;
+    switch (record.kind) {
+        case CheckpointKind::CCCV:
+            validPhase = phase == StepPhase::ConstantCurrent || phase == StepPhase::ConstantVoltage;
+            if (validPhase) {
+                routine = cccvRoutine(channel, state.current, state.targetVoltage, std::move(limits), phase);
+            }
+            break;
+        case CheckpointKind::CurrentRamp:
+            validPhase = phase == StepPhase::Ramping || phase == StepPhase::Holding;
+            if (validPhase) {
+                routine = currentRampRoutine(channel, state.current, state.rampRate, std::move(limits), phase);
+            }
+            break;
+        case CheckpointKind::Rest:
+            validPhase = phase == StepPhase::Resting;
+            if (validPhase) {
+                double duration = record.duration;
+                if (duration > 0.0) {
+                    // The wall clock measures the time the service was down too
+                    double elapsed = static_cast<double>(realtimeNanoseconds() - record.startedAt) / 1e9;
+                    duration = std::max(duration - elapsed, 1e-9);
+                }
+                routine = restRoutine(channel, std::move(limits), duration, phase);
+            }
+            break;
+        case CheckpointKind::Profile:
+            validPhase = phase == StepPhase::Profile;
+            if (validPhase) {
+                routine = profileRoutine(channel, nullptr, std::move(limits), phase);
+            }
+            break;
+        default:
+            break;
+    }
+    if (!validPhase) {
+        error = "its routine was in an unexpected phase";
+        return false;
+    }
+
+    // The routine enters its phase without a command, so the batch stays empty
+    ChannelCommandBatch batch;
+    controlRoutines.start(channel, std::move(routine), channel - lane.firstChannel, batch);
+    return true;
+}
+
+/**
+ * @brief Turns a step transition into a task on the real-time control lane.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param transition The transition returned by the step engine.
+ */
+void BatteryTestingService::applyStepTransition(IngestLane& lane, uint32_t channel, const StepTransition& transition) {
+    ChannelCommandBatch batch;
+    addStepTransition(lane, batch, channel, transition);
+    addCommandBatch(lane, batch);
+}
+
+/**
+ * @brief Adds the command of a step transition to a batch.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param batch The batch of the lane to add the command to.
+ * @param channel The channel number.
+ * @param transition The transition returned by the step engine.
+ */
+void BatteryTestingService::addStepTransition(IngestLane& lane, ChannelCommandBatch& batch, uint32_t channel,
+    const StepTransition& transition) {
+    uint32_t local = channel - lane.firstChannel;
+    switch (transition.action) {
+        case StepAction::SetConstantCurrent:
+            batch.set(local, ChannelCommandMode::ConstantCurrent, transition.setpoint);
+            break;
+        case StepAction::SetConstantVoltage:
+            batch.set(local, ChannelCommandMode::ConstantVoltage, transition.setpoint);
+            IngestLane::count(lane.cvSwitches);
+            break;
+        case StepAction::SetRest:
+            batch.set(local, ChannelCommandMode::Rest);
+            break;
+        case StepAction::None:
+            break;
+    }
+    if (transition.completed) {
+        IngestLane::count(lane.stepsCompleted);
+    }
+}
+
+/**
+ * @brief Sends a command batch to the control service of a lane on the real-time control lane.
+ *
+ * @param lane The ingest lane the batch is for.
+ * @param batch The commands to send, nothing is sent if the mask is empty.
+ * @param triggerTime Reception time of the sample that caused the commands, 0 for API calls.
+ */
+void BatteryTestingService::addCommandBatch(IngestLane& lane, const ChannelCommandBatch& batch, uint64_t triggerTime) {
+    if (batch.channelMask == 0) {
+        return;
+    }
+
+    TaskHandle task;
+    uint32_t local = static_cast<uint32_t>(__builtin_ctzll(batch.channelMask));
+    const ChannelCommand& command = batch.commands[local];
+    if (batch.channelMask & (batch.channelMask - 1)) {
+        task = batchTaskPool.acquire(batch, lane.ctrlService);
+    } else {
+        switch (command.mode) {
+            case ChannelCommandMode::ConstantCurrent:
+                task = ccTaskPool.acquire(local, command.setpoint, lane.ctrlService);
+                break;
+            case ChannelCommandMode::ConstantVoltage:
+                task = cvTaskPool.acquire(local, command.setpoint, lane.ctrlService);
+                break;
+            case ChannelCommandMode::Rest:
+                task = restTaskPool.acquire(local, lane.ctrlService);
+                break;
+            case ChannelCommandMode::Off:
+                task = batchTaskPool.acquire(batch, lane.ctrlService);
+                break;
+        }
+    }
+    task->triggerTime = triggerTime;
+    addControlTask(std::move(task));
+}
+
+/**
+ * @brief Adds the profile a control routine has just started to the profile command of its lane.
+ *
+ * @param lane The ingest lane of the channel.
+ * @param channel The channel number.
+ * @param command The profile command of the lane.
+ */
+void BatteryTestingService::collectRoutineProfile(IngestLane& lane, uint32_t channel, ProfileCommand& command) {
+    if (!controlRoutines.hasProfile(channel)) {
+        return;
+    }
+    std::shared_ptr<const SetpointProfile> profile = controlRoutines.takeProfile(channel);
+    if (command.profile != profile) {
+        addProfileCommand(lane, command);
+        command.profile = std::move(profile);
+    }
+    command.channelMask |= 1ULL << (channel - lane.firstChannel);
+}
+
+/**
+ * @brief Sends a profile command to the control service of a lane on the real-time control lane.
+ *
+ * @param lane The ingest lane the command is for.
+ * @param command The profile and its channels, cleared once sent; nothing is sent if the mask is empty.
+ * @param triggerTime Reception time of the sample that caused the command, 0 for API calls.
+ */
+void BatteryTestingService::addProfileCommand(IngestLane& lane, ProfileCommand& command, uint64_t triggerTime) {
+    if (command.channelMask != 0 && command.profile) {
+        TaskHandle task = profileTaskPool.acquire(command.channelMask, std::move(command.profile), lane.ctrlService);
+        task->triggerTime = triggerTime;
+        addControlTask(std::move(task));
+    }
+    command.profile.reset();
+    command.channelMask = 0;
+}
+
+/**
+ * @brief Creates the data processing tasks for a frame of M4 data.
+ *
+ * @param firstChannel The first channel of the frame.
+ * @param channelCount The number of channels in the frame, at most 64.
+ * @param updatedMask Bit n is set if channel firstChannel + n received new data.
+ */
+void BatteryTestingService::dispatchDataTasks(uint32_t firstChannel, uint32_t channelCount, uint64_t updatedMask) {
+    uint32_t blockSize = dataTaskBlockSize;
+
+    for (uint32_t offset = 0; offset < channelCount; offset += blockSize) {
+        uint32_t count = std::min(blockSize, channelCount - offset);
+        uint64_t blockMask = (count == 64 ? ~0ULL : ((1ULL << count) - 1)) << offset;
+        uint64_t updated = updatedMask & blockMask;
+
+        // A task still pending for the same channels will read this sample too
+        std::atomic<uint32_t>* slot;
+        if (updated == blockMask) {
+            // Regular data: one pass over the whole block
+            uint32_t channel = firstChannel + offset;
+            if (claimCoalescingSlot(channel, count, TaskType::Filtering, 1, slot)) {
+                addTask(filteringTaskPool.acquire(channel, count, channelDataService, &filterEngine), slot);
+            }
+            if (claimCoalescingSlot(channel, count, TaskType::Fitting, 1, slot)) {
+                addTask(fittingTaskPool.acquire(channel, count, channelDataService, &fittingEngine), slot);
+            }
+            continue;
+        }
+
+        // Irregular data: one task per updated channel
+        for (uint32_t bit = offset; bit < offset + count; ++bit) {
+            if (updated & (1ULL << bit)) {
+                uint32_t channel = firstChannel + bit;
+                if (claimCoalescingSlot(channel, 1, TaskType::Filtering, 1, slot)) {
+                    addTask(filteringTaskPool.acquire(channel, 1u, channelDataService, &filterEngine), slot);
+                }
+                if (claimCoalescingSlot(channel, 1, TaskType::Fitting, 1, slot)) {
+                    addTask(fittingTaskPool.acquire(channel, 1u, channelDataService, &fittingEngine), slot);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Ingest thread function for continuously receiving the data of one M4 endpoint.
+ *
+ * Blocks on the lane's M4 endpoint until frames arrive, then decodes every
+ * pending frame straight into the global data table with its reception time
+ * before creating one round of data tasks and callbacks for the channels the
+ * batch updated. The thread only wakes up for frames, when the endpoint is
+ * woken for a posted command or to stop, or when a timer of its wheel is due. Each endpoint has its own thread, so ingest throughput
+ * grows with the number of endpoints.
+ * Worker threads handle data processing (filtering, fitting, etc.) and callbacks.
+ *
+ * @param lane The ingest lane of the endpoint.
+ */
+void BatteryTestingService::m4DataThreadFunction(IngestLane& lane) {
+    M4FrameBuffer frames[M4_MAX_BATCH_FRAMES];
+
+    std::function<void()> command;
+
+    while (!stopThreads) {
+        int timeoutMs = lane.timers.getTimeoutMs(monotonicNanoseconds());
+        size_t frameCount = lane.endpoint->waitForFrames(frames, M4_MAX_BATCH_FRAMES, timeoutMs);
+
+        // Apply the commands posted by other threads (step starts, ...)
+        bool ranCommands = false;
+        while (lane.commands.pop(command)) {
+            command();
+            ranCommands = true;
+        }
+        command = nullptr;
+        if (ranCommands) {
+            syncLaneTimers(lane, monotonicNanoseconds());
+        }
+
+        // Fire the due routine timeouts and watchdogs before the new samples are looked at
+        if (lane.timers.getArmedCount() > 0) {
+            expireTimers(lane, monotonicNanoseconds());
+        }
+
+        if (frameCount == 0) {
+            continue;
+        }
+
+        // Measure the frame rate over windows of at least FRAME_RATE_WINDOW_NS
+        uint64_t batchStart = frames[0].receiveTime;
+        uint64_t windowStart = lane.rateWindowStart.load(std::memory_order_relaxed);
+        lane.rateWindowFrames += frameCount;
+        if (windowStart == 0) {
+            lane.rateWindowStart.store(batchStart, std::memory_order_relaxed);
+            lane.rateWindowFrames = 0;
+        } else if (batchStart - windowStart >= FRAME_RATE_WINDOW_NS) {
+            lane.frameRate.store(lane.rateWindowFrames * 1e9 / (batchStart - windowStart), std::memory_order_relaxed);
+            lane.rateWindowStart.store(batchStart, std::memory_order_relaxed);
+            lane.rateWindowFrames = 0;
+        }
+
+        // Update the data table from every frame of the batch, advancing the steps after each frame
+        uint64_t batchMask = 0;
+        for (size_t f = 0; f < frameCount; ++f) {
+            uint64_t updatedMask;
+            if (lane.frameParser.parse(frames[f].data, frames[f].size, frames[f].receiveTime,
+                    *channelDataService, updatedMask)) {
+                advanceSteps(lane, updatedMask);
+                batchMask |= updatedMask;
+            }
+        }
+        if (batchMask == 0) {
+            continue;
+        }
+
+        // Create data processing tasks (filtering, fitting, etc.) per block of channels
+        dispatchDataTasks(lane.firstChannel, lane.channelCount, batchMask);
+
+        // Execute callbacks for subscribed channels, decimated by their rate and deadbands
+        uint64_t batchEnd = frames[frameCount - 1].receiveTime;
+        for (uint64_t bits = batchMask; bits != 0; bits &= bits - 1) {
+            uint32_t channel = lane.firstChannel + static_cast<uint32_t>(__builtin_ctzll(bits));
+            if (channelDataService->acceptSample(channel, batchEnd)) {
+                handleCallbacks(lane, channel);
+            }
+        }
+        lane.batchLatency.record(monotonicNanoseconds() - batchStart);
+    }
+}
+
+/**
+ * @brief Executes the constant current task.
+ *
+ * @return The status of the control service.
+ */
+ErrorLogging::Status CCTask::execute() {
+    return ctrlService->doConstantCurrent(channel, current);
+}
+
+/**
+ * @brief Executes the constant voltage task.
+ *
+ * @return The status of the control service.
+ */
+ErrorLogging::Status CVTask::execute() {
+    return ctrlService->doConstantVoltage(channel, targetVoltage);
+}
+
+/**
+ * @brief Executes the rest task.
+ *
+ * @return The status of the control service.
+ */
+ErrorLogging::Status RestTask::execute() {
+    return ctrlService->doRest(channel);
+}
+
+/**
+ * @brief Executes the batch control task.
+ *
+ * @return The status of the control service.
+ */
+ErrorLogging::Status BatchControlTask::execute() {
+    return ctrlService->doBatch(batch);
+}
+
+/**
+ * @brief Executes the profile control task.
+ *
+ * @return The status of the control service.
+ */
+ErrorLogging::Status ProfileControlTask::execute() {
+    return ctrlService->doProfile(channelMask, profile);
+}
+
+/**
+ * @brief Executes the fitting algorithm on the raw data.
+ *
+ * Takes one consistent snapshot of the whole channel range, updates the
+ * streaming fit of all channels, then publishes dv/dt, di/dt and the fitted
+ * voltage back to the data table, where getDvDt and the callbacks read them.
+ *
+ * @return The status of storing the derived values.
+ */
+ErrorLogging::Status FittingDataTask::execute() {
+    ChannelBlock block;
+    dataService->getDataTable().readBlock(firstChannel, channelCount, block);
+
+    if (fittingEngine->process(block) > 0) {
+        return dataService->receiveDerivedData(block, ChannelField::DvDt, 3);
+    }
+    return {};
+}
+
+/**
+ * @brief Executes the filtering algorithm on the raw data.
+ *
+ * Takes one consistent snapshot of the whole channel range, filters voltage
+ * and current of all channels with the vector kernel, then publishes the
+ * filtered columns back to the data table.
+ *
+ * @return The status of storing the derived values.
+ */
+ErrorLogging::Status FilteringDataTask::execute() {
+    ChannelBlock block;
+    dataService->getDataTable().readBlock(firstChannel, channelCount, block);
+
+    if (filterEngine->process(block) > 0) {
+        return dataService->receiveDerivedData(block, ChannelField::FilteredVoltage, 2);
+    }
+    return {};
+}
+
+/**
+ * @brief Executes the generic control task.
+ *
+ * @return Success.
+ */
+ErrorLogging::Status GenericControlTask::execute() {
+    while (!ctrlServices.empty()) {
+        ChannelCtrlService* service = ctrlServices.front();
+        ctrlServices.pop();
+        // Clean up the service after execution
+        delete service;
+    }
+    return {};
+}
+
+/**
+ * @brief Adds a ChannelCtrlService to the queue.
+ *
+ * @param service The ChannelCtrlService to add.
+ */
+void GenericControlTask::addCtrlService(ChannelCtrlService* service) {
+    ctrlServices.push(service);
+}
+
+/**
+ * @brief Executes the callback control task.
+ *
+ * Copies a consistent snapshot of the channel from the data service and
+ * executes the registered callback function on it. The copy is taken
+ * without locking, so the ingest thread is never stalled.
  *
- * Reads the latest data for the channel from the data service and
- * executes the registered callback function.
+ * @return Success.
  */
-void CallbackControlTask::execute() {
+ErrorLogging::Status CallbackControlTask::execute() {
     // Get the latest data for this channel from the data service
-    const std::map<std::string, float>& channelData = dataService->getChannelData(channel);
+    ChannelSnapshot snapshot = dataService->getSnapshot(channel);
     
     // Execute the callback with the channel data
-    if (callback) {
-        callback(channel, channelData);
+    if (callback && *callback) {
+        (*callback)(channel, snapshot);
     }
+    return {};
 }
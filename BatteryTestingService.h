@@ -2,29 +2,51 @@
 #define BATTERYTESTINGSERVICE_H
 
 #include <iostream>
-#include <queue>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 #include "Task.h"
+#include "TaskPool.h"
+#include "TaskScheduler.h"
 #include "ChannelService.h"
+#include "ChannelTopology.h"
+#include "ControlExecutor.h"
+#include "ControlRoutine.h"
+#include "ErrorEvents.h"
+#include "FilterEngine.h"
+#include "FittingEngine.h"
+#include "M4Endpoint.h"
+#include "M4FrameParser.h"
+#include "MetricsExporter.h"
+#include "MpmcQueue.h"
+#include "Recipe.h"
+#include "ServiceMetrics.h"
+#include "SharedChannelTable.h"
+#include "StateCheckpoint.h"
+#include "StepEngine.h"
+#include "StepLimitEvaluator.h"
+#include "TaskCoalescer.h"
+#include "TelemetryRecorder.h"
+#include "TimerWheel.h"
+#include "WorkerAutoscaler.h"
+
+// Default slope of runCurrentRamp, in A per second of step time
+#define DEFAULT_CURRENT_RAMP_RATE 0.1f
+
+// Interval at which the error reporter thread drains the ErrorEventRing, in milliseconds
+#define ERROR_REPORT_INTERVAL_MS 10
 
 // Forward declarations
 class ChannelCtrlService;
 class ChannelDataService;
 class Task;
 
-typedef struct
-{
-    std::string var_type;
-    float target_value;
-} StepLimit; // Define the StepLimit struct
-
 /**
  * @brief The BatteryTestingService class provides an abstraction layer for controlling battery testing hardware.
  *
@@ -34,12 +56,20 @@ typedef struct
 class BatteryTestingService {
 public:
     /**
-     * @brief Constructor for the BatteryTestingService class.
+     * @brief Constructor for the BatteryTestingService class, for a single M4 endpoint.
      *
      * @param numWorkerThreads The initial number of worker threads to create.
      */
     BatteryTestingService(size_t numWorkerThreads = 3);
 
+    /**
+     * @brief Constructor for the BatteryTestingService class.
+     *
+     * @param topology The boards and M4 cores of the rack; one ingest thread is started per endpoint.
+     * @param numWorkerThreads The initial number of worker threads to create.
+     */
+    BatteryTestingService(const ChannelTopology& topology, size_t numWorkerThreads = 3);
+
     /**
      * @brief Destructor for the BatteryTestingService class.
      */
@@ -60,22 +90,157 @@ public:
      *
      * @param channel The channel number.
      * @param current The target current value.
+     * @param rampRate The ramp slope in A per second of step time.
+     * @param steplimit The step limit for the test.
      */
-    void runCurrentRamp(uint32_t channel, float current);
+    void runCurrentRamp(uint32_t channel, float current, float rampRate = DEFAULT_CURRENT_RAMP_RATE,
+        const std::vector<StepLimit> &steplimit = {});
 
     /**
      * @brief Sets the channel to a rest state (open circuit).
+     * A rest duration, a "time" limit on its own, runs as a timer instead of a per-sample limit.
+     *
+     * @param channel The channel number.
+     * @param steplimit The step limit ending the rest, e.g. a rest duration.
+     */
+    void runRest(uint32_t channel, const std::vector<StepLimit> &steplimit = {});
+
+    /**
+     * @brief Runs a setpoint profile on a channel, executed by the M4 at its control rate.
+     * The host is only woken by the end of the profile or the step limits.
+     *
+     * @param channel The channel number.
+     * @param profile The profile, can be shared between channels.
+     * @param steplimit The step limit ending the profile early.
+     */
+    void runProfile(uint32_t channel, std::shared_ptr<const SetpointProfile> profile,
+        const std::vector<StepLimit> &steplimit = {});
+
+    /**
+     * @brief Runs a coroutine control routine on a channel, replacing its step or routine.
+     * The routine is resumed by the ingest thread of the channel; see ControlRoutine.
+     * A custom routine cannot be checkpointed; a resumed service sets the channel to rest.
+     *
+     * @param channel The channel number.
+     * @param routine The routine, which must address this channel only.
+     */
+    void runControlRoutine(uint32_t channel, ControlRoutine routine);
+
+    /**
+     * @brief Runs a compiled recipe (a multi-step schedule) on a channel.
+     *
+     * @param channel The channel number.
+     * @param program The recipe compiled by RecipeProgram::compile(), can be shared between channels.
+     */
+    void runRecipe(uint32_t channel, std::shared_ptr<const RecipeProgram> program);
+
+    /**
+     * @brief Runs the same CCCV test on a group of channels, starting them at the same tick.
+     * Channels of the same endpoint start at the same tick, up to M4_COMMAND_CHANNELS_PER_FRAME of them.
+     *
+     * @param channels The global channel numbers.
+     * @param current The target current value.
+     * @param targetVoltage The target voltage value.
+     * @param steplimit The step limit for the test.
+     */
+    void runCCCVGroup(const std::vector<uint32_t>& channels, float current, float targetVoltage,
+        const std::vector<StepLimit> &steplimit);
+
+    /**
+     * @brief Runs a compiled recipe on a group of channels, starting them at the same tick.
+     * Channels of the same endpoint start at the same tick, up to M4_COMMAND_CHANNELS_PER_FRAME of them.
+     *
+     * @param channels The global channel numbers.
+     * @param program The recipe compiled by RecipeProgram::compile().
+     */
+    void runRecipeGroup(const std::vector<uint32_t>& channels, std::shared_ptr<const RecipeProgram> program);
+
+    /**
+     * @brief Runs the same setpoint profile on a group of channels, starting them at the same tick.
+     * Channels of the same endpoint get the profile in one upload and start at the same tick.
+     *
+     * @param channels The global channel numbers.
+     * @param profile The profile.
+     * @param steplimit The step limit ending the profile early, evaluated per channel.
+     */
+    void runProfileGroup(const std::vector<uint32_t>& channels, std::shared_ptr<const SetpointProfile> profile,
+        const std::vector<StepLimit> &steplimit = {});
+
+    /**
+     * @brief Turns off a group of channels and aborts their steps.
+     * Channels of the same endpoint are turned off at the same tick, up to M4_COMMAND_CHANNELS_PER_FRAME of them.
+     *
+     * @param channels The global channel numbers.
+     */
+    void emergencyStop(const std::vector<uint32_t>& channels);
+
+    /**
+     * @brief Aborts the step running on a channel and sets it to rest.
+     *
+     * @param channel The channel number.
+     */
+    void stopStep(uint32_t channel);
+
+    /**
+     * @brief Gets the phase of the step running on a channel.
+     *
+     * @param channel The channel number.
+     * @return The phase of the channel's step state machine.
+     */
+    StepPhase getStepPhase(uint32_t channel) const;
+
+    /**
+     * @brief Gets the index of the recipe step a channel runs or ran last.
+     *
+     * @param channel The channel number.
+     * @return The index of the step in the recipe, counting steps only.
+     */
+    uint32_t getRecipeStep(uint32_t channel) const;
+
+    /**
+     * @brief Sets the data watchdog of the channels running a step or routine.
+     * A channel that receives no sample for the timeout has its step stopped and is set to rest.
+     *
+     * @param milliseconds The timeout, 0 to disable the watchdog.
+     */
+    void setDataWatchdogTimeout(uint32_t milliseconds);
+
+    /**
+     * @brief Gets the timeout of the data watchdog.
+     *
+     * @return The timeout in milliseconds, 0 if disabled.
+     */
+    uint32_t getDataWatchdogTimeout() const;
+
+    /**
+     * @brief Gets the checkpointed execution state of a channel.
      *
      * @param channel The channel number.
+     * @param record Receives the record, with the capacity and energy of the completed steps.
+     * @return True on success, false if there is no checkpoint or the channel is unknown.
      */
-    void runRest(uint32_t channel);
+    bool getChannelCheckpoint(uint32_t channel, CheckpointRecord& record) const;
 
     /**
      * @brief Adds or removes worker threads dynamically.
+     * Workers are added or retired one at a time while the others keep running tasks.
      *
-     * @param numThreads The new total number of worker threads.
+     * @param numThreads The new total number of worker threads, at most MAX_WORKER_THREADS.
      */
     void setWorkerThreadCount(size_t numThreads);
+
+    /**
+     * @brief Starts resizing the worker pool automatically from queue depth and task latency.
+     * Replaces the running autoscaler, if any.
+     *
+     * @param config The bounds and thresholds of the autoscaler.
+     */
+    void enableAutoscaler(const WorkerAutoscalerConfig& config);
+
+    /**
+     * @brief Stops the autoscaler; the worker count stays as it is.
+     */
+    void disableAutoscaler();
     
     /**
      * @brief Gets the current number of worker threads.
@@ -84,32 +249,249 @@ public:
      */
     size_t getWorkerThreadCount() const;
 
+    /**
+     * @brief Gets the worker thread that owns a channel.
+     * Tasks of the channel run on that worker unless an idle worker steals them.
+     *
+     * @param channel The channel number.
+     * @return The index of the worker thread.
+     */
+    size_t getChannelWorker(uint32_t channel) const;
+
+    /**
+     * @brief Sets how many channels each batch data task covers.
+     *
+     * @param numChannels The block size, clamped to [1, MAX_BLOCK_CHANNELS].
+     */
+    void setDataTaskBlockSize(size_t numChannels);
+
+    /**
+     * @brief Gets how many channels each batch data task covers.
+     *
+     * @return The block size.
+     */
+    size_t getDataTaskBlockSize() const;
+
+    /**
+     * @brief Sets the real-time priority, CPU pinning and latency budget of the control lane.
+     *
+     * @param config The configuration, e.g. {80, 1} for SCHED_FIFO 80 on CPU 1.
+     * @return True if the priority and pinning could be applied.
+     */
+    bool configureControlExecutor(const ControlExecutorConfig& config);
+
+    /**
+     * @brief Sets the coalescing of data and callback tasks and the policy of each full scheduler lane.
+     *
+     * @param config The configuration; HIGH tasks are only dropped after blocking for blockTimeoutNs.
+     * @return True if applied, false if it drops HIGH tasks.
+     */
+    bool configureTaskOverload(const TaskOverloadConfig& config);
+
+    /**
+     * @brief Gets the counters of the coalesced, dropped and blocked tasks.
+     *
+     * @return A copy of the counters.
+     */
+    TaskOverloadStatistics getTaskOverloadStatistics() const;
+
+    /**
+     * @brief Gets the dispatch latency counters of the control lane.
+     *
+     * @return A copy of the counters.
+     */
+    ControlExecutorStatistics getControlExecutorStatistics() const;
+
+    /**
+     * @brief Gets the counters of the M4 frame parsers (parsed, dropped and rejected frames).
+     *
+     * @return The sum of the counters of all endpoints.
+     */
+    M4FrameStatistics getM4FrameStatistics() const;
+
+    /**
+     * @brief Gets the counters of the M4 frame parser of one endpoint.
+     *
+     * @param endpoint The index of the endpoint in the topology.
+     * @return A copy of the counters, all zero for an unknown endpoint.
+     */
+    M4FrameStatistics getM4FrameStatistics(size_t endpoint) const;
+
+    /**
+     * @brief Gets the boards and M4 cores of the rack.
+     *
+     * @return The topology given at construction.
+     */
+    const ChannelTopology& getTopology() const;
+
+    /**
+     * @brief Starts recording every sample of every channel to telemetry files.
+     *
+     * @param config The files and chunking.
+     * @param error Receives the reason if the recording cannot be started.
+     * @return True if the recording started.
+     */
+    bool startTelemetryRecording(const TelemetryRecorderConfig& config, std::string& error);
+
+    /**
+     * @brief Stops the telemetry recording and closes its file.
+     */
+    void stopTelemetryRecording();
+
+    /**
+     * @brief Gets the counters of the telemetry recorder (recorded and dropped samples, bytes written).
+     *
+     * @return A copy of the counters.
+     */
+    TelemetryStatistics getTelemetryStatistics() const;
+
+    /**
+     * @brief Gets a snapshot of the runtime metrics.
+     *
+     * Adds up the queue wait and execution time histograms of the worker
+     * threads and the control executor per task type and priority, and reads
+     * the queue depths, the frame counters and rate and the batch latency of
+     * every ingest lane, and the callbacks queued per channel. Recording
+     * never blocks; this call takes the worker resize lock briefly.
+     *
+     * @return The metrics.
+     */
+    ServiceMetrics getMetrics() const;
+
+    /**
+     * @brief Starts serving getMetrics() in the Prometheus text format over HTTP.
+     *
+     * @param config The address and port to listen on.
+     * @param error Receives the reason if the exporter cannot be started.
+     * @return True if the exporter is listening.
+     */
+    bool startMetricsExporter(const MetricsExporterConfig& config, std::string& error);
+
+    /**
+     * @brief Stops the metrics exporter.
+     */
+    void stopMetricsExporter();
+
+    /**
+     * @brief Sets where the errors of the ingest, worker and control threads are reported.
+     *
+     * Those threads never throw or write to a stream: they queue their
+     * errors to the ErrorEventRing of the process, and a reporter thread of
+     * the service drains it every ERROR_REPORT_INTERVAL_MS into the handler,
+     * e.g. to forward the events to ErrorLogging::Logger. The default
+     * handler writes them to std::cerr.
+     *
+     * @param handler Called on the reporter thread for each event; nullptr restores the default.
+     */
+    void setErrorHandler(std::function<void(const ErrorEvent&)> handler);
+
 private:
     /**
-     * @brief Adds a task to the task queue.
+     * @brief The ingest path of one M4 endpoint.
      *
-     * @param task The task to add.
+     * Each endpoint has its own thread, frame parser and command queue, so
+     * endpoints are ingested in parallel, and its own control service, which
+     * receives the commands of the endpoint's channels.
      */
-    void addTask(Task* task);
+    struct IngestLane {
+        IngestLane(uint32_t firstChannel, uint32_t channelCount, M4Endpoint* endpoint,
+            ChannelCtrlService* ctrlService);
+
+        uint32_t firstChannel;          // Global channel of local channel 0
+        uint32_t channelCount;
+        M4Endpoint* endpoint;           // Source of the endpoint's frames, owned by the lane
+        ChannelCtrlService* ctrlService;// Control service of the endpoint's board, owned by the lane
+        M4FrameParser frameParser;      // Used by the lane's thread only
+        // Commands run on the lane's thread, see postToIngest
+        MpmcQueue<std::function<void()>> commands;
+        // Callback functions of the lane's channels, owned by the lane's thread
+        std::map<uint32_t, std::vector<CallbackControlTask::CallbackPtr>> callbackMap;
+        // Routine timeouts and data watchdogs of the lane's channels, driven by the lane's thread
+        TimerWheel timers;
+        uint64_t watchdogNs = 0;
+        // Checkpoint records of the lane's channels as last written, owned by the lane's thread
+        std::vector<CheckpointRecord> checkpoints;
+        std::thread thread;
+
+        // Metrics written by the lane's thread only
+        LatencyHistogram batchLatency;  // From the reception of a batch to its last queued task
+        std::atomic<uint64_t> rateWindowStart{0};
+        uint64_t rateWindowFrames = 0;
+        std::atomic<double> frameRate{0.0};
+        std::atomic<uint64_t> cvSwitches{0};    // Steps that reached their target voltage and switched to CV
+        std::atomic<uint64_t> stepsCompleted{0};// Steps and control routines that ended
+
+        /**
+         * @brief Increments a counter of the lane. Called by the lane's thread only.
+         *
+         * @param counter The counter, e.g. cvSwitches.
+         */
+        static void count(std::atomic<uint64_t>& counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @brief Adds a task to the task queue, applying the overload policy of its priority if its lane is full.
+     *
+     * @param task The task to add. Ownership passes to the scheduler.
+     * @param coalesceSlot The slot claimed for the task from taskCoalescer, or nullptr.
+     */
+    void addTask(TaskHandle task, std::atomic<uint32_t>* coalesceSlot = nullptr);
+
+    /**
+     * @brief Claims the coalescing slot of new data or callback tasks.
+     *
+     * @param channel The first channel of the tasks.
+     * @param channelCount The number of channels the tasks cover.
+     * @param type The type of the tasks.
+     * @param taskCount The number of tasks.
+     * @param slot Receives the slot to pass to addTask(), nullptr if coalescing is off.
+     * @return True to queue the tasks, false if pending tasks already cover them.
+     */
+    bool claimCoalescingSlot(uint32_t channel, uint32_t channelCount, TaskType type, uint32_t taskCount,
+        std::atomic<uint32_t>*& slot);
+
+    /**
+     * @brief Adds a control task to the real-time control lane.
+     *
+     * @param task The task to add. Ownership passes to the control executor.
+     */
+    void addControlTask(TaskHandle task);
     
+    /**
+     * @brief Creates the data processing tasks for a frame of M4 data.
+     * Channels are grouped in blocks of dataTaskBlockSize; a fully updated block
+     * gets one filtering and one fitting task, the channels of a partially
+     * updated block fall back to one task each.
+     *
+     * @param firstChannel The first channel of the frame.
+     * @param channelCount The number of channels in the frame, at most 64.
+     * @param updatedMask Bit n is set if channel firstChannel + n received new data.
+     */
+    void dispatchDataTasks(uint32_t firstChannel, uint32_t channelCount, uint64_t updatedMask);
+
     /**
      * @brief Registers a callback function for a specific channel.
+     * The callback map is updated on the ingest thread of the channel, which owns it.
      *
      * @param channel The channel number.
      * @param callback The callback function to register.
      */
-    void registerCallback(uint32_t channel, std::function<void(uint32_t, const std::map<std::string, float>&)> callback);
+    void registerCallback(uint32_t channel, CallbackControlTask::CallbackFunction callback);
     
     /**
      * @brief Handles notifications of new data from the data plane.
      * Creates and adds a CallbackControlTask to execute the registered callback.
      *
+     * @param lane The ingest lane of the channel.
      * @param channel The channel number with new data.
      */
-    void handleCallbacks(uint32_t channel);
+    void handleCallbacks(IngestLane& lane, uint32_t channel);
     
     /**
      * @brief Unregisters a callback function for a specific channel.
+     * The callback map is updated on the ingest thread of the channel, which owns it.
      *
      * @param channel The channel number.
      * @param callbackIndex Optional index of the specific callback to unregister.
@@ -117,31 +499,335 @@ private:
      */
     void unregisterCallback(uint32_t channel, int callbackIndex = -1);
 
-    // Single task queue for all tasks
-    std::priority_queue<Task*, std::vector<Task*>, TaskComparator> taskQueue;
+    /**
+     * @brief Compiles the step limits of a control type, reporting an unknown field to the ErrorEventRing.
+     *
+     * @param channel The channel number, or ERROR_EVENT_NO_CHANNEL for a group.
+     * @param steplimit The step limits.
+     * @param limits Receives the compiled limits.
+     * @return True on success, false if a limit names an unknown field.
+     */
+    static bool compileLimits(uint32_t channel, const std::vector<StepLimit>& steplimit, StepLimitEvaluator& limits);
 
-    // Worker threads and M4 data thread
-    std::vector<std::thread> workerThreads;
-    std::thread m4DataThread;    // Dedicated thread for receiving M4 data
-    
-    // Flag to signal threads to stop
+    /**
+     * @brief Takes the rest duration out of the step limits of a rest.
+     * A "time" limit alone in its group ends the rest on its own, so it can be a timer.
+     *
+     * @param steplimit The step limits.
+     * @param sampleLimits Receives the limits that still need the samples.
+     * @return The shortest such duration in seconds, 0 if there is none.
+     */
+    static double splitRestDuration(const std::vector<StepLimit>& steplimit, std::vector<StepLimit>& sampleLimits);
+
+    /**
+     * @brief Starts a step on the step engines of a group of channels.
+     * The first setpoints of the channels of an endpoint go out as one command batch.
+     *
+     * @param channels The global channel numbers.
+     * @param step The step to run.
+     */
+    void startStepGroup(const std::vector<uint32_t>& channels, const StepDefinition& step);
+
+    /**
+     * @brief Gets the step time of the latest sample of a channel, for the start of a step.
+     *
+     * @param channel The global channel number.
+     * @return The StepTime field of the data table.
+     */
+    float getStepTime(uint32_t channel) const;
+
+    /**
+     * @brief Gets the ingest lane of a channel.
+     *
+     * @param channel The global channel number.
+     * @return The lane, or nullptr if the channel is not in the topology.
+     */
+    IngestLane* getLane(uint32_t channel) const;
+
+    /**
+     * @brief Splits a list of channels by ingest lane.
+     *
+     * @param channels The global channel numbers; unknown channels are ignored.
+     * @return Bit n of entry i is set if local channel n of lane i is in the list.
+     */
+    std::vector<uint64_t> getLaneMasks(const std::vector<uint32_t>& channels) const;
+
+    /**
+     * @brief Runs a command on the ingest thread of a lane, between two batches of frames.
+     * Used to change the state owned by the ingest path without locking it.
+     *
+     * @param lane The ingest lane.
+     * @param command The command to run.
+     */
+    void postToIngest(IngestLane& lane, std::function<void()> command);
+
+    /**
+     * @brief Advances the step state machines of the channels updated by a frame.
+     * Called on the ingest thread of the lane right after the frame is published.
+     *
+     * @param lane The ingest lane that received the frame.
+     * @param updatedMask Bit n is set if local channel n of the lane received new data.
+     */
+    void advanceSteps(IngestLane& lane, uint64_t updatedMask);
+
+    /**
+     * @brief Fires the timers of a lane that are due and sends the resulting commands.
+     * Called on the ingest thread of the lane on every wakeup.
+     *
+     * @param lane The ingest lane.
+     * @param now Monotonic time in nanoseconds.
+     */
+    void expireTimers(IngestLane& lane, uint64_t now);
+
+    /**
+     * @brief Arms or cancels the timer of a channel's routine after it entered a new wait.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param now Monotonic time in nanoseconds the wait started at.
+     */
+    void syncRoutineTimer(IngestLane& lane, uint32_t channel, uint64_t now);
+
+    /**
+     * @brief Updates the routine timers and data watchdogs of a lane after posted commands ran.
+     * Steps and routines are started and stopped by posted commands only.
+     *
+     * @param lane The ingest lane.
+     * @param now Monotonic time in nanoseconds.
+     */
+    void syncLaneTimers(IngestLane& lane, uint64_t now);
+
+    /**
+     * @brief Turns a step transition into a control task.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param transition The transition returned by the step engine.
+     */
+    void applyStepTransition(IngestLane& lane, uint32_t channel, const StepTransition& transition);
+
+    /**
+     * @brief Runs a control routine on a channel and checkpoints it with its descriptor.
+     *
+     * @param channel The channel number.
+     * @param routine The routine, which must address this channel only.
+     * @param record The kind, setpoints and limits of the routine, to resume it from.
+     */
+    void startControlRoutine(uint32_t channel, ControlRoutine routine, const CheckpointRecord& record);
+
+    /**
+     * @brief Describes a routine of a single-channel control type for its checkpoint.
+     *
+     * @param kind The control type.
+     * @param current The current setpoint.
+     * @param targetVoltage The CV voltage.
+     * @param rampRate The ramp slope.
+     * @param duration The rest duration in seconds.
+     * @param limits The compiled step limits of the routine.
+     * @return The record; Opaque if the limits do not fit in it.
+     */
+    static CheckpointRecord describeRoutine(CheckpointKind kind, float current, float targetVoltage, float rampRate,
+        double duration, const StepLimitEvaluator& limits);
+
+    /**
+     * @brief Starts the checkpoint record of a channel that began a step, recipe or routine.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param record The descriptor of a routine, or an empty record for the step engine.
+     */
+    void beginCheckpoint(IngestLane& lane, uint32_t channel, const CheckpointRecord& record);
+
+    /**
+     * @brief Writes the checkpoint record of a channel after a transition.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param sample The sample of the transition, nullptr for a command.
+     */
+    void saveCheckpoint(IngestLane& lane, uint32_t channel, const ChannelSample* sample);
+
+    /**
+     * @brief Resumes the checkpointed channels of a lane before its thread starts.
+     * Channels that cannot be resumed are set to rest.
+     *
+     * @param lane The ingest lane.
+     * @return The number of channels resumed.
+     */
+    size_t resumeLane(IngestLane& lane);
+
+    /**
+     * @brief Resumes one checkpointed channel on the step engine or as a routine.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param record The checkpoint record of the channel.
+     * @param error Receives the reason on failure.
+     * @return True if the channel runs again.
+     */
+    bool resumeChannel(IngestLane& lane, uint32_t channel, const CheckpointRecord& record, std::string& error);
+
+    /**
+     * @brief Adds the command of a step transition to a batch.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param batch The batch of the lane to add the command to.
+     * @param channel The channel number.
+     * @param transition The transition returned by the step engine.
+     */
+    void addStepTransition(IngestLane& lane, ChannelCommandBatch& batch, uint32_t channel,
+        const StepTransition& transition);
+
+    /**
+     * @brief Sends a command batch to the control service of a lane on the real-time control lane.
+     * A batch of a single channel is sent as a per-channel control task.
+     *
+     * @param lane The ingest lane the batch is for.
+     * @param batch The commands to send, nothing is sent if the mask is empty.
+     * @param triggerTime Reception time of the sample that caused the commands, 0 for API calls.
+     */
+    void addCommandBatch(IngestLane& lane, const ChannelCommandBatch& batch, uint64_t triggerTime = 0);
+
+    /**
+     * @brief Channels of a lane starting the same setpoint profile.
+     */
+    struct ProfileCommand {
+        std::shared_ptr<const SetpointProfile> profile;
+        uint64_t channelMask = 0;
+    };
+
+    /**
+     * @brief Adds the profile a control routine has just started to the profile command of its lane.
+     * A different profile than the one collected so far sends the collected one first.
+     *
+     * @param lane The ingest lane of the channel.
+     * @param channel The channel number.
+     * @param command The profile command of the lane.
+     */
+    void collectRoutineProfile(IngestLane& lane, uint32_t channel, ProfileCommand& command);
+
+    /**
+     * @brief Sends a profile command to the control service of a lane on the real-time control lane.
+     *
+     * @param lane The ingest lane the command is for.
+     * @param command The profile and its channels, cleared once sent; nothing is sent if the mask is empty.
+     * @param triggerTime Reception time of the sample that caused the command, 0 for API calls.
+     */
+    void addProfileCommand(IngestLane& lane, ProfileCommand& command, uint64_t triggerTime = 0);
+
+    // Boards and M4 cores of the rack
+    ChannelTopology topology;
+
+    // Lock-free scheduler with channel-affine shards, one lane per task priority in each
+    TaskScheduler taskScheduler;
+
+    /**
+     * @brief A worker thread and its retire token.
+     */
+    struct WorkerSlot {
+        std::thread thread;
+        // Set to make this worker exit once its current task is done
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> retire{false};
+        // Worst queueing latency seen by this worker since the autoscaler last read it
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> maxQueueLatency{0};
+        // Task histograms of this slot, allocated with its first thread and kept across resizes
+        std::unique_ptr<TaskMetricsShard> taskMetrics;
+    };
+
+    // Worker threads, slots [0, workerCount) are running
+    WorkerSlot workers[MAX_WORKER_THREADS];
+    std::atomic<size_t> workerCount;
+    mutable std::mutex workerResizeMutex;    // Serializes resizes by the API and the autoscaler, and metric reads
+
+    // Flag to signal the ingest threads to stop
     std::atomic<bool> stopThreads;
 
-    // Mutex and condition variable for task queue
-    std::mutex taskQueueMutex;
-    std::condition_variable taskQueueCV;
+    // Autoscaler thread and its stop signal
+    std::thread autoscalerThread;
+    std::mutex autoscalerMutex;
+    std::condition_variable autoscalerCV;
+    bool stopAutoscaler;
+
+    // Number of channels covered by each batch data task
+    std::atomic<uint32_t> dataTaskBlockSize;
+
+    // Latest-wins slots of the data and callback tasks, and the overload policies and counters
+    TaskCoalescer taskCoalescer;
+    std::atomic<bool> coalescingEnabled{true};
+    std::atomic<OverloadPolicy> overloadPolicies[TASK_PRIORITY_COUNT];
+    std::atomic<uint64_t> droppedTasks[TASK_PRIORITY_COUNT];
+    std::atomic<uint64_t> blockedTasks[TASK_PRIORITY_COUNT];
+    std::atomic<uint64_t> blockTimeoutNs{DEFAULT_TASK_BLOCK_TIMEOUT_NS};
+
+    // Error reporter thread, its stop signal and its handler, guarded by errorReporterMutex
+    std::thread errorReporterThread;
+    std::mutex errorReporterMutex;
+    std::condition_variable errorReporterCV;
+    bool stopErrorReporter;
+    std::function<void(const ErrorEvent&)> errorHandler;
 
     // Thread Functions
-    void workerThreadFunction();
-    void m4DataThreadFunction();
+    void workerThreadFunction(size_t workerIndex);
+    void m4DataThreadFunction(IngestLane& lane);
+    void autoscalerThreadFunction(WorkerAutoscalerConfig config);
+    void errorReporterThreadFunction();
+
+    // Shared-memory segment of the global channel table, if the topology publishes it
+    SharedChannelTable sharedTable;
 
-    // Low-Level Services
-    ChannelCtrlService* channelCtrlService;
+    // Data service holding the global channel table of all endpoints
     ChannelDataService* channelDataService;
-    
-    // Callback map to store multiple callback functions for each channel
-    std::map<uint32_t, std::vector<std::function<void(uint32_t, const std::map<std::string, float>&)>>> callbackMap;
+
+    // Execution state of every channel in a memory-mapped file; holds the engine state below, so it outlives them
+    StateCheckpoint checkpoint;
+
+    // Vectorized filter state of all channels, shared by the filtering tasks
+    FilterEngine filterEngine;
+
+    // Streaming linear fit (dv/dt, di/dt) of all channels, shared by the fitting tasks
+    FittingEngine fittingEngine;
+
+    // Step state machines of all channels, each channel driven by the ingest thread of its lane
+    StepEngine stepEngine;
+
+    // Coroutine control routines of the single-channel control types, resumed by the same ingest threads
+    ControlRoutineEngine controlRoutines;
+
+    // Timers of each channel on the wheel of its lane, at local channel * TIMERS_PER_CHANNEL
+    static constexpr uint32_t ROUTINE_TIMER = 0;
+    static constexpr uint32_t WATCHDOG_TIMER = 1;
+    static constexpr uint32_t TIMERS_PER_CHANNEL = 2;
+
+    // Timeout of the data watchdog, applied by each lane's thread
+    std::atomic<uint32_t> dataWatchdogMs{0};
+
+    // Pools for the tasks created on every sample, so the ingest path never allocates
+    TaskPool<FilteringDataTask> filteringTaskPool;
+    TaskPool<FittingDataTask> fittingTaskPool;
+    TaskPool<CallbackControlTask> callbackTaskPool;
+
+    // Pools for the tasks created on step transitions
+    TaskPool<CCTask> ccTaskPool;
+    TaskPool<CVTask> cvTaskPool;
+    TaskPool<RestTask> restTaskPool;
+    TaskPool<BatchControlTask> batchTaskPool;
+    TaskPool<ProfileControlTask> profileTaskPool;
+
+    // Real-time lane for control tasks, destroyed before the pools its ring refers to
+    ControlExecutor controlExecutor;
+
+    // Recorder of every sample, one source per ingest lane
+    TelemetryRecorder telemetryRecorder;
+
+    // Callback tasks queued per channel, each channel written by the ingest thread of its lane
+    std::unique_ptr<std::atomic<uint64_t>[]> callbackCounts;
+
+    // HTTP endpoint of getMetrics(), stopped before the lanes it reads are destroyed
+    MetricsExporter metricsExporter;
+
+    // Ingest path of every endpoint of the topology, in topology order
+    std::vector<std::unique_ptr<IngestLane>> ingestLanes;
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,297 @@
+#include "../BatteryTestingService.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// End-to-end benchmarks of the BatteryTestingService on simulated hardware,
+// reported as one JSON document so runs before and after a scheduler or
+// data table change can be compared by a script:
+//
+//   latency      Time from the reception of the sample that crosses the
+//                target voltage of a CCCV step to the start of the CV
+//                command on the control lane (CVTask, or BatchControlTask
+//                when several channels of an endpoint switch on the same
+//                frame), over every channel of a simulated rack.
+//   throughput   Data tasks per second through addTask and the worker
+//                threads, for each combination of channel count and
+//                worker count, with the queue wait and execution time of
+//                the filtering tasks since the service started.
+//   allocations  Heap allocations per channel sample on the ingest, task
+//                and control paths while a CCCV step runs on every channel.
+//
+// Latencies come from the service's own histograms (getMetrics), whose
+// percentiles are bucket upper bounds within 12.5 %. The service does no
+// console I/O on its ingest, worker and control threads; the messages of
+// its API calls are redirected to stderr, so stdout holds the JSON only.
+//
+// Channels of an endpoint that switch to CV on the same frame share one
+// BatchControlTask, so the latency histogram counts CV commands
+// (cv_commands), which can be fewer than the channels switched
+// (cv_switches, from the ingest lane counters).
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -I.. EndToEndBenchmark.cpp $(ls ../*.cpp | grep -v main.cpp) ../ErrorLogging/ErrorCodes.cpp
+// Run:
+//   ./a.out [all|latency|throughput|allocations] [seconds] [sampleRate] > results.json
+
+namespace {
+
+// Heap allocations made by any thread since start-up
+std::atomic<uint64_t> allocationCount{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* memory = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace {
+
+// Channel counts and worker counts of the throughput grid
+const uint32_t THROUGHPUT_CHANNELS[] = {64, 256, 1024};
+const size_t THROUGHPUT_WORKERS[] = {1, 2, 4};
+
+/**
+ * @brief Gets a simulated rack whose cells reach 4.2 V within seconds at 0.3 A.
+ *
+ * @param sampleRate The frames per second of every endpoint.
+ * @return The simulation settings.
+ */
+ChannelSimulationConfig fastChargingRack(double sampleRate) {
+    ChannelSimulationConfig simulation;
+    simulation.enabled = true;
+    simulation.sampleRate = sampleRate;
+    simulation.battery.capacityAh = 0.0005f;
+    simulation.battery.initialSoc = 0.3f;
+    simulation.battery.voltageNoise = 0.0f;
+    return simulation;
+}
+
+/**
+ * @brief Formats a latency summary as a JSON object.
+ *
+ * @param summary The summary.
+ * @return The object.
+ */
+std::string toJson(const LatencySummary& summary) {
+    char text[256];
+    std::snprintf(text, sizeof(text),
+        "{\"count\": %llu, \"mean_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+        static_cast<unsigned long long>(summary.count), static_cast<unsigned long long>(summary.meanNs),
+        static_cast<unsigned long long>(summary.p50Ns), static_cast<unsigned long long>(summary.p99Ns),
+        static_cast<unsigned long long>(summary.p999Ns), static_cast<unsigned long long>(summary.maxNs));
+    return text;
+}
+
+/**
+ * @brief Adds up the execution counts of every task type and priority.
+ *
+ * @param metrics The metrics.
+ * @return The number of tasks run.
+ */
+uint64_t tasksRun(const ServiceMetrics& metrics) {
+    uint64_t count = 0;
+    for (const auto& type : metrics.tasks) {
+        for (const TaskLatencyMetrics& task : type) {
+            count += task.execution.count;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Counts the channel samples parsed by every endpoint.
+ *
+ * @param service The service.
+ * @return Frames times channels per frame, over all endpoints.
+ */
+uint64_t samplesParsed(const BatteryTestingService& service) {
+    const ChannelTopology& topology = service.getTopology();
+    uint64_t samples = 0;
+    for (size_t i = 0; i < topology.getEndpointCount(); ++i) {
+        samples += service.getM4FrameStatistics(i).framesParsed * topology.getEndpoint(i).channelCount;
+    }
+    return samples;
+}
+
+/**
+ * @brief Measures the time from the sample crossing the target voltage to the CV command.
+ *
+ * The step limit is out of reach, so the only commands with a trigger
+ * sample are the CC to CV switches.
+ *
+ * @param channels The number of channels.
+ * @param sampleRate The frames per second of every endpoint.
+ * @return The JSON result.
+ */
+std::string runLatency(uint32_t channels, double sampleRate) {
+    BatteryTestingService service(ChannelTopology::simulatedRack(channels, fastChargingRack(sampleRate)), 3);
+    std::vector<uint32_t> group;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        group.push_back(channel);
+    }
+    service.runCCCVGroup(group, 0.3f, 4.2f, {{"time", 1e9f, LimitComparison::GreaterOrEqual}});
+
+    uint32_t switched = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (switched < channels && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        switched = 0;
+        for (uint32_t channel : group) {
+            switched += service.getStepPhase(channel) == StepPhase::ConstantVoltage;
+        }
+    }
+    // Let the executor run the last switches before reading its histogram
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ServiceMetrics metrics = service.getMetrics();
+    service.emergencyStop(group);
+    uint64_t cvSwitches = 0;
+    for (const IngestMetrics& ingest : metrics.ingest) {
+        cvSwitches += ingest.cvSwitches;
+    }
+
+    char text[320];
+    std::snprintf(text, sizeof(text),
+        "{\"name\": \"cv_switch_latency\", \"channels\": %u, \"sample_rate\": %g, \"channels_switched\": %u, "
+        "\"cv_switches\": %llu, \"cv_commands\": %llu, ",
+        channels, sampleRate, switched, static_cast<unsigned long long>(cvSwitches),
+        static_cast<unsigned long long>(metrics.controlReaction.count));
+    return text + std::string("\"sample_to_command\": ") + toJson(metrics.controlReaction) +
+        ", \"ingest_batch\": " + toJson(metrics.ingest.empty() ? LatencySummary() : metrics.ingest[0].batchLatency) +
+        "}";
+}
+
+/**
+ * @brief Measures the sustained data task throughput for one channel and worker count.
+ *
+ * @param channels The number of channels.
+ * @param workers The number of worker threads.
+ * @param sampleRate The frames per second of every endpoint.
+ * @param seconds The measurement time, after a warm-up of half a second.
+ * @return The JSON result.
+ */
+std::string runThroughput(uint32_t channels, size_t workers, double sampleRate, double seconds) {
+    BatteryTestingService service(ChannelTopology::simulatedRack(channels, fastChargingRack(sampleRate)), workers);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    ServiceMetrics before = service.getMetrics();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    ServiceMetrics after = service.getMetrics();
+
+    double elapsed = static_cast<double>(after.timestampNs - before.timestampNs) * 1e-9;
+    uint64_t dropped = 0;
+    uint64_t frames = 0;
+    for (size_t i = 0; i < after.ingest.size(); ++i) {
+        frames += after.ingest[i].frames.framesParsed - before.ingest[i].frames.framesParsed;
+        dropped += after.ingest[i].frames.framesDropped - before.ingest[i].frames.framesDropped;
+    }
+    const TaskLatencyMetrics& filtering =
+        after.tasks[static_cast<size_t>(TaskType::Filtering)][static_cast<size_t>(TaskPriority::NORMAL)];
+
+    char text[256];
+    std::snprintf(text, sizeof(text),
+        "{\"name\": \"task_throughput\", \"channels\": %u, \"workers\": %zu, \"sample_rate\": %g, "
+        "\"tasks_per_second\": %.1f, \"frames_per_second\": %.1f, \"frames_dropped\": %llu, ",
+        channels, workers, sampleRate, static_cast<double>(tasksRun(after) - tasksRun(before)) / elapsed,
+        static_cast<double>(frames) / elapsed, static_cast<unsigned long long>(dropped));
+    return text + std::string("\"filtering_queue_wait\": ") + toJson(filtering.queueWait) +
+        ", \"filtering_execution\": " + toJson(filtering.execution) + "}";
+}
+
+/**
+ * @brief Counts the heap allocations per channel sample while every channel runs a CCCV step.
+ *
+ * @param channels The number of channels.
+ * @param sampleRate The frames per second of every endpoint.
+ * @param seconds The measurement time, after a warm-up of one second.
+ * @return The JSON result.
+ */
+std::string runAllocations(uint32_t channels, double sampleRate, double seconds) {
+    BatteryTestingService service(ChannelTopology::simulatedRack(channels, fastChargingRack(sampleRate)), 3);
+    std::vector<uint32_t> group;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        group.push_back(channel);
+    }
+    service.runCCCVGroup(group, 0.3f, 4.2f, {{"time", 1e9f, LimitComparison::GreaterOrEqual}});
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // Neither sleeping nor reading the frame counters allocates
+    uint64_t allocationsBefore = allocationCount.load();
+    uint64_t samplesBefore = samplesParsed(service);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    uint64_t samples = samplesParsed(service) - samplesBefore;
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+    service.emergencyStop(group);
+
+    char text[256];
+    std::snprintf(text, sizeof(text),
+        "{\"name\": \"allocations_per_sample\", \"channels\": %u, \"sample_rate\": %g, \"samples\": %llu, "
+        "\"allocations\": %llu, \"allocations_per_sample\": %.6f}",
+        channels, sampleRate, static_cast<unsigned long long>(samples),
+        static_cast<unsigned long long>(allocations),
+        samples ? static_cast<double>(allocations) / static_cast<double>(samples) : 0.0);
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "all";
+    double seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 2.0;
+    double sampleRate = argc > 3 ? std::strtod(argv[3], nullptr) : 1000.0;
+    if (mode != "all" && mode != "latency" && mode != "throughput" && mode != "allocations") {
+        std::cerr << "Unknown benchmark " << mode << ", expected all, latency, throughput or allocations" << std::endl;
+        return 1;
+    }
+
+    std::streambuf* console = std::cout.rdbuf(std::cerr.rdbuf());
+    std::vector<std::string> results;
+    if (mode == "all" || mode == "latency") {
+        results.push_back(runLatency(256, sampleRate));
+    }
+    if (mode == "all" || mode == "throughput") {
+        for (uint32_t channels : THROUGHPUT_CHANNELS) {
+            for (size_t workers : THROUGHPUT_WORKERS) {
+                results.push_back(runThroughput(channels, workers, sampleRate, seconds));
+            }
+        }
+    }
+    if (mode == "all" || mode == "allocations") {
+        results.push_back(runAllocations(256, sampleRate, seconds));
+    }
+    std::cout.rdbuf(console);
+
+    std::cout << "{\n  \"benchmark\": \"end_to_end\",\n  \"hardware_threads\": "
+              << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::cout << "    " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ]\n}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "../ErrorLogging/Logger.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of the logging macros as seen by the calling threads, which
+// stand in for the ingest and worker threads. Each thread logs formatted
+// sample lines to a file sink on /dev/null. Also compares a filtered-out
+// LOG_DEBUG_FMT with the previous path, which built the message string
+// before the level was checked.
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -DSPDLOG_FMT_EXTERNAL -I.. LoggingThroughputBenchmark.cpp
+//       ../ErrorLogging/Logger.cpp ../ErrorLogging/ErrorCodes.cpp -lspdlog -lfmt
+// Run:
+//   ./a.out [sync|async|overrun] [threads] [messagesPerThread]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Logs from every thread at once, returns the calls per second
+double runLogging(size_t threads, size_t messagesPerThread) {
+    std::vector<std::thread> loggers;
+    Clock::time_point start = Clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        loggers.emplace_back([t, messagesPerThread] {
+            for (size_t i = 0; i < messagesPerThread; ++i) {
+                LOG_INFO_FMT("thread {} channel {} voltage {:.4f} V current {:.4f} A",
+                             t, i % 64, 3.7 + i * 1e-6, 1.25);
+            }
+        });
+    }
+    for (std::thread& logger : loggers) {
+        logger.join();
+    }
+    return threads * messagesPerThread / secondsSince(start);
+}
+
+// Cost of one filtered-out debug call, in nanoseconds
+template <typename Log>
+double runFiltered(size_t iterations, Log log) {
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        log(i);
+    }
+    return secondsSince(start) * 1e9 / iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* mode = argc > 1 ? argv[1] : "async";
+    size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+    size_t messagesPerThread = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 200000;
+
+    ErrorLogging::Logger& logger = ErrorLogging::Logger::getInstance();
+    if (std::strcmp(mode, "sync") == 0) {
+        logger.initialize("benchmark");
+    } else {
+        ErrorLogging::AsyncOptions options;
+        if (std::strcmp(mode, "overrun") == 0) {
+            options.overflowPolicy = ErrorLogging::OverflowPolicy::OVERRUN_OLDEST;
+        }
+        logger.initializeAsync(options, "benchmark");
+    }
+    logger.addFileSink("/dev/null");
+    logger.setLogLevel(ErrorLogging::LogLevel::INFO);
+
+    std::cout << "mode=" << mode << " threads=" << threads
+              << " messages/thread=" << messagesPerThread << std::endl;
+
+    double calls = runLogging(threads, messagesPerThread);
+    logger.flush();
+    std::cout << "LOG_INFO_FMT:            " << calls << " calls/s" << std::endl;
+    std::cout << "overrun:                 " << logger.getOverrunCount() << " messages" << std::endl;
+
+    size_t iterations = 10000000;
+    double legacy = runFiltered(iterations, [&logger](size_t i) {
+        logger.debug("channel " + std::to_string(i % 64) + " voltage " + std::to_string(3.7));
+    });
+    double filtered = runFiltered(iterations, [](size_t i) {
+        LOG_DEBUG_FMT("channel {} voltage {:.4f}", i % 64, 3.7);
+    });
+    std::cout << "filtered debug, string:  " << legacy << " ns/call" << std::endl;
+    std::cout << "filtered LOG_DEBUG_FMT:  " << filtered << " ns/call" << std::endl;
+    return 0;
+}
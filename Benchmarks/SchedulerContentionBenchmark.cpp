@@ -0,0 +1,190 @@
+#include "../ChannelTopology.h"
+#include "../Task.h"
+#include "../TaskScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Contention benchmark of the lock-free TaskScheduler against the previous
+// BatteryTestingService::addTask path (single mutex + std::priority_queue +
+// condition variable).
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -I.. SchedulerContentionBenchmark.cpp ../TaskScheduler.cpp ../ChannelDataTable.cpp
+// Run:
+//   ./a.out [producers] [workers] [tasksPerProducer]
+
+namespace {
+
+std::atomic<uint64_t> executedTasks{0};
+
+// Minimal task, so the benchmark measures queueing rather than work
+class CountingTask : public Task {
+public:
+    CountingTask(TaskPriority priority, uint32_t channel) : Task(priority, channel) {}
+
+    ErrorLogging::Status execute() override {
+        executedTasks.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+};
+
+// Replica of the previous addTask/workerThreadFunction queue
+class LegacyTaskQueue {
+public:
+    explicit LegacyTaskQueue(size_t) {}
+
+    void addTask(Task* task) {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        taskQueue.push(task);
+        taskQueueCV.notify_one();
+    }
+
+    void workerThreadFunction(size_t) {
+        while (!stopThreads) {
+            Task* task = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(taskQueueMutex);
+                taskQueueCV.wait(lock, [this] {
+                    return !taskQueue.empty() || stopThreads;
+                });
+                if (stopThreads && taskQueue.empty()) {
+                    break;
+                }
+                if (!taskQueue.empty()) {
+                    task = taskQueue.top();
+                    taskQueue.pop();
+                }
+            }
+            if (task) {
+                (void)task->execute();
+                delete task;
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(taskQueueMutex);
+            stopThreads = true;
+        }
+        taskQueueCV.notify_all();
+    }
+
+private:
+    struct TaskComparator {
+        bool operator()(const Task* a, const Task* b) {
+            return a->priority > b->priority;
+        }
+    };
+
+    std::priority_queue<Task*, std::vector<Task*>, TaskComparator> taskQueue;
+    std::mutex taskQueueMutex;
+    std::condition_variable taskQueueCV;
+    bool stopThreads = false;
+};
+
+// Replica of the current addTask/workerThreadFunction over the sharded scheduler
+class LaneTaskQueue {
+public:
+    explicit LaneTaskQueue(size_t workers) : scheduler(DEFAULT_CHANNEL_COUNT) {
+        scheduler.setWorkerCount(workers);
+    }
+
+    void addTask(Task* task) {
+        while (!scheduler.push(task)) {
+            std::this_thread::yield();
+        }
+    }
+
+    void workerThreadFunction(size_t worker) {
+        while (!stopThreads) {
+            uint32_t shard;
+            Task* task = scheduler.waitPop(worker, stopThreads, shard);
+            if (task) {
+                (void)task->execute();
+                delete task;
+                scheduler.finish(shard);
+            }
+        }
+    }
+
+    void stop() {
+        stopThreads = true;
+        scheduler.wakeAll();
+    }
+
+private:
+    TaskScheduler scheduler;
+    std::atomic<bool> stopThreads{false};
+};
+
+// Same priority mix as the M4 thread: two data tasks and one callback per channel
+TaskPriority priorityFor(size_t index) {
+    return index % 3 == 2 ? TaskPriority::HIGH : TaskPriority::NORMAL;
+}
+
+template <typename Queue>
+double run(size_t producers, size_t workers, size_t tasksPerProducer) {
+    Queue queue(workers);
+    executedTasks = 0;
+    const uint64_t total = static_cast<uint64_t>(producers) * tasksPerProducer;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workerThreads;
+    for (size_t i = 0; i < workers; ++i) {
+        workerThreads.emplace_back(&Queue::workerThreadFunction, &queue, i);
+    }
+
+    std::vector<std::thread> producerThreads;
+    for (size_t p = 0; p < producers; ++p) {
+        producerThreads.emplace_back([&queue, tasksPerProducer] {
+            for (size_t i = 0; i < tasksPerProducer; ++i) {
+                queue.addTask(new CountingTask(priorityFor(i), static_cast<uint32_t>(i / 3 % DEFAULT_CHANNEL_COUNT)));
+            }
+        });
+    }
+    for (auto& thread : producerThreads) {
+        thread.join();
+    }
+
+    while (executedTasks.load(std::memory_order_relaxed) < total) {
+        std::this_thread::yield();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    queue.stop();
+    for (auto& thread : workerThreads) {
+        thread.join();
+    }
+
+    return total / std::chrono::duration<double>(elapsed).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t producers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1;
+    size_t workers = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 3;
+    size_t tasksPerProducer = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1000000;
+
+    std::cout << "producers=" << producers << " workers=" << workers
+              << " tasks/producer=" << tasksPerProducer << std::endl;
+
+    double legacy = run<LegacyTaskQueue>(producers, workers, tasksPerProducer);
+    std::cout << "mutex + priority_queue: " << legacy << " tasks/s" << std::endl;
+
+    double lanes = run<LaneTaskQueue>(producers, workers, tasksPerProducer);
+    std::cout << "lock-free lanes:        " << lanes << " tasks/s" << std::endl;
+
+    std::cout << "speedup: " << lanes / legacy << "x" << std::endl;
+    return 0;
+}
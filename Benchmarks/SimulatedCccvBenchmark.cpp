@@ -0,0 +1,76 @@
+#include "../BatteryTestingService.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Load test of the whole ingest and control path on simulated hardware:
+// every channel of a simulated rack runs the same CCCV charge, with cells
+// small enough to reach the CV phase and the current cutoff within
+// seconds. Reports the frame throughput, the frames the ingest threads
+// could not keep up with, and the dispatch latency of the CC to CV and
+// end-of-step commands on the control lane. When the ingest threads
+// outnumber the CPUs, the control executor only meets its latency budget
+// with a realtimePriority (SCHED_FIFO, needs CAP_SYS_NICE).
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -I.. SimulatedCccvBenchmark.cpp $(ls ../*.cpp | grep -v main.cpp) ../ErrorLogging/ErrorCodes.cpp
+// Run:
+//   ./a.out [channels] [sampleRate] [workers] [realtimePriority]
+
+int main(int argc, char* argv[]) {
+    uint32_t channels = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1024;
+    double sampleRate = argc > 2 ? std::strtod(argv[2], nullptr) : 1000.0;
+    size_t workers = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3;
+    int realtimePriority = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    ChannelSimulationConfig simulation;
+    simulation.sampleRate = sampleRate;
+    simulation.battery.capacityAh = 0.0005f;
+    simulation.battery.initialSoc = 0.3f;
+    simulation.battery.voltageNoise = 0.0f;
+
+    std::cout << "channels=" << channels << " sampleRate=" << sampleRate << " workers=" << workers << std::endl;
+
+    BatteryTestingService service(ChannelTopology::simulatedRack(channels, simulation), workers);
+    if (realtimePriority > 0) {
+        ControlExecutorConfig control;
+        control.realtimePriority = realtimePriority;
+        service.configureControlExecutor(control);
+    }
+    std::vector<uint32_t> group;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+        group.push_back(channel);
+    }
+
+    // Charge at 600C, end the CV phase at 30C once the step has run for a second
+    std::vector<StepLimit> limits = {
+        {"current", 0.015f, LimitComparison::LessOrEqual},
+        {"time", 1.0f, LimitComparison::GreaterOrEqual}};
+    auto start = std::chrono::steady_clock::now();
+    service.runCCCVGroup(group, 0.3f, 4.2f, limits);
+
+    size_t done = 0;
+    while (done < channels && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        done = 0;
+        for (uint32_t channel : group) {
+            done += service.getStepPhase(channel) == StepPhase::Done;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    M4FrameStatistics frames = service.getM4FrameStatistics();
+    ControlExecutorStatistics control = service.getControlExecutorStatistics();
+    std::cout << "finished:        " << done << "/" << channels << " channels in " << seconds << " s" << std::endl;
+    std::cout << "frames:          " << frames.framesParsed / seconds << " frames/s, "
+              << frames.framesParsed * (channels / service.getTopology().getEndpointCount()) / seconds
+              << " samples/s" << std::endl;
+    std::cout << "frames dropped:  " << frames.framesDropped << std::endl;
+    std::cout << "control tasks:   " << control.dispatched << ", mean latency "
+              << (control.dispatched ? control.totalLatencyNs / control.dispatched : 0) << " ns, max "
+              << control.maxLatencyNs << " ns, over budget " << control.overBudget << std::endl;
+    return done == channels ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include "../ChannelDataTable.h"
+#include "../Task.h"
+#include "../TaskPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+
+// Counts heap allocations per task for the previous new/delete path and for
+// TaskPool, using the same shapes as the per-sample tasks (a ChannelSample
+// copy, or a shared callback). Exits with status 1 if the pooled path
+// allocates at steady state.
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -I.. TaskPoolAllocationBenchmark.cpp ../ChannelDataTable.cpp
+// Run:
+//   ./a.out [iterations]
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{0};
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+using Callback = std::function<void(uint32_t, const ChannelSnapshot&)>;
+
+// Same shape as FilteringDataTask / FittingDataTask
+class SampleTask : public DataTask {
+public:
+    SampleTask(uint32_t channel, const ChannelSample& data)
+        : DataTask(TaskPriority::NORMAL), channel(channel), rawData(data) {}
+
+    ErrorLogging::Status execute() override { return {}; }
+
+private:
+    uint32_t channel;
+    ChannelSample rawData;
+};
+
+// Same shape as the previous CallbackControlTask, which copied the callback
+class LegacyCallbackTask : public ControlTask {
+public:
+    LegacyCallbackTask(uint32_t channel, Callback callback)
+        : ControlTask(TaskPriority::HIGH), channel(channel), callback(callback) {}
+
+    ErrorLogging::Status execute() override { return {}; }
+
+private:
+    uint32_t channel;
+    Callback callback;
+};
+
+// Same shape as CallbackControlTask
+class CallbackTask : public ControlTask {
+public:
+    CallbackTask(uint32_t channel, std::shared_ptr<const Callback> callback)
+        : ControlTask(TaskPriority::HIGH), channel(channel), callback(std::move(callback)) {}
+
+    ErrorLogging::Status execute() override { return {}; }
+
+private:
+    uint32_t channel;
+    std::shared_ptr<const Callback> callback;
+};
+
+struct Result {
+    double allocationsPerTask;
+    double nanosecondsPerTask;
+};
+
+template <typename Body>
+Result measure(size_t iterations, size_t tasksPerIteration, Body body) {
+    uint64_t before = allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        body();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t allocations = allocationCount.load() - before;
+    double tasks = static_cast<double>(iterations * tasksPerIteration);
+    return {allocations / tasks, std::chrono::duration<double, std::nano>(elapsed).count() / tasks};
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+    ChannelSample sample;
+    // Capture enough state to defeat std::function's small buffer, like the runCCCV lambdas
+    float targetVoltage = 4.2f;
+    void* owner = &sample;
+    const ChannelSample* limits = &sample;
+    uint32_t captured = 1;
+    Callback callback = [owner, limits, captured, targetVoltage](uint32_t, const ChannelSnapshot& snapshot) {
+        (void)owner;
+        (void)limits;
+        (void)captured;
+        (void)(snapshot.sample[ChannelField::Voltage] >= targetVoltage);
+    };
+    auto sharedCallback = std::make_shared<const Callback>(callback);
+
+    // Previous path: new per task and a std::function copy per callback task
+    Result heap = measure(iterations, 3, [&] {
+        Task* filtering = new SampleTask(0, sample);
+        Task* fitting = new SampleTask(0, sample);
+        Task* callbackTask = new LegacyCallbackTask(0, callback);
+        delete filtering;
+        delete fitting;
+        delete callbackTask;
+    });
+
+    TaskPool<SampleTask> filteringPool(64);
+    TaskPool<SampleTask> fittingPool(64);
+    TaskPool<CallbackTask> callbackPool(64);
+
+    // Pooled path: same task mix through TaskPool and TaskHandle
+    Result pooled = measure(iterations, 3, [&] {
+        TaskHandle filtering = filteringPool.acquire(0u, sample);
+        TaskHandle fitting = fittingPool.acquire(0u, sample);
+        TaskHandle callbackTask = callbackPool.acquire(0u, sharedCallback);
+    });
+
+    std::cout << "new/delete: " << heap.allocationsPerTask << " allocations/task, "
+              << heap.nanosecondsPerTask << " ns/task" << std::endl;
+    std::cout << "TaskPool:   " << pooled.allocationsPerTask << " allocations/task, "
+              << pooled.nanosecondsPerTask << " ns/task" << std::endl;
+
+    if (pooled.allocationsPerTask != 0.0) {
+        std::cout << "FAIL: pooled task path allocated at steady state" << std::endl;
+        return 1;
+    }
+    return 0;
+}
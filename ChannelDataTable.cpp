@@ -0,0 +1,298 @@
+#include "ChannelDataTable.h"
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include "Seqlock.h"
+
+namespace {
+
+// Legacy string keys, indexed by ChannelField
+const char* const FIELD_NAMES[CHANNEL_FIELD_COUNT] = {
+    "voltage",
+    "current",
+    "temperature",
+    "capacity",
+    "energy",
+    "time",
+    "profile_state",
+    "filtered_voltage",
+    "filtered_current",
+    "dvdt",
+    "didt",
+    "fitted_voltage"
+};
+
+// Number of floats in one cache line
+constexpr size_t FLOATS_PER_CACHE_LINE = CACHE_LINE_SIZE / sizeof(float);
+
+} // namespace
+
+/**
+ * @brief Gets the legacy string key of a field.
+ *
+ * @param field The field.
+ * @return The key used by the map-based interface.
+ */
+const char* channelFieldName(ChannelField field) {
+    size_t index = static_cast<size_t>(field);
+    return index < CHANNEL_FIELD_COUNT ? FIELD_NAMES[index] : "";
+}
+
+/**
+ * @brief Resolves a legacy string key to a field.
+ *
+ * @param name The key used by the map-based interface.
+ * @param field Receives the field if the key is known.
+ * @return True if the key names a field of the schema, false otherwise.
+ */
+bool channelFieldFromName(const std::string& name, ChannelField& field) {
+    for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+        if (name == FIELD_NAMES[i]) {
+            field = static_cast<ChannelField>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Converts a sample to the legacy string-keyed representation.
+ *
+ * @param sample The sample to convert.
+ * @return A map containing one entry per field.
+ */
+std::map<std::string, float> toFieldMap(const ChannelSample& sample) {
+    std::map<std::string, float> data;
+    for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+        data[FIELD_NAMES[i]] = sample.values[i];
+    }
+    return data;
+}
+
+/**
+ * @brief Applies legacy string-keyed values to a sample.
+ *
+ * @param data The legacy values.
+ * @param sample The sample to update.
+ */
+void applyFieldMap(const std::map<std::string, float>& data, ChannelSample& sample) {
+    for (const auto& pair : data) {
+        ChannelField field;
+        if (channelFieldFromName(pair.first, field)) {
+            sample[field] = pair.second;
+        }
+    }
+}
+
+/**
+ * @brief Gets the memory layout of a table.
+ *
+ * The seqlocks come first, one cache line per channel, followed by the
+ * columns, each padded to a whole number of cache lines.
+ *
+ * @param channelCount The number of channels held by the table.
+ * @return The layout; the memory must be aligned to CACHE_LINE_SIZE.
+ */
+ChannelDataTable::MemoryLayout ChannelDataTable::getMemoryLayout(size_t channelCount) {
+    MemoryLayout layout;
+    layout.versionsOffset = 0;
+    layout.versionStride = sizeof(ChannelVersion);
+    layout.versionWordOffset = offsetof(ChannelVersion, version);
+    layout.sequenceOffset = offsetof(ChannelVersion, sequence);
+    layout.receiveTimeOffset = offsetof(ChannelVersion, receiveTime);
+    layout.sampleTimeOffset = offsetof(ChannelVersion, sampleTime);
+    layout.storageOffset = channelCount * sizeof(ChannelVersion);
+    layout.columnStride = (channelCount + FLOATS_PER_CACHE_LINE - 1) / FLOATS_PER_CACHE_LINE * FLOATS_PER_CACHE_LINE;
+    layout.totalSize = layout.storageOffset + CHANNEL_FIELD_COUNT * layout.columnStride * sizeof(float);
+    return layout;
+}
+
+/**
+ * @brief Constructor for the ChannelDataTable class.
+ *
+ * Allocates the seqlocks and all columns in a single cache-line-aligned block.
+ *
+ * @param channelCount The number of channels held by the table.
+ */
+ChannelDataTable::ChannelDataTable(size_t channelCount) : ChannelDataTable(channelCount, nullptr) {}
+
+/**
+ * @brief Constructor for a ChannelDataTable in memory provided by the caller.
+ *
+ * @param channelCount The number of channels held by the table.
+ * @param memory getMemoryLayout().totalSize bytes, aligned to CACHE_LINE_SIZE, that outlive the
+ *        table; nullptr to allocate them.
+ * @param initialize True to clear the memory, false to attach to a table set up by another
+ *        instance, e.g. in another process; an attached table must only be read.
+ */
+ChannelDataTable::ChannelDataTable(size_t channelCount, void* memory, bool initialize) :
+    channelCount(channelCount), ownedMemory(nullptr) {
+    MemoryLayout layout = getMemoryLayout(channelCount);
+    if (!memory) {
+        memory = ownedMemory = ::operator new(layout.totalSize, std::align_val_t(CACHE_LINE_SIZE));
+        initialize = true;
+    }
+    unsigned char* base = static_cast<unsigned char*>(memory);
+    columnStride = layout.columnStride;
+    storage = reinterpret_cast<float*>(base + layout.storageOffset);
+    versions = reinterpret_cast<ChannelVersion*>(base + layout.versionsOffset);
+    if (initialize) {
+        std::memset(storage, 0, layout.totalSize - layout.storageOffset);
+        for (size_t channel = 0; channel < channelCount; ++channel) {
+            new (&versions[channel]) ChannelVersion();
+        }
+    }
+}
+
+/**
+ * @brief Destructor for the ChannelDataTable class.
+ *
+ * The seqlocks are trivially destructible, so memory provided by the caller is left as it is.
+ */
+ChannelDataTable::~ChannelDataTable() {
+    if (ownedMemory) {
+        ::operator delete(ownedMemory, std::align_val_t(CACHE_LINE_SIZE));
+    }
+}
+
+/**
+ * @brief Enters the write section of a channel.
+ *
+ * Moves the version from even to odd, spinning only if another writer is
+ * inside the write section of the same channel.
+ *
+ * @param channelVersion The seqlock of the channel.
+ * @return The version to store when leaving the write section.
+ */
+uint32_t ChannelDataTable::beginWrite(ChannelVersion& channelVersion) {
+    uint32_t current = channelVersion.version.load(std::memory_order_relaxed);
+    while ((current & 1) != 0 ||
+           !channelVersion.version.compare_exchange_weak(current, current + 1,
+                std::memory_order_acquire, std::memory_order_relaxed)) {
+        cpuRelax();
+        current = channelVersion.version.load(std::memory_order_relaxed);
+    }
+    // Make the odd version visible before any of the values change
+    std::atomic_thread_fence(std::memory_order_release);
+    return current + 2;
+}
+
+/**
+ * @brief Publishes a new sample for a channel.
+ *
+ * @param channel The channel number.
+ * @param sample The new values.
+ * @param receiveTime Monotonic time in nanoseconds at which the sample was received, 0 if unknown.
+ * @param sampleTime M4 time of the measurement in microseconds, 0 if unknown.
+ */
+void ChannelDataTable::publish(uint32_t channel, const ChannelSample& sample, uint64_t receiveTime,
+    uint64_t sampleTime) {
+    ChannelVersion& channelVersion = versions[channel];
+    uint32_t nextVersion = beginWrite(channelVersion);
+
+    for (size_t i = 0; i < CHANNEL_RAW_FIELD_COUNT; ++i) {
+        storage[i * columnStride + channel] = sample.values[i];
+    }
+    channelVersion.sequence.store(channelVersion.sequence.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    channelVersion.receiveTime.store(receiveTime, std::memory_order_relaxed);
+    channelVersion.sampleTime.store(sampleTime, std::memory_order_relaxed);
+
+    channelVersion.version.store(nextVersion, std::memory_order_release);
+}
+
+/**
+ * @brief Publishes derived values for every channel of a block.
+ *
+ * @param block The block holding the new values.
+ * @param firstField The first field to write.
+ * @param fieldCount The number of consecutive fields to write.
+ */
+void ChannelDataTable::publishDerived(const ChannelBlock& block, ChannelField firstField, size_t fieldCount) {
+    size_t first = static_cast<size_t>(firstField);
+
+    for (uint32_t offset = 0; offset < block.channelCount; ++offset) {
+        uint32_t channel = block.firstChannel + offset;
+        ChannelVersion& channelVersion = versions[channel];
+        uint32_t nextVersion = beginWrite(channelVersion);
+
+        for (size_t i = first; i < first + fieldCount; ++i) {
+            storage[i * columnStride + channel] = block.values[i][offset];
+        }
+
+        channelVersion.version.store(nextVersion, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Copies out a consistent snapshot of a channel without locking.
+ *
+ * Retries the copy until no write overlapped it.
+ *
+ * @param channel The channel number.
+ * @return The channel's values, their sequence number and reception time.
+ */
+ChannelSnapshot ChannelDataTable::read(uint32_t channel) const {
+    const ChannelVersion& channelVersion = versions[channel];
+    ChannelSnapshot snapshot;
+    Seqlock::read(channelVersion.version, [&] { copySnapshot(channel, snapshot); });
+    return snapshot;
+}
+
+/**
+ * @brief Copies out a consistent snapshot of a channel, giving up on a writer that does not finish.
+ *
+ * @param channel The channel number.
+ * @param snapshot Receives the channel's values, their sequence number and reception time.
+ * @param maxAttempts The number of copies to try.
+ * @return True if a consistent copy was made.
+ */
+bool ChannelDataTable::tryRead(uint32_t channel, ChannelSnapshot& snapshot, uint32_t maxAttempts) const {
+    return Seqlock::tryRead(versions[channel].version, [&] { copySnapshot(channel, snapshot); }, maxAttempts);
+}
+
+/**
+ * @brief Copies out a consistent snapshot of a range of channels without locking.
+ *
+ * Each channel is copied under its own seqlock, straight into the columns
+ * of the block.
+ *
+ * @param firstChannel The first channel of the range.
+ * @param channelCount The number of channels, at most MAX_BLOCK_CHANNELS.
+ * @param block Receives the values, sequence numbers and sample times of the range.
+ */
+void ChannelDataTable::readBlock(uint32_t firstChannel, uint32_t channelCount, ChannelBlock& block) const {
+    block.firstChannel = firstChannel;
+    block.channelCount = channelCount;
+
+    for (uint32_t offset = 0; offset < channelCount; ++offset) {
+        uint32_t channel = firstChannel + offset;
+        const ChannelVersion& channelVersion = versions[channel];
+
+        Seqlock::read(channelVersion.version, [&] {
+            for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+                block.values[i][offset] = storage[i * columnStride + channel];
+            }
+            block.sequences[offset] = channelVersion.sequence.load(std::memory_order_relaxed);
+            block.sampleTimes[offset] = channelVersion.sampleTime.load(std::memory_order_relaxed);
+        });
+    }
+}
+
+/**
+ * @brief Copies the values, sequence number and reception time of a channel, for one seqlock attempt.
+ *
+ * @param channel The channel number.
+ * @param snapshot Receives the copy, which is only consistent if the attempt succeeds.
+ */
+void ChannelDataTable::copySnapshot(uint32_t channel, ChannelSnapshot& snapshot) const {
+    const ChannelVersion& channelVersion = versions[channel];
+    for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+        snapshot.sample.values[i] = storage[i * columnStride + channel];
+    }
+    snapshot.sequence = channelVersion.sequence.load(std::memory_order_relaxed);
+    snapshot.receiveTime = channelVersion.receiveTime.load(std::memory_order_relaxed);
+    snapshot.sampleTime = channelVersion.sampleTime.load(std::memory_order_relaxed);
+}
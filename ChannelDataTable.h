@@ -0,0 +1,355 @@
+#ifndef CHANNELDATATABLE_H
+#define CHANNELDATATABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "Platform.h"
+
+/**
+ * @brief Fixed schema of the values kept for every channel.
+ *
+ * The enumerator value is the index of the field in a ChannelSample and
+ * the column index in the ChannelDataTable. Fields up to StepTime are
+ * measured by the M4 core; the fields after it are derived on the host by
+ * the data tasks.
+ */
+enum class ChannelField : uint32_t {
+    // Measured by the M4 core
+    Voltage,
+    Current,
+    Temperature,
+    Capacity,
+    Energy,
+    StepTime,
+    ProfileState, // M4_PROFILE_STATE_* of the setpoint profile of the step
+    // Derived by the data tasks
+    FilteredVoltage,
+    FilteredCurrent,
+    DvDt,
+    DiDt,
+    FittedVoltage,
+    Count
+};
+
+constexpr size_t CHANNEL_FIELD_COUNT = static_cast<size_t>(ChannelField::Count);
+
+// Number of fields measured by the M4 core, which come first in the schema
+constexpr size_t CHANNEL_RAW_FIELD_COUNT = static_cast<size_t>(ChannelField::FilteredVoltage);
+
+/**
+ * @brief Gets the legacy string key of a field (e.g. "voltage").
+ *
+ * @param field The field.
+ * @return The key used by the map-based interface.
+ */
+const char* channelFieldName(ChannelField field);
+
+/**
+ * @brief Resolves a legacy string key to a field.
+ *
+ * @param name The key used by the map-based interface.
+ * @param field Receives the field if the key is known.
+ * @return True if the key names a field of the schema, false otherwise.
+ */
+bool channelFieldFromName(const std::string& name, ChannelField& field);
+
+/**
+ * @brief One complete set of values for a single channel.
+ *
+ * Plain fixed-size storage indexed by ChannelField, cheap to copy and
+ * never allocating.
+ */
+struct ChannelSample {
+    float values[CHANNEL_FIELD_COUNT] = {};
+
+    float& operator[](ChannelField field) { return values[static_cast<size_t>(field)]; }
+    float operator[](ChannelField field) const { return values[static_cast<size_t>(field)]; }
+};
+
+/**
+ * @brief A consistent copy of a channel's values.
+ *
+ * The sequence number counts the samples published for the channel since
+ * start-up (0 means nothing was ever published). Comparing the sequence of
+ * two consecutive snapshots tells a reader whether it is looking at the same
+ * sample again (stale) or whether samples were published in between (skipped).
+ */
+struct ChannelSnapshot {
+    ChannelSample sample;
+    uint64_t sequence = 0;
+    // Monotonic time in nanoseconds at which the host received the sample, 0 if unknown
+    uint64_t receiveTime = 0;
+    // M4 time of the measurement in microseconds, from the frame header, 0 if unknown
+    uint64_t sampleTime = 0;
+};
+
+// Largest number of channels in a ChannelBlock
+#define MAX_BLOCK_CHANNELS 64
+
+/**
+ * @brief Consistent copy of a contiguous range of channels, in columns.
+ *
+ * Same struct-of-arrays layout as the table, so an algorithm can run over
+ * all channels of the block in one pass over contiguous memory. Each
+ * channel's values come from a single sample. sampleTimes holds the M4
+ * time of each sample in microseconds (0 if unknown), which unlike the
+ * float StepTime keeps microsecond resolution over a test of any length.
+ */
+struct ChannelBlock {
+    alignas(CACHE_LINE_SIZE) float values[CHANNEL_FIELD_COUNT][MAX_BLOCK_CHANNELS];
+    uint64_t sequences[MAX_BLOCK_CHANNELS];
+    uint64_t sampleTimes[MAX_BLOCK_CHANNELS];
+    uint32_t firstChannel = 0;
+    uint32_t channelCount = 0;
+
+    float* column(ChannelField field) { return values[static_cast<size_t>(field)]; }
+    const float* column(ChannelField field) const { return values[static_cast<size_t>(field)]; }
+};
+
+/**
+ * @brief Converts a sample to the legacy string-keyed representation.
+ *
+ * @param sample The sample to convert.
+ * @return A map containing one entry per field.
+ */
+std::map<std::string, float> toFieldMap(const ChannelSample& sample);
+
+/**
+ * @brief Applies legacy string-keyed values to a sample.
+ *
+ * Keys that do not name a field of the schema are ignored.
+ *
+ * @param data The legacy values.
+ * @param sample The sample to update.
+ */
+void applyFieldMap(const std::map<std::string, float>& data, ChannelSample& sample);
+
+/**
+ * @brief Struct-of-arrays table holding the latest values of every channel.
+ *
+ * Each field is stored as one contiguous column indexed by channel. Every
+ * column starts on a cache line boundary and is padded to a whole number of
+ * cache lines, so a block of channels maps to whole cache lines of a column
+ * and no two fields ever share a line. The table never allocates after
+ * construction.
+ *
+ * Every channel is guarded by its own seqlock, kept on a separate cache line
+ * per channel. Writers publish without waiting for readers, and readers copy
+ * out a consistent sample without taking a lock, retrying if a write
+ * overlapped the copy.
+ *
+ * The seqlocks and columns live in one block described by MemoryLayout,
+ * which can be provided by the caller, e.g. a shared-memory segment that
+ * other processes map to read the table in place.
+ */
+class ChannelDataTable {
+public:
+    /**
+     * @brief Placement of the seqlocks and columns in the memory of a table.
+     *
+     * All offsets are in bytes from the start of the table's memory.
+     */
+    struct MemoryLayout {
+        size_t versionsOffset;      // Seqlock of channel 0; channel n is at versionsOffset + n * versionStride
+        size_t versionStride;
+        size_t versionWordOffset;   // Offsets of the seqlock words within a channel's seqlock
+        size_t sequenceOffset;
+        size_t receiveTimeOffset;
+        size_t sampleTimeOffset;
+        size_t storageOffset;       // Column of field 0; field n is at storageOffset + n * columnStride floats
+        size_t columnStride;        // In floats
+        size_t totalSize;
+    };
+
+    /**
+     * @brief Gets the memory layout of a table.
+     *
+     * @param channelCount The number of channels held by the table.
+     * @return The layout; the memory must be aligned to CACHE_LINE_SIZE.
+     */
+    static MemoryLayout getMemoryLayout(size_t channelCount);
+
+    /**
+     * @brief Constructor for the ChannelDataTable class.
+     *
+     * @param channelCount The number of channels held by the table.
+     */
+    explicit ChannelDataTable(size_t channelCount);
+
+    /**
+     * @brief Constructor for a ChannelDataTable in memory provided by the caller.
+     *
+     * @param channelCount The number of channels held by the table.
+     * @param memory getMemoryLayout().totalSize bytes, aligned to CACHE_LINE_SIZE, that outlive the
+     *        table; nullptr to allocate them.
+     * @param initialize True to clear the memory, false to attach to a table set up by another
+     *        instance, e.g. in another process; an attached table must only be read.
+     */
+    ChannelDataTable(size_t channelCount, void* memory, bool initialize = true);
+
+    /**
+     * @brief Destructor for the ChannelDataTable class.
+     */
+    ~ChannelDataTable();
+
+    ChannelDataTable(const ChannelDataTable&) = delete;
+    ChannelDataTable& operator=(const ChannelDataTable&) = delete;
+
+    /**
+     * @brief Gets the number of channels held by the table.
+     *
+     * @return The number of channels.
+     */
+    size_t getChannelCount() const { return channelCount; }
+
+    /**
+     * @brief Gets the distance in elements between two consecutive columns.
+     *
+     * @return The column stride, a multiple of one cache line.
+     */
+    size_t getColumnStride() const { return columnStride; }
+
+    /**
+     * @brief Gets a single value without taking a snapshot.
+     *
+     * A single value is never torn, but consecutive calls may observe
+     * values from different samples. Use read() for a consistent set.
+     *
+     * @param channel The channel number.
+     * @param field The field to read.
+     * @return The value.
+     */
+    float get(uint32_t channel, ChannelField field) const {
+        return storage[static_cast<size_t>(field) * columnStride + channel];
+    }
+
+    /**
+     * @brief Publishes a new sample for a channel.
+     *
+     * Writes the fields measured by the M4 core and advances the channel's
+     * sequence number; derived fields keep their values. Never waits for
+     * readers. Concurrent writers to the same channel are serialized on the
+     * channel's version word and only spin while another write is in progress.
+     *
+     * @param channel The channel number.
+     * @param sample The new values.
+     * @param receiveTime Monotonic time in nanoseconds at which the sample was received, 0 if unknown.
+     * @param sampleTime M4 time of the measurement in microseconds, 0 if unknown.
+     */
+    void publish(uint32_t channel, const ChannelSample& sample, uint64_t receiveTime = 0, uint64_t sampleTime = 0);
+
+    /**
+     * @brief Publishes derived values for every channel of a block.
+     *
+     * Writes a contiguous range of fields from the block's columns, one
+     * channel at a time under its seqlock. The sequence number is unchanged,
+     * since no new sample arrived.
+     *
+     * @param block The block holding the new values.
+     * @param firstField The first field to write.
+     * @param fieldCount The number of consecutive fields to write.
+     */
+    void publishDerived(const ChannelBlock& block, ChannelField firstField, size_t fieldCount);
+
+    /**
+     * @brief Copies out a consistent snapshot of a channel without locking.
+     *
+     * @param channel The channel number.
+     * @return The channel's values, their sequence number and reception time.
+     */
+    ChannelSnapshot read(uint32_t channel) const;
+
+    /**
+     * @brief Copies out a consistent snapshot of a channel, giving up on a writer that does not finish.
+     *
+     * For readers that cannot trust the writer to make progress, e.g. a
+     * process reading the table of another one, which may have died inside
+     * a write.
+     *
+     * @param channel The channel number.
+     * @param snapshot Receives the channel's values, their sequence number and reception time.
+     * @param maxAttempts The number of copies to try.
+     * @return True if a consistent copy was made.
+     */
+    bool tryRead(uint32_t channel, ChannelSnapshot& snapshot, uint32_t maxAttempts) const;
+
+    /**
+     * @brief Copies out a consistent snapshot of a range of channels without locking.
+     *
+     * @param firstChannel The first channel of the range.
+     * @param channelCount The number of channels, at most MAX_BLOCK_CHANNELS.
+     * @param block Receives the values, sequence numbers and sample times of the range.
+     */
+    void readBlock(uint32_t firstChannel, uint32_t channelCount, ChannelBlock& block) const;
+
+    /**
+     * @brief Gets the sequence number of the latest sample of a channel.
+     *
+     * @param channel The channel number.
+     * @return The number of samples published for the channel.
+     */
+    uint64_t getSequence(uint32_t channel) const {
+        return versions[channel].sequence.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Gets the reception time of the latest sample of a channel.
+     *
+     * @param channel The channel number.
+     * @return Monotonic time in nanoseconds, 0 if unknown.
+     */
+    uint64_t getReceiveTime(uint32_t channel) const {
+        return versions[channel].receiveTime.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gets the contiguous column of a field.
+     *
+     * @param field The field.
+     * @return Pointer to the value of channel 0; channel n is at offset n.
+     */
+    const float* column(ChannelField field) const {
+        return storage + static_cast<size_t>(field) * columnStride;
+    }
+
+    /**
+     * @brief Checks if a channel number is inside the table.
+     *
+     * @param channel The channel number.
+     * @return True if the channel is held by the table, false otherwise.
+     */
+    bool contains(uint32_t channel) const { return channel < channelCount; }
+
+private:
+    /**
+     * @brief Seqlock state of a single channel, one cache line per channel.
+     */
+    struct alignas(CACHE_LINE_SIZE) ChannelVersion {
+        // Odd while a write is in progress
+        std::atomic<uint32_t> version{0};
+        // Number of samples published
+        std::atomic<uint64_t> sequence{0};
+        // Reception time of the latest sample
+        std::atomic<uint64_t> receiveTime{0};
+        // M4 time of the latest sample
+        std::atomic<uint64_t> sampleTime{0};
+    };
+
+    // Enters the write section of a channel and returns the version to publish on exit
+    uint32_t beginWrite(ChannelVersion& channelVersion);
+    // Copies a channel into a snapshot for one read attempt under its seqlock
+    void copySnapshot(uint32_t channel, ChannelSnapshot& snapshot) const;
+
+    size_t channelCount;
+    size_t columnStride;
+    float* storage;
+    ChannelVersion* versions;
+    // Memory allocated by the table, nullptr if provided by the caller
+    void* ownedMemory;
+};
+
+#endif
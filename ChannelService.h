@@ -5,16 +5,72 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 
-#define MAX_CHAN_NUM 32
+#include "ChannelDataTable.h"
+#include "ErrorEvents.h"
+#include "SetpointProfile.h"
+#include "SubscriptionFilter.h"
+
+// Channels served by one M4 endpoint and its ChannelCtrlService; the channel masks of an endpoint fit in 64 bits
+#define MAX_BOARD_CHANNELS 64
+
 // Forward declaration
 class Task;
 
+/**
+ * @brief Control mode of a channel command.
+ */
+enum class ChannelCommandMode : uint8_t {
+    ConstantCurrent,  // setpoint is the current
+    ConstantVoltage,  // setpoint is the voltage
+    Rest,             // open circuit, setpoint ignored
+    Off               // output off, setpoint ignored
+};
+
+/**
+ * @brief Command for one channel of a ChannelCommandBatch.
+ */
+struct ChannelCommand {
+    ChannelCommandMode mode = ChannelCommandMode::Off;
+    float setpoint = 0.0f;
+};
+
+/**
+ * @brief Commands for a group of channels of one endpoint, to be applied at the same time.
+ *
+ * Channels are numbered locally to the endpoint, as ChannelCtrlService sees them.
+ */
+struct ChannelCommandBatch {
+    // Bit n is set if commands[n] holds a command for channel n
+    uint64_t channelMask = 0;
+    ChannelCommand commands[MAX_BOARD_CHANNELS];
+
+    /**
+     * @brief Sets the command of a channel, replacing any previous one.
+     *
+     * @param channel The channel number, ignored if not below MAX_BOARD_CHANNELS.
+     * @param mode The control mode.
+     * @param setpoint The current or voltage setpoint of the mode.
+     */
+    void set(uint32_t channel, ChannelCommandMode mode, float setpoint = 0.0f) {
+        if (channel < MAX_BOARD_CHANNELS) {
+            commands[channel].mode = mode;
+            commands[channel].setpoint = setpoint;
+            channelMask |= 1ULL << channel;
+        }
+    }
+};
+
 /**
  * @brief Abstract base class for channel control services.
  *
  * This class defines the interface for controlling the hardware channels.
+ * There is one instance per M4 endpoint, and channel numbers are local to
+ * that endpoint. The control calls run on the control and worker threads,
+ * so they never throw: a failure is reported to the ErrorEventRing where it
+ * is detected, with its details, and returned as an error code.
  */
 class ChannelCtrlService {
 public:
@@ -33,30 +89,96 @@ public:
      *
      * @param channel The channel number.
      * @param current The target current value.
+     * @return Success, or the error code of a command that could not be applied.
      */
-    virtual void doConstantCurrent(uint32_t channel, float current) = 0;
+    virtual ErrorLogging::Status doConstantCurrent(uint32_t channel, float current) = 0;
 
     /**
      * @brief Performs constant voltage control on a channel.
      *
      * @param channel The channel number.
      * @param voltage The target voltage value.
+     * @return Success, or the error code of a command that could not be applied.
      */
-    virtual void doConstantVoltage(uint32_t channel, float voltage) = 0;
+    virtual ErrorLogging::Status doConstantVoltage(uint32_t channel, float voltage) = 0;
 
     /**
      * @brief Sets the channel to a rest state (open circuit).
      *
      * @param channel The channel number.
+     * @return Success, or the error code of a command that could not be applied.
      */
-    virtual void doRest(uint32_t channel) = 0;
+    virtual ErrorLogging::Status doRest(uint32_t channel) = 0;
 
     /**
      * @brief Turns off the channel.
      *
      * @param channel The channel number.
+     * @return Success, or the error code of a command that could not be applied.
+     */
+    virtual ErrorLogging::Status doOFF(uint32_t channel) = 0;
+
+    /**
+     * @brief Applies commands to a group of channels at the same time.
+     *
+     * Implementations send the batch to the M4 in as few transactions as the
+     * transport allows, so that the channels change mode at the same control
+     * tick; RpmsgChannelCtrlService needs a second frame beyond
+     * M4_COMMAND_CHANNELS_PER_FRAME channels. The default implementation
+     * applies the commands one channel at a time.
+     *
+     * @param batch The commands, one per channel set in the channel mask.
+     * @return Success, or the error code of the first command that could not be applied.
      */
-    virtual void doOFF(uint32_t channel) = 0;
+    virtual ErrorLogging::Status doBatch(const ChannelCommandBatch& batch) {
+        ErrorLogging::Status status;
+        for (uint64_t mask = batch.channelMask; mask != 0; mask &= mask - 1) {
+            uint32_t channel = static_cast<uint32_t>(__builtin_ctzll(mask));
+            const ChannelCommand& command = batch.commands[channel];
+            ErrorLogging::Status applied;
+            switch (command.mode) {
+                case ChannelCommandMode::ConstantCurrent:
+                    applied = doConstantCurrent(channel, command.setpoint);
+                    break;
+                case ChannelCommandMode::ConstantVoltage:
+                    applied = doConstantVoltage(channel, command.setpoint);
+                    break;
+                case ChannelCommandMode::Rest:
+                    applied = doRest(channel);
+                    break;
+                case ChannelCommandMode::Off:
+                    applied = doOFF(channel);
+                    break;
+            }
+            // The other channels are still commanded
+            if (status && !applied) {
+                status = applied;
+            }
+        }
+        return status;
+    }
+
+    /**
+     * @brief Runs a setpoint profile on a group of channels.
+     *
+     * Implementations upload the profile once and let the M4 execute it,
+     * starting every channel of the mask at the same control tick. The
+     * default implementation, for services without profile support, sets
+     * the channels to rest.
+     *
+     * @param channelMask The channels, bit n for channel n.
+     * @param profile The profile, validated by the caller.
+     * @return Success, or the error code of a profile that could not be started.
+     */
+    virtual ErrorLogging::Status doProfile(uint64_t channelMask, const std::shared_ptr<const SetpointProfile>& profile) {
+        (void)profile;
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::NOT_IMPLEMENTED,
+            "Setpoint profiles are not supported by this control service, setting the channels to rest");
+        for (uint64_t mask = channelMask; mask != 0; mask &= mask - 1) {
+            (void)doRest(static_cast<uint32_t>(__builtin_ctzll(mask)));
+        }
+        return ErrorLogging::makeError(ErrorLogging::ErrorCode::NOT_IMPLEMENTED);
+    }
 
     // ... other control functions
 
@@ -84,11 +206,12 @@ public:
     virtual ~ChannelDataService() {}
 
     /**
-     * @brief Subscribes to data updates for a specific channel.
+     * @brief Subscribes to data updates for a specific channel, or changes its subscription.
      *
      * @param channel The channel number.
+     * @param subscription The callback rate and field deadbands; the default runs callbacks on every sample.
      */
-    virtual void subscribeChannel(uint32_t channel) = 0;
+    virtual void subscribeChannel(uint32_t channel, const ChannelSubscription& subscription = ChannelSubscription()) = 0;
 
     /**
      * @brief Unsubscribes from data updates for a specific channel.
@@ -105,6 +228,23 @@ public:
      */
     virtual bool isChannelSubscribed(uint32_t channel) const = 0;
 
+    /**
+     * @brief Decides whether the latest sample of a channel triggers its callbacks.
+     * Called by the ingest thread of the channel once the sample is published.
+     *
+     * @param channel The channel number.
+     * @param receiveTime Monotonic time in nanoseconds at which the sample was received.
+     * @return True if the channel is subscribed and the sample passes its rate and deadbands.
+     */
+    virtual bool acceptSample(uint32_t channel, uint64_t receiveTime) = 0;
+
+    /**
+     * @brief Gets the number of samples of subscribed channels that triggered no callbacks.
+     *
+     * @return The count over all channels.
+     */
+    virtual uint64_t getSuppressedSampleCount() const = 0;
+
     /**
      * @brief Gets the voltage value for a specific channel.
      *
@@ -129,23 +269,64 @@ public:
      */
     virtual float getDvDt(uint32_t channel) = 0;
 
+    /**
+     * @brief Gets a single field of the data table for a specific channel.
+     *
+     * @param channel The channel number.
+     * @param field The field to read.
+     * @return The field value.
+     */
+    virtual float getField(uint32_t channel, ChannelField field) const = 0;
+
     /**
      * @brief Gets all current data for a specific channel.
      *
      * @param channel The channel number.
-     * @return A reference to the channel's data map.
+     * @return A copy of the channel's values.
      */
-    virtual const std::map<std::string, float>& getChannelData(uint32_t channel) const = 0;
+    virtual ChannelSample getSample(uint32_t channel) const = 0;
+
+    /**
+     * @brief Gets a consistent snapshot of a specific channel without locking.
+     *
+     * Safe to call from any thread while receiveM4Data is publishing.
+     *
+     * @param channel The channel number.
+     * @return The channel's values, the sequence number and the reception time of the sample.
+     */
+    virtual ChannelSnapshot getSnapshot(uint32_t channel) const = 0;
+
+    /**
+     * @brief Gets the channel data table, for data tasks that process whole channel ranges.
+     *
+     * @return The table holding the latest values of every channel.
+     */
+    virtual const ChannelDataTable& getDataTable() const = 0;
 
     // ... other get data functions
     
     /**
      * @brief Receives data from the M4 core.
+     * Publishes a new version of the channel's data without blocking readers.
      *
      * @param channel The channel number.
-     * @param data The data received from the M4 core.
+     * @param sample The data received from the M4 core.
+     * @param receiveTime Monotonic time in nanoseconds at which the frame was received, 0 if unknown.
+     * @param sampleTime M4 time of the measurement in microseconds, from the frame header, 0 if unknown.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel outside the data table.
+     */
+    virtual ErrorLogging::Status receiveM4Data(uint32_t channel, const ChannelSample& sample, uint64_t receiveTime = 0,
+        uint64_t sampleTime = 0) = 0;
+
+    /**
+     * @brief Receives values derived by the data tasks (filtering, fitting, ...).
+     *
+     * @param block The processed block of channels.
+     * @param firstField The first derived field to store.
+     * @param fieldCount The number of consecutive fields to store.
+     * @return Success, or the error code of values that could not be stored.
      */
-    virtual void receiveM4Data(uint32_t channel, const std::map<std::string, float>& data) = 0;
+    virtual ErrorLogging::Status receiveDerivedData(const ChannelBlock& block, ChannelField firstField, size_t fieldCount) = 0;
     
 };
 
@@ -157,14 +338,24 @@ public:
  */
 class DummyChannelCtrlService : public ChannelCtrlService {
 public:
+    /**
+     * @brief Constructor for the DummyChannelCtrlService class.
+     *
+     * @param board The board the service controls, shown in the log.
+     * @param core The M4 core of the board, shown in the log.
+     */
+    explicit DummyChannelCtrlService(uint32_t board = 0, uint32_t core = 0) : board(board), core(core) {}
+
     /**
      * @brief Performs constant current control on a channel.
      *
      * @param channel The channel number.
      * @param current The target current value.
+     * @return Success.
      */
-    void doConstantCurrent(uint32_t channel, float current) override {
-        std::cout << "CC on channel " << channel << ", current: " << current << std::endl;
+    ErrorLogging::Status doConstantCurrent(uint32_t channel, float current) override {
+        std::cout << "CC on board " << board << " core " << core << " channel " << channel << ", current: " << current << std::endl;
+        return {};
     }
     
     /**
@@ -172,28 +363,72 @@ public:
      *
      * @param channel The channel number.
      * @param voltage The target voltage value.
+     * @return Success.
      */
-    void doConstantVoltage(uint32_t channel, float voltage) override {
-        std::cout << "CV on channel " << channel << ", voltage: " << voltage << std::endl;
+    ErrorLogging::Status doConstantVoltage(uint32_t channel, float voltage) override {
+        std::cout << "CV on board " << board << " core " << core << " channel " << channel << ", voltage: " << voltage << std::endl;
+        return {};
     }
     
     /**
      * @brief Sets the channel to a rest state (open circuit).
      *
      * @param channel The channel number.
+     * @return Success.
      */
-    void doRest(uint32_t channel) override {
-        std::cout << "Rest on channel " << channel << std::endl;
+    ErrorLogging::Status doRest(uint32_t channel) override {
+        std::cout << "Rest on board " << board << " core " << core << " channel " << channel << std::endl;
+        return {};
     }
     
     /**
      * @brief Turns off the channel.
      *
      * @param channel The channel number.
+     * @return Success.
+     */
+    ErrorLogging::Status doOFF(uint32_t channel) override {
+        std::cout << "OFF on board " << board << " core " << core << " channel " << channel << std::endl;
+        return {};
+    }
+
+    /**
+     * @brief Applies commands to a group of channels at the same time.
+     *
+     * @param batch The commands, one per channel set in the channel mask.
+     * @return Success.
      */
-    void doOFF(uint32_t channel) override {
-        std::cout << "OFF on channel " << channel << std::endl;
+    ErrorLogging::Status doBatch(const ChannelCommandBatch& batch) override {
+        static const char* const modeNames[] = {"CC", "CV", "Rest", "OFF"};
+        std::cout << "Batch on board " << board << " core " << core << ", " << __builtin_popcountll(batch.channelMask) << " channels:";
+        for (uint64_t mask = batch.channelMask; mask != 0; mask &= mask - 1) {
+            uint32_t channel = static_cast<uint32_t>(__builtin_ctzll(mask));
+            const ChannelCommand& command = batch.commands[channel];
+            std::cout << " " << channel << "=" << modeNames[static_cast<size_t>(command.mode)];
+            if (command.mode == ChannelCommandMode::ConstantCurrent || command.mode == ChannelCommandMode::ConstantVoltage) {
+                std::cout << "(" << command.setpoint << ")";
+            }
+        }
+        std::cout << std::endl;
+        return {};
+    }
+
+    /**
+     * @brief Runs a setpoint profile on a group of channels.
+     *
+     * @param channelMask The channels, bit n for channel n.
+     * @param profile The profile.
+     * @return Success.
+     */
+    ErrorLogging::Status doProfile(uint64_t channelMask, const std::shared_ptr<const SetpointProfile>& profile) override {
+        std::cout << "Profile on board " << board << " core " << core << ", " << __builtin_popcountll(channelMask)
+                  << " channels, " << profile->points.size() << " points over " << profile->duration() << " s" << std::endl;
+        return {};
     }
+
+private:
+    uint32_t board;
+    uint32_t core;
 };
 
 /**
@@ -206,20 +441,30 @@ public:
 class DummyChannelDataService : public ChannelDataService {
 private:
     // Channel data table to store up-to-date information for all channels
-    std::map<uint32_t, std::map<std::string, float>> channelDataTable;
+    ChannelDataTable channelDataTable;
     
-    // Map to track subscribed channels
-    std::map<uint32_t, bool> subscribedChannels;
+    // Subscriptions with their rates and deadbands
+    SubscriptionFilter subscriptions;
     
 public:
     /**
-     * @brief Subscribes to data updates for a specific channel.
+     * @brief Constructor for the DummyChannelDataService class.
+     *
+     * @param channelCount The number of channels of the data table, over all endpoints.
+     * @param tableMemory Memory of the data table, e.g. a shared-memory segment; nullptr to allocate it.
+     */
+    explicit DummyChannelDataService(size_t channelCount, void* tableMemory = nullptr) :
+        channelDataTable(channelCount, tableMemory), subscriptions(channelCount) {}
+
+    /**
+     * @brief Subscribes to data updates for a specific channel, or changes its subscription.
      *
      * @param channel The channel number.
+     * @param subscription The callback rate and field deadbands.
      */
-    void subscribeChannel(uint32_t channel) override {
-        std::cout << "Subscribing to channel " << channel << std::endl;
-        subscribedChannels[channel] = true;
+    void subscribeChannel(uint32_t channel, const ChannelSubscription& subscription = ChannelSubscription()) override {
+        std::cout << "Subscribing to channel " << channel << ", rate: " << subscription.rate << std::endl;
+        subscriptions.subscribe(channel, subscription);
     }
     
     /**
@@ -229,7 +474,7 @@ public:
      */
     void unsubscribeChannel(uint32_t channel) override {
         std::cout << "Unsubscribing from channel " << channel << std::endl;
-        subscribedChannels[channel] = false;
+        subscriptions.unsubscribe(channel);
     }
     
     /**
@@ -239,8 +484,27 @@ public:
      * @return True if subscribed, false otherwise.
      */
     bool isChannelSubscribed(uint32_t channel) const override {
-        auto it = subscribedChannels.find(channel);
-        return it != subscribedChannels.end() && it->second;
+        return subscriptions.isSubscribed(channel);
+    }
+
+    /**
+     * @brief Decides whether the latest sample of a channel triggers its callbacks.
+     *
+     * @param channel The channel number.
+     * @param receiveTime Monotonic time in nanoseconds at which the sample was received.
+     * @return True if the channel is subscribed and the sample passes its rate and deadbands.
+     */
+    bool acceptSample(uint32_t channel, uint64_t receiveTime) override {
+        return subscriptions.accept(channel, channelDataTable, receiveTime);
+    }
+
+    /**
+     * @brief Gets the number of samples of subscribed channels that triggered no callbacks.
+     *
+     * @return The count over all channels.
+     */
+    uint64_t getSuppressedSampleCount() const override {
+        return subscriptions.getSuppressedCount();
     }
     
     /**
@@ -251,10 +515,7 @@ public:
      */
     float getVoltage(uint32_t channel) override {
         std::cout << "Getting voltage for channel " << channel << std::endl;
-        if (channelDataTable.count(channel) > 0) {
-            return channelDataTable[channel]["voltage"];
-        }
-        return 0.0f; // Default value
+        return getField(channel, ChannelField::Voltage);
     }
     
     /**
@@ -265,10 +526,7 @@ public:
      */
     float getCurrent(uint32_t channel) override {
         std::cout << "Getting current for channel " << channel << std::endl;
-        if (channelDataTable.count(channel) > 0) {
-            return channelDataTable[channel]["current"];
-        }
-        return 0.0f; // Default value
+        return getField(channel, ChannelField::Current);
     }
     
     /**
@@ -279,8 +537,19 @@ public:
      */
     float getDvDt(uint32_t channel) override {
         std::cout << "Getting dv/dt for channel " << channel << std::endl;
-        if (channelDataTable.count(channel) > 0) {
-            return channelDataTable[channel]["dvdt"];
+        return getField(channel, ChannelField::DvDt);
+    }
+    
+    /**
+     * @brief Gets a single field of the data table for a specific channel.
+     *
+     * @param channel The channel number.
+     * @param field The field to read.
+     * @return The field value, or 0 if the channel is out of range.
+     */
+    float getField(uint32_t channel, ChannelField field) const override {
+        if (channelDataTable.contains(channel)) {
+            return channelDataTable.get(channel, field);
         }
         return 0.0f; // Default value
     }
@@ -289,32 +558,286 @@ public:
      * @brief Gets all current data for a specific channel.
      *
      * @param channel The channel number.
-     * @return A reference to the channel's data map.
+     * @return A copy of the channel's values, all zero if the channel is out of range.
+     */
+    ChannelSample getSample(uint32_t channel) const override {
+        return getSnapshot(channel).sample;
+    }
+    
+    /**
+     * @brief Gets a consistent snapshot of a specific channel without locking.
+     *
+     * @param channel The channel number.
+     * @return The channel's values and sequence number, empty if the channel is out of range.
      */
-    const std::map<std::string, float>& getChannelData(uint32_t channel) const override {
-        static const std::map<std::string, float> emptyMap;
-        if (channelDataTable.count(channel) > 0) {
-            return channelDataTable.at(channel);
+    ChannelSnapshot getSnapshot(uint32_t channel) const override {
+        if (channelDataTable.contains(channel)) {
+            return channelDataTable.read(channel);
         }
-        return emptyMap; // Return empty map if channel not found
+        return ChannelSnapshot(); // Return empty snapshot if channel not found
+    }
+    
+    /**
+     * @brief Gets the channel data table.
+     *
+     * @return The table holding the latest values of every channel.
+     */
+    const ChannelDataTable& getDataTable() const override {
+        return channelDataTable;
     }
     
     /**
      * @brief Receives data from the M4 core.
-     * Updates the channel data table.
+     * Publishes the sample as a new version in the channel data table.
      *
      * @param channel The channel number.
-     * @param data The data received from the M4 core.
+     * @param sample The data received from the M4 core.
+     * @param receiveTime Monotonic time in nanoseconds at which the frame was received, 0 if unknown.
+     * @param sampleTime M4 time of the measurement in microseconds, from the frame header, 0 if unknown.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel outside the data table.
      */
-    void receiveM4Data(uint32_t channel, const std::map<std::string, float>& data) override {
+    ErrorLogging::Status receiveM4Data(uint32_t channel, const ChannelSample& sample, uint64_t receiveTime = 0,
+        uint64_t sampleTime = 0) override {
         std::cout << "Receiving M4 data for channel " << channel << std::endl;
         
         // Update the channel data table with new values
-        for (const auto& pair : data) {
-            channelDataTable[channel][pair.first] = pair.second;
+        if (!channelDataTable.contains(channel)) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
         }
+        channelDataTable.publish(channel, sample, receiveTime, sampleTime);
+        return {};
+    }
+    
+    /**
+     * @brief Receives values derived by the data tasks.
+     * Publishes them into the channel data table.
+     *
+     * @param block The processed block of channels.
+     * @param firstField The first derived field to store.
+     * @param fieldCount The number of consecutive fields to store.
+     * @return Success.
+     */
+    ErrorLogging::Status receiveDerivedData(const ChannelBlock& block, ChannelField firstField, size_t fieldCount) override {
+        channelDataTable.publishDerived(block, firstField, fieldCount);
+        return {};
     }
     
 };
 
+/**
+ * @brief Channel data service of the production ingest path.
+ *
+ * Same data table and subscriptions as DummyChannelDataService, without
+ * the console output, so the ingest and worker threads do no stream I/O
+ * per sample.
+ */
+class TableChannelDataService : public ChannelDataService {
+public:
+    /**
+     * @brief Constructor for the TableChannelDataService class.
+     *
+     * @param channelCount The number of channels of the data table, over all endpoints.
+     * @param tableMemory Memory of the data table, e.g. a shared-memory segment; nullptr to allocate it.
+     */
+    explicit TableChannelDataService(size_t channelCount, void* tableMemory = nullptr) :
+        channelDataTable(channelCount, tableMemory), subscriptions(channelCount) {}
+
+    /**
+     * @brief Subscribes to data updates for a specific channel, or changes its subscription.
+     *
+     * @param channel The channel number.
+     * @param subscription The callback rate and field deadbands.
+     */
+    void subscribeChannel(uint32_t channel, const ChannelSubscription& subscription = ChannelSubscription()) override {
+        subscriptions.subscribe(channel, subscription);
+    }
+
+    /**
+     * @brief Unsubscribes from data updates for a specific channel.
+     *
+     * @param channel The channel number.
+     */
+    void unsubscribeChannel(uint32_t channel) override {
+        subscriptions.unsubscribe(channel);
+    }
+
+    /**
+     * @brief Checks if a channel is subscribed.
+     *
+     * @param channel The channel number.
+     * @return True if subscribed, false otherwise.
+     */
+    bool isChannelSubscribed(uint32_t channel) const override {
+        return subscriptions.isSubscribed(channel);
+    }
+
+    /**
+     * @brief Decides whether the latest sample of a channel triggers its callbacks.
+     *
+     * @param channel The channel number.
+     * @param receiveTime Monotonic time in nanoseconds at which the sample was received.
+     * @return True if the channel is subscribed and the sample passes its rate and deadbands.
+     */
+    bool acceptSample(uint32_t channel, uint64_t receiveTime) override {
+        return subscriptions.accept(channel, channelDataTable, receiveTime);
+    }
+
+    /**
+     * @brief Gets the number of samples of subscribed channels that triggered no callbacks.
+     *
+     * @return The count over all channels.
+     */
+    uint64_t getSuppressedSampleCount() const override {
+        return subscriptions.getSuppressedCount();
+    }
+
+    /**
+     * @brief Gets the voltage value for a specific channel.
+     *
+     * @param channel The channel number.
+     * @return The voltage value.
+     */
+    float getVoltage(uint32_t channel) override {
+        return getField(channel, ChannelField::Voltage);
+    }
+
+    /**
+     * @brief Gets the current value for a specific channel.
+     *
+     * @param channel The channel number.
+     * @return The current value.
+     */
+    float getCurrent(uint32_t channel) override {
+        return getField(channel, ChannelField::Current);
+    }
+
+    /**
+     * @brief Gets the voltage derivative (dv/dt) for a specific channel.
+     *
+     * @param channel The channel number.
+     * @return The dv/dt value.
+     */
+    float getDvDt(uint32_t channel) override {
+        return getField(channel, ChannelField::DvDt);
+    }
+
+    /**
+     * @brief Gets a single field of the data table for a specific channel.
+     *
+     * @param channel The channel number.
+     * @param field The field to read.
+     * @return The field value, 0 for an unknown channel.
+     */
+    float getField(uint32_t channel, ChannelField field) const override {
+        return channelDataTable.contains(channel) ? channelDataTable.get(channel, field) : 0.0f;
+    }
+
+    /**
+     * @brief Gets all current data for a specific channel.
+     *
+     * @param channel The channel number.
+     * @return A copy of the channel's values.
+     */
+    ChannelSample getSample(uint32_t channel) const override {
+        return getSnapshot(channel).sample;
+    }
+
+    /**
+     * @brief Gets a consistent snapshot of a specific channel without locking.
+     *
+     * @param channel The channel number.
+     * @return The channel's values, or an empty snapshot for an unknown channel.
+     */
+    ChannelSnapshot getSnapshot(uint32_t channel) const override {
+        return channelDataTable.contains(channel) ? channelDataTable.read(channel) : ChannelSnapshot();
+    }
+
+    /**
+     * @brief Gets the channel data table.
+     *
+     * @return The table holding the latest values of every channel.
+     */
+    const ChannelDataTable& getDataTable() const override {
+        return channelDataTable;
+    }
+
+    /**
+     * @brief Receives data from the M4 core.
+     * Publishes the sample as a new version in the channel data table.
+     *
+     * @param channel The channel number.
+     * @param sample The data received from the M4 core.
+     * @param receiveTime Monotonic time in nanoseconds at which the frame was received.
+     * @param sampleTime M4 time of the measurement in microseconds, from the frame header, 0 if unknown.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel outside the data table.
+     */
+    ErrorLogging::Status receiveM4Data(uint32_t channel, const ChannelSample& sample, uint64_t receiveTime = 0,
+        uint64_t sampleTime = 0) override {
+        if (!channelDataTable.contains(channel)) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
+        }
+        channelDataTable.publish(channel, sample, receiveTime, sampleTime);
+        return {};
+    }
+
+    /**
+     * @brief Receives values derived by the data tasks (filtering, fitting, ...).
+     *
+     * @param block The processed block of channels.
+     * @param firstField The first derived field to store.
+     * @param fieldCount The number of consecutive fields to store.
+     * @return Success.
+     */
+    ErrorLogging::Status receiveDerivedData(const ChannelBlock& block, ChannelField firstField, size_t fieldCount) override {
+        channelDataTable.publishDerived(block, firstField, fieldCount);
+        return {};
+    }
+
+private:
+    ChannelDataTable channelDataTable;
+    SubscriptionFilter subscriptions;
+};
+
+/**
+ * @brief Map-based adapter over a ChannelDataService for legacy callers.
+ *
+ * Translates the string-keyed representation used by older code to the
+ * fixed-schema interface. Not intended for per-sample paths.
+ */
+class LegacyChannelDataAdapter {
+public:
+    /**
+     * @brief Constructor for the LegacyChannelDataAdapter class.
+     *
+     * @param dataService The data service to adapt.
+     */
+    explicit LegacyChannelDataAdapter(ChannelDataService& dataService) : dataService(dataService) {}
+
+    /**
+     * @brief Gets all current data for a specific channel.
+     *
+     * @param channel The channel number.
+     * @return The channel's data keyed by field name.
+     */
+    std::map<std::string, float> getChannelData(uint32_t channel) const {
+        return toFieldMap(dataService.getSample(channel));
+    }
+
+    /**
+     * @brief Receives string-keyed data from the M4 core.
+     * Fields missing from the map keep their previous value.
+     *
+     * @param channel The channel number.
+     * @param data The data received from the M4 core.
+     */
+    void receiveM4Data(uint32_t channel, const std::map<std::string, float>& data) {
+        ChannelSample sample = dataService.getSample(channel);
+        applyFieldMap(data, sample);
+        (void)dataService.receiveM4Data(channel, sample);
+    }
+
+private:
+    ChannelDataService& dataService;
+};
+
 #endif
\ No newline at end of file
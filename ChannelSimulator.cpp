@@ -0,0 +1,292 @@
+#include "ChannelSimulator.h"
+#include "M4Frame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Open-circuit voltage of a generic NMC cell, every 10 % of state of charge
+constexpr double OCV_TABLE[] = {3.00, 3.45, 3.55, 3.62, 3.68, 3.74, 3.82, 3.91, 4.00, 4.08, 4.20};
+constexpr size_t OCV_POINTS = sizeof(OCV_TABLE) / sizeof(OCV_TABLE[0]);
+
+} // namespace
+
+/**
+ * @brief Constructor for the ChannelSimulator class.
+ *
+ * @param channelCount The number of channels, at most MAX_BOARD_CHANNELS.
+ * @param parameters The cell model.
+ * @param seed Seed of the per-cell deviations and the measurement noise.
+ */
+ChannelSimulator::ChannelSimulator(uint32_t channelCount, const BatteryModelParameters& parameters, uint32_t seed) :
+    channelCount(std::min<uint32_t>(channelCount, MAX_BOARD_CHANNELS)),
+    parameters(parameters),
+    cells(this->channelCount),
+    noiseState(seed ? seed : 1),
+    pendingProfiles(this->channelCount),
+    hasPending(false),
+    appliedCommands(0) {
+    for (Cell& cell : cells) {
+        cell.capacityAh = parameters.capacityAh * (1.0f + parameters.spread * noise());
+        cell.seriesResistance = parameters.seriesResistance * (1.0f + parameters.spread * noise());
+        cell.soc = std::clamp(parameters.initialSoc + 0.5f * parameters.spread * noise(), 0.0f, 1.0f);
+        cell.temperature = parameters.ambientTemperature;
+        cell.voltage = static_cast<float>(openCircuitVoltage(cell.soc));
+    }
+}
+
+/**
+ * @brief Queues commands for the next step.
+ *
+ * A command replaces any command or profile of the same channel that was not applied yet.
+ *
+ * @param batch The commands, channels local to the endpoint.
+ */
+void ChannelSimulator::command(const ChannelCommandBatch& batch) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    pendingProfileMask &= ~batch.channelMask;
+    for (uint64_t mask = batch.channelMask; mask != 0; mask &= mask - 1) {
+        uint32_t channel = static_cast<uint32_t>(__builtin_ctzll(mask));
+        pendingBatch.set(channel, batch.commands[channel].mode, batch.commands[channel].setpoint);
+    }
+    hasPending.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Queues a command for a single channel.
+ *
+ * @param channel The local channel number.
+ * @param mode The control mode.
+ * @param setpoint The current or voltage setpoint of the mode.
+ */
+void ChannelSimulator::command(uint32_t channel, ChannelCommandMode mode, float setpoint) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    pendingProfileMask &= ~(1ULL << channel);
+    pendingBatch.set(channel, mode, setpoint);
+    hasPending.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Queues a setpoint profile for the next step.
+ *
+ * The profile replaces any command or profile of the same channels that was not applied yet.
+ *
+ * @param channelMask The local channels running the profile.
+ * @param profile The profile.
+ */
+void ChannelSimulator::profile(uint64_t channelMask, std::shared_ptr<const SetpointProfile> profile) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    uint64_t valid = channelCount == 64 ? ~0ULL : (1ULL << channelCount) - 1;
+    for (uint64_t mask = channelMask & valid; mask != 0; mask &= mask - 1) {
+        pendingProfiles[__builtin_ctzll(mask)] = profile;
+    }
+    pendingProfileMask |= channelMask & valid;
+    pendingBatch.channelMask &= ~channelMask;
+    hasPending.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Applies the queued commands and advances every channel.
+ *
+ * In CV the current is the one that holds the terminal voltage at the
+ * setpoint, limited to the channel's maximum current, so it tapers as the
+ * cell charges. The RC pair is integrated exactly for the time step. A
+ * profile leaving its voltage window sets the channel to rest.
+ *
+ * @param dt The time step in seconds.
+ */
+void ChannelSimulator::step(double dt) {
+    if (hasPending.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        uint64_t applied = 0;
+        for (uint64_t mask = pendingBatch.channelMask; mask != 0; mask &= mask - 1) {
+            uint32_t channel = static_cast<uint32_t>(__builtin_ctzll(mask));
+            if (channel < channelCount) {
+                Cell& cell = cells[channel];
+                cell.mode = pendingBatch.commands[channel].mode;
+                cell.setpoint = pendingBatch.commands[channel].setpoint;
+                cell.stepCapacity = 0.0;
+                cell.stepEnergy = 0.0;
+                cell.stepTime = 0.0;
+                cell.profile.reset();
+                cell.profileState = M4_PROFILE_STATE_NONE;
+                ++applied;
+            }
+        }
+        for (uint64_t mask = pendingProfileMask; mask != 0; mask &= mask - 1) {
+            Cell& cell = cells[__builtin_ctzll(mask)];
+            cell.profile = std::move(pendingProfiles[__builtin_ctzll(mask)]);
+            cell.profileTime = 0.0;
+            cell.profileSegment = 0;
+            cell.profileRepeat = 0;
+            cell.profileState = M4_PROFILE_STATE_RUNNING;
+            cell.stepCapacity = 0.0;
+            cell.stepEnergy = 0.0;
+            cell.stepTime = 0.0;
+            ++applied;
+        }
+        pendingBatch.channelMask = 0;
+        pendingProfileMask = 0;
+        hasPending.store(false, std::memory_order_relaxed);
+        appliedCommands.store(appliedCommands.load(std::memory_order_relaxed) + applied, std::memory_order_relaxed);
+    }
+
+    double tau = static_cast<double>(parameters.rcResistance) * parameters.rcCapacitance;
+    double decay = tau > 0.0 ? std::exp(-dt / tau) : 0.0;
+    double thermal = parameters.thermalTimeConstant > 0.0f ? dt / parameters.thermalTimeConstant : 1.0;
+    double maxCurrent = parameters.maxCurrent;
+
+    for (Cell& cell : cells) {
+        if (cell.profile) {
+            applyProfile(cell);
+        }
+        double ocv = openCircuitVoltage(cell.soc);
+        double current = 0.0;
+        switch (cell.mode) {
+            case ChannelCommandMode::ConstantCurrent:
+                current = std::clamp<double>(cell.setpoint, -maxCurrent, maxCurrent);
+                break;
+            case ChannelCommandMode::ConstantVoltage:
+                current = std::clamp((cell.setpoint - ocv - cell.rcVoltage) / cell.seriesResistance,
+                    -maxCurrent, maxCurrent);
+                break;
+            case ChannelCommandMode::Rest:
+            case ChannelCommandMode::Off:
+                break;
+        }
+
+        cell.rcVoltage = cell.rcVoltage * decay + current * parameters.rcResistance * (1.0 - decay);
+        cell.soc = std::clamp(cell.soc + current * dt / (cell.capacityAh * 3600.0), 0.0, 1.0);
+        double voltage = openCircuitVoltage(cell.soc) + cell.rcVoltage + current * cell.seriesResistance;
+        double heat = current * current * cell.seriesResistance * parameters.thermalResistance;
+        cell.temperature += (parameters.ambientTemperature + heat - cell.temperature) * std::min(thermal, 1.0);
+
+        cell.stepCapacity += std::fabs(current) * dt / 3600.0;
+        cell.stepEnergy += std::fabs(current * voltage) * dt / 3600.0;
+        cell.stepTime += dt;
+        cell.voltage = static_cast<float>(voltage) + parameters.voltageNoise * noise();
+        cell.current = static_cast<float>(current);
+
+        if (cell.profile) {
+            cell.profileTime += dt;
+            if (voltage < cell.profile->minVoltage || voltage > cell.profile->maxVoltage) {
+                cell.mode = ChannelCommandMode::Rest;
+                cell.profile.reset();
+                cell.profileState = M4_PROFILE_STATE_LIMIT;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Sets the mode and setpoint of a cell from its profile.
+ *
+ * Moves to the next repetition at the end of the points, or holds the last
+ * value and reports completion after the last repetition. A power setpoint
+ * is turned into a current with the last measured voltage.
+ *
+ * @param cell The cell, with a profile.
+ */
+void ChannelSimulator::applyProfile(Cell& cell) {
+    const SetpointProfile& profile = *cell.profile;
+    double duration = profile.duration();
+    if (cell.profileTime >= duration) {
+        bool last = profile.repeatCount != 0 && cell.profileRepeat + 1 >= profile.repeatCount;
+        if (last || duration <= 0.0) {
+            cell.profileTime = duration;
+            cell.profileState = M4_PROFILE_STATE_COMPLETED;
+        } else {
+            cell.profileTime -= duration;
+            cell.profileSegment = 0;
+            ++cell.profileRepeat;
+        }
+    }
+
+    float value = profile.valueAt(static_cast<float>(cell.profileTime), cell.profileSegment);
+    switch (profile.mode) {
+        case ProfileMode::Current:
+            cell.mode = ChannelCommandMode::ConstantCurrent;
+            cell.setpoint = value;
+            break;
+        case ProfileMode::Voltage:
+            cell.mode = ChannelCommandMode::ConstantVoltage;
+            cell.setpoint = value;
+            break;
+        case ProfileMode::Power:
+            cell.mode = ChannelCommandMode::ConstantCurrent;
+            cell.setpoint = value / std::max(cell.voltage, 0.1f);
+            break;
+    }
+}
+
+/**
+ * @brief Writes an M4 data frame holding a record for every channel.
+ *
+ * @param sequence The sequence number of the frame.
+ * @param timestamp The M4 time of the measurement, in microseconds.
+ * @param buffer Receives the frame, at least getFrameSize() bytes.
+ * @return The size of the frame.
+ */
+size_t ChannelSimulator::encodeFrame(uint32_t sequence, uint64_t timestamp, uint8_t* buffer) const {
+    M4FrameHeader header;
+    header.magic = M4_FRAME_MAGIC;
+    header.version = M4_FRAME_VERSION;
+    header.recordSize = sizeof(M4ChannelRecord);
+    header.frameSize = static_cast<uint16_t>(getFrameSize());
+    header.firstChannel = 0;
+    header.sequence = sequence;
+    header.timestamp = timestamp;
+    header.channelMask = channelCount == 64 ? ~0ULL : (1ULL << channelCount) - 1;
+    std::memcpy(buffer, &header, sizeof(header));
+
+    uint8_t* record = buffer + sizeof(header);
+    for (const Cell& cell : cells) {
+        M4ChannelRecord values;
+        values.voltage = cell.voltage;
+        values.current = cell.current;
+        values.temperature = static_cast<float>(cell.temperature);
+        values.capacity = static_cast<float>(cell.stepCapacity);
+        values.energy = static_cast<float>(cell.stepEnergy);
+        values.stepTime = static_cast<float>(cell.stepTime);
+        values.profileState = cell.profileState;
+        std::memcpy(record, &values, sizeof(values));
+        record += sizeof(values);
+    }
+    return header.frameSize;
+}
+
+/**
+ * @brief Gets the size of the frames written by encodeFrame().
+ *
+ * @return The size in bytes.
+ */
+size_t ChannelSimulator::getFrameSize() const {
+    return sizeof(M4FrameHeader) + channelCount * sizeof(M4ChannelRecord);
+}
+
+/**
+ * @brief Gets the open-circuit voltage at a state of charge.
+ *
+ * @param soc The state of charge, 0 to 1.
+ * @return The voltage, interpolated in OCV_TABLE.
+ */
+double ChannelSimulator::openCircuitVoltage(double soc) {
+    double position = std::clamp(soc, 0.0, 1.0) * (OCV_POINTS - 1);
+    size_t index = std::min(static_cast<size_t>(position), OCV_POINTS - 2);
+    double fraction = position - index;
+    return OCV_TABLE[index] + (OCV_TABLE[index + 1] - OCV_TABLE[index]) * fraction;
+}
+
+/**
+ * @brief Draws uniform noise from the simulator's xorshift generator.
+ *
+ * @return A value in [-1, 1].
+ */
+float ChannelSimulator::noise() {
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    return static_cast<float>(noiseState) / 2147483648.0f - 1.0f;
+}
@@ -0,0 +1,192 @@
+#ifndef CHANNELSIMULATOR_H
+#define CHANNELSIMULATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ChannelService.h"
+
+// Default sample rate of a simulated endpoint, in frames per second
+#define DEFAULT_SIMULATION_SAMPLE_RATE 1000.0
+
+/**
+ * @brief Equivalent-circuit model of the simulated cells.
+ *
+ * Each cell is an open-circuit voltage source depending on the state of
+ * charge, a series resistance and one RC pair for the polarization. The
+ * capacity and resistance of each cell deviate from the nominal values by
+ * up to the given spread, so the channels of a group do not all reach
+ * their limits on the same sample.
+ */
+struct BatteryModelParameters {
+    float capacityAh = 2.5f;          // Nominal capacity
+    float seriesResistance = 0.03f;   // R0, in ohms
+    float rcResistance = 0.015f;      // R1 of the RC pair, in ohms
+    float rcCapacitance = 2000.0f;    // C1 of the RC pair, in farads
+    float initialSoc = 0.2f;          // State of charge at start-up, 0 to 1
+    float spread = 0.02f;             // Relative deviation of capacity and R0 between cells
+    float maxCurrent = 10.0f;         // Limit of the channel's current source, in A
+    float ambientTemperature = 25.0f; // In degrees Celsius
+    float thermalResistance = 8.0f;   // Temperature rise per watt dissipated in R0, in K/W
+    float thermalTimeConstant = 600.0f; // In seconds
+    float voltageNoise = 0.0005f;     // Peak noise added to the measured voltage, in V
+};
+
+/**
+ * @brief Simulated hardware of a rack, used in place of the M4 cores.
+ */
+struct ChannelSimulationConfig {
+    bool enabled = false;
+    double sampleRate = DEFAULT_SIMULATION_SAMPLE_RATE;  // Frames per second of every endpoint
+    BatteryModelParameters battery;
+};
+
+/**
+ * @brief Simulated channels of one M4 endpoint.
+ *
+ * Integrates the cell model of every channel under its current command
+ * (CC, CV, rest, off or a setpoint profile) and produces the measured
+ * fields of the M4 records: voltage, current, temperature, the capacity,
+ * energy and time of the running step, which restart with every command,
+ * and the state of the profile. Profiles are executed like the M4 does,
+ * interpolated at every step.
+ *
+ * Commands may come from any thread. They are applied at the start of the
+ * next step(), all the channels of a batch together, like the M4 applies a
+ * command frame at one control tick. step() and encodeFrame() must be
+ * called from a single thread.
+ */
+class ChannelSimulator {
+public:
+    /**
+     * @brief Constructor for the ChannelSimulator class.
+     *
+     * @param channelCount The number of channels, at most MAX_BOARD_CHANNELS.
+     * @param parameters The cell model.
+     * @param seed Seed of the per-cell deviations and the measurement noise.
+     */
+    ChannelSimulator(uint32_t channelCount, const BatteryModelParameters& parameters, uint32_t seed = 1);
+
+    /**
+     * @brief Queues commands for the next step.
+     *
+     * @param batch The commands, channels local to the endpoint.
+     */
+    void command(const ChannelCommandBatch& batch);
+
+    /**
+     * @brief Queues a command for a single channel.
+     *
+     * @param channel The local channel number.
+     * @param mode The control mode.
+     * @param setpoint The current or voltage setpoint of the mode.
+     */
+    void command(uint32_t channel, ChannelCommandMode mode, float setpoint = 0.0f);
+
+    /**
+     * @brief Queues a setpoint profile for the next step.
+     *
+     * @param channelMask The local channels running the profile.
+     * @param profile The profile.
+     */
+    void profile(uint64_t channelMask, std::shared_ptr<const SetpointProfile> profile);
+
+    /**
+     * @brief Applies the queued commands and advances every channel.
+     *
+     * @param dt The time step in seconds.
+     */
+    void step(double dt);
+
+    /**
+     * @brief Writes an M4 data frame holding a record for every channel.
+     *
+     * @param sequence The sequence number of the frame.
+     * @param timestamp The M4 time of the measurement, in microseconds.
+     * @param buffer Receives the frame, at least getFrameSize() bytes.
+     * @return The size of the frame.
+     */
+    size_t encodeFrame(uint32_t sequence, uint64_t timestamp, uint8_t* buffer) const;
+
+    /**
+     * @brief Gets the size of the frames written by encodeFrame().
+     *
+     * @return The size in bytes.
+     */
+    size_t getFrameSize() const;
+
+    /**
+     * @brief Gets the number of channels.
+     *
+     * @return The number of channels.
+     */
+    uint32_t getChannelCount() const { return channelCount; }
+
+    /**
+     * @brief Gets the number of channel commands applied so far.
+     *
+     * @return The count; safe to call from any thread.
+     */
+    uint64_t getAppliedCommandCount() const { return appliedCommands.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Gets the state of charge of a channel.
+     *
+     * @param channel The local channel number.
+     * @return The state of charge, 0 to 1. Only valid on the thread calling step().
+     */
+    float getSoc(uint32_t channel) const { return static_cast<float>(cells[channel].soc); }
+
+private:
+    /**
+     * @brief State of one simulated cell and its channel.
+     */
+    struct Cell {
+        ChannelCommandMode mode = ChannelCommandMode::Off;
+        float setpoint = 0.0f;
+        float capacityAh = 0.0f;
+        float seriesResistance = 0.0f;
+        double soc = 0.0;
+        double rcVoltage = 0.0;      // Voltage across the RC pair
+        double temperature = 0.0;
+        double stepCapacity = 0.0;   // Ah since the last command
+        double stepEnergy = 0.0;     // Wh since the last command
+        double stepTime = 0.0;       // Seconds since the last command
+        float voltage = 0.0f;        // Measured terminal voltage
+        float current = 0.0f;        // Measured current, positive when charging
+        // Setpoint profile of the step, null without one or once stopped by the voltage window
+        std::shared_ptr<const SetpointProfile> profile;
+        double profileTime = 0.0;    // Seconds since the start of the repetition
+        size_t profileSegment = 0;
+        uint32_t profileRepeat = 0;
+        float profileState = 0.0f;   // M4_PROFILE_STATE_*
+    };
+
+    // Open-circuit voltage at a state of charge
+    static double openCircuitVoltage(double soc);
+
+    // Sets the mode and setpoint of a cell from its profile
+    static void applyProfile(Cell& cell);
+
+    // Uniform noise in [-1, 1] from the simulator's generator
+    float noise();
+
+    uint32_t channelCount;
+    BatteryModelParameters parameters;
+    std::vector<Cell> cells;
+    uint32_t noiseState;
+
+    // Commands queued by the control threads for the next step
+    std::mutex commandMutex;
+    ChannelCommandBatch pendingBatch;
+    uint64_t pendingProfileMask = 0;
+    std::vector<std::shared_ptr<const SetpointProfile>> pendingProfiles;
+    std::atomic<bool> hasPending;
+    std::atomic<uint64_t> appliedCommands;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "ChannelTopology.h"
+
+#include <algorithm>
+
+/**
+ * @brief Creates a topology of one endpoint, the layout of a single board.
+ *
+ * @param channelCount The number of channels, at most MAX_BOARD_CHANNELS.
+ * @return The topology.
+ */
+ChannelTopology ChannelTopology::singleEndpoint(uint32_t channelCount) {
+    ChannelTopology topology;
+    ChannelEndpointConfig config;
+    config.channelCount = channelCount;
+    std::string error;
+    topology.addEndpoint(config, error);
+    return topology;
+}
+
+/**
+ * @brief Creates a simulated rack, one endpoint of up to MAX_BOARD_CHANNELS channels per board.
+ *
+ * @param channelCount The total number of channels.
+ * @param simulation The sample rate and cell model; enabled is set.
+ * @return The topology.
+ */
+ChannelTopology ChannelTopology::simulatedRack(uint32_t channelCount, const ChannelSimulationConfig& simulation) {
+    ChannelTopology topology;
+    std::string error;
+    for (uint32_t board = 0; board * MAX_BOARD_CHANNELS < channelCount; ++board) {
+        ChannelEndpointConfig config;
+        config.board = board;
+        config.channelCount = std::min<uint32_t>(channelCount - board * MAX_BOARD_CHANNELS, MAX_BOARD_CHANNELS);
+        topology.addEndpoint(config, error);
+    }
+    topology.simulation = simulation;
+    topology.simulation.enabled = true;
+    return topology;
+}
+
+/**
+ * @brief Adds an endpoint; its channels follow those of the previous endpoints.
+ *
+ * @param config The board, core, channel count and devices of the endpoint.
+ * @param error Receives the reason on failure.
+ * @return True on success.
+ */
+bool ChannelTopology::addEndpoint(const ChannelEndpointConfig& config, std::string& error) {
+    if (config.channelCount == 0 || config.channelCount > MAX_BOARD_CHANNELS) {
+        error = "endpoint channel count must be between 1 and " + std::to_string(MAX_BOARD_CHANNELS);
+        return false;
+    }
+    for (const ChannelEndpointConfig& endpoint : endpoints) {
+        if (endpoint.board == config.board && endpoint.core == config.core) {
+            error = "board " + std::to_string(config.board) + " core " + std::to_string(config.core) +
+                " is already in the topology";
+            return false;
+        }
+    }
+
+    uint16_t index = static_cast<uint16_t>(endpoints.size());
+    firstChannels.push_back(getChannelCount());
+    endpoints.push_back(config);
+    channelEndpoints.insert(channelEndpoints.end(), config.channelCount, index);
+    return true;
+}
+
+/**
+ * @brief Finds the endpoint and local channel of a global channel.
+ *
+ * @param channel The global channel number.
+ * @param location Receives the location.
+ * @return True if the channel is in the topology.
+ */
+bool ChannelTopology::locate(uint32_t channel, ChannelLocation& location) const {
+    if (channel >= channelEndpoints.size()) {
+        return false;
+    }
+    uint32_t endpoint = channelEndpoints[channel];
+    location.endpoint = endpoint;
+    location.board = endpoints[endpoint].board;
+    location.core = endpoints[endpoint].core;
+    location.localChannel = channel - firstChannels[endpoint];
+    return true;
+}
+
+/**
+ * @brief Gets the global channel number of a local channel.
+ *
+ * @param board The board.
+ * @param core The M4 core of the board.
+ * @param localChannel The channel number on the endpoint.
+ * @return The global channel number, or NO_CHANNEL.
+ */
+uint32_t ChannelTopology::getGlobalChannel(uint32_t board, uint32_t core, uint32_t localChannel) const {
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        if (endpoints[i].board == board && endpoints[i].core == core) {
+            return localChannel < endpoints[i].channelCount ? firstChannels[i] + localChannel : NO_CHANNEL;
+        }
+    }
+    return NO_CHANNEL;
+}
+
+/**
+ * @brief Gets the global channel numbers of all channels of a board.
+ *
+ * @param board The board.
+ * @return The channels, in ascending order.
+ */
+std::vector<uint32_t> ChannelTopology::getBoardChannels(uint32_t board) const {
+    std::vector<uint32_t> channels;
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        if (endpoints[i].board == board) {
+            for (uint32_t local = 0; local < endpoints[i].channelCount; ++local) {
+                channels.push_back(firstChannels[i] + local);
+            }
+        }
+    }
+    return channels;
+}
@@ -0,0 +1,190 @@
+#ifndef CHANNELTOPOLOGY_H
+#define CHANNELTOPOLOGY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ChannelService.h"
+#include "ChannelSimulator.h"
+#include "SharedChannelTable.h"
+#include "StateCheckpoint.h"
+
+// Number of channels of the default single-endpoint topology
+#define DEFAULT_CHANNEL_COUNT 32
+
+// Channel number returned for a location that is not in the topology
+#define NO_CHANNEL UINT32_MAX
+
+/**
+ * @brief One M4 core serving a contiguous range of channels of a board.
+ */
+struct ChannelEndpointConfig {
+    uint32_t board = 0;
+    uint32_t core = 0;
+    uint32_t channelCount = DEFAULT_CHANNEL_COUNT;  // At most MAX_BOARD_CHANNELS
+    std::string dataDevice = "/dev/ttyRPMSG0";      // RPMsg device carrying the M4 data frames
+    std::string controlDevice;                      // RPMsg device for M4 commands, empty for a dummy service
+};
+
+/**
+ * @brief Where a global channel lives.
+ */
+struct ChannelLocation {
+    uint32_t endpoint = 0;      // Index of the endpoint in the topology
+    uint32_t board = 0;
+    uint32_t core = 0;
+    uint32_t localChannel = 0;  // Channel number on the endpoint
+};
+
+/**
+ * @brief Runtime map of the channels of a rack onto boards and M4 cores.
+ *
+ * Endpoints are numbered in the order they are added, and global channel
+ * numbers are assigned to them in the same order, as contiguous ranges
+ * starting at 0. All public APIs of BatteryTestingService take global
+ * channel numbers; the topology translates them to an endpoint and a local
+ * channel, which is what the M4 frames and commands carry.
+ */
+class ChannelTopology {
+public:
+    /**
+     * @brief Creates a topology of one endpoint, the layout of a single board.
+     *
+     * @param channelCount The number of channels, at most MAX_BOARD_CHANNELS.
+     * @return The topology.
+     */
+    static ChannelTopology singleEndpoint(uint32_t channelCount = DEFAULT_CHANNEL_COUNT);
+
+    /**
+     * @brief Creates a simulated rack, one endpoint of up to MAX_BOARD_CHANNELS channels per board.
+     *
+     * @param channelCount The total number of channels.
+     * @param simulation The sample rate and cell model; enabled is set.
+     * @return The topology.
+     */
+    static ChannelTopology simulatedRack(uint32_t channelCount,
+        const ChannelSimulationConfig& simulation = ChannelSimulationConfig());
+
+    /**
+     * @brief Sets the simulated hardware. When enabled, every endpoint is simulated
+     * and its devices are ignored.
+     *
+     * @param simulation The simulation configuration.
+     */
+    void setSimulation(const ChannelSimulationConfig& simulation) { this->simulation = simulation; }
+
+    /**
+     * @brief Gets the simulated hardware configuration.
+     *
+     * @return The configuration, disabled for real hardware.
+     */
+    const ChannelSimulationConfig& getSimulation() const { return simulation; }
+
+    /**
+     * @brief Publishes the channel table of the service in a POSIX shared-memory segment.
+     *
+     * @param sharing The segment name; an empty name keeps the table private.
+     */
+    void setSharedTable(const SharedTableConfig& sharing) { this->sharing = sharing; }
+
+    /**
+     * @brief Gets the shared-memory publication of the channel table.
+     *
+     * @return The configuration, with an empty name if the table is private.
+     */
+    const SharedTableConfig& getSharedTable() const { return sharing; }
+
+    /**
+     * @brief Checkpoints the execution state of every channel to a file, and resumes it at startup.
+     *
+     * @param checkpoint The file and the recipes that may be resumed; an empty path keeps no checkpoint.
+     */
+    void setCheckpoint(const CheckpointConfig& checkpoint) { this->checkpoint = checkpoint; }
+
+    /**
+     * @brief Gets the checkpoint of the execution state.
+     *
+     * @return The configuration, with an empty path if there is no checkpoint.
+     */
+    const CheckpointConfig& getCheckpoint() const { return checkpoint; }
+
+    /**
+     * @brief Adds an endpoint; its channels follow those of the previous endpoints.
+     *
+     * @param config The board, core, channel count and devices of the endpoint.
+     * @param error Receives the reason on failure.
+     * @return True on success, false if the channel count is 0 or above
+     *         MAX_BOARD_CHANNELS, or the board and core are already used.
+     */
+    bool addEndpoint(const ChannelEndpointConfig& config, std::string& error);
+
+    /**
+     * @brief Gets the number of endpoints.
+     *
+     * @return The number of endpoints.
+     */
+    size_t getEndpointCount() const { return endpoints.size(); }
+
+    /**
+     * @brief Gets the configuration of an endpoint.
+     *
+     * @param endpoint The index of the endpoint.
+     * @return The configuration.
+     */
+    const ChannelEndpointConfig& getEndpoint(size_t endpoint) const { return endpoints[endpoint]; }
+
+    /**
+     * @brief Gets the first global channel of an endpoint.
+     *
+     * @param endpoint The index of the endpoint.
+     * @return The global channel number of local channel 0.
+     */
+    uint32_t getFirstChannel(size_t endpoint) const { return firstChannels[endpoint]; }
+
+    /**
+     * @brief Gets the number of channels of all endpoints.
+     *
+     * @return The size of the global channel table.
+     */
+    uint32_t getChannelCount() const { return static_cast<uint32_t>(channelEndpoints.size()); }
+
+    /**
+     * @brief Finds the endpoint and local channel of a global channel.
+     *
+     * @param channel The global channel number.
+     * @param location Receives the location.
+     * @return True if the channel is in the topology.
+     */
+    bool locate(uint32_t channel, ChannelLocation& location) const;
+
+    /**
+     * @brief Gets the global channel number of a local channel.
+     *
+     * @param board The board.
+     * @param core The M4 core of the board.
+     * @param localChannel The channel number on the endpoint.
+     * @return The global channel number, or NO_CHANNEL.
+     */
+    uint32_t getGlobalChannel(uint32_t board, uint32_t core, uint32_t localChannel) const;
+
+    /**
+     * @brief Gets the global channel numbers of all channels of a board.
+     *
+     * @param board The board.
+     * @return The channels, in ascending order.
+     */
+    std::vector<uint32_t> getBoardChannels(uint32_t board) const;
+
+private:
+    std::vector<ChannelEndpointConfig> endpoints;
+    std::vector<uint32_t> firstChannels;
+    // Endpoint of every global channel, so locate() is a single lookup
+    std::vector<uint16_t> channelEndpoints;
+    ChannelSimulationConfig simulation;
+    SharedTableConfig sharing;
+    CheckpointConfig checkpoint;
+};
+
+#endif
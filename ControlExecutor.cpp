@@ -0,0 +1,181 @@
+#include "ControlExecutor.h"
+#include "ErrorEvents.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+// Number of empty polls before the executor parks
+constexpr int SPIN_BEFORE_PARK = 256;
+
+} // namespace
+
+/**
+ * @brief Constructor for the ControlExecutor class. Starts the executor thread.
+ *
+ * @param capacity The number of control tasks the ring can hold.
+ */
+ControlExecutor::ControlExecutor(size_t capacity) :
+    ring(capacity),
+    stopping(false),
+    latencyBudgetNs(DEFAULT_CONTROL_LATENCY_BUDGET_NS),
+    dispatched(0),
+    overBudget(0),
+    maxLatencyNs(0),
+    totalLatencyNs(0) {
+    thread = std::thread(&ControlExecutor::threadFunction, this);
+}
+
+/**
+ * @brief Destructor for the ControlExecutor class.
+ *
+ * Shuts the executor down and destroys the tasks pushed after shutdown().
+ */
+ControlExecutor::~ControlExecutor() {
+    shutdown();
+    Task* task = nullptr;
+    while (ring.pop(task)) {
+        TaskHandle(task).reset();
+    }
+}
+
+/**
+ * @brief Stops the thread after running the tasks already queued.
+ */
+void ControlExecutor::shutdown() {
+    stopping = true;
+    eventCount.notifyAll();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Queues a control task and wakes the executor.
+ *
+ * The task is timestamped here, so the measured latency covers the ring
+ * and the wakeup of the executor.
+ *
+ * @param task The task. Ownership passes to the executor on success.
+ * @return True on success, false if the ring is full; the caller keeps the task.
+ */
+bool ControlExecutor::push(TaskHandle& task) {
+    task->enqueueTime = monotonicNanoseconds();
+    if (!ring.push(task.get())) {
+        return false;
+    }
+    task.release();
+    eventCount.notifyOne();
+    return true;
+}
+
+/**
+ * @brief Applies the scheduling policy, CPU pinning and latency budget.
+ *
+ * The thread keeps running with its previous scheduling if the kernel
+ * refuses the request, e.g. without CAP_SYS_NICE.
+ *
+ * @param config The configuration.
+ * @return True if the thread priority and affinity could be applied.
+ */
+bool ControlExecutor::configure(const ControlExecutorConfig& config) {
+    latencyBudgetNs = config.latencyBudgetNs;
+    if (!thread.joinable()) {
+        return false;
+    }
+    bool applied = true;
+
+    sched_param param{};
+    int policy = SCHED_OTHER;
+    if (config.realtimePriority > 0) {
+        policy = SCHED_FIFO;
+        param.sched_priority = config.realtimePriority;
+    }
+    int error = pthread_setschedparam(thread.native_handle(), policy, &param);
+    if (error != 0) {
+        std::cerr << "Cannot set control executor priority: " << std::strerror(error) << std::endl;
+        applied = false;
+    }
+
+    if (config.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+        error = pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+        if (error != 0) {
+            std::cerr << "Cannot pin control executor to CPU " << config.cpu << ": "
+                      << std::strerror(error) << std::endl;
+            applied = false;
+        }
+    }
+    return applied;
+}
+
+/**
+ * @brief Gets a copy of the dispatch latency counters.
+ *
+ * @return The counters.
+ */
+ControlExecutorStatistics ControlExecutor::getStatistics() const {
+    ControlExecutorStatistics statistics;
+    statistics.dispatched = dispatched.load(std::memory_order_relaxed);
+    statistics.overBudget = overBudget.load(std::memory_order_relaxed);
+    statistics.maxLatencyNs = maxLatencyNs.load(std::memory_order_relaxed);
+    statistics.totalLatencyNs = totalLatencyNs.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+/**
+ * @brief Executor thread function: runs the control tasks in ring order.
+ *
+ * Spins briefly after each task, since control tasks tend to come in
+ * bursts (e.g. a whole frame of CC to CV switches), then parks.
+ */
+void ControlExecutor::threadFunction() {
+    for (;;) {
+        Task* next = nullptr;
+        for (int spin = 0; spin < SPIN_BEFORE_PARK && !ring.pop(next); ++spin) {
+            cpuRelax();
+        }
+
+        if (!next) {
+            uint32_t key = eventCount.prepareWait();
+            if (ring.pop(next)) {
+                eventCount.cancelWait();
+            } else if (stopping.load()) {
+                eventCount.cancelWait();
+                return;
+            } else {
+                eventCount.commitWait(key);
+                continue;
+            }
+        }
+
+        TaskHandle task(next);
+        uint64_t start = monotonicNanoseconds();
+        uint64_t latency = start - task->enqueueTime;
+        dispatched.store(dispatched.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalLatencyNs.store(totalLatencyNs.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+        if (latency > maxLatencyNs.load(std::memory_order_relaxed)) {
+            maxLatencyNs.store(latency, std::memory_order_relaxed);
+        }
+        if (latency > latencyBudgetNs.load(std::memory_order_relaxed)) {
+            overBudget.store(overBudget.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        if (task->triggerTime != 0) {
+            reactionLatency.record(start - task->triggerTime);
+        }
+        ErrorLogging::Status status = task->execute();
+        taskMetrics.record(task->getType(), task->priority, latency, monotonicNanoseconds() - start);
+        if (!status) {
+            taskMetrics.recordFailure(task->getType());
+            ErrorEventRing::instance().report(status.error(), "Control task failed", task->affinity,
+                taskTypeName(task->getType()));
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef CONTROLEXECUTOR_H
+#define CONTROLEXECUTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "MpmcQueue.h"
+#include "Platform.h"
+#include "TaskMetrics.h"
+#include "TaskPool.h"
+#include "TaskScheduler.h"
+
+// Default dispatch latency budget of a control task, in nanoseconds
+#define DEFAULT_CONTROL_LATENCY_BUDGET_NS 100000
+
+/**
+ * @brief Scheduling of the control executor thread.
+ */
+struct ControlExecutorConfig {
+    int realtimePriority = 0;   // SCHED_FIFO priority (1-99), 0 keeps the default policy
+    int cpu = -1;               // CPU to pin the thread to, -1 for any CPU
+    uint64_t latencyBudgetNs = DEFAULT_CONTROL_LATENCY_BUDGET_NS;
+};
+
+/**
+ * @brief Dispatch latency counters of the control executor.
+ */
+struct ControlExecutorStatistics {
+    uint64_t dispatched = 0;      // Control tasks run
+    uint64_t overBudget = 0;      // Control tasks that waited longer than the latency budget
+    uint64_t maxLatencyNs = 0;    // Worst time from push() to execute()
+    uint64_t totalLatencyNs = 0;  // Sum of the times from push() to execute()
+};
+
+/**
+ * @brief Dedicated real-time lane for control tasks.
+ *
+ * Control tasks (CC, CV, rest) change the state of the hardware and must
+ * not wait behind filtering and fitting work. The executor runs them on a
+ * thread of its own, optionally under SCHED_FIFO and pinned to a CPU, from
+ * a preallocated ring of task pointers, so data tasks on the worker pool
+ * can never delay or preempt them. The time from push() to execute() is
+ * measured for every task and checked against a budget, and recorded
+ * with the execution time in the executor's task histograms.
+ *
+ * Tasks must be short and must not block: they run one at a time.
+ */
+class ControlExecutor {
+public:
+    /**
+     * @brief Constructor for the ControlExecutor class. Starts the executor thread.
+     *
+     * @param capacity The number of control tasks the ring can hold.
+     */
+    explicit ControlExecutor(size_t capacity);
+
+    /**
+     * @brief Destructor for the ControlExecutor class.
+     *
+     * Shuts the executor down and destroys the tasks pushed after shutdown().
+     */
+    ~ControlExecutor();
+
+    ControlExecutor(const ControlExecutor&) = delete;
+    ControlExecutor& operator=(const ControlExecutor&) = delete;
+
+    /**
+     * @brief Queues a control task and wakes the executor.
+     *
+     * @param task The task. Ownership passes to the executor on success.
+     * @return True on success, false if the ring is full; the caller keeps the task.
+     */
+    bool push(TaskHandle& task);
+
+    /**
+     * @brief Stops the thread after running the tasks already queued.
+     */
+    void shutdown();
+
+    /**
+     * @brief Applies the scheduling policy, CPU pinning and latency budget.
+     *
+     * @param config The configuration.
+     * @return True if the thread priority and affinity could be applied.
+     */
+    bool configure(const ControlExecutorConfig& config);
+
+    /**
+     * @brief Gets a copy of the dispatch latency counters.
+     *
+     * @return The counters.
+     */
+    ControlExecutorStatistics getStatistics() const;
+
+    /**
+     * @brief Gets the queue wait and execution time histograms of the tasks run by the executor.
+     *
+     * @return The histograms, written by the executor thread only.
+     */
+    const TaskMetricsShard& getTaskMetrics() const { return taskMetrics; }
+
+    /**
+     * @brief Gets the histogram of the time from the sample that caused a control task to its execution.
+     *
+     * Only tasks with a trigger time are counted, i.e. the commands of step
+     * transitions, not the commands of API calls.
+     *
+     * @return The histogram, written by the executor thread only.
+     */
+    const LatencyHistogram& getReactionLatency() const { return reactionLatency; }
+
+    /**
+     * @brief Gets the approximate number of control tasks waiting in the ring.
+     *
+     * @return The number of tasks.
+     */
+    size_t getQueueDepth() const { return ring.sizeApprox(); }
+
+private:
+    void threadFunction();
+
+    MpmcQueue<Task*> ring;
+    EventCount eventCount;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> latencyBudgetNs;
+
+    // Written by the executor thread only
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dispatched;
+    std::atomic<uint64_t> overBudget;
+    std::atomic<uint64_t> maxLatencyNs;
+    std::atomic<uint64_t> totalLatencyNs;
+    TaskMetricsShard taskMetrics;
+    LatencyHistogram reactionLatency;
+
+    std::thread thread;
+};
+
+#endif
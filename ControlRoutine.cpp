@@ -0,0 +1,375 @@
+#include "ControlRoutine.h"
+#include "ErrorEvents.h"
+
+#include <new>
+
+namespace {
+
+/**
+ * @brief Flags a routine that addressed another channel than its own.
+ *
+ * @param promise The promise of the routine.
+ * @param channel The channel the routine addressed.
+ * @return True if the channel is the routine's.
+ */
+bool checkChannel(ControlRoutine::promise_type& promise, uint32_t channel) {
+    if (channel != promise.channel) {
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::INVALID_ARGUMENT,
+            "Control routine addressed another channel; channel", promise.channel, nullptr, 0, static_cast<float>(channel));
+        promise.failed = true;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Gets the pool of the process, created on first use.
+ *
+ * @return The pool.
+ */
+ControlFramePool& ControlFramePool::instance() {
+    static ControlFramePool pool(CONTROL_ROUTINE_FRAME_COUNT);
+    return pool;
+}
+
+/**
+ * @brief Constructor for the ControlFramePool class.
+ *
+ * @param slotCount The number of frames that can be live at the same time without heap allocation.
+ */
+ControlFramePool::ControlFramePool(size_t slotCount) : capacity(static_cast<uint32_t>(slotCount)) {
+    slots = new Slot[capacity];
+    for (uint32_t i = 0; i < capacity; ++i) {
+        slots[i].next.store(i + 1 < capacity ? i + 1 : NO_SLOT, std::memory_order_relaxed);
+    }
+    freeHead.store(capacity > 0 ? 0 : NO_SLOT, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Destructor for the ControlFramePool class.
+ */
+ControlFramePool::~ControlFramePool() {
+    delete[] slots;
+}
+
+/**
+ * @brief Allocates a coroutine frame.
+ *
+ * @param size The size of the frame.
+ * @return The frame storage.
+ */
+void* ControlFramePool::allocate(size_t size) {
+    uint32_t index = size <= CONTROL_ROUTINE_FRAME_SIZE ? popFreeSlot() : NO_SLOT;
+    if (index == NO_SLOT) {
+        heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+    return slots[index].storage;
+}
+
+/**
+ * @brief Returns a frame to the pool, or to the heap if it came from there.
+ *
+ * @param frame The frame storage returned by allocate().
+ */
+void ControlFramePool::deallocate(void* frame) {
+    Slot* slot = reinterpret_cast<Slot*>(static_cast<unsigned char*>(frame) - offsetof(Slot, storage));
+    if (slot >= slots && slot < slots + capacity) {
+        pushFreeSlot(static_cast<uint32_t>(slot - slots));
+    } else {
+        ::operator delete(frame);
+    }
+}
+
+uint32_t ControlFramePool::popFreeSlot() {
+    // The free list head packs a slot index with a tag that defeats ABA
+    uint64_t head = freeHead.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t index = static_cast<uint32_t>(head);
+        if (index == NO_SLOT) {
+            return NO_SLOT;
+        }
+        uint32_t next = slots[index].next.load(std::memory_order_relaxed);
+        if (freeHead.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | next,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+            return index;
+        }
+    }
+}
+
+void ControlFramePool::pushFreeSlot(uint32_t index) {
+    uint64_t head = freeHead.load(std::memory_order_relaxed);
+    for (;;) {
+        slots[index].next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        if (freeHead.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | index,
+                std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Records the wait of the routine; the routine stays suspended until advance() resumes it.
+ *
+ * @param handle The suspended routine.
+ */
+void UntilAwaiter::await_suspend(ControlRoutine::Handle handle) {
+    promise = &handle.promise();
+    if (checkChannel(*promise, channel)) {
+        promise->wait = wait;
+        promise->condition = condition;
+        promise->limits = limits;
+        promise->timeoutNs = timeoutNs;
+    }
+}
+
+/**
+ * @brief Adds the command to the batch of the current frame.
+ *
+ * @param handle The routine.
+ * @return False to continue the routine at once, true to suspend a routine that addressed another channel.
+ */
+bool CommandAwaiter::await_suspend(ControlRoutine::Handle handle) {
+    ControlRoutine::promise_type& promise = handle.promise();
+    if (!checkChannel(promise, channel)) {
+        return true;
+    }
+    if (mode != NO_COMMAND) {
+        promise.batch->set(promise.localChannel, mode, setpoint);
+        promise.profile.reset();
+    }
+    promise.phase->store(phase, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Hands the profile to the engine in place of the channel's command in the current batch.
+ *
+ * @param handle The routine.
+ * @return False to continue the routine at once, true to suspend a routine that addressed another channel.
+ */
+bool ProfileAwaiter::await_suspend(ControlRoutine::Handle handle) {
+    ControlRoutine::promise_type& promise = handle.promise();
+    if (!checkChannel(promise, channel)) {
+        return true;
+    }
+    promise.batch->channelMask &= ~(1ULL << promise.localChannel);
+    promise.profile = std::move(profile);
+    promise.phase->store(phase, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Builds the ramp in the channel's profile and hands it to the engine like ProfileAwaiter.
+ *
+ * The profile of the last ramp may still be held by a profile task that
+ * has not run yet, or by a simulated channel running it; the ramp then
+ * gets a new profile, which allocates.
+ *
+ * @param handle The routine.
+ * @return False to continue the routine at once, true to suspend a routine that addressed another channel.
+ */
+bool RampAwaiter::await_suspend(ControlRoutine::Handle handle) {
+    ControlRoutine::promise_type& promise = handle.promise();
+    if (!checkChannel(promise, channel)) {
+        return true;
+    }
+    std::shared_ptr<SetpointProfile>& profile = *promise.rampProfile;
+    if (profile.use_count() == 1) {
+        // Order the last reads of the previous holder before the profile is rewritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+        profile->setCurrentRamp(current, rampRate);
+    } else {
+        profile = std::make_shared<SetpointProfile>(SetpointProfile::currentRamp(current, rampRate));
+    }
+    promise.batch->channelMask &= ~(1ULL << promise.localChannel);
+    promise.profile = profile;
+    promise.phase->store(phase, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Constructor for the ControlRoutineEngine class.
+ *
+ * @param channelCount The number of channels.
+ */
+ControlRoutineEngine::ControlRoutineEngine(size_t channelCount) : slots(channelCount) {
+    for (Slot& slot : slots) {
+        slot.rampProfile = std::make_shared<SetpointProfile>(SetpointProfile::currentRamp(0.0f, 1.0f));
+    }
+}
+
+/**
+ * @brief Destructor for the ControlRoutineEngine class. Destroys the suspended routines.
+ */
+ControlRoutineEngine::~ControlRoutineEngine() {
+    for (Slot& slot : slots) {
+        if (slot.handle) {
+            slot.handle.destroy();
+        }
+    }
+}
+
+/**
+ * @brief Starts a routine on a channel, replacing the running one, and runs it to its first wait.
+ *
+ * @param channel The channel number.
+ * @param routine The routine, which must address this channel.
+ * @param localChannel The channel number within its endpoint.
+ * @param batch Receives the initial commands of the routine.
+ * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+ * @return True if the routine already ended.
+ */
+bool ControlRoutineEngine::start(uint32_t channel, ControlRoutine routine, uint32_t localChannel,
+    ChannelCommandBatch& batch, float stepTime) {
+    if (channel >= slots.size() || !routine) {
+        return false;
+    }
+    Slot& slot = slots[channel];
+    if (slot.handle) {
+        slot.handle.destroy();
+    }
+    slot.handle = routine.release();
+    ControlRoutine::promise_type& promise = slot.handle.promise();
+    promise.channel = channel;
+    promise.phase = &slot.phase;
+    promise.rampProfile = &slot.rampProfile;
+    slot.phase.store(StepPhase::Idle, std::memory_order_relaxed);
+    slot.active.store(true, std::memory_order_relaxed);
+    slot.awaitingRestart = stepTime > 0.0f;
+    slot.restartStepTime = stepTime;
+    slot.restartSamples = 0;
+    return resume(slot, localChannel, batch);
+}
+
+/**
+ * @brief Resumes the routine of a channel if a new sample satisfies its wait.
+ *
+ * The step limits of the wait are evaluated first on every sample, like
+ * the StepEngine does, so crossing limits see every sample. Samples from
+ * before the M4 restarted the step time are skipped, see start().
+ *
+ * @param channel The channel number.
+ * @param sample The latest values of the channel.
+ * @param localChannel The channel number within its endpoint.
+ * @param batch Receives the commands of the routine.
+ * @return True if the routine ended on this sample.
+ */
+bool ControlRoutineEngine::advance(uint32_t channel, const ChannelSample& sample, uint32_t localChannel,
+    ChannelCommandBatch& batch) {
+    if (!isWaiting(channel)) {
+        return false;
+    }
+    Slot& slot = slots[channel];
+    ControlRoutine::promise_type& promise = slot.handle.promise();
+
+    if (slot.awaitingRestart) {
+        if (sample[ChannelField::StepTime] >= slot.restartStepTime &&
+            ++slot.restartSamples < STEP_RESTART_MAX_SAMPLES) {
+            return false;
+        }
+        slot.awaitingRestart = false;
+    }
+
+    bool limitsMet = promise.limits && !promise.limits->empty() && promise.limits->evaluate(sample);
+    if (!limitsMet) {
+        if (promise.wait == ControlWait::Limits || promise.wait == ControlWait::Timer ||
+            (promise.wait == ControlWait::Condition && !promise.condition(sample))) {
+            return false;
+        }
+    }
+    promise.result.sample = sample;
+    promise.result.limitsMet = limitsMet;
+    promise.result.timedOut = false;
+    return resume(slot, localChannel, batch);
+}
+
+/**
+ * @brief Resumes the routine of a channel whose wait timed out.
+ *
+ * Does nothing if the routine is not in a wait with a timeout, e.g. when
+ * a stale timer of a stopped routine fires.
+ *
+ * @param channel The channel number.
+ * @param sample The latest values of the channel.
+ * @param localChannel The channel number within its endpoint.
+ * @param batch Receives the commands of the routine.
+ * @return True if the routine ended.
+ */
+bool ControlRoutineEngine::expire(uint32_t channel, const ChannelSample& sample, uint32_t localChannel,
+    ChannelCommandBatch& batch) {
+    if (!isWaiting(channel) || slots[channel].timeoutNs == 0) {
+        return false;
+    }
+    Slot& slot = slots[channel];
+    ControlRoutine::promise_type& promise = slot.handle.promise();
+    promise.result.sample = sample;
+    promise.result.limitsMet = false;
+    promise.result.timedOut = true;
+    return resume(slot, localChannel, batch);
+}
+
+/**
+ * @brief Aborts the routine of a channel and hands the channel back to the step engine.
+ *
+ * @param channel The channel number.
+ * @return True if a routine was suspended.
+ */
+bool ControlRoutineEngine::stop(uint32_t channel) {
+    if (channel >= slots.size()) {
+        return false;
+    }
+    Slot& slot = slots[channel];
+    bool waiting = static_cast<bool>(slot.handle);
+    if (waiting) {
+        slot.handle.destroy();
+        slot.handle = nullptr;
+    }
+    slot.profile.reset();
+    slot.timeoutNs = 0;
+    slot.timerChanged = true;
+    slot.phase.store(StepPhase::Idle, std::memory_order_relaxed);
+    slot.active.store(false, std::memory_order_relaxed);
+    return waiting;
+}
+
+/**
+ * @brief Resumes a routine and finishes it if it returned.
+ *
+ * A routine that threw or addressed another channel is ended and its
+ * channel set to rest.
+ *
+ * @param slot The slot of the channel.
+ * @param localChannel The channel number within its endpoint.
+ * @param batch Receives the commands of the routine.
+ * @return True if the routine ended.
+ */
+bool ControlRoutineEngine::resume(Slot& slot, uint32_t localChannel, ChannelCommandBatch& batch) {
+    ControlRoutine::promise_type& promise = slot.handle.promise();
+    promise.batch = &batch;
+    promise.localChannel = localChannel;
+    promise.timeoutNs = 0;
+    slot.handle.resume();
+    promise.batch = nullptr;
+    slot.profile = std::move(promise.profile);
+
+    // Every resumption ends the wait, so the caller re-arms or cancels the timer
+    slot.timerChanged = true;
+    if (!slot.handle.done() && !promise.failed) {
+        slot.timeoutNs = promise.timeoutNs;
+        return false;
+    }
+    slot.timeoutNs = 0;
+    if (promise.failed) {
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::TASK_EXECUTION_FAILED,
+            "Control routine failed, setting the channel to rest", promise.channel);
+        batch.set(localChannel, ChannelCommandMode::Rest);
+        slot.profile.reset();
+    }
+    slot.handle.destroy();
+    slot.handle = nullptr;
+    slot.phase.store(StepPhase::Done, std::memory_order_relaxed);
+    return true;
+}
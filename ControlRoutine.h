@@ -0,0 +1,700 @@
+#ifndef CONTROLROUTINE_H
+#define CONTROLROUTINE_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ChannelDataTable.h"
+#include "ChannelService.h"
+#include "Platform.h"
+#include "StepEngine.h"
+#include "StepLimitEvaluator.h"
+
+// Size of a pooled coroutine frame; routines with larger frames fall back to the heap
+#define CONTROL_ROUTINE_FRAME_SIZE 1024
+// Number of pooled coroutine frames, shared by every service of the process
+#define CONTROL_ROUTINE_FRAME_COUNT 1024
+
+/**
+ * @brief Fixed-capacity slab of coroutine frames for the control routines.
+ *
+ * Works like TaskPool: all frames are allocated once and linked into a
+ * lock-free free list, so starting a routine from any thread and finishing
+ * it on an ingest thread never touches the heap. A frame that does not fit
+ * a slot, or a routine started while the slab is exhausted, is allocated on
+ * the heap and counted.
+ */
+class ControlFramePool {
+public:
+    /**
+     * @brief Gets the pool of the process, created on first use.
+     *
+     * @return The pool.
+     */
+    static ControlFramePool& instance();
+
+    /**
+     * @brief Destructor for the ControlFramePool class.
+     */
+    ~ControlFramePool();
+
+    ControlFramePool(const ControlFramePool&) = delete;
+    ControlFramePool& operator=(const ControlFramePool&) = delete;
+
+    /**
+     * @brief Allocates a coroutine frame.
+     *
+     * @param size The size of the frame.
+     * @return The frame storage.
+     */
+    void* allocate(size_t size);
+
+    /**
+     * @brief Returns a frame to the pool, or to the heap if it came from there.
+     *
+     * @param frame The frame storage returned by allocate().
+     */
+    void deallocate(void* frame);
+
+    /**
+     * @brief Gets the number of frames that had to be allocated on the heap.
+     *
+     * @return The number of heap fallbacks since start-up.
+     */
+    uint64_t getHeapFallbackCount() const {
+        return heapFallbacks.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        alignas(std::max_align_t) unsigned char storage[CONTROL_ROUTINE_FRAME_SIZE];
+        std::atomic<uint32_t> next;
+    };
+
+    explicit ControlFramePool(size_t slotCount);
+
+    uint32_t popFreeSlot();
+    void pushFreeSlot(uint32_t index);
+
+    const uint32_t capacity;
+    Slot* slots;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> freeHead;
+    std::atomic<uint64_t> heapFallbacks{0};
+};
+
+/**
+ * @brief Condition on one field of a channel sample, e.g. Field::Voltage >= 4.2f.
+ */
+struct FieldCondition {
+    ChannelField field = ChannelField::Voltage;
+    LimitComparison comparison = LimitComparison::GreaterOrEqual; // GreaterOrEqual or LessOrEqual
+    float target = 0.0f;
+
+    /**
+     * @brief Evaluates the condition on a sample.
+     *
+     * @param sample The latest values of the channel.
+     * @return True if the condition holds.
+     */
+    bool operator()(const ChannelSample& sample) const {
+        return comparison == LimitComparison::LessOrEqual ? sample[field] <= target : sample[field] >= target;
+    }
+};
+
+/**
+ * @brief Names a field in a FieldCondition expression.
+ */
+struct FieldRef {
+    ChannelField field;
+};
+
+constexpr FieldCondition operator>=(FieldRef ref, float target) {
+    return {ref.field, LimitComparison::GreaterOrEqual, target};
+}
+
+constexpr FieldCondition operator<=(FieldRef ref, float target) {
+    return {ref.field, LimitComparison::LessOrEqual, target};
+}
+
+// Fields of a channel sample, for conditions like Field::Voltage >= 4.2f
+namespace Field {
+inline constexpr FieldRef Voltage{ChannelField::Voltage};
+inline constexpr FieldRef Current{ChannelField::Current};
+inline constexpr FieldRef Temperature{ChannelField::Temperature};
+inline constexpr FieldRef Capacity{ChannelField::Capacity};
+inline constexpr FieldRef Energy{ChannelField::Energy};
+inline constexpr FieldRef StepTime{ChannelField::StepTime};
+inline constexpr FieldRef ProfileState{ChannelField::ProfileState};
+inline constexpr FieldRef FilteredVoltage{ChannelField::FilteredVoltage};
+inline constexpr FieldRef FilteredCurrent{ChannelField::FilteredCurrent};
+inline constexpr FieldRef DvDt{ChannelField::DvDt};
+inline constexpr FieldRef DiDt{ChannelField::DiDt};
+inline constexpr FieldRef FittedVoltage{ChannelField::FittedVoltage};
+} // namespace Field
+
+/**
+ * @brief Result of waiting for a sample.
+ */
+struct UntilResult {
+    ChannelSample sample;   // The sample that resumed the routine
+    bool limitsMet = false; // The step limits were met on this sample, checked before the condition
+    bool timedOut = false;  // The timeout of the wait elapsed; sample holds the latest values
+};
+
+/**
+ * @brief What a suspended routine waits for.
+ */
+enum class ControlWait : uint8_t {
+    Condition,  // The field condition holds, or the limits are met
+    Limits,     // The limits are met
+    AnySample,  // The next sample of the channel
+    Timer       // The timeout only; the samples are not looked at
+};
+
+/**
+ * @brief Coroutine type of a control routine.
+ *
+ * A control routine is a straight-line description of a control type,
+ * for example a CCCV step:
+ *
+ *     ControlRoutine cccv(uint32_t channel, float current, float voltage, StepLimitEvaluator limits) {
+ *         co_await cc(channel, current);
+ *         if (!(co_await until(channel, limits, Field::Voltage >= voltage)).limitsMet) {
+ *             co_await cv(channel, voltage);
+ *             co_await until(channel, limits);
+ *         }
+ *         co_await rest(channel);
+ *     }
+ *
+ * Calling the function only creates the suspended routine; it starts when
+ * it is handed to ControlRoutineEngine::start(). Commands do not suspend,
+ * they are added to the command batch of the current frame, or for a
+ * setpoint profile handed to the engine's caller. Waits suspend
+ * the routine until the ingest thread sees a sample satisfying them, so a
+ * waiting routine costs one comparison per sample and no resumption. A
+ * wait with a timeout is also resumed by the timer wheel of the ingest
+ * lane, and a pure timer wait, e.g. a rest duration, costs nothing per sample.
+ *
+ * The frame comes from the ControlFramePool. Move-only: the routine is
+ * destroyed with its owner unless it was released to an engine.
+ */
+class ControlRoutine {
+public:
+    struct promise_type {
+        ControlRoutine get_return_object() {
+            return ControlRoutine(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { failed = true; }
+
+        static void* operator new(size_t size) { return ControlFramePool::instance().allocate(size); }
+        static void operator delete(void* frame) { ControlFramePool::instance().deallocate(frame); }
+
+        // Set by the engine before the routine runs
+        uint32_t channel = 0;
+        std::atomic<StepPhase>* phase = nullptr;
+        // Batch of the frame being handled and the channel's index in it, set before each resumption
+        ChannelCommandBatch* batch = nullptr;
+        uint32_t localChannel = 0;
+        // Profile started in place of a batch command, taken by the engine after the resumption
+        std::shared_ptr<const SetpointProfile> profile;
+        // Preallocated current ramp of the channel, set by the engine before the routine runs
+        std::shared_ptr<SetpointProfile>* rampProfile = nullptr;
+
+        // Current wait, set by the awaiters
+        ControlWait wait = ControlWait::AnySample;
+        FieldCondition condition;
+        StepLimitEvaluator* limits = nullptr;
+        // Armed on the timer wheel of the ingest lane when the routine suspends, 0 for none
+        uint64_t timeoutNs = 0;
+        UntilResult result;
+
+        // The routine addressed another channel or threw; the engine ends it
+        bool failed = false;
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    ControlRoutine() : handle(nullptr) {}
+    ControlRoutine(ControlRoutine&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ControlRoutine& operator=(ControlRoutine&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+    ~ControlRoutine() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    ControlRoutine(const ControlRoutine&) = delete;
+    ControlRoutine& operator=(const ControlRoutine&) = delete;
+
+    /**
+     * @brief Checks if the object holds a routine.
+     */
+    explicit operator bool() const { return static_cast<bool>(handle); }
+
+    /**
+     * @brief Gives up ownership of the routine.
+     *
+     * @return The coroutine handle, to be destroyed by the caller.
+     */
+    Handle release() {
+        Handle released = handle;
+        handle = nullptr;
+        return released;
+    }
+
+private:
+    explicit ControlRoutine(Handle handle) : handle(handle) {}
+
+    Handle handle;
+};
+
+/**
+ * @brief Awaiter suspending a routine until a sample satisfies its wait.
+ */
+class UntilAwaiter {
+public:
+    UntilAwaiter(uint32_t channel, ControlWait wait, FieldCondition condition, StepLimitEvaluator* limits,
+        uint64_t timeoutNs = 0)
+        : channel(channel), wait(wait), condition(condition), limits(limits), timeoutNs(timeoutNs), promise(nullptr) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(ControlRoutine::Handle handle);
+    UntilResult await_resume() const { return promise->result; }
+
+private:
+    uint32_t channel;
+    ControlWait wait;
+    FieldCondition condition;
+    StepLimitEvaluator* limits;
+    uint64_t timeoutNs;
+    ControlRoutine::promise_type* promise;
+};
+
+/**
+ * @brief Awaiter adding a command to the batch of the current frame, without suspending.
+ */
+class CommandAwaiter {
+public:
+    // Mode of an awaiter that only changes the phase
+    static constexpr ChannelCommandMode NO_COMMAND = static_cast<ChannelCommandMode>(0xFF);
+
+    CommandAwaiter(uint32_t channel, ChannelCommandMode mode, float setpoint, StepPhase phase)
+        : channel(channel), mode(mode), setpoint(setpoint), phase(phase) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(ControlRoutine::Handle handle);
+    void await_resume() const {}
+
+private:
+    uint32_t channel;
+    ChannelCommandMode mode;
+    float setpoint;
+    StepPhase phase;
+};
+
+/**
+ * @brief Awaiter starting a setpoint profile, without suspending.
+ */
+class ProfileAwaiter {
+public:
+    ProfileAwaiter(uint32_t channel, std::shared_ptr<const SetpointProfile> profile, StepPhase phase)
+        : channel(channel), profile(std::move(profile)), phase(phase) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(ControlRoutine::Handle handle);
+    void await_resume() const {}
+
+private:
+    uint32_t channel;
+    std::shared_ptr<const SetpointProfile> profile;
+    StepPhase phase;
+};
+
+/**
+ * @brief Awaiter starting a current ramp held in the channel's preallocated profile, without suspending.
+ */
+class RampAwaiter {
+public:
+    RampAwaiter(uint32_t channel, float current, float rampRate, StepPhase phase)
+        : channel(channel), current(current), rampRate(rampRate), phase(phase) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(ControlRoutine::Handle handle);
+    void await_resume() const {}
+
+private:
+    uint32_t channel;
+    float current;
+    float rampRate;
+    StepPhase phase;
+};
+
+/**
+ * @brief Waits until a field condition holds on a sample of the channel.
+ *
+ * @param channel The channel of the routine.
+ * @param condition The condition, e.g. Field::Voltage >= 4.2f.
+ * @return The awaiter, resuming with the sample.
+ */
+inline UntilAwaiter until(uint32_t channel, FieldCondition condition) {
+    return UntilAwaiter(channel, ControlWait::Condition, condition, nullptr);
+}
+
+/**
+ * @brief Waits until the step limits are met.
+ *
+ * @param channel The channel of the routine.
+ * @param limits The limits, owned by the routine.
+ * @return The awaiter, resuming with limitsMet set.
+ */
+inline UntilAwaiter until(uint32_t channel, StepLimitEvaluator& limits) {
+    return UntilAwaiter(channel, ControlWait::Limits, FieldCondition(), &limits);
+}
+
+/**
+ * @brief Waits until the step limits are met or a field condition holds.
+ *
+ * @param channel The channel of the routine.
+ * @param limits The limits, owned by the routine and checked first.
+ * @param condition The condition.
+ * @return The awaiter, resuming with limitsMet set if the limits ended the wait.
+ */
+inline UntilAwaiter until(uint32_t channel, StepLimitEvaluator& limits, FieldCondition condition) {
+    return UntilAwaiter(channel, ControlWait::Condition, condition, &limits);
+}
+
+/**
+ * @brief Waits for the next sample of the channel.
+ *
+ * @param channel The channel of the routine.
+ * @return The awaiter, resuming with the sample.
+ */
+inline UntilAwaiter nextSample(uint32_t channel) {
+    return UntilAwaiter(channel, ControlWait::AnySample, FieldCondition(), nullptr);
+}
+
+/**
+ * @brief Waits for the next sample of the channel and checks the step limits on it.
+ *
+ * @param channel The channel of the routine.
+ * @param limits The limits, owned by the routine.
+ * @return The awaiter, resuming with the sample and limitsMet.
+ */
+inline UntilAwaiter nextSample(uint32_t channel, StepLimitEvaluator& limits) {
+    return UntilAwaiter(channel, ControlWait::AnySample, FieldCondition(), &limits);
+}
+
+/**
+ * @brief Converts a wait duration to the timeout of an UntilAwaiter.
+ *
+ * @param seconds The duration.
+ * @return The timeout in nanoseconds, at least 1.
+ */
+inline uint64_t toTimeoutNs(double seconds) {
+    return seconds > 1e-9 ? static_cast<uint64_t>(seconds * 1e9) : 1;
+}
+
+/**
+ * @brief Waits for a duration, measured by the host from the suspension.
+ *
+ * @param channel The channel of the routine.
+ * @param seconds The duration.
+ * @return The awaiter, resuming with timedOut set and the latest sample.
+ */
+inline UntilAwaiter waitFor(uint32_t channel, double seconds) {
+    return UntilAwaiter(channel, ControlWait::Timer, FieldCondition(), nullptr, toTimeoutNs(seconds));
+}
+
+/**
+ * @brief Waits for a duration, or until the step limits are met.
+ *
+ * Without limits this is a pure timer wait, which does not look at the samples.
+ *
+ * @param channel The channel of the routine.
+ * @param seconds The duration.
+ * @param limits The limits, owned by the routine.
+ * @return The awaiter, resuming with limitsMet or timedOut set.
+ */
+inline UntilAwaiter waitFor(uint32_t channel, double seconds, StepLimitEvaluator& limits) {
+    return UntilAwaiter(channel, limits.empty() ? ControlWait::Timer : ControlWait::Limits, FieldCondition(),
+        &limits, toTimeoutNs(seconds));
+}
+
+/**
+ * @brief Sets the channel to constant current.
+ *
+ * @param channel The channel of the routine.
+ * @param current The current setpoint.
+ * @param phase The phase reported by getStepPhase() from now on.
+ * @return The awaiter.
+ */
+inline CommandAwaiter cc(uint32_t channel, float current, StepPhase phase = StepPhase::ConstantCurrent) {
+    return CommandAwaiter(channel, ChannelCommandMode::ConstantCurrent, current, phase);
+}
+
+/**
+ * @brief Sets the channel to constant voltage.
+ *
+ * @param channel The channel of the routine.
+ * @param voltage The voltage setpoint.
+ * @param phase The phase reported by getStepPhase() from now on.
+ * @return The awaiter.
+ */
+inline CommandAwaiter cv(uint32_t channel, float voltage, StepPhase phase = StepPhase::ConstantVoltage) {
+    return CommandAwaiter(channel, ChannelCommandMode::ConstantVoltage, voltage, phase);
+}
+
+/**
+ * @brief Sets the channel to rest (open circuit).
+ *
+ * @param channel The channel of the routine.
+ * @param phase The phase reported by getStepPhase() from now on.
+ * @return The awaiter.
+ */
+inline CommandAwaiter rest(uint32_t channel, StepPhase phase = StepPhase::Resting) {
+    return CommandAwaiter(channel, ChannelCommandMode::Rest, 0.0f, phase);
+}
+
+/**
+ * @brief Starts a setpoint profile on the M4, replacing the command of this frame.
+ *
+ * The profile reports its state in Field::ProfileState: wait for
+ * M4_PROFILE_STATE_RUNNING, then for a state below it for its end.
+ *
+ * @param channel The channel of the routine.
+ * @param profile The profile, validated by the caller.
+ * @param phase The phase reported by getStepPhase() from now on.
+ * @return The awaiter.
+ */
+inline ProfileAwaiter startProfile(uint32_t channel, std::shared_ptr<const SetpointProfile> profile,
+    StepPhase phase = StepPhase::Profile) {
+    return ProfileAwaiter(channel, std::move(profile), phase);
+}
+
+/**
+ * @brief Starts a current ramp on the M4, replacing the command of this frame.
+ *
+ * Like startProfile() with SetpointProfile::currentRamp(), but the profile
+ * is built in storage the engine preallocated for the channel, so it does
+ * not allocate on the ingest thread.
+ *
+ * @param channel The channel of the routine.
+ * @param current The final current, held once reached.
+ * @param rampRate The ramp slope in A per second, must not be 0.
+ * @param phase The phase reported by getStepPhase() from now on.
+ * @return The awaiter.
+ */
+inline RampAwaiter startCurrentRamp(uint32_t channel, float current, float rampRate,
+    StepPhase phase = StepPhase::Ramping) {
+    return RampAwaiter(channel, current, rampRate, phase);
+}
+
+/**
+ * @brief Changes the phase reported by getStepPhase(), without a command.
+ *
+ * @param channel The channel of the routine.
+ * @param phase The new phase.
+ * @return The awaiter.
+ */
+inline CommandAwaiter enterPhase(uint32_t channel, StepPhase phase) {
+    return CommandAwaiter(channel, CommandAwaiter::NO_COMMAND, 0.0f, phase);
+}
+
+/**
+ * @brief Per-channel control routines, resumed by the ingest path.
+ *
+ * Plays the role of the StepEngine for routines: start(), advance(),
+ * expire() and stop() must be called from the ingest thread of the channel,
+ * and the commands of the routine go into the batch passed to them, and a
+ * profile started by the routine is kept for takeProfile(). The timeout
+ * of each new wait is kept for takeTimer(), to be armed by the caller,
+ * which calls expire() when it elapses. advance()
+ * checks the wait of the suspended routine and resumes it only when the
+ * wait is satisfied; it never allocates, and startCurrentRamp() builds its
+ * profile in storage preallocated per channel. When a routine returns, its frame
+ * goes back to the pool and the channel's phase becomes Done.
+ *
+ * isActive() and getPhase() can be called from any thread.
+ */
+class ControlRoutineEngine {
+public:
+    /**
+     * @brief Constructor for the ControlRoutineEngine class.
+     *
+     * @param channelCount The number of channels.
+     */
+    explicit ControlRoutineEngine(size_t channelCount);
+
+    /**
+     * @brief Destructor for the ControlRoutineEngine class. Destroys the suspended routines.
+     */
+    ~ControlRoutineEngine();
+
+    ControlRoutineEngine(const ControlRoutineEngine&) = delete;
+    ControlRoutineEngine& operator=(const ControlRoutineEngine&) = delete;
+
+    /**
+     * @brief Starts a routine on a channel, replacing the running one, and runs it to its first wait.
+     *
+     * Like the StepEngine, the waits of the routine ignore the samples of the
+     * previous step until the M4 restarts the step time, so a time or
+     * capacity limit cannot end the routine on stale values.
+     *
+     * @param channel The channel number.
+     * @param routine The routine, which must address this channel.
+     * @param localChannel The channel number within its endpoint.
+     * @param batch Receives the initial commands of the routine.
+     * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+     * @return True if the routine already ended.
+     */
+    bool start(uint32_t channel, ControlRoutine routine, uint32_t localChannel, ChannelCommandBatch& batch,
+        float stepTime = 0.0f);
+
+    /**
+     * @brief Resumes the routine of a channel if a new sample satisfies its wait.
+     *
+     * @param channel The channel number.
+     * @param sample The latest values of the channel.
+     * @param localChannel The channel number within its endpoint.
+     * @param batch Receives the commands of the routine.
+     * @return True if the routine ended on this sample.
+     */
+    bool advance(uint32_t channel, const ChannelSample& sample, uint32_t localChannel, ChannelCommandBatch& batch);
+
+    /**
+     * @brief Resumes the routine of a channel whose wait timed out.
+     *
+     * @param channel The channel number.
+     * @param sample The latest values of the channel.
+     * @param localChannel The channel number within its endpoint.
+     * @param batch Receives the commands of the routine.
+     * @return True if the routine ended.
+     */
+    bool expire(uint32_t channel, const ChannelSample& sample, uint32_t localChannel, ChannelCommandBatch& batch);
+
+    /**
+     * @brief Aborts the routine of a channel and hands the channel back to the step engine.
+     *
+     * @param channel The channel number.
+     * @return True if a routine was suspended.
+     */
+    bool stop(uint32_t channel);
+
+    /**
+     * @brief Checks if a routine is suspended on a channel. Ingest thread only.
+     *
+     * @param channel The channel number.
+     * @return True if advance() has a routine to resume.
+     */
+    bool isWaiting(uint32_t channel) const {
+        return channel < slots.size() && slots[channel].handle;
+    }
+
+    /**
+     * @brief Checks if the routine of a channel looks at the samples. Ingest thread only.
+     *
+     * @param channel The channel number.
+     * @return True if a routine is suspended on a wait other than a pure timer.
+     */
+    bool isWaitingForSamples(uint32_t channel) const {
+        return isWaiting(channel) && slots[channel].handle.promise().wait != ControlWait::Timer;
+    }
+
+    /**
+     * @brief Takes the timeout of the wait a channel's routine entered since the last call.
+     *
+     * @param channel The channel number.
+     * @param timeoutNs Receives the timeout from now, 0 to cancel the armed one.
+     * @return True if the routine entered a new wait, ended or was stopped since the last call.
+     */
+    bool takeTimer(uint32_t channel, uint64_t& timeoutNs) {
+        if (channel >= slots.size() || !slots[channel].timerChanged) {
+            return false;
+        }
+        slots[channel].timerChanged = false;
+        timeoutNs = slots[channel].timeoutNs;
+        return true;
+    }
+
+    /**
+     * @brief Checks if the last start() or advance() of a channel started a setpoint profile.
+     *
+     * @param channel The channel number.
+     * @return True if takeProfile() has a profile to hand out.
+     */
+    bool hasProfile(uint32_t channel) const {
+        return channel < slots.size() && slots[channel].profile;
+    }
+
+    /**
+     * @brief Takes the setpoint profile started by the routine of a channel, to be sent by the caller.
+     *
+     * @param channel The channel number.
+     * @return The profile, or null if none was started.
+     */
+    std::shared_ptr<const SetpointProfile> takeProfile(uint32_t channel) {
+        return channel < slots.size() ? std::move(slots[channel].profile) : nullptr;
+    }
+
+    /**
+     * @brief Checks if the phase of a channel is owned by a routine.
+     *
+     * @param channel The channel number.
+     * @return True from start() to stop(), including after the routine ended.
+     */
+    bool isActive(uint32_t channel) const {
+        return channel < slots.size() && slots[channel].active.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gets the phase of the routine of a channel.
+     *
+     * @param channel The channel number.
+     * @return The phase of the last command, Done once the routine ended.
+     */
+    StepPhase getPhase(uint32_t channel) const {
+        return channel < slots.size() ? slots[channel].phase.load(std::memory_order_relaxed) : StepPhase::Idle;
+    }
+
+private:
+    struct Slot {
+        ControlRoutine::Handle handle = nullptr;
+        std::shared_ptr<const SetpointProfile> profile;
+        // Current ramp built by startCurrentRamp(), preallocated by the constructor
+        std::shared_ptr<SetpointProfile> rampProfile;
+        // Timeout of the current wait, changed flag for takeTimer()
+        uint64_t timeoutNs = 0;
+        bool timerChanged = false;
+        std::atomic<StepPhase> phase{StepPhase::Idle};
+        std::atomic<bool> active{false};
+        // Samples are ignored until the M4 restarts the step time
+        bool awaitingRestart = false;
+        float restartStepTime = 0.0f;
+        uint32_t restartSamples = 0;
+    };
+
+    // Resumes a routine and finishes it if it returned
+    bool resume(Slot& slot, uint32_t localChannel, ChannelCommandBatch& batch);
+
+    std::vector<Slot> slots;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "ControlRoutines.h"
+
+#include "M4Frame.h"
+
+#include <memory>
+
+/**
+ * @brief Constant Current Constant Voltage control type.
+ *
+ * @param channel The channel number.
+ * @param current The CC current.
+ * @param targetVoltage The CV voltage.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine cccvRoutine(uint32_t channel, float current, float targetVoltage, StepLimitEvaluator limits,
+    StepPhase resumeAt) {
+    if (resumeAt == StepPhase::ConstantVoltage) {
+        co_await enterPhase(channel, StepPhase::ConstantVoltage);
+    } else {
+        if (resumeAt == StepPhase::ConstantCurrent) {
+            co_await enterPhase(channel, StepPhase::ConstantCurrent);
+        } else {
+            co_await cc(channel, current);
+        }
+        // A discharge (negative current) reaches its target voltage from above
+        FieldCondition targetReached = current < 0.0f ? Field::Voltage <= targetVoltage : Field::Voltage >= targetVoltage;
+        UntilResult reached = co_await until(channel, limits, targetReached);
+        if (reached.limitsMet) {
+            co_await rest(channel);
+            co_return;
+        }
+        co_await cv(channel, targetVoltage);
+    }
+    co_await until(channel, limits);
+    co_await rest(channel);
+}
+
+/**
+ * @brief Current ramp control type.
+ *
+ * A ramp resumed in the Ramping phase waits for the end of the profile
+ * only, since the M4 may have finished it meanwhile.
+ *
+ * @param channel The channel number.
+ * @param current The final current.
+ * @param rampRate The ramp slope in A per second of step time, 0 jumps to current.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine currentRampRoutine(uint32_t channel, float current, float rampRate, StepLimitEvaluator limits,
+    StepPhase resumeAt) {
+    if (resumeAt == StepPhase::Holding) {
+        co_await enterPhase(channel, StepPhase::Holding);
+    } else if (rampRate != 0.0f && current != 0.0f) {
+        UntilResult result;
+        if (resumeAt == StepPhase::Ramping) {
+            co_await enterPhase(channel, StepPhase::Ramping);
+        } else {
+            co_await startCurrentRamp(channel, current, rampRate, StepPhase::Ramping);
+            result = co_await until(channel, limits, Field::ProfileState >= M4_PROFILE_STATE_RUNNING);
+        }
+        if (!result.limitsMet) {
+            result = co_await until(channel, limits, Field::ProfileState <= M4_PROFILE_STATE_LIMIT);
+        }
+        if (result.limitsMet || result.sample[ChannelField::ProfileState] != M4_PROFILE_STATE_COMPLETED) {
+            co_await rest(channel);
+            co_return;
+        }
+        // The M4 holds the final current
+        co_await enterPhase(channel, StepPhase::Holding);
+    } else {
+        co_await cc(channel, current, StepPhase::Holding);
+    }
+    co_await until(channel, limits);
+    co_await rest(channel);
+}
+
+/**
+ * @brief Setpoint profile control type.
+ *
+ * A profile resumed in the Profile phase waits for its end only.
+ *
+ * @param channel The channel number.
+ * @param profile The profile, validated by the caller; unused when resuming, as the M4 holds it.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine profileRoutine(uint32_t channel, std::shared_ptr<const SetpointProfile> profile,
+    StepLimitEvaluator limits, StepPhase resumeAt) {
+    UntilResult result;
+    if (resumeAt == StepPhase::Profile) {
+        co_await enterPhase(channel, StepPhase::Profile);
+    } else {
+        co_await startProfile(channel, std::move(profile));
+        // Wait for the M4 to start the profile, then for its end
+        result = co_await until(channel, limits, Field::ProfileState >= M4_PROFILE_STATE_RUNNING);
+    }
+    if (!result.limitsMet) {
+        result = co_await until(channel, limits, Field::ProfileState <= M4_PROFILE_STATE_LIMIT);
+    }
+    // Out of its voltage window, the M4 has already set the channel to rest
+    if (result.limitsMet || result.sample[ChannelField::ProfileState] != M4_PROFILE_STATE_LIMIT) {
+        co_await rest(channel);
+    }
+}
+
+/**
+ * @brief Rest control type: open circuit until the limits are met or the duration elapses.
+ *
+ * The duration is a timer on the ingest lane, so a rest with no other
+ * limits is not resumed or evaluated on its samples.
+ *
+ * @param channel The channel number.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param duration The rest duration in seconds, 0 for none; the time left when resuming.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine restRoutine(uint32_t channel, StepLimitEvaluator limits, double duration, StepPhase resumeAt) {
+    if (resumeAt == StepPhase::Resting) {
+        co_await enterPhase(channel, StepPhase::Resting);
+    } else {
+        co_await rest(channel);
+    }
+    if (duration > 0.0) {
+        co_await waitFor(channel, duration, limits);
+    } else {
+        co_await until(channel, limits);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef CONTROLROUTINES_H
+#define CONTROLROUTINES_H
+
+#include <cstdint>
+#include <memory>
+
+#include "ControlRoutine.h"
+#include "SetpointProfile.h"
+#include "StepLimitEvaluator.h"
+
+/*
+ * A checkpointed routine is continued by calling its control type again
+ * with the phase it reached: the routine enters that phase without a
+ * command, since the M4 kept running the last one, and waits as before.
+ */
+
+/**
+ * @brief Constant Current Constant Voltage control type.
+ *
+ * CC at current until the voltage reaches targetVoltage, CV at targetVoltage
+ * until the limits are met, then rest. Limits met during CC skip the CV phase.
+ * A negative current discharges, and the voltage reaches its target from above.
+ *
+ * @param channel The channel number.
+ * @param current The CC current.
+ * @param targetVoltage The CV voltage.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine cccvRoutine(uint32_t channel, float current, float targetVoltage, StepLimitEvaluator limits,
+    StepPhase resumeAt = StepPhase::Idle);
+
+/**
+ * @brief Current ramp control type.
+ *
+ * The ramp from 0 to current is uploaded to the M4 as a setpoint profile,
+ * which raises the current at every control tick and holds the final
+ * current. The routine is resumed only when the profile ends, then rests
+ * when the limits are met.
+ *
+ * @param channel The channel number.
+ * @param current The final current.
+ * @param rampRate The ramp slope in A per second of step time, 0 jumps to current.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine currentRampRoutine(uint32_t channel, float current, float rampRate, StepLimitEvaluator limits,
+    StepPhase resumeAt = StepPhase::Idle);
+
+/**
+ * @brief Setpoint profile control type.
+ *
+ * Starts the profile on the M4 and rests when the profile completes or the
+ * limits are met, whichever comes first. A profile stopped by its voltage
+ * window has already been set to rest by the M4.
+ *
+ * @param channel The channel number.
+ * @param profile The profile, validated by the caller; unused when resuming, as the M4 holds it.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine profileRoutine(uint32_t channel, std::shared_ptr<const SetpointProfile> profile,
+    StepLimitEvaluator limits, StepPhase resumeAt = StepPhase::Idle);
+
+/**
+ * @brief Rest control type: open circuit until the limits are met or the duration elapses.
+ *
+ * The duration is a timer on the ingest lane, so a rest with no other
+ * limits is not resumed or evaluated on its samples.
+ *
+ * @param channel The channel number.
+ * @param limits The compiled step limits, owned by the routine.
+ * @param duration The rest duration in seconds, 0 for none; the time left when resuming.
+ * @param resumeAt Idle to start, or the phase of a checkpointed routine to continue without a new command.
+ * @return The routine.
+ */
+ControlRoutine restRoutine(uint32_t channel, StepLimitEvaluator limits, double duration = 0.0,
+    StepPhase resumeAt = StepPhase::Idle);
+
+#endif
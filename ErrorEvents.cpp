@@ -0,0 +1,92 @@
+#include "ErrorEvents.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "Platform.h"
+
+/**
+ * @brief Gets the ring of the process, created on first use.
+ *
+ * @return The ring.
+ */
+ErrorEventRing& ErrorEventRing::instance() {
+    static ErrorEventRing ring;
+    return ring;
+}
+
+/**
+ * @brief Constructor for the ErrorEventRing class. Allocates all events.
+ */
+ErrorEventRing::ErrorEventRing() : events(ERROR_EVENT_RING_CAPACITY), reported(0), dropped(0) {}
+
+/**
+ * @brief Queues an error event. Safe from any thread.
+ *
+ * @param code The error code.
+ * @param message Static description of the error.
+ * @param channel The channel concerned, or ERROR_EVENT_NO_CHANNEL.
+ * @param source The device or component, copied; nullptr for none.
+ * @param systemError errno of the failed call, 0 if none.
+ * @param value Value qualifying the error.
+ * @return True if queued, false if the ring was full and the event was dropped.
+ */
+bool ErrorEventRing::report(ErrorLogging::ErrorCode code, const char* message, uint32_t channel,
+    const char* source, int32_t systemError, float value) {
+    ErrorEvent event;
+    event.code = code;
+    event.channel = channel;
+    event.systemError = systemError;
+    event.value = value;
+    event.time = realtimeNanoseconds();
+    event.message = message;
+    if (source) {
+        std::strncpy(event.source, source, ERROR_EVENT_SOURCE_SIZE - 1);
+    }
+    if (!events.push(event)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    reported.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Formats an event as one line of text, without allocating.
+ *
+ * For example "Error 2004 (Channel communication error): Cannot send M4
+ * command [/dev/ttyRPMSG1] (Broken pipe)" or "Error 9003 (Operation
+ * timeout) on channel 3: No data, stopping the step; watchdog ms: 500".
+ *
+ * @param event The event.
+ * @param buffer Receives the text, terminated with a zero.
+ * @param size The size of the buffer.
+ * @return The length of the text, truncated to the buffer.
+ */
+size_t ErrorEventRing::format(const ErrorEvent& event, char* buffer, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    int length = std::snprintf(buffer, size, "Error %d (%s)", static_cast<int>(event.code),
+        ErrorLogging::ErrorCodeName(event.code));
+    auto append = [&](const char* text, auto... args) {
+        size_t used = std::min(static_cast<size_t>(std::max(length, 0)), size - 1);
+        int added = std::snprintf(buffer + used, size - used, text, args...);
+        length = static_cast<int>(used) + std::max(added, 0);
+    };
+    if (event.channel != ERROR_EVENT_NO_CHANNEL) {
+        append(" on channel %u", event.channel);
+    }
+    append(": %s", event.message);
+    if (event.value != 0.0f) {
+        append(": %g", static_cast<double>(event.value));
+    }
+    if (event.source[0] != '\0') {
+        append(" [%s]", event.source);
+    }
+    if (event.systemError != 0) {
+        append(" (%s)", std::strerror(event.systemError));
+    }
+    return std::min(static_cast<size_t>(std::max(length, 0)), size - 1);
+}
@@ -0,0 +1,112 @@
+#ifndef ERROREVENTS_H
+#define ERROREVENTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ErrorLogging/ErrorCodes.h"
+#include "ErrorLogging/Result.h"
+#include "MpmcQueue.h"
+
+// Events the error ring holds before new ones are dropped and counted
+#define ERROR_EVENT_RING_CAPACITY 1024
+// Size of ErrorEvent::source, including the terminating zero
+#define ERROR_EVENT_SOURCE_SIZE 32
+// Channel of an event that concerns no single channel
+#define ERROR_EVENT_NO_CHANNEL 0xFFFFFFFFu
+
+/**
+ * @brief An error of the ingest, worker or control threads, queued for reporting.
+ *
+ * A plain struct, so reporting copies it into the ring and never
+ * allocates. The message must be a string literal or another string that
+ * outlives the process, since it is reported later by another thread.
+ */
+struct ErrorEvent {
+    ErrorLogging::ErrorCode code = ErrorLogging::ErrorCode::UNKNOWN_ERROR;
+    uint32_t channel = ERROR_EVENT_NO_CHANNEL;  // Global or endpoint-local channel; see the message
+    int32_t systemError = 0;                    // errno of the failed call, 0 if none
+    float value = 0.0f;                         // Value named by the end of the message, 0 if none
+    uint64_t time = 0;                          // CLOCK_REALTIME nanoseconds
+    const char* message = "";                   // Static description
+    char source[ERROR_EVENT_SOURCE_SIZE] = {};  // Device or component, truncated
+};
+
+/**
+ * @brief Lock-free ring carrying error events from the real-time threads to a reporter.
+ *
+ * Code on the per-sample and control paths reports a failure here instead
+ * of throwing or writing to a stream: report() costs a clock read and one
+ * MpmcQueue push, with no lock, system call or allocation. A reporter
+ * thread, e.g. the one of BatteryTestingService, drains the ring and
+ * hands the events to the logger. When the ring is full the event is
+ * dropped and counted, so a storm of errors never stalls its producers.
+ */
+class ErrorEventRing {
+public:
+    /**
+     * @brief Gets the ring of the process, created on first use.
+     *
+     * @return The ring.
+     */
+    static ErrorEventRing& instance();
+
+    ErrorEventRing(const ErrorEventRing&) = delete;
+    ErrorEventRing& operator=(const ErrorEventRing&) = delete;
+
+    /**
+     * @brief Queues an error event. Safe from any thread.
+     *
+     * @param code The error code.
+     * @param message Static description of the error.
+     * @param channel The channel concerned, or ERROR_EVENT_NO_CHANNEL.
+     * @param source The device or component, copied; nullptr for none.
+     * @param systemError errno of the failed call, 0 if none.
+     * @param value Value qualifying the error.
+     * @return True if queued, false if the ring was full and the event was dropped.
+     */
+    bool report(ErrorLogging::ErrorCode code, const char* message, uint32_t channel = ERROR_EVENT_NO_CHANNEL,
+        const char* source = nullptr, int32_t systemError = 0, float value = 0.0f);
+
+    /**
+     * @brief Removes the oldest event.
+     *
+     * @param event Receives the event.
+     * @return True on success, false if the ring is empty.
+     */
+    bool pop(ErrorEvent& event) { return events.pop(event); }
+
+    /**
+     * @brief Gets the number of events queued since start-up.
+     *
+     * @return The number of reported events, dropped ones excluded.
+     */
+    uint64_t getReportedCount() const { return reported.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Gets the number of events dropped on a full ring.
+     *
+     * @return The number of dropped events since start-up.
+     */
+    uint64_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Formats an event as one line of text, without allocating.
+     *
+     * @param event The event.
+     * @param buffer Receives the text, terminated with a zero.
+     * @param size The size of the buffer.
+     * @return The length of the text, truncated to the buffer.
+     */
+    static size_t format(const ErrorEvent& event, char* buffer, size_t size);
+
+private:
+    ErrorEventRing();
+
+    MpmcQueue<ErrorEvent> events;
+    std::atomic<uint64_t> reported;
+    std::atomic<uint64_t> dropped;
+};
+
+#endif
@@ -2,7 +2,7 @@
 
 namespace ErrorLogging {
 
-std::string ErrorCodeToString(ErrorCode code) {
+const char* ErrorCodeName(ErrorCode code) {
     switch (code) {
         // System level errors
         case ErrorCode::SYSTEM_ERROR:
@@ -65,4 +65,8 @@ std::string ErrorCodeToString(ErrorCode code) {
     }
 }
 
+std::string ErrorCodeToString(ErrorCode code) {
+    return ErrorCodeName(code);
+}
+
 } // namespace ErrorLogging
\ No newline at end of file
@@ -40,6 +40,9 @@ enum class ErrorCode {
     OPERATION_TIMEOUT = 9003
 };
 
+// Get the name of an error code; the string is static, so this never allocates
+const char* ErrorCodeName(ErrorCode code);
+
 // Convert error code to string representation
 std::string ErrorCodeToString(ErrorCode code);
 
@@ -3,6 +3,8 @@
 
 // Include spdlog headers
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
@@ -10,7 +12,7 @@
 
 namespace ErrorLogging {
 
-Logger::Logger() : m_initialized(false) {
+Logger::Logger() : m_level(static_cast<int>(LogLevel::INFO)), m_initialized(false) {
     // Constructor is private due to singleton pattern
 }
 
@@ -24,11 +26,34 @@ void Logger::initialize(const std::string& loggerName) {
         return;
     }
     
+    createLogger(loggerName, OverflowPolicy::BLOCK);
+}
+
+void Logger::initializeAsync(const AsyncOptions& options, const std::string& loggerName) {
+    if (m_initialized) {
+        return;
+    }
+    
+    // The queue is allocated once here; queueing a message copies it into a slot
+    m_threadPool = std::make_shared<spdlog::details::thread_pool>(
+        std::max<size_t>(options.queueSize, 1), std::max<size_t>(options.threadCount, 1));
+    createLogger(loggerName, options.overflowPolicy);
+}
+
+void Logger::createLogger(const std::string& loggerName, OverflowPolicy overflowPolicy) {
     // Create logger
-    m_logger = std::make_shared<spdlog::logger>(loggerName);
+    if (m_threadPool) {
+        m_logger = std::make_shared<spdlog::async_logger>(loggerName, m_sinks.begin(), m_sinks.end(), m_threadPool,
+            overflowPolicy == OverflowPolicy::OVERRUN_OLDEST ? spdlog::async_overflow_policy::overrun_oldest
+                                                             : spdlog::async_overflow_policy::block);
+    } else {
+        m_logger = std::make_shared<spdlog::logger>(loggerName);
+    }
     
     // Set pattern
     m_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] [thread %t] %v");
+    m_logger->set_level(static_cast<spdlog::level::level_enum>(toSpdlogLevel(LogLevel::INFO)));
+    m_level.store(static_cast<int>(LogLevel::INFO), std::memory_order_relaxed);
     
     // Register with spdlog
     spdlog::register_logger(m_logger);
@@ -36,6 +61,10 @@ void Logger::initialize(const std::string& loggerName) {
     m_initialized = true;
 }
 
+size_t Logger::getOverrunCount() const {
+    return m_threadPool ? m_threadPool->overrun_counter() : 0;
+}
+
 void Logger::addFileSink(const std::string& filename, bool truncate) {
     if (!m_initialized) {
         initialize();
@@ -102,6 +131,7 @@ void Logger::setLogLevel(LogLevel level) {
     }
     
     m_logger->set_level(static_cast<spdlog::level::level_enum>(toSpdlogLevel(level)));
+    m_level.store(static_cast<int>(level), std::memory_order_relaxed);
 }
 
 void Logger::trace(const std::string& message) {
@@ -153,42 +183,28 @@ void Logger::critical(const std::string& message) {
 }
 
 void Logger::log(LogLevel level, ErrorCode code, const std::string& message) {
+    if (!shouldLog(level)) {
+        return;
+    }
+    
+    // Formatted on the stack: no temporary strings
+    logfCode(level, code, "{}", message);
+}
+
+void Logger::write(LogLevel level, const char* message, size_t size) {
     if (!m_initialized) {
         initialize();
     }
     
-    std::string formattedMessage = 
-        "Error " + std::to_string(static_cast<int>(code)) + 
-        " (" + ErrorCodeToString(code) + "): " + message;
-    
-    switch (level) {
-        case LogLevel::TRACE:
-            m_logger->trace(formattedMessage);
-            break;
-        case LogLevel::DEBUG:
-            m_logger->debug(formattedMessage);
-            break;
-        case LogLevel::INFO:
-            m_logger->info(formattedMessage);
-            break;
-        case LogLevel::WARNING:
-            m_logger->warn(formattedMessage);
-            break;
-        case LogLevel::ERROR:
-            m_logger->error(formattedMessage);
-            break;
-        case LogLevel::CRITICAL:
-            m_logger->critical(formattedMessage);
-            break;
-        default:
-            // Do nothing for OFF
-            break;
+    if (level != LogLevel::OFF) {
+        m_logger->log(static_cast<spdlog::level::level_enum>(toSpdlogLevel(level)),
+            spdlog::string_view_t(message, size));
     }
 }
 
 void Logger::logException(LogLevel level, const std::exception& exception) {
-    if (!m_initialized) {
-        initialize();
+    if (!shouldLog(level)) {
+        return;
     }
     
     // Check if it's our custom exception
@@ -198,32 +214,7 @@ void Logger::logException(LogLevel level, const std::exception& exception) {
         log(level, customEx->getErrorCode(), customEx->getMessage());
     } else {
         // Generic exception
-        std::string message = "Exception: ";
-        message += exception.what();
-        
-        switch (level) {
-            case LogLevel::TRACE:
-                m_logger->trace(message);
-                break;
-            case LogLevel::DEBUG:
-                m_logger->debug(message);
-                break;
-            case LogLevel::INFO:
-                m_logger->info(message);
-                break;
-            case LogLevel::WARNING:
-                m_logger->warn(message);
-                break;
-            case LogLevel::ERROR:
-                m_logger->error(message);
-                break;
-            case LogLevel::CRITICAL:
-                m_logger->critical(message);
-                break;
-            default:
-                // Do nothing for OFF
-                break;
-        }
+        logf(level, "Exception: {}", exception.what());
     }
 }
 
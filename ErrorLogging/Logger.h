@@ -1,10 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <string>
 #include <memory>
 #include <vector>
 #include "ErrorCodes.h"
 
+// fmt (bundled with spdlog or external), used by the format-string macros
+#include <spdlog/fmt/fmt.h>
+
 // Forward declarations for spdlog
 namespace spdlog {
     class logger;
@@ -12,8 +18,25 @@ namespace spdlog {
     namespace sinks {
         class sink;
     }
+
+    namespace details {
+        class thread_pool;
+    }
 }
 
+// Largest message formatted by the *_FMT macros, longer messages are truncated
+#define LOG_MESSAGE_MAX_SIZE 512
+
+// Lowest level compiled into the LOG_* macros (0 = TRACE ... 6 = OFF).
+// Release builds strip TRACE and DEBUG; define it to override.
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL 2
+#else
+#define LOG_COMPILE_LEVEL 0
+#endif
+#endif
+
 namespace ErrorLogging {
 
 // Log levels
@@ -27,6 +50,19 @@ enum class LogLevel {
     OFF
 };
 
+// What an async logger does when its queue is full
+enum class OverflowPolicy {
+    BLOCK,          // Wait until the logging thread makes room
+    OVERRUN_OLDEST  // Drop the oldest queued message, never wait
+};
+
+// Options of the async mode
+struct AsyncOptions {
+    size_t queueSize = 8192;   // Messages the queue holds, preallocated
+    size_t threadCount = 1;    // Logging threads writing the sinks
+    OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK;
+};
+
 // Logger class
 class Logger {
 public:
@@ -36,6 +72,16 @@ public:
     // Initialize the logger with sinks
     void initialize(const std::string& loggerName = "channel_manager_logger");
     
+    // Initialize the logger in async mode: callers only queue messages and a
+    // logging thread pool writes them to the sinks. Must be the first call.
+    void initializeAsync(const AsyncOptions& options, const std::string& loggerName = "channel_manager_logger");
+    
+    // Check if the logger runs in async mode
+    bool isAsync() const { return m_threadPool != nullptr; }
+    
+    // Get the number of messages dropped by the OVERRUN_OLDEST policy
+    size_t getOverrunCount() const;
+    
     // Add a file sink
     void addFileSink(const std::string& filename, bool truncate = false);
     
@@ -51,6 +97,11 @@ public:
     // Set global log level
     void setLogLevel(LogLevel level);
     
+    // Check the level before building a message; lock-free and never allocates
+    bool shouldLog(LogLevel level) const {
+        return level != LogLevel::OFF && static_cast<int>(level) >= m_level.load(std::memory_order_relaxed);
+    }
+    
     // Log methods
     void trace(const std::string& message);
     void debug(const std::string& message);
@@ -62,6 +113,28 @@ public:
     // Log with error code
     void log(LogLevel level, ErrorCode code, const std::string& message);
     
+    // Format a message into a stack buffer and log it, without heap allocation
+    template <typename... Args>
+    void logf(LogLevel level, fmt::format_string<Args...> format, Args&&... args) {
+        char buffer[LOG_MESSAGE_MAX_SIZE];
+        auto result = fmt::format_to_n(buffer, sizeof(buffer), format, std::forward<Args>(args)...);
+        write(level, buffer, std::min(result.size, sizeof(buffer)));
+    }
+    
+    // Same as logf, prefixed with the error code and its name
+    template <typename... Args>
+    void logfCode(LogLevel level, ErrorCode code, fmt::format_string<Args...> format, Args&&... args) {
+        char buffer[LOG_MESSAGE_MAX_SIZE];
+        auto prefix = fmt::format_to_n(buffer, sizeof(buffer), "Error {} ({}): ",
+            static_cast<int>(code), ErrorCodeName(code));
+        size_t size = std::min(prefix.size, sizeof(buffer));
+        auto result = fmt::format_to_n(buffer + size, sizeof(buffer) - size, format, std::forward<Args>(args)...);
+        write(level, buffer, size + std::min(result.size, sizeof(buffer) - size));
+    }
+    
+    // Log a message that is already formatted
+    void write(LogLevel level, const char* message, size_t size);
+    
     // Log exception
     void logException(LogLevel level, const std::exception& exception);
     
@@ -77,7 +150,10 @@ private:
     Logger& operator=(const Logger&) = delete;
     
     // Convert LogLevel to spdlog level
-    int toSpdlogLevel(LogLevel level);
+    static int toSpdlogLevel(LogLevel level);
+    
+    // Create and register the logger, async if m_threadPool is set
+    void createLogger(const std::string& loggerName, OverflowPolicy overflowPolicy);
     
     // The actual spdlog logger
     std::shared_ptr<spdlog::logger> m_logger;
@@ -85,23 +161,61 @@ private:
     // Collection of sinks
     std::vector<std::shared_ptr<spdlog::sinks::sink>> m_sinks;
     
+    // Thread pool of the async mode, null in sync mode
+    std::shared_ptr<spdlog::details::thread_pool> m_threadPool;
+    
+    // Level checked by shouldLog, mirrors the spdlog logger's level
+    std::atomic<int> m_level;
+    
     // Flag to check if logger is initialized
     bool m_initialized;
 };
 
+// Logs through a Logger method only if the level is enabled, so the message
+// expression is not evaluated for filtered levels
+#define LOG_IF_ENABLED(level, call) \
+    do { \
+        ErrorLogging::Logger& logger_ = ErrorLogging::Logger::getInstance(); \
+        if (static_cast<int>(level) >= LOG_COMPILE_LEVEL && logger_.shouldLog(level)) { \
+            logger_.call; \
+        } \
+    } while (0)
+
 // Convenience macros for logging
-#define LOG_TRACE(message) ErrorLogging::Logger::getInstance().trace(message)
-#define LOG_DEBUG(message) ErrorLogging::Logger::getInstance().debug(message)
-#define LOG_INFO(message) ErrorLogging::Logger::getInstance().info(message)
-#define LOG_WARNING(message) ErrorLogging::Logger::getInstance().warning(message)
-#define LOG_ERROR(message) ErrorLogging::Logger::getInstance().error(message)
-#define LOG_CRITICAL(message) ErrorLogging::Logger::getInstance().critical(message)
+#if LOG_COMPILE_LEVEL <= 0
+#define LOG_TRACE(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::TRACE, trace(message))
+#define LOG_TRACE_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::TRACE, logf(ErrorLogging::LogLevel::TRACE, __VA_ARGS__))
+#else
+#define LOG_TRACE(message) ((void)0)
+#define LOG_TRACE_FMT(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 1
+#define LOG_DEBUG(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::DEBUG, debug(message))
+#define LOG_DEBUG_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::DEBUG, logf(ErrorLogging::LogLevel::DEBUG, __VA_ARGS__))
+#else
+#define LOG_DEBUG(message) ((void)0)
+#define LOG_DEBUG_FMT(...) ((void)0)
+#endif
+
+#define LOG_INFO(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::INFO, info(message))
+#define LOG_WARNING(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::WARNING, warning(message))
+#define LOG_ERROR(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::ERROR, error(message))
+#define LOG_CRITICAL(message) LOG_IF_ENABLED(ErrorLogging::LogLevel::CRITICAL, critical(message))
+
+// Format-string macros, e.g. LOG_INFO_FMT("channel {} at {:.3f} V", channel, voltage).
+// The level is checked before any argument is formatted, and formatting never allocates.
+#define LOG_INFO_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::INFO, logf(ErrorLogging::LogLevel::INFO, __VA_ARGS__))
+#define LOG_WARNING_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::WARNING, logf(ErrorLogging::LogLevel::WARNING, __VA_ARGS__))
+#define LOG_ERROR_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::ERROR, logf(ErrorLogging::LogLevel::ERROR, __VA_ARGS__))
+#define LOG_CRITICAL_FMT(...) LOG_IF_ENABLED(ErrorLogging::LogLevel::CRITICAL, logf(ErrorLogging::LogLevel::CRITICAL, __VA_ARGS__))
 
 // Macros for logging with error code
-#define LOG_ERROR_CODE(level, code, message) ErrorLogging::Logger::getInstance().log(level, code, message)
+#define LOG_ERROR_CODE(level, code, message) LOG_IF_ENABLED(level, log(level, code, message))
+#define LOG_ERROR_CODE_FMT(level, code, ...) LOG_IF_ENABLED(level, logfCode(level, code, __VA_ARGS__))
 
 // Macro for logging exceptions
-#define LOG_EXCEPTION(level, exception) ErrorLogging::Logger::getInstance().logException(level, exception)
+#define LOG_EXCEPTION(level, exception) LOG_IF_ENABLED(level, logException(level, exception))
 
 // Macro for try-catch with logging
 #define TRY_LOG_CATCH(code) \
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "ErrorCodes.h"
+
+namespace ErrorLogging {
+
+// Error part of a Result, built with makeError(code)
+struct ResultError {
+    ErrorCode code;
+};
+
+// Build the error of a Result, e.g. return makeError(ErrorCode::CHANNEL_NOT_FOUND);
+constexpr ResultError makeError(ErrorCode code) noexcept {
+    return ResultError{code};
+}
+
+// Value or error code returned by the hot paths instead of throwing, in the
+// spirit of std::expected<T, ErrorCode>. Never allocates and never throws;
+// the value of a failed result must not be accessed. Exceptions remain for
+// setup and configuration failures.
+template <typename T>
+class [[nodiscard]] Result {
+public:
+    // Successful result holding a value
+    Result(const T& value) : m_ok(true) { new (&m_value) T(value); }
+    Result(T&& value) : m_ok(true) { new (&m_value) T(std::move(value)); }
+
+    // Failed result holding an error code
+    Result(ResultError error) noexcept : m_ok(false), m_error(error.code) {}
+
+    Result(const Result& other) : m_ok(other.m_ok) {
+        if (m_ok) {
+            new (&m_value) T(other.m_value);
+        } else {
+            m_error = other.m_error;
+        }
+    }
+
+    Result(Result&& other) noexcept(std::is_nothrow_move_constructible_v<T>) : m_ok(other.m_ok) {
+        if (m_ok) {
+            new (&m_value) T(std::move(other.m_value));
+        } else {
+            m_error = other.m_error;
+        }
+    }
+
+    Result& operator=(Result other) {
+        this->~Result();
+        new (this) Result(std::move(other));
+        return *this;
+    }
+
+    ~Result() {
+        if (m_ok) {
+            m_value.~T();
+        }
+    }
+
+    // Check if the result holds a value
+    bool ok() const noexcept { return m_ok; }
+    explicit operator bool() const noexcept { return m_ok; }
+
+    // Get the value; only valid if ok()
+    T& value() & noexcept { return m_value; }
+    const T& value() const & noexcept { return m_value; }
+    T&& value() && noexcept { return std::move(m_value); }
+
+    // Get the value, or a fallback if the result failed
+    T valueOr(T fallback) const { return m_ok ? m_value : fallback; }
+
+    // Get the error code; only valid if !ok()
+    ErrorCode error() const noexcept { return m_error; }
+
+private:
+    bool m_ok;
+    union {
+        T m_value;
+        ErrorCode m_error;
+    };
+};
+
+// Result of an operation without a value
+template <>
+class [[nodiscard]] Result<void> {
+public:
+    // Successful result
+    constexpr Result() noexcept : m_ok(true), m_error(ErrorCode::UNKNOWN_ERROR) {}
+
+    // Failed result holding an error code
+    constexpr Result(ResultError error) noexcept : m_ok(false), m_error(error.code) {}
+
+    // Check if the operation succeeded
+    constexpr bool ok() const noexcept { return m_ok; }
+    constexpr explicit operator bool() const noexcept { return m_ok; }
+
+    // Get the error code; only valid if !ok()
+    constexpr ErrorCode error() const noexcept { return m_error; }
+
+private:
+    bool m_ok;
+    ErrorCode m_error;
+};
+
+// Result of an operation without a value, e.g. a control command
+using Status = Result<void>;
+
+} // namespace ErrorLogging
@@ -0,0 +1,488 @@
+#include "FilterEngine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_ENGINE_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#define FILTER_ENGINE_HAVE_NEON 1
+#endif
+
+namespace {
+
+// Number of floats in one cache line
+constexpr size_t FLOATS_PER_CACHE_LINE = CACHE_LINE_SIZE / sizeof(float);
+
+// Number of state columns per filtered field
+constexpr size_t COLUMNS_PER_FIELD = (MAX_MEDIAN_WINDOW - 1) + MAX_AVERAGE_WINDOW + 1;
+
+// Input and output columns of the filtered fields, in FieldState order
+const ChannelField INPUT_FIELDS[] = {ChannelField::Voltage, ChannelField::Current};
+const ChannelField OUTPUT_FIELDS[] = {ChannelField::FilteredVoltage, ChannelField::FilteredCurrent};
+
+inline float median3(float a, float b, float c) {
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+inline float median5(float a, float b, float c, float d, float e) {
+    float low = std::max(std::min(a, b), std::min(c, d));
+    float high = std::min(std::max(a, b), std::max(c, d));
+    return median3(e, low, high);
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the FilterEngine class.
+ *
+ * Allocates every state column in one cache-line-aligned block and selects
+ * the kernel.
+ *
+ * @param channelCount The number of channels to keep filter state for.
+ * @param config The filter pipeline configuration.
+ */
+FilterEngine::FilterEngine(size_t channelCount, const FilterConfig& config) :
+    config(config),
+    channelCount(channelCount),
+    columnStride((channelCount + FLOATS_PER_CACHE_LINE - 1) / FLOATS_PER_CACHE_LINE * FLOATS_PER_CACHE_LINE),
+    stripeLocks(channelCount) {
+    // Clamp the configuration to what the kernels support
+    if (this->config.medianWindow != 3 && this->config.medianWindow != 5) {
+        this->config.medianWindow = 1;
+    }
+    this->config.averageWindow = std::clamp<uint32_t>(this->config.averageWindow, 1, MAX_AVERAGE_WINDOW);
+    if (!(this->config.emaAlpha > 0.0f && this->config.emaAlpha <= 1.0f)) {
+        this->config.emaAlpha = 1.0f;
+    }
+
+    kernelFunction = selectKernel(config.kernel, kernel);
+    this->config.kernel = kernel;
+
+    size_t bytes = FILTERED_FIELD_COUNT * COLUMNS_PER_FIELD * columnStride * sizeof(float);
+    stateStorage = static_cast<float*>(::operator new(bytes, std::align_val_t(CACHE_LINE_SIZE)));
+    std::memset(stateStorage, 0, bytes);
+
+    assignColumns(stateStorage);
+
+    lastSequences = new uint64_t[channelCount]();
+}
+
+/**
+ * @brief Destructor for the FilterEngine class.
+ */
+FilterEngine::~FilterEngine() {
+    if (ownsState) {
+        delete[] lastSequences;
+        ::operator delete(stateStorage, std::align_val_t(CACHE_LINE_SIZE));
+    }
+}
+
+/**
+ * @brief Points the history columns of every field into a block of state.
+ *
+ * @param storage The block, FILTERED_FIELD_COUNT * COLUMNS_PER_FIELD columns.
+ */
+void FilterEngine::assignColumns(float* storage) {
+    float* column = storage;
+    for (FieldState& state : fieldStates) {
+        for (float*& history : state.medianHistory) {
+            history = column;
+            column += columnStride;
+        }
+        for (float*& history : state.averageHistory) {
+            history = column;
+            column += columnStride;
+        }
+        state.ema = column;
+        column += columnStride;
+    }
+}
+
+/**
+ * @brief Gets the size of the filter state, for moveState().
+ *
+ * The layout does not depend on the configuration: the columns of the
+ * largest windows are always kept.
+ *
+ * @return The size in bytes.
+ */
+size_t FilterEngine::getStateSize() const {
+    return FILTERED_FIELD_COUNT * COLUMNS_PER_FIELD * columnStride * sizeof(float) + channelCount * sizeof(uint64_t);
+}
+
+/**
+ * @brief Moves the filter state into caller-owned memory, e.g. a checkpoint file.
+ *
+ * The state is the history columns followed by the last sequence filtered
+ * of each channel. Restored channels that had been seeded keep their
+ * history: the next sample continues the filters instead of seeding them
+ * again, as the sequences of a new data table start over.
+ *
+ * @param memory getStateSize() bytes, cache-line aligned, outliving the engine.
+ * @param restore True if memory holds the state of an earlier engine of the same size.
+ */
+void FilterEngine::moveState(void* memory, bool restore) {
+    size_t bytes = FILTERED_FIELD_COUNT * COLUMNS_PER_FIELD * columnStride * sizeof(float);
+    float* storage = static_cast<float*>(memory);
+    uint64_t* sequences = reinterpret_cast<uint64_t*>(static_cast<unsigned char*>(memory) + bytes);
+    if (restore) {
+        for (size_t channel = 0; channel < channelCount; ++channel) {
+            sequences[channel] = sequences[channel] != 0 ? RESTORED_SEQUENCE : 0;
+        }
+    } else {
+        std::memcpy(storage, stateStorage, bytes);
+        std::memcpy(sequences, lastSequences, channelCount * sizeof(uint64_t));
+    }
+
+    if (ownsState) {
+        delete[] lastSequences;
+        ::operator delete(stateStorage, std::align_val_t(CACHE_LINE_SIZE));
+        ownsState = false;
+    }
+    stateStorage = storage;
+    lastSequences = sequences;
+    assignColumns(stateStorage);
+}
+
+/**
+ * @brief Gets the name of a kernel.
+ *
+ * @param kernel The kernel.
+ * @return A short name such as "avx2".
+ */
+const char* FilterEngine::kernelName(FilterKernel kernel) {
+    switch (kernel) {
+        case FilterKernel::Auto:
+            return "auto";
+        case FilterKernel::Scalar:
+            return "scalar";
+        case FilterKernel::Avx2:
+            return "avx2";
+        case FilterKernel::Neon:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Picks the kernel to run, falling back to scalar if the CPU lacks support.
+ *
+ * @param requested The requested kernel, or Auto for the best available one.
+ * @param selected Receives the kernel actually selected.
+ * @return The kernel function.
+ */
+FilterEngine::KernelFunction FilterEngine::selectKernel(FilterKernel requested, FilterKernel& selected) {
+    bool avx2 = false;
+    bool neon = false;
+
+#if defined(FILTER_ENGINE_HAVE_AVX2)
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+#if defined(FILTER_ENGINE_HAVE_NEON)
+#if defined(__linux__)
+    neon = (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#else
+    neon = true; // Advanced SIMD is mandatory on AArch64
+#endif
+#endif
+
+    if ((requested == FilterKernel::Auto || requested == FilterKernel::Avx2) && avx2) {
+        selected = FilterKernel::Avx2;
+        return &FilterEngine::runAvx2;
+    }
+    if ((requested == FilterKernel::Auto || requested == FilterKernel::Neon) && neon) {
+        selected = FilterKernel::Neon;
+        return &FilterEngine::runNeon;
+    }
+    selected = FilterKernel::Scalar;
+    return &FilterEngine::runScalar;
+}
+
+/**
+ * @brief Filters the new samples of a block.
+ *
+ * Runs the kernel over each run of consecutive channels that have a new
+ * sample, once per filtered field.
+ *
+ * @param block The block to filter, as read from the data table.
+ * @return The number of channels that had a new sample.
+ */
+uint32_t FilterEngine::process(ChannelBlock& block) {
+    stripeLocks.lock(block.firstChannel, block.channelCount);
+
+    uint32_t updated = 0;
+    uint32_t runStart = 0;
+    for (uint32_t offset = 0; offset <= block.channelCount; ++offset) {
+        bool isNew = false;
+        if (offset < block.channelCount) {
+            size_t channel = block.firstChannel + offset;
+            uint64_t sequence = block.sequences[offset];
+            isNew = sequence != 0 && sequence != lastSequences[channel];
+            if (isNew) {
+                if (lastSequences[channel] == 0) {
+                    float inputs[FILTERED_FIELD_COUNT];
+                    for (size_t f = 0; f < FILTERED_FIELD_COUNT; ++f) {
+                        inputs[f] = block.column(INPUT_FIELDS[f])[offset];
+                    }
+                    seedChannel(channel, inputs);
+                }
+                lastSequences[channel] = sequence;
+                ++updated;
+                continue;
+            }
+        }
+
+        // End of a run of new samples
+        if (offset > runStart) {
+            for (size_t f = 0; f < FILTERED_FIELD_COUNT; ++f) {
+                kernelFunction(config, fieldStates[f],
+                    block.column(INPUT_FIELDS[f]) + runStart,
+                    block.column(OUTPUT_FIELDS[f]) + runStart,
+                    block.firstChannel + runStart, offset - runStart);
+            }
+        }
+        runStart = offset + 1;
+    }
+
+    stripeLocks.unlock(block.firstChannel, block.channelCount);
+    return updated;
+}
+
+/**
+ * @brief Seeds the whole history of a channel with its first sample.
+ *
+ * Makes the filters start from the first measurement rather than from zero.
+ *
+ * @param channel The channel number.
+ * @param inputs The first value of every filtered field.
+ */
+void FilterEngine::seedChannel(size_t channel, const float* inputs) {
+    for (size_t f = 0; f < FILTERED_FIELD_COUNT; ++f) {
+        FieldState& state = fieldStates[f];
+        for (float* history : state.medianHistory) {
+            history[channel] = inputs[f];
+        }
+        for (float* history : state.averageHistory) {
+            history[channel] = inputs[f];
+        }
+        state.ema[channel] = inputs[f];
+    }
+}
+
+/**
+ * @brief Scalar reference kernel.
+ *
+ * The vector kernels perform exactly the same operations in the same order.
+ *
+ * @param config The filter pipeline configuration.
+ * @param state The filter state of the field.
+ * @param input The new values, one per channel.
+ * @param output Receives the filtered values.
+ * @param firstChannel The channel of input[0].
+ * @param count The number of channels.
+ */
+void FilterEngine::runScalar(const FilterConfig& config, FieldState& state,
+    const float* input, float* output, size_t firstChannel, size_t count) {
+    const float inverseWindow = 1.0f / static_cast<float>(config.averageWindow);
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t channel = firstChannel + i;
+        float x = input[i];
+
+        // Median-of-N spike rejection
+        float median = x;
+        if (config.medianWindow == 3) {
+            float h0 = state.medianHistory[0][channel];
+            float h1 = state.medianHistory[1][channel];
+            median = median3(x, h0, h1);
+            state.medianHistory[1][channel] = h0;
+            state.medianHistory[0][channel] = x;
+        } else if (config.medianWindow == 5) {
+            float h0 = state.medianHistory[0][channel];
+            float h1 = state.medianHistory[1][channel];
+            float h2 = state.medianHistory[2][channel];
+            float h3 = state.medianHistory[3][channel];
+            median = median5(x, h0, h1, h2, h3);
+            state.medianHistory[3][channel] = h2;
+            state.medianHistory[2][channel] = h1;
+            state.medianHistory[1][channel] = h0;
+            state.medianHistory[0][channel] = x;
+        }
+
+        // Moving average over a shift register
+        float sum = median;
+        for (size_t k = config.averageWindow - 1; k > 0; --k) {
+            float previous = state.averageHistory[k - 1][channel];
+            state.averageHistory[k][channel] = previous;
+            sum += previous;
+        }
+        state.averageHistory[0][channel] = median;
+        float average = sum * inverseWindow;
+
+        // Exponential filter
+        float ema = state.ema[channel];
+        ema = ema + config.emaAlpha * (average - ema);
+        state.ema[channel] = ema;
+
+        output[i] = ema;
+    }
+}
+
+#if defined(FILTER_ENGINE_HAVE_AVX2)
+
+/**
+ * @brief AVX2 kernel, 8 channels per instruction.
+ *
+ * @param config The filter pipeline configuration.
+ * @param state The filter state of the field.
+ * @param input The new values, one per channel.
+ * @param output Receives the filtered values.
+ * @param firstChannel The channel of input[0].
+ * @param count The number of channels.
+ */
+__attribute__((target("avx2")))
+void FilterEngine::runAvx2(const FilterConfig& config, FieldState& state,
+    const float* input, float* output, size_t firstChannel, size_t count) {
+    const __m256 inverseWindow = _mm256_set1_ps(1.0f / static_cast<float>(config.averageWindow));
+    const __m256 alpha = _mm256_set1_ps(config.emaAlpha);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        size_t channel = firstChannel + i;
+        __m256 x = _mm256_loadu_ps(input + i);
+
+        __m256 median = x;
+        if (config.medianWindow == 3) {
+            __m256 h0 = _mm256_loadu_ps(state.medianHistory[0] + channel);
+            __m256 h1 = _mm256_loadu_ps(state.medianHistory[1] + channel);
+            median = _mm256_max_ps(_mm256_min_ps(x, h0), _mm256_min_ps(_mm256_max_ps(x, h0), h1));
+            _mm256_storeu_ps(state.medianHistory[1] + channel, h0);
+            _mm256_storeu_ps(state.medianHistory[0] + channel, x);
+        } else if (config.medianWindow == 5) {
+            __m256 h0 = _mm256_loadu_ps(state.medianHistory[0] + channel);
+            __m256 h1 = _mm256_loadu_ps(state.medianHistory[1] + channel);
+            __m256 h2 = _mm256_loadu_ps(state.medianHistory[2] + channel);
+            __m256 h3 = _mm256_loadu_ps(state.medianHistory[3] + channel);
+            __m256 low = _mm256_max_ps(_mm256_min_ps(x, h0), _mm256_min_ps(h1, h2));
+            __m256 high = _mm256_min_ps(_mm256_max_ps(x, h0), _mm256_max_ps(h1, h2));
+            median = _mm256_max_ps(_mm256_min_ps(h3, low), _mm256_min_ps(_mm256_max_ps(h3, low), high));
+            _mm256_storeu_ps(state.medianHistory[3] + channel, h2);
+            _mm256_storeu_ps(state.medianHistory[2] + channel, h1);
+            _mm256_storeu_ps(state.medianHistory[1] + channel, h0);
+            _mm256_storeu_ps(state.medianHistory[0] + channel, x);
+        }
+
+        __m256 sum = median;
+        for (size_t k = config.averageWindow - 1; k > 0; --k) {
+            __m256 previous = _mm256_loadu_ps(state.averageHistory[k - 1] + channel);
+            _mm256_storeu_ps(state.averageHistory[k] + channel, previous);
+            sum = _mm256_add_ps(sum, previous);
+        }
+        _mm256_storeu_ps(state.averageHistory[0] + channel, median);
+        __m256 average = _mm256_mul_ps(sum, inverseWindow);
+
+        __m256 ema = _mm256_loadu_ps(state.ema + channel);
+        ema = _mm256_add_ps(ema, _mm256_mul_ps(alpha, _mm256_sub_ps(average, ema)));
+        _mm256_storeu_ps(state.ema + channel, ema);
+
+        _mm256_storeu_ps(output + i, ema);
+    }
+
+    // Remaining channels
+    runScalar(config, state, input + i, output + i, firstChannel + i, count - i);
+}
+
+#else
+
+void FilterEngine::runAvx2(const FilterConfig& config, FieldState& state,
+    const float* input, float* output, size_t firstChannel, size_t count) {
+    runScalar(config, state, input, output, firstChannel, count);
+}
+
+#endif
+
+#if defined(FILTER_ENGINE_HAVE_NEON)
+
+/**
+ * @brief NEON kernel, 4 channels per instruction.
+ *
+ * @param config The filter pipeline configuration.
+ * @param state The filter state of the field.
+ * @param input The new values, one per channel.
+ * @param output Receives the filtered values.
+ * @param firstChannel The channel of input[0].
+ * @param count The number of channels.
+ */
+void FilterEngine::runNeon(const FilterConfig& config, FieldState& state,
+    const float* input, float* output, size_t firstChannel, size_t count) {
+    const float32x4_t inverseWindow = vdupq_n_f32(1.0f / static_cast<float>(config.averageWindow));
+    const float32x4_t alpha = vdupq_n_f32(config.emaAlpha);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        size_t channel = firstChannel + i;
+        float32x4_t x = vld1q_f32(input + i);
+
+        float32x4_t median = x;
+        if (config.medianWindow == 3) {
+            float32x4_t h0 = vld1q_f32(state.medianHistory[0] + channel);
+            float32x4_t h1 = vld1q_f32(state.medianHistory[1] + channel);
+            median = vmaxq_f32(vminq_f32(x, h0), vminq_f32(vmaxq_f32(x, h0), h1));
+            vst1q_f32(state.medianHistory[1] + channel, h0);
+            vst1q_f32(state.medianHistory[0] + channel, x);
+        } else if (config.medianWindow == 5) {
+            float32x4_t h0 = vld1q_f32(state.medianHistory[0] + channel);
+            float32x4_t h1 = vld1q_f32(state.medianHistory[1] + channel);
+            float32x4_t h2 = vld1q_f32(state.medianHistory[2] + channel);
+            float32x4_t h3 = vld1q_f32(state.medianHistory[3] + channel);
+            float32x4_t low = vmaxq_f32(vminq_f32(x, h0), vminq_f32(h1, h2));
+            float32x4_t high = vminq_f32(vmaxq_f32(x, h0), vmaxq_f32(h1, h2));
+            median = vmaxq_f32(vminq_f32(h3, low), vminq_f32(vmaxq_f32(h3, low), high));
+            vst1q_f32(state.medianHistory[3] + channel, h2);
+            vst1q_f32(state.medianHistory[2] + channel, h1);
+            vst1q_f32(state.medianHistory[1] + channel, h0);
+            vst1q_f32(state.medianHistory[0] + channel, x);
+        }
+
+        float32x4_t sum = median;
+        for (size_t k = config.averageWindow - 1; k > 0; --k) {
+            float32x4_t previous = vld1q_f32(state.averageHistory[k - 1] + channel);
+            vst1q_f32(state.averageHistory[k] + channel, previous);
+            sum = vaddq_f32(sum, previous);
+        }
+        vst1q_f32(state.averageHistory[0] + channel, median);
+        float32x4_t average = vmulq_f32(sum, inverseWindow);
+
+        // Separate multiply and add (no vfma) to match the scalar reference
+        float32x4_t ema = vld1q_f32(state.ema + channel);
+        ema = vaddq_f32(ema, vmulq_f32(alpha, vsubq_f32(average, ema)));
+        vst1q_f32(state.ema + channel, ema);
+
+        vst1q_f32(output + i, ema);
+    }
+
+    // Remaining channels
+    runScalar(config, state, input + i, output + i, firstChannel + i, count - i);
+}
+
+#else
+
+void FilterEngine::runNeon(const FilterConfig& config, FieldState& state,
+    const float* input, float* output, size_t firstChannel, size_t count) {
+    runScalar(config, state, input, output, firstChannel, count);
+}
+
+#endif
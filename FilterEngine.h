@@ -0,0 +1,167 @@
+#ifndef FILTERENGINE_H
+#define FILTERENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ChannelDataTable.h"
+#include "Platform.h"
+#include "StripeLocks.h"
+
+// Largest supported median window (spike rejection)
+#define MAX_MEDIAN_WINDOW 5
+
+// Largest supported moving-average window
+#define MAX_AVERAGE_WINDOW 16
+
+/**
+ * @brief Implementation used to run the filter kernel.
+ */
+enum class FilterKernel {
+    Auto,   // Best kernel supported by the CPU at runtime
+    Scalar, // Portable reference implementation
+    Avx2,   // x86 AVX2, 8 channels per instruction
+    Neon    // ARM NEON, 4 channels per instruction
+};
+
+/**
+ * @brief Configuration of the filter pipeline, shared by all channels.
+ *
+ * Every new voltage and current sample goes through median-of-N spike
+ * rejection, then a moving average, then an exponential filter. A window
+ * of 1 or an alpha of 1 disables the corresponding stage.
+ */
+struct FilterConfig {
+    uint32_t medianWindow = 3;   // 1, 3 or 5
+    uint32_t averageWindow = 8;  // 1 to MAX_AVERAGE_WINDOW
+    float emaAlpha = 0.5f;       // (0, 1]
+    FilterKernel kernel = FilterKernel::Auto;
+};
+
+/**
+ * @brief Vectorized filtering of voltage and current across all channels.
+ *
+ * Filter state lives in the engine, not in the tasks: one cache-line-aligned
+ * column per history slot, indexed by channel like the ChannelDataTable, so a
+ * kernel processes 4 (NEON) or 8 (AVX2) channels per instruction. The kernel
+ * is chosen once at construction; the scalar kernel is the reference and all
+ * kernels produce identical results.
+ *
+ * Tasks for overlapping channel ranges may run concurrently; the engine
+ * serializes them on StripeLocks.
+ */
+class FilterEngine {
+public:
+    /**
+     * @brief Constructor for the FilterEngine class.
+     *
+     * @param channelCount The number of channels to keep filter state for.
+     * @param config The filter pipeline configuration.
+     */
+    FilterEngine(size_t channelCount, const FilterConfig& config = FilterConfig());
+
+    /**
+     * @brief Destructor for the FilterEngine class.
+     */
+    ~FilterEngine();
+
+    FilterEngine(const FilterEngine&) = delete;
+    FilterEngine& operator=(const FilterEngine&) = delete;
+
+    /**
+     * @brief Filters the new samples of a block.
+     *
+     * Channels whose sequence number did not advance since they were last
+     * filtered are left untouched. For the others, FilteredVoltage and
+     * FilteredCurrent are written into the block's columns.
+     *
+     * @param block The block to filter, as read from the data table.
+     * @return The number of channels that had a new sample.
+     */
+    uint32_t process(ChannelBlock& block);
+
+    /**
+     * @brief Gets the kernel selected at construction.
+     *
+     * @return The kernel in use, never FilterKernel::Auto.
+     */
+    FilterKernel getKernel() const { return kernel; }
+
+    /**
+     * @brief Gets the filter pipeline configuration.
+     *
+     * @return The configuration, with windows clamped to the supported range.
+     */
+    const FilterConfig& getConfig() const { return config; }
+
+    /**
+     * @brief Gets the name of a kernel, for logs and benchmarks.
+     *
+     * @param kernel The kernel.
+     * @return A short name such as "avx2".
+     */
+    static const char* kernelName(FilterKernel kernel);
+
+    /**
+     * @brief Gets the size of the filter state, for moveState().
+     *
+     * @return The size in bytes.
+     */
+    size_t getStateSize() const;
+
+    /**
+     * @brief Moves the filter state into caller-owned memory, e.g. a checkpoint file.
+     * Must be called before the first process().
+     *
+     * @param memory getStateSize() bytes, cache-line aligned, outliving the engine.
+     * @param restore True if memory holds the state of an earlier engine of the same size.
+     */
+    void moveState(void* memory, bool restore);
+
+private:
+    /**
+     * @brief Filter state of one input field, one column per history slot.
+     */
+    struct FieldState {
+        float* medianHistory[MAX_MEDIAN_WINDOW - 1];
+        float* averageHistory[MAX_AVERAGE_WINDOW];
+        float* ema;
+    };
+
+    // Signature shared by the scalar, AVX2 and NEON kernels
+    using KernelFunction = void (*)(const FilterConfig& config, FieldState& state,
+        const float* input, float* output, size_t firstChannel, size_t count);
+
+    // Number of input fields filtered (voltage and current)
+    static constexpr size_t FILTERED_FIELD_COUNT = 2;
+
+    static KernelFunction selectKernel(FilterKernel requested, FilterKernel& selected);
+    static void runScalar(const FilterConfig& config, FieldState& state,
+        const float* input, float* output, size_t firstChannel, size_t count);
+    static void runAvx2(const FilterConfig& config, FieldState& state,
+        const float* input, float* output, size_t firstChannel, size_t count);
+    static void runNeon(const FilterConfig& config, FieldState& state,
+        const float* input, float* output, size_t firstChannel, size_t count);
+
+    // Seeds the whole history of a channel with its first sample
+    void seedChannel(size_t channel, const float* inputs);
+
+    // Points the history columns of every field into a block of state
+    void assignColumns(float* storage);
+
+    // Last sequence of a channel whose state was restored: any new sample is filtered without seeding
+    static constexpr uint64_t RESTORED_SEQUENCE = ~0ULL;
+
+    FilterConfig config;
+    FilterKernel kernel;
+    KernelFunction kernelFunction;
+    size_t channelCount;
+    size_t columnStride;
+    float* stateStorage;
+    FieldState fieldStates[FILTERED_FIELD_COUNT];
+    uint64_t* lastSequences;
+    bool ownsState = true;      // False once moveState() placed the state in caller memory
+    StripeLocks stripeLocks;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "FittingEngine.h"
+
+#include <algorithm>
+
+/**
+ * @brief Constructor for the FittingEngine class.
+ *
+ * Allocates the running sums and the sample windows of every channel.
+ *
+ * @param channelCount The number of channels to keep fitting state for.
+ * @param config The fitting configuration.
+ */
+FittingEngine::FittingEngine(size_t channelCount, const FittingConfig& config) :
+    config(config),
+    channelCount(channelCount),
+    stripeLocks(channelCount) {
+    this->config.windowSize = std::clamp<uint32_t>(this->config.windowSize, 2, MAX_FIT_WINDOW);
+
+    fits = new ChannelFit[channelCount];
+    points = new Point[channelCount * this->config.windowSize];
+    lastSequences = new uint64_t[channelCount]();
+}
+
+/**
+ * @brief Destructor for the FittingEngine class.
+ */
+FittingEngine::~FittingEngine() {
+    if (ownsState) {
+        delete[] lastSequences;
+        delete[] points;
+        delete[] fits;
+    }
+}
+
+/**
+ * @brief Gets the size of the fitting state, for moveState().
+ *
+ * @return The size in bytes.
+ */
+size_t FittingEngine::getStateSize() const {
+    return channelCount * (sizeof(ChannelFit) + config.windowSize * sizeof(Point) + sizeof(uint64_t));
+}
+
+/**
+ * @brief Moves the fitting state into caller-owned memory, e.g. a checkpoint file.
+ *
+ * The state is the running sums, then the windows, then the last sequence
+ * of each channel. A restored window continues with the next sample, or
+ * restarts if the M4 time or the step time went back.
+ *
+ * @param memory getStateSize() bytes, cache-line aligned, outliving the engine.
+ * @param restore True if memory holds the state of an earlier engine with the same window.
+ */
+void FittingEngine::moveState(void* memory, bool restore) {
+    unsigned char* bytes = static_cast<unsigned char*>(memory);
+    ChannelFit* movedFits = reinterpret_cast<ChannelFit*>(bytes);
+    Point* movedPoints = reinterpret_cast<Point*>(bytes + channelCount * sizeof(ChannelFit));
+    uint64_t* sequences = reinterpret_cast<uint64_t*>(bytes +
+        channelCount * (sizeof(ChannelFit) + config.windowSize * sizeof(Point)));
+    if (restore) {
+        for (size_t channel = 0; channel < channelCount; ++channel) {
+            sequences[channel] = sequences[channel] != 0 ? RESTORED_SEQUENCE : 0;
+        }
+    } else {
+        std::copy(fits, fits + channelCount, movedFits);
+        std::copy(points, points + channelCount * config.windowSize, movedPoints);
+        std::copy(lastSequences, lastSequences + channelCount, sequences);
+    }
+
+    if (ownsState) {
+        delete[] lastSequences;
+        delete[] points;
+        delete[] fits;
+        ownsState = false;
+    }
+    fits = movedFits;
+    points = movedPoints;
+    lastSequences = sequences;
+}
+
+/**
+ * @brief Updates the fit with the new samples of a block.
+ *
+ * @param block The block to fit, as read from the data table.
+ * @return The number of channels that had a new sample.
+ */
+uint32_t FittingEngine::process(ChannelBlock& block) {
+    const float* stepTime = block.column(ChannelField::StepTime);
+    const float* voltage = block.column(ChannelField::Voltage);
+    const float* current = block.column(ChannelField::Current);
+    float* dvdt = block.column(ChannelField::DvDt);
+    float* didt = block.column(ChannelField::DiDt);
+    float* fittedVoltage = block.column(ChannelField::FittedVoltage);
+
+    stripeLocks.lock(block.firstChannel, block.channelCount);
+
+    uint32_t updated = 0;
+    for (uint32_t offset = 0; offset < block.channelCount; ++offset) {
+        size_t channel = block.firstChannel + offset;
+        uint64_t sequence = block.sequences[offset];
+        if (sequence == 0 || sequence == lastSequences[channel]) {
+            continue;
+        }
+        lastSequences[channel] = sequence;
+        ++updated;
+
+        uint64_t sampleTime = block.sampleTimes[offset];
+        double t = sampleTime != 0 ? static_cast<double>(sampleTime) * 1e-6 : stepTime[offset];
+        update(channel, t, stepTime[offset], voltage[offset], current[offset]);
+
+        // Least-squares slopes and fitted value from the running sums
+        const ChannelFit& fit = fits[channel];
+        double n = fit.count;
+        double denominator = n * fit.sumTT - fit.sumT * fit.sumT;
+        if (fit.count < 2 || denominator <= 0.0) {
+            dvdt[offset] = 0.0f;
+            didt[offset] = 0.0f;
+            fittedVoltage[offset] = voltage[offset];
+            continue;
+        }
+        double slopeV = (n * fit.sumTV - fit.sumT * fit.sumV) / denominator;
+        double slopeI = (n * fit.sumTI - fit.sumT * fit.sumI) / denominator;
+        double latest = t - fit.origin;
+
+        dvdt[offset] = static_cast<float>(slopeV);
+        didt[offset] = static_cast<float>(slopeI);
+        fittedVoltage[offset] = static_cast<float>((fit.sumV + slopeV * (n * latest - fit.sumT)) / n);
+    }
+
+    stripeLocks.unlock(block.firstChannel, block.channelCount);
+    return updated;
+}
+
+/**
+ * @brief Adds a sample to a channel's window in O(1).
+ *
+ * Evicts the oldest sample if the window is full, then adds the new one.
+ * Restarts the window if the time did not advance or the step time went back.
+ *
+ * @param channel The channel number.
+ * @param time The time of the sample in seconds.
+ * @param stepTime The step time of the sample.
+ * @param voltage The measured voltage.
+ * @param current The measured current.
+ */
+void FittingEngine::update(size_t channel, double time, float stepTime, float voltage, float current) {
+    const uint32_t window = config.windowSize;
+    ChannelFit& fit = fits[channel];
+    Point* ring = points + channel * window;
+
+    const Point& latest = ring[(fit.head + fit.count - 1) % window];
+    if (fit.count > 0 && (time <= latest.time || stepTime < latest.stepTime)) {
+        // New step (or a repeated sample): the previous window no longer applies
+        fit = ChannelFit();
+    }
+    if (fit.count == 0) {
+        fit.origin = time;
+        fit.head = 0;
+    }
+
+    if (fit.count == window) {
+        const Point& oldest = ring[fit.head];
+        double dt = oldest.time - fit.origin;
+        fit.sumT -= dt;
+        fit.sumTT -= dt * dt;
+        fit.sumV -= oldest.voltage;
+        fit.sumTV -= dt * oldest.voltage;
+        fit.sumI -= oldest.current;
+        fit.sumTI -= dt * oldest.current;
+        fit.head = (fit.head + 1) % window;
+        fit.count--;
+
+        // Once per pass over the ring, move the origin to the oldest sample
+        if (fit.head == 0) {
+            rebase(fit, ring[fit.head].time);
+        }
+    }
+
+    Point& slot = ring[(fit.head + fit.count) % window];
+    slot.time = time;
+    slot.stepTime = stepTime;
+    slot.voltage = voltage;
+    slot.current = current;
+
+    double dt = time - fit.origin;
+    fit.sumT += dt;
+    fit.sumTT += dt * dt;
+    fit.sumV += voltage;
+    fit.sumTV += dt * voltage;
+    fit.sumI += current;
+    fit.sumTI += dt * current;
+    fit.count++;
+}
+
+/**
+ * @brief Moves the time origin of a channel's sums in O(1).
+ *
+ * Shifting every time by d changes the sums algebraically, so the window
+ * does not need to be rescanned.
+ *
+ * @param fit The channel's running sums.
+ * @param origin The new time origin.
+ */
+void FittingEngine::rebase(ChannelFit& fit, double origin) {
+    double d = origin - fit.origin;
+    double n = fit.count;
+    fit.sumTT += n * d * d - 2.0 * d * fit.sumT;
+    fit.sumTV -= d * fit.sumV;
+    fit.sumTI -= d * fit.sumI;
+    fit.sumT -= n * d;
+    fit.origin = origin;
+}
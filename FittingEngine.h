@@ -0,0 +1,143 @@
+#ifndef FITTINGENGINE_H
+#define FITTINGENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ChannelDataTable.h"
+#include "StripeLocks.h"
+
+// Largest supported fitting window, in samples
+#define MAX_FIT_WINDOW 1024
+
+/**
+ * @brief Configuration of the streaming linear fit, shared by all channels.
+ */
+struct FittingConfig {
+    uint32_t windowSize = 32; // 2 to MAX_FIT_WINDOW samples
+};
+
+/**
+ * @brief Streaming sliding-window linear fit of voltage and current over time.
+ *
+ * Every channel keeps the running sums of an ordinary least-squares fit over
+ * its last windowSize samples. A new sample adds its terms, and the sample
+ * that falls out of the window subtracts its terms, so an update costs O(1)
+ * whatever the window and the window is never rescanned. Sums are kept in
+ * double relative to a time origin that is moved to the oldest sample of the
+ * window each time the ring wraps (also O(1)), so precision does not degrade
+ * as the step time grows.
+ *
+ * The fit runs on the 64-bit M4 time of each sample (ChannelBlock::sampleTimes),
+ * not on the float StepTime: past about 4.5 h a float step time no longer
+ * resolves 1 ms samples. Samples without an M4 time, e.g. from the legacy
+ * string-keyed path, fall back to StepTime.
+ *
+ * The slopes are written to DvDt and DiDt (per second) and the fitted
+ * voltage at the latest sample to FittedVoltage. A window restarts when the
+ * time does not advance or the step time goes back, as happens at the start
+ * of a new step.
+ *
+ * Tasks for overlapping channel ranges may run concurrently; the engine
+ * serializes them on StripeLocks.
+ */
+class FittingEngine {
+public:
+    /**
+     * @brief Constructor for the FittingEngine class.
+     *
+     * @param channelCount The number of channels to keep fitting state for.
+     * @param config The fitting configuration.
+     */
+    FittingEngine(size_t channelCount, const FittingConfig& config = FittingConfig());
+
+    /**
+     * @brief Destructor for the FittingEngine class.
+     */
+    ~FittingEngine();
+
+    FittingEngine(const FittingEngine&) = delete;
+    FittingEngine& operator=(const FittingEngine&) = delete;
+
+    /**
+     * @brief Updates the fit with the new samples of a block.
+     *
+     * Channels whose sequence number did not advance since they were last
+     * fitted are left untouched. For the others, DvDt, DiDt and FittedVoltage
+     * are written into the block's columns.
+     *
+     * @param block The block to fit, as read from the data table.
+     * @return The number of channels that had a new sample.
+     */
+    uint32_t process(ChannelBlock& block);
+
+    /**
+     * @brief Gets the fitting configuration.
+     *
+     * @return The configuration, with the window clamped to the supported range.
+     */
+    const FittingConfig& getConfig() const { return config; }
+
+    /**
+     * @brief Gets the size of the fitting state, for moveState().
+     *
+     * @return The size in bytes.
+     */
+    size_t getStateSize() const;
+
+    /**
+     * @brief Moves the fitting state into caller-owned memory, e.g. a checkpoint file.
+     * Must be called before the first process().
+     *
+     * @param memory getStateSize() bytes, cache-line aligned, outliving the engine.
+     * @param restore True if memory holds the state of an earlier engine with the same window.
+     */
+    void moveState(void* memory, bool restore);
+
+private:
+    /**
+     * @brief One sample kept in a channel's window.
+     */
+    struct Point {
+        double time;    // Seconds
+        float stepTime; // To tell a new step
+        float voltage;
+        float current;
+    };
+
+    /**
+     * @brief Running sums of one channel, on its own cache line.
+     *
+     * Times are relative to origin.
+     */
+    struct alignas(CACHE_LINE_SIZE) ChannelFit {
+        double origin = 0.0;
+        double sumT = 0.0;
+        double sumTT = 0.0;
+        double sumV = 0.0;
+        double sumTV = 0.0;
+        double sumI = 0.0;
+        double sumTI = 0.0;
+        uint32_t count = 0; // Samples in the window
+        uint32_t head = 0;  // Ring slot of the oldest sample
+    };
+
+    // Adds a sample to the window, evicting the oldest one if the window is full
+    void update(size_t channel, double time, float stepTime, float voltage, float current);
+
+    // Moves the time origin of a channel to a new value
+    static void rebase(ChannelFit& fit, double origin);
+
+    // Last sequence of a channel whose window was restored, so the next sample is always new
+    static constexpr uint64_t RESTORED_SEQUENCE = ~0ULL;
+
+    FittingConfig config;
+    size_t channelCount;
+    ChannelFit* fits;
+    Point* points; // windowSize points per channel
+    uint64_t* lastSequences;
+    bool ownsState = true;  // False once moveState() placed the state in caller memory
+    StripeLocks stripeLocks;
+};
+
+#endif
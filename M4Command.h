@@ -0,0 +1,131 @@
+#ifndef M4COMMAND_H
+#define M4COMMAND_H
+
+/*
+ * Binary layout of the control frames sent to the M4 core.
+ *
+ * Shared with the M4 firmware, so this header is plain C. All integers and
+ * floats are little-endian and every structure is packed.
+ *
+ *   M4CommandHeader
+ *   M4ChannelCommand for channel firstChannel + n, for every bit n set in
+ *   channelMask, in ascending order
+ *
+ * The M4 validates the whole frame first and then applies every command of
+ * the frame at the same control tick, so the channels of a frame change
+ * mode together. A frame is sent in a single RPMsg transaction, so it must
+ * fit an M4_RPMSG_BUFFER_SIZE buffer: a frame carries at most
+ * M4_COMMAND_CHANNELS_PER_FRAME commands. Commands for more channels are
+ * sent as consecutive frames, each starting at its own firstChannel, and
+ * the M4 applies each of them at the tick it arrives; only the channels of
+ * one frame are guaranteed to change mode together.
+ *
+ * Setpoint profiles are uploaded in profile frames:
+ *
+ *   M4ProfileHeader
+ *   pointCount M4ProfilePoint, points firstPoint to firstPoint + pointCount - 1
+ *
+ * A profile of up to M4_PROFILE_MAX_POINTS points is split into frames of
+ * at most M4_PROFILE_POINTS_PER_FRAME points, sent in order with the same
+ * profileId. When the frame holding the last point arrives, the M4 starts
+ * the profile on every channel of channelMask at the same control tick and
+ * restarts their step time. A frame missing from the sequence discards the
+ * profile, and the channels keep their mode.
+ *
+ * The M4 interpolates linearly between the points; two points with the same
+ * time make a step. After the last point of the last repetition the value of
+ * the last point is held and the channel reports M4_PROFILE_STATE_COMPLETED.
+ * A terminal voltage outside [minVoltage, maxVoltage] sets the channel to
+ * rest and reports M4_PROFILE_STATE_LIMIT. A command frame for a channel
+ * ends its profile.
+ */
+
+#include <stdint.h>
+
+/* "MC" in little-endian */
+#define M4_COMMAND_MAGIC 0x434D
+
+/* Version of the command frame layout */
+#define M4_COMMAND_VERSION 1
+
+/* Payload of one RPMsg buffer, the largest frame a single transaction carries */
+#define M4_RPMSG_BUFFER_SIZE 496
+
+/* Channels a command frame can address, one bit of channelMask each */
+#define M4_COMMAND_MAX_CHANNELS 64
+
+/* Commands of one command frame, so that a frame fits a 496-byte RPMsg buffer */
+#define M4_COMMAND_CHANNELS_PER_FRAME 59
+
+/* Control modes of M4ChannelCommand */
+#define M4_COMMAND_MODE_CC 1   /* setpoint is the current in A */
+#define M4_COMMAND_MODE_CV 2   /* setpoint is the voltage in V */
+#define M4_COMMAND_MODE_REST 3 /* open circuit, setpoint ignored */
+#define M4_COMMAND_MODE_OFF 4  /* output off, setpoint ignored */
+
+/* "MP" in little-endian */
+#define M4_PROFILE_MAGIC 0x504D
+
+/* Version of the profile frame layout */
+#define M4_PROFILE_VERSION 1
+
+/* Points a profile can hold in the M4 memory */
+#define M4_PROFILE_MAX_POINTS 8192
+
+/* Points of one profile frame, so that a frame fits a 496-byte RPMsg buffer */
+#define M4_PROFILE_POINTS_PER_FRAME 56
+
+/* Quantities of M4ProfileHeader.mode */
+#define M4_PROFILE_MODE_CURRENT 1 /* values are currents in A */
+#define M4_PROFILE_MODE_VOLTAGE 2 /* values are voltages in V */
+#define M4_PROFILE_MODE_POWER 3   /* values are powers in W */
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;        /* M4_COMMAND_MAGIC */
+    uint8_t version;       /* M4_COMMAND_VERSION */
+    uint8_t recordSize;    /* Size of one channel command in bytes */
+    uint16_t frameSize;    /* Size of the whole frame, header included */
+    uint16_t firstChannel; /* Channel of bit 0 of channelMask */
+    uint32_t sequence;     /* Incremented by one for every command frame sent */
+    uint64_t channelMask;  /* Bit n set if the frame carries a command for firstChannel + n */
+} M4CommandHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mode;          /* M4_COMMAND_MODE_* */
+    uint8_t reserved[3];
+    float setpoint;
+} M4ChannelCommand;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;        /* M4_PROFILE_MAGIC */
+    uint8_t version;       /* M4_PROFILE_VERSION */
+    uint8_t mode;          /* M4_PROFILE_MODE_* */
+    uint16_t frameSize;    /* Size of the whole frame, header included */
+    uint16_t firstChannel; /* Channel of bit 0 of channelMask */
+    uint32_t sequence;     /* Shared with the command frames */
+    uint64_t channelMask;  /* Bit n set if the profile runs on firstChannel + n */
+    uint32_t profileId;    /* Same in every frame of a profile */
+    uint32_t totalPoints;  /* Points of the whole profile */
+    uint32_t firstPoint;   /* Index of the first point of this frame */
+    uint32_t repeatCount;  /* Repetitions of the profile, 0 until the next command */
+    float minVoltage;      /* Voltage window, left only by ending the profile */
+    float maxVoltage;
+} M4ProfileHeader;
+
+typedef struct __attribute__((packed)) {
+    float time;            /* Seconds from the start of the repetition */
+    float value;           /* Setpoint in the unit of the mode */
+} M4ProfilePoint;
+
+#ifdef __cplusplus
+static_assert(sizeof(M4CommandHeader) == 20, "M4CommandHeader layout changed");
+static_assert(sizeof(M4ChannelCommand) == 8, "M4ChannelCommand layout changed");
+static_assert(sizeof(M4ProfileHeader) == 44, "M4ProfileHeader layout changed");
+static_assert(sizeof(M4ProfilePoint) == 8, "M4ProfilePoint layout changed");
+static_assert(sizeof(M4CommandHeader) + M4_COMMAND_CHANNELS_PER_FRAME * sizeof(M4ChannelCommand) <=
+    M4_RPMSG_BUFFER_SIZE, "A command frame must fit one RPMsg buffer");
+static_assert(sizeof(M4ProfileHeader) + M4_PROFILE_POINTS_PER_FRAME * sizeof(M4ProfilePoint) <=
+    M4_RPMSG_BUFFER_SIZE, "A profile frame must fit one RPMsg buffer");
+#endif
+
+#endif
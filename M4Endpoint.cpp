@@ -0,0 +1,235 @@
+#include "M4Endpoint.h"
+#include "ErrorEvents.h"
+#include "M4FrameParser.h"
+#include "Platform.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor for the RpmsgM4Endpoint class.
+ *
+ * Creates the wakeup eventfd and the epoll set, then tries to open the device.
+ *
+ * @param device The path of the RPMsg device, e.g. "/dev/ttyRPMSG0".
+ */
+RpmsgM4Endpoint::RpmsgM4Endpoint(const std::string& device) :
+    device(device),
+    deviceFd(-1),
+    pendingBytes(0),
+    pendingTime(0),
+    unavailableReported(false),
+    discardedBytes(0) {
+    pending = new uint8_t[M4_MAX_FRAME_SIZE * M4_MAX_BATCH_FRAMES];
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    openDevice();
+}
+
+/**
+ * @brief Destructor for the RpmsgM4Endpoint class.
+ */
+RpmsgM4Endpoint::~RpmsgM4Endpoint() {
+    closeDevice();
+    close(epollFd);
+    close(wakeFd);
+    delete[] pending;
+}
+
+/**
+ * @brief Opens the device and adds it to the epoll set.
+ *
+ * A tty device is switched to raw mode so that frames are passed through
+ * unchanged. A failure is reported to the ErrorEventRing once, until the
+ * device is open again.
+ *
+ * @return True if the device is open.
+ */
+bool RpmsgM4Endpoint::openDevice() {
+    int fd = ::open(device.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        if (!unavailableReported) {
+            ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+                "Cannot open M4 device", ERROR_EVENT_NO_CHANNEL, device.c_str(), errno);
+            unavailableReported = true;
+        }
+        return false;
+    }
+
+    if (isatty(fd)) {
+        termios attributes;
+        if (tcgetattr(fd, &attributes) == 0) {
+            cfmakeraw(&attributes);
+            tcsetattr(fd, TCSANOW, &attributes);
+        }
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        if (!unavailableReported) {
+            ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+                "Cannot poll M4 device", ERROR_EVENT_NO_CHANNEL, device.c_str(), errno);
+            unavailableReported = true;
+        }
+        close(fd);
+        return false;
+    }
+
+    deviceFd = fd;
+    pendingBytes = 0;
+    unavailableReported = false;
+    return true;
+}
+
+/**
+ * @brief Removes the device from the epoll set and closes it.
+ */
+void RpmsgM4Endpoint::closeDevice() {
+    if (deviceFd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, deviceFd, nullptr);
+        close(deviceFd);
+        deviceFd = -1;
+    }
+    pendingBytes = 0;
+}
+
+/**
+ * @brief Blocks until at least one frame is available, then drains the pending frames.
+ *
+ * Frames already buffered are returned without waiting. Otherwise waits on
+ * the device and the wakeup eventfd; while the device is closed, waits on
+ * the eventfd only and retries to open the device every M4_REOPEN_INTERVAL_MS.
+ *
+ * @param frames Receives the frames, each with its reception time.
+ * @param maxFrames The capacity of frames.
+ * @param timeoutMs The longest wait in milliseconds, -1 to wait for frames or wake() only.
+ * @return The number of frames received.
+ */
+size_t RpmsgM4Endpoint::waitForFrames(M4FrameBuffer* frames, size_t maxFrames, int timeoutMs) {
+    size_t count = drain(frames, maxFrames);
+    if (count > 0) {
+        return count;
+    }
+
+    epoll_event events[2];
+    if (deviceFd < 0 && (timeoutMs < 0 || timeoutMs > M4_REOPEN_INTERVAL_MS)) {
+        timeoutMs = M4_REOPEN_INTERVAL_MS;
+    }
+    int ready = epoll_wait(epollFd, events, 2, timeoutMs);
+    if (ready < 0) {
+        // Interrupted by a signal: let the caller check its stop condition
+        return 0;
+    }
+
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.fd == wakeFd) {
+            uint64_t value;
+            ssize_t ignored = read(wakeFd, &value, sizeof(value));
+            (void)ignored;
+        } else if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+            ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+                "M4 device hung up", ERROR_EVENT_NO_CHANNEL, device.c_str());
+            closeDevice();
+        }
+    }
+
+    if (deviceFd < 0) {
+        openDevice();
+        return 0;
+    }
+    return drain(frames, maxFrames);
+}
+
+/**
+ * @brief Interrupts a waitForFrames() call in progress, or the next one.
+ */
+void RpmsgM4Endpoint::wake() {
+    uint64_t value = 1;
+    ssize_t ignored = write(wakeFd, &value, sizeof(value));
+    (void)ignored;
+}
+
+/**
+ * @brief Reads everything the device has without blocking and cuts it into frames.
+ *
+ * Stops when the device has no more data or maxFrames frames were cut.
+ * Bytes of an incomplete frame stay buffered for the next call.
+ *
+ * @param frames Receives the frames.
+ * @param maxFrames The capacity of frames.
+ * @return The number of frames cut.
+ */
+size_t RpmsgM4Endpoint::drain(M4FrameBuffer* frames, size_t maxFrames) {
+    const size_t capacity = M4_MAX_FRAME_SIZE * M4_MAX_BATCH_FRAMES;
+    size_t count = 0;
+    size_t consumed = 0;
+
+    for (;;) {
+        // Deliver the complete frames that are buffered
+        while (count < maxFrames) {
+            size_t length = M4FrameParser::frameLength(pending + consumed, pendingBytes - consumed);
+            if (length == SIZE_MAX || length > M4_MAX_FRAME_SIZE) {
+                // Not a frame header: skip a byte and look again
+                ++consumed;
+                discardedBytes.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (length == 0 || pendingBytes - consumed < length) {
+                break;
+            }
+            M4FrameBuffer& frame = frames[count++];
+            std::memcpy(frame.data, pending + consumed, length);
+            frame.size = static_cast<uint32_t>(length);
+            frame.receiveTime = pendingTime;
+            consumed += length;
+        }
+        if (count == maxFrames || deviceFd < 0) {
+            break;
+        }
+
+        // Make room at the end of the buffer
+        if (consumed > 0) {
+            std::memmove(pending, pending + consumed, pendingBytes - consumed);
+            pendingBytes -= consumed;
+            consumed = 0;
+        }
+
+        ssize_t bytes = read(deviceFd, pending + pendingBytes, capacity - pendingBytes);
+        if (bytes > 0) {
+            pendingBytes += static_cast<size_t>(bytes);
+            pendingTime = monotonicNanoseconds();
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+            bytes == 0 ? "End of file on M4 device" : "Cannot read M4 device", ERROR_EVENT_NO_CHANNEL,
+            device.c_str(), bytes == 0 ? 0 : errno);
+        closeDevice();
+        return count;
+    }
+
+    std::memmove(pending, pending + consumed, pendingBytes - consumed);
+    pendingBytes -= consumed;
+    return count;
+}
@@ -0,0 +1,133 @@
+#ifndef M4ENDPOINT_H
+#define M4ENDPOINT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Largest frame an endpoint can deliver, in bytes
+#define M4_MAX_FRAME_SIZE 2048
+
+// Largest number of frames drained from an endpoint in one batch
+#define M4_MAX_BATCH_FRAMES 16
+
+// Delay between attempts to reopen a device that is missing or failed
+#define M4_REOPEN_INTERVAL_MS 1000
+
+/**
+ * @brief One frame received from the M4 core.
+ */
+struct M4FrameBuffer {
+    // Monotonic time in nanoseconds at which the host received the frame
+    uint64_t receiveTime = 0;
+    // Number of valid bytes in data
+    uint32_t size = 0;
+    alignas(8) uint8_t data[M4_MAX_FRAME_SIZE];
+};
+
+/**
+ * @brief Abstract source of frames from the M4 core.
+ *
+ * The ingest thread blocks in waitForFrames() until frames arrive, so it
+ * reacts to each frame as soon as it is received and does not wake up
+ * while the M4 core is idle, unless its timer wheel has a timer due. Any other thread can interrupt the wait with
+ * wake().
+ */
+class M4Endpoint {
+public:
+    /**
+     * @brief Virtual destructor for the M4Endpoint class.
+     */
+    virtual ~M4Endpoint() {}
+
+    /**
+     * @brief Blocks until at least one frame is available, then drains the pending frames.
+     *
+     * Returns early, possibly with no frames, when wake() is called or the timeout elapses.
+     *
+     * @param frames Receives the frames, each with its reception time.
+     * @param maxFrames The capacity of frames.
+     * @param timeoutMs The longest wait in milliseconds, -1 to wait for frames or wake() only.
+     * @return The number of frames received.
+     */
+    virtual size_t waitForFrames(M4FrameBuffer* frames, size_t maxFrames, int timeoutMs) = 0;
+
+    /**
+     * @brief Interrupts a waitForFrames() call in progress, or the next one.
+     *
+     * Safe to call from any thread.
+     */
+    virtual void wake() = 0;
+};
+
+/**
+ * @brief M4 endpoint reading M4Frame frames from an RPMsg device.
+ *
+ * Waits on the device and on an eventfd with epoll. The device is a byte
+ * stream (ttyRPMSG) or a message device (rpmsg char): either way the bytes
+ * are cut into frames using the frame size in each M4FrameHeader, and a
+ * frame is timestamped by the read that completed it. Bytes that do not
+ * start a valid header are discarded one at a time until the stream is back
+ * in sync. If the device is missing or fails, the endpoint keeps retrying to
+ * open it every M4_REOPEN_INTERVAL_MS while still honouring wake(). Its
+ * failures are reported to the ErrorEventRing, off the ingest thread.
+ */
+class RpmsgM4Endpoint : public M4Endpoint {
+public:
+    /**
+     * @brief Constructor for the RpmsgM4Endpoint class.
+     *
+     * @param device The path of the RPMsg device, e.g. "/dev/ttyRPMSG0".
+     */
+    explicit RpmsgM4Endpoint(const std::string& device);
+
+    /**
+     * @brief Destructor for the RpmsgM4Endpoint class.
+     */
+    ~RpmsgM4Endpoint() override;
+
+    RpmsgM4Endpoint(const RpmsgM4Endpoint&) = delete;
+    RpmsgM4Endpoint& operator=(const RpmsgM4Endpoint&) = delete;
+
+    size_t waitForFrames(M4FrameBuffer* frames, size_t maxFrames, int timeoutMs) override;
+    void wake() override;
+
+    /**
+     * @brief Checks if the device is currently open.
+     *
+     * @return True if frames can be received, false while retrying to open the device.
+     */
+    bool isOpen() const { return deviceFd >= 0; }
+
+    /**
+     * @brief Gets the number of bytes discarded to resynchronize on a frame header.
+     *
+     * @return The number of discarded bytes since construction.
+     */
+    uint64_t getDiscardedByteCount() const { return discardedBytes.load(std::memory_order_relaxed); }
+
+private:
+    // Opens the device and adds it to the epoll set
+    bool openDevice();
+
+    // Removes the device from the epoll set and closes it
+    void closeDevice();
+
+    // Reads everything the device has without blocking and cuts it into frames
+    size_t drain(M4FrameBuffer* frames, size_t maxFrames);
+
+    std::string device;
+    int deviceFd;
+    int wakeFd;
+    int epollFd;
+    // Bytes read but not yet delivered as a frame
+    uint8_t* pending;
+    size_t pendingBytes;
+    uint64_t pendingTime;
+    // Set once a failed open is reported, so a missing device is reported once until it is back
+    bool unavailableReported;
+    std::atomic<uint64_t> discardedBytes;
+};
+
+#endif
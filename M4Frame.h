@@ -0,0 +1,67 @@
+#ifndef M4FRAME_H
+#define M4FRAME_H
+
+/*
+ * Binary layout of the data frames sent by the M4 core.
+ *
+ * Shared with the M4 firmware, so this header is plain C. All integers and
+ * floats are little-endian and every structure is packed.
+ *
+ *   M4FrameHeader
+ *   M4ChannelRecord for channel firstChannel + n, for every bit n set in
+ *   channelMask, in ascending order
+ *
+ * Compatible additions append fields to M4ChannelRecord: the header carries
+ * the record size, and a receiver ignores the bytes it does not know about
+ * and zeroes the fields an older sender does not send. Incompatible changes
+ * increment M4_FRAME_VERSION.
+ */
+
+#include <stdint.h>
+
+/* "M4" in little-endian */
+#define M4_FRAME_MAGIC 0x344D
+
+/* Version of the frame layout */
+#define M4_FRAME_VERSION 1
+
+/* Channels a frame can carry, one bit of channelMask each */
+#define M4_FRAME_MAX_CHANNELS 64
+
+/* Values of M4ChannelRecord.profileState, ordered so that every state a profile
+ * can end in is below M4_PROFILE_STATE_RUNNING */
+#define M4_PROFILE_STATE_NONE 0      /* No profile since the last command */
+#define M4_PROFILE_STATE_COMPLETED 1 /* Last point reached, its value is held */
+#define M4_PROFILE_STATE_LIMIT 2     /* Voltage window left, channel set to rest */
+#define M4_PROFILE_STATE_RUNNING 3   /* Profile executing */
+
+/* Size of the records of the first layout, the smallest a receiver accepts */
+#define M4_CHANNEL_RECORD_MIN_SIZE 24
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;        /* M4_FRAME_MAGIC */
+    uint8_t version;       /* M4_FRAME_VERSION */
+    uint8_t recordSize;    /* Size of one channel record in bytes */
+    uint16_t frameSize;    /* Size of the whole frame, header included */
+    uint16_t firstChannel; /* Channel of bit 0 of channelMask */
+    uint32_t sequence;     /* Incremented by one for every frame sent, 0 for the first frame after a start */
+    uint64_t timestamp;    /* M4 time of the measurement, in microseconds */
+    uint64_t channelMask;  /* Bit n set if the frame carries a record for firstChannel + n */
+} M4FrameHeader;
+
+typedef struct __attribute__((packed)) {
+    float voltage;
+    float current;
+    float temperature;
+    float capacity;
+    float energy;
+    float stepTime;
+    float profileState;    /* M4_PROFILE_STATE_*, appended to the first layout */
+} M4ChannelRecord;
+
+#ifdef __cplusplus
+static_assert(sizeof(M4FrameHeader) == 28, "M4FrameHeader layout changed");
+static_assert(sizeof(M4ChannelRecord) == 28, "M4ChannelRecord layout changed");
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+#include "M4FrameParser.h"
+#include "ChannelService.h"
+#include "TelemetryRecorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(M4ChannelRecord) == CHANNEL_RAW_FIELD_COUNT * sizeof(float),
+    "M4ChannelRecord must hold the measured fields of ChannelField, in order");
+
+namespace {
+
+// Consecutive frames behind the last sequence number after which the M4 core is taken to have restarted
+constexpr uint32_t SEQUENCE_RESYNC_FRAMES = 16;
+
+} // namespace
+
+/**
+ * @brief Checks the header at the start of a buffer and gets the frame size.
+ *
+ * @param data The buffer.
+ * @param available The number of bytes in the buffer.
+ * @return The size of the frame, 0 if more bytes are needed to tell, or
+ *         SIZE_MAX if the buffer does not start with a frame header.
+ */
+size_t M4FrameParser::frameLength(const uint8_t* data, size_t available) {
+    if (available < sizeof(uint16_t)) {
+        return 0;
+    }
+    uint16_t magic;
+    std::memcpy(&magic, data, sizeof(magic));
+    if (magic != M4_FRAME_MAGIC) {
+        return SIZE_MAX;
+    }
+    if (available < sizeof(M4FrameHeader)) {
+        return 0;
+    }
+
+    M4FrameHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.frameSize < sizeof(M4FrameHeader)) {
+        return SIZE_MAX;
+    }
+    return header.frameSize;
+}
+
+/**
+ * @brief Decodes a frame and publishes its records to the data service.
+ *
+ * The header is validated first: magic, version, a record size holding at
+ * least the known fields, and a frame size matching the number of records.
+ * Records of channels outside the endpoint or the data table are skipped.
+ * Published samples are also queued to the recorder, if one is set.
+ *
+ * @param data The frame, starting with an M4FrameHeader.
+ * @param size The number of bytes in the frame.
+ * @param receiveTime Monotonic time in nanoseconds at which the frame was received.
+ * @param dataService The data service that receives the channel samples.
+ * @param updatedMask Receives the channels that were published, bit n for local channel n.
+ * @return True if the frame was valid and published, false if it was rejected.
+ */
+bool M4FrameParser::parse(const uint8_t* data, size_t size, uint64_t receiveTime,
+    ChannelDataService& dataService, uint64_t& updatedMask) {
+    updatedMask = 0;
+
+    M4FrameHeader header;
+    if (size < sizeof(header)) {
+        framesRejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+
+    size_t recordCount = static_cast<size_t>(__builtin_popcountll(header.channelMask));
+    if (header.magic != M4_FRAME_MAGIC || header.version != M4_FRAME_VERSION ||
+        header.recordSize < M4_CHANNEL_RECORD_MIN_SIZE || header.frameSize != size ||
+        size != sizeof(header) + recordCount * header.recordSize) {
+        framesRejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Sequence numbers: count a gap as dropped frames, reject a frame that
+    // repeats or goes back, which is stale. Sequence 0 is the first frame of
+    // a started M4 core and restarts the count. So does a run of frames that
+    // follow each other behind the last sequence, for a restart whose frame
+    // 0 was lost.
+    if (hasSequence && header.sequence != 0) {
+        int32_t distance = static_cast<int32_t>(header.sequence - lastSequence);
+        if (distance <= 0) {
+            staleRun = staleRun != 0 && header.sequence == staleSequence + 1 ? staleRun + 1 : 1;
+            staleSequence = header.sequence;
+            if (staleRun < SEQUENCE_RESYNC_FRAMES) {
+                framesOutOfOrder.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } else {
+            framesDropped.fetch_add(static_cast<uint64_t>(distance - 1), std::memory_order_relaxed);
+        }
+    }
+    hasSequence = true;
+    lastSequence = header.sequence;
+    staleRun = 0;
+
+    // Copy each record from the buffer into a sample and publish it
+    const ChannelDataTable& table = dataService.getDataTable();
+    const uint8_t* record = data + sizeof(header);
+    // Fields missing from the records of an older M4 stay zero
+    ChannelSample sample;
+    size_t recordBytes = std::min<size_t>(header.recordSize, sizeof(M4ChannelRecord));
+    uint64_t mask = header.channelMask;
+    while (mask != 0) {
+        uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(mask));
+        mask &= mask - 1;
+
+        uint32_t local = header.firstChannel + bit;
+        uint32_t channel = firstChannel + local;
+        if (local < channelCount && table.contains(channel)) {
+            std::memcpy(sample.values, record, recordBytes);
+            if (dataService.receiveM4Data(channel, sample, receiveTime, header.timestamp)) {
+                if (recorder) {
+                    recorder->record(recorderSource, channel, header.timestamp, receiveTime, sample);
+                }
+                updatedMask |= 1ULL << local;
+            }
+        }
+        record += header.recordSize;
+    }
+
+    framesParsed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Sets the recorder that receives every published sample.
+ *
+ * @param newRecorder The recorder, nullptr to record nothing.
+ * @param source The recorder source of the thread calling parse().
+ */
+void M4FrameParser::setRecorder(TelemetryRecorder* newRecorder, size_t source) {
+    recorder = newRecorder;
+    recorderSource = source;
+}
+
+/**
+ * @brief Gets the counters kept by the parser.
+ *
+ * @return A copy of the counters.
+ */
+M4FrameStatistics M4FrameParser::getStatistics() const {
+    M4FrameStatistics statistics;
+    statistics.framesParsed = framesParsed.load(std::memory_order_relaxed);
+    statistics.framesDropped = framesDropped.load(std::memory_order_relaxed);
+    statistics.framesRejected = framesRejected.load(std::memory_order_relaxed);
+    statistics.framesOutOfOrder = framesOutOfOrder.load(std::memory_order_relaxed);
+    return statistics;
+}
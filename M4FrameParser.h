@@ -0,0 +1,105 @@
+#ifndef M4FRAMEPARSER_H
+#define M4FRAMEPARSER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "M4Frame.h"
+
+class ChannelDataService;
+class TelemetryRecorder;
+
+/**
+ * @brief Counters kept by the M4FrameParser.
+ */
+struct M4FrameStatistics {
+    uint64_t framesParsed = 0;      // Frames published to the data table
+    uint64_t framesDropped = 0;     // Frames missing from the sequence numbers
+    uint64_t framesRejected = 0;    // Frames with a bad header, size or version
+    uint64_t framesOutOfOrder = 0;  // Frames rejected for repeating or going back in the sequence numbers
+};
+
+/**
+ * @brief Decodes M4 frames straight from the receive buffer into the data table.
+ *
+ * Each channel record is copied from the buffer into a ChannelSample and
+ * published; there is no intermediate container. Gaps in the frame sequence
+ * numbers are counted as dropped frames. A frame whose sequence number
+ * repeats or goes back is stale and rejected, except sequence 0, which
+ * starts the count of a restarted M4 core.
+ *
+ * Each M4 endpoint has its own parser, which maps the local channels of the
+ * frames onto its range of the global data table.
+ *
+ * parse() must be called from a single thread (the M4 data thread); the
+ * statistics can be read from any thread.
+ */
+class M4FrameParser {
+public:
+    /**
+     * @brief Constructor for the M4FrameParser class.
+     *
+     * @param firstChannel The global channel of local channel 0 of the endpoint.
+     * @param channelCount The number of channels of the endpoint, at most 64.
+     */
+    explicit M4FrameParser(uint32_t firstChannel = 0, uint32_t channelCount = M4_FRAME_MAX_CHANNELS) :
+        firstChannel(firstChannel), channelCount(channelCount) {}
+
+    /**
+     * @brief Checks the header at the start of a buffer and gets the frame size.
+     *
+     * Used by byte-stream endpoints to cut frames.
+     *
+     * @param data The buffer.
+     * @param available The number of bytes in the buffer.
+     * @return The size of the frame, 0 if more bytes are needed to tell, or
+     *         SIZE_MAX if the buffer does not start with a frame header.
+     */
+    static size_t frameLength(const uint8_t* data, size_t available);
+
+    /**
+     * @brief Decodes a frame and publishes its records to the data service.
+     *
+     * @param data The frame, starting with an M4FrameHeader.
+     * @param size The number of bytes in the frame.
+     * @param receiveTime Monotonic time in nanoseconds at which the frame was received.
+     * @param dataService The data service that receives the channel samples.
+     * @param updatedMask Receives the channels that were published, bit n for local channel n.
+     * @return True if the frame was valid and published, false if it was rejected.
+     */
+    bool parse(const uint8_t* data, size_t size, uint64_t receiveTime,
+        ChannelDataService& dataService, uint64_t& updatedMask);
+
+    /**
+     * @brief Gets the counters kept by the parser.
+     *
+     * @return A copy of the counters.
+     */
+    M4FrameStatistics getStatistics() const;
+
+    /**
+     * @brief Sets the recorder that receives every published sample.
+     * Must be called before the first parse().
+     *
+     * @param recorder The recorder, nullptr to record nothing.
+     * @param source The recorder source of the thread calling parse().
+     */
+    void setRecorder(TelemetryRecorder* recorder, size_t source);
+
+private:
+    uint32_t firstChannel;
+    uint32_t channelCount;
+    TelemetryRecorder* recorder = nullptr;
+    size_t recorderSource = 0;
+    bool hasSequence = false;
+    uint32_t lastSequence = 0;
+    uint32_t staleSequence = 0;     // Last rejected sequence number
+    uint32_t staleRun = 0;          // Consecutive rejected frames that follow each other
+    std::atomic<uint64_t> framesParsed{0};
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> framesRejected{0};
+    std::atomic<uint64_t> framesOutOfOrder{0};
+};
+
+#endif
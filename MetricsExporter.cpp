@@ -0,0 +1,188 @@
+#include "MetricsExporter.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Size of the buffer holding the request line and headers; longer requests are cut
+constexpr size_t REQUEST_BUFFER_SIZE = 4096;
+
+// Time a client has to send its request, in milliseconds
+constexpr int REQUEST_TIMEOUT_MS = 1000;
+
+/**
+ * @brief Writes a whole buffer to a socket.
+ *
+ * @param fd The socket.
+ * @param data The bytes to write.
+ * @param size The number of bytes.
+ * @return True if every byte was written.
+ */
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the MetricsExporter class. The exporter starts stopped.
+ */
+MetricsExporter::MetricsExporter() : listenFd(-1), wakeFd(-1), port(0), stopping(false) {}
+
+/**
+ * @brief Destructor for the MetricsExporter class. Stops the exporter.
+ */
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+/**
+ * @brief Starts listening and serving the metrics.
+ *
+ * @param config The address to listen on.
+ * @param render Produces the body of each response, called on the exporter thread.
+ * @param error Receives the reason if the exporter cannot be started.
+ * @return True if the exporter is listening.
+ */
+bool MetricsExporter::start(const MetricsExporterConfig& config, std::function<std::string()> render,
+    std::string& error) {
+    stop();
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.address.c_str(), &address.sin_addr) != 1) {
+        error = "Invalid metrics exporter address " + config.address;
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int reuse = 1;
+    socklen_t length = sizeof(address);
+    if (listenFd < 0 || wakeFd < 0 ||
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, 8) != 0 ||
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        error = "Cannot listen on " + config.address + ":" + std::to_string(config.port) + ": " +
+            std::strerror(errno);
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+        listenFd = -1;
+        wakeFd = -1;
+        return false;
+    }
+
+    this->render = std::move(render);
+    port = ntohs(address.sin_port);
+    stopping = false;
+    thread = std::thread(&MetricsExporter::threadFunction, this);
+    return true;
+}
+
+/**
+ * @brief Stops serving and closes the socket; a scrape in progress is completed first.
+ */
+void MetricsExporter::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    stopping = true;
+    uint64_t value = 1;
+    ssize_t ignored = write(wakeFd, &value, sizeof(value));
+    (void)ignored;
+    thread.join();
+
+    close(listenFd);
+    close(wakeFd);
+    listenFd = -1;
+    wakeFd = -1;
+    port = 0;
+}
+
+/**
+ * @brief Exporter thread function: accepts connections until stop().
+ */
+void MetricsExporter::threadFunction() {
+    while (!stopping.load()) {
+        pollfd fds[2] = {{listenFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client >= 0) {
+            serve(client);
+            close(client);
+        }
+    }
+}
+
+/**
+ * @brief Answers the request of one connection.
+ *
+ * Only the request line is looked at: GET /metrics (or /) gets the
+ * metrics, anything else a 404.
+ *
+ * @param client The connected socket, closed by the caller.
+ */
+void MetricsExporter::serve(int client) {
+    char request[REQUEST_BUFFER_SIZE];
+    size_t received = 0;
+    while (received < sizeof(request) - 1) {
+        pollfd fd = {client, POLLIN, 0};
+        if (poll(&fd, 1, REQUEST_TIMEOUT_MS) <= 0) {
+            return;
+        }
+        ssize_t count = recv(client, request + received, sizeof(request) - 1 - received, 0);
+        if (count <= 0) {
+            return;
+        }
+        received += static_cast<size_t>(count);
+        request[received] = '\0';
+        if (std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[received] = '\0';
+
+    bool found = std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET / ", 6) == 0;
+    std::string body = found ? render() : "Not found\n";
+    std::string response = std::string(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n") +
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n";
+    if (writeAll(client, response.data(), response.size())) {
+        writeAll(client, body.data(), body.size());
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Default TCP port of the metrics exporter
+#define DEFAULT_METRICS_EXPORTER_PORT 9464
+
+/**
+ * @brief Address of the metrics exporter.
+ */
+struct MetricsExporterConfig {
+    std::string address = "127.0.0.1";  // IPv4 address to listen on, "0.0.0.0" for all interfaces
+    uint16_t port = DEFAULT_METRICS_EXPORTER_PORT;  // 0 picks a free port, see getPort()
+};
+
+/**
+ * @brief Minimal HTTP endpoint serving metrics to a Prometheus scraper.
+ *
+ * Answers GET /metrics with the text of the render function, one request
+ * per connection, on a thread of its own. Metrics are only computed when
+ * a scrape arrives, so the exporter costs nothing between scrapes.
+ */
+class MetricsExporter {
+public:
+    /**
+     * @brief Constructor for the MetricsExporter class. The exporter starts stopped.
+     */
+    MetricsExporter();
+
+    /**
+     * @brief Destructor for the MetricsExporter class. Stops the exporter.
+     */
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    /**
+     * @brief Starts listening and serving the metrics.
+     *
+     * @param config The address to listen on.
+     * @param render Produces the body of each response, called on the exporter thread.
+     * @param error Receives the reason if the exporter cannot be started.
+     * @return True if the exporter is listening.
+     */
+    bool start(const MetricsExporterConfig& config, std::function<std::string()> render, std::string& error);
+
+    /**
+     * @brief Stops serving and closes the socket; a scrape in progress is completed first.
+     */
+    void stop();
+
+    /**
+     * @brief Checks if the exporter is listening.
+     *
+     * @return True between a successful start() and stop().
+     */
+    bool isRunning() const { return thread.joinable(); }
+
+    /**
+     * @brief Gets the TCP port the exporter listens on.
+     *
+     * @return The port, 0 if not running.
+     */
+    uint16_t getPort() const { return port; }
+
+private:
+    void threadFunction();
+
+    // Answers the request of one connection
+    void serve(int client);
+
+    std::function<std::string()> render;
+    int listenFd;
+    int wakeFd;
+    uint16_t port;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+#endif
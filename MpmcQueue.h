@@ -0,0 +1,149 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "Platform.h"
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer FIFO queue.
+ *
+ * Array-based queue where every cell carries its own sequence number, so
+ * producers and consumers only contend on a single atomic increment of the
+ * enqueue or dequeue position. The capacity is rounded up to a power of two
+ * and all storage is allocated once at construction.
+ *
+ * @tparam T The element type. Must be default constructible and movable.
+ */
+template <typename T>
+class MpmcQueue {
+public:
+    /**
+     * @brief Constructor for the MpmcQueue class.
+     *
+     * @param capacity The minimum number of elements the queue can hold.
+     */
+    explicit MpmcQueue(size_t capacity) : mask(roundUpToPowerOfTwo(capacity) - 1) {
+        cells = new Cell[mask + 1];
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Destructor for the MpmcQueue class.
+     */
+    ~MpmcQueue() {
+        delete[] cells;
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    /**
+     * @brief Appends an element to the queue.
+     *
+     * @param value The element to append.
+     * @return True on success, false if the queue is full.
+     */
+    bool push(T value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Removes the oldest element from the queue.
+     *
+     * @param value Receives the element.
+     * @return True on success, false if the queue is empty.
+     */
+    bool pop(T& value) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Gets the approximate number of elements in the queue.
+     *
+     * @return The number of elements at some recent point in time.
+     */
+    size_t sizeApprox() const {
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    /**
+     * @brief Checks if the queue is empty at some recent point in time.
+     *
+     * @return True if no element was queued, false otherwise.
+     */
+    bool emptyApprox() const {
+        return sizeApprox() == 0;
+    }
+
+    /**
+     * @brief Gets the number of elements the queue can hold.
+     *
+     * @return The capacity.
+     */
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t mask;
+    Cell* cells;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePos;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePos;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief Hints to the CPU that the calling thread is busy-waiting.
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief Gets the monotonic clock in nanoseconds, used for reception timestamps.
+ *
+ * @return Nanoseconds since an arbitrary fixed point (CLOCK_MONOTONIC on Linux).
+ */
+inline uint64_t monotonicNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Gets the wall clock in nanoseconds, used for times that must survive a restart.
+ *
+ * @return Nanoseconds since the Unix epoch (CLOCK_REALTIME on Linux).
+ */
+inline uint64_t realtimeNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "Recipe.h"
+
+#include <cstring>
+#include <map>
+
+namespace {
+
+/**
+ * @brief Incremental 64-bit FNV-1a hash over the fields of a program.
+ */
+class Fingerprint {
+public:
+    template <typename T>
+    void add(T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (unsigned char byte : bytes) {
+            hash = (hash ^ byte) * 0x100000001b3ULL;
+        }
+    }
+
+    uint64_t get() const { return hash; }
+
+private:
+    uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+/**
+ * @brief Computes the fingerprint of a compiled program.
+ *
+ * Fields are hashed one by one, so padding never enters the hash and the
+ * same recipe gets the same fingerprint in every process.
+ *
+ * @param program The program.
+ * @return The fingerprint, never 0.
+ */
+uint64_t fingerprintProgram(const RecipeProgram& program) {
+    Fingerprint fingerprint;
+    for (const RecipeInstruction& instruction : program.instructions) {
+        fingerprint.add(static_cast<uint8_t>(instruction.op));
+        fingerprint.add(instruction.step);
+        fingerprint.add(instruction.target);
+        fingerprint.add(instruction.count);
+        fingerprint.add(instruction.slot);
+        fingerprint.add(instruction.firstBranch);
+        fingerprint.add(instruction.branchCount);
+    }
+    for (size_t i = 0; i < program.steps.size(); ++i) {
+        const StepDefinition& step = program.steps[i];
+        fingerprint.add(static_cast<uint8_t>(step.type));
+        fingerprint.add(step.current);
+        fingerprint.add(step.targetVoltage);
+        fingerprint.add(step.rampRate);
+
+        LimitConditionState conditions[STEP_SNAPSHOT_MAX_LIMITS];
+        uint32_t count = 0;
+        fingerprint.add(static_cast<uint8_t>(program.limits[i].save(conditions, STEP_SNAPSHOT_MAX_LIMITS, count)));
+        fingerprint.add(count);
+        for (uint32_t c = 0; c < count && c < STEP_SNAPSHOT_MAX_LIMITS; ++c) {
+            fingerprint.add(conditions[c].field);
+            fingerprint.add(conditions[c].group);
+            fingerprint.add(conditions[c].target);
+            fingerprint.add(conditions[c].hysteresis);
+            fingerprint.add(static_cast<uint8_t>(conditions[c].comparison));
+        }
+    }
+    for (const RecipeJump& branch : program.branches) {
+        fingerprint.add(branch.group);
+        fingerprint.add(branch.target);
+    }
+    fingerprint.add(program.loopCount);
+    return fingerprint.get() != 0 ? fingerprint.get() : 1;
+}
+
+} // namespace
+
+/**
+ * @brief Appends a Constant Current Constant Voltage step.
+ *
+ * @param current The CC current.
+ * @param targetVoltage The CV voltage.
+ * @param limits The step limits.
+ * @param branches The branches taken by limit group.
+ * @return This recipe.
+ */
+Recipe& Recipe::cccv(float current, float targetVoltage, const std::vector<StepLimit>& limits,
+    const std::vector<RecipeBranch>& branches) {
+    StepDefinition definition;
+    definition.type = StepType::CCCV;
+    definition.current = current;
+    definition.targetVoltage = targetVoltage;
+    definition.limits = limits;
+    return step(definition, branches);
+}
+
+/**
+ * @brief Appends a Constant Current step, e.g. a discharge.
+ *
+ * @param current The current.
+ * @param limits The step limits.
+ * @param branches The branches taken by limit group.
+ * @return This recipe.
+ */
+Recipe& Recipe::cc(float current, const std::vector<StepLimit>& limits,
+    const std::vector<RecipeBranch>& branches) {
+    return currentRamp(current, 0.0f, limits, branches);
+}
+
+/**
+ * @brief Appends a Current Ramp step.
+ *
+ * @param current The final current.
+ * @param rampRate The ramp slope in A per second of step time.
+ * @param limits The step limits.
+ * @param branches The branches taken by limit group.
+ * @return This recipe.
+ */
+Recipe& Recipe::currentRamp(float current, float rampRate, const std::vector<StepLimit>& limits,
+    const std::vector<RecipeBranch>& branches) {
+    StepDefinition definition;
+    definition.type = StepType::CurrentRamp;
+    definition.current = current;
+    definition.rampRate = rampRate;
+    definition.limits = limits;
+    return step(definition, branches);
+}
+
+/**
+ * @brief Appends a Rest step.
+ *
+ * @param limits The step limits.
+ * @param branches The branches taken by limit group.
+ * @return This recipe.
+ */
+Recipe& Recipe::rest(const std::vector<StepLimit>& limits, const std::vector<RecipeBranch>& branches) {
+    StepDefinition definition;
+    definition.type = StepType::Rest;
+    definition.limits = limits;
+    return step(definition, branches);
+}
+
+/**
+ * @brief Appends any step.
+ *
+ * @param step The step.
+ * @param branches The branches taken by limit group.
+ * @return This recipe.
+ */
+Recipe& Recipe::step(const StepDefinition& step, const std::vector<RecipeBranch>& branches) {
+    RecipeItem item;
+    item.type = RecipeItemType::Step;
+    item.step = step;
+    item.branches = branches;
+    items.push_back(std::move(item));
+    return *this;
+}
+
+/**
+ * @brief Starts a loop body, closed by endLoop().
+ *
+ * @param count The number of times the body runs.
+ * @return This recipe.
+ */
+Recipe& Recipe::loop(uint32_t count) {
+    RecipeItem item;
+    item.type = RecipeItemType::Loop;
+    item.count = count;
+    items.push_back(std::move(item));
+    return *this;
+}
+
+/**
+ * @brief Closes the innermost loop body.
+ *
+ * @return This recipe.
+ */
+Recipe& Recipe::endLoop() {
+    RecipeItem item;
+    item.type = RecipeItemType::EndLoop;
+    items.push_back(std::move(item));
+    return *this;
+}
+
+/**
+ * @brief Names the position of the next item.
+ *
+ * @param name The label.
+ * @return This recipe.
+ */
+Recipe& Recipe::label(const std::string& name) {
+    RecipeItem item;
+    item.type = RecipeItemType::Label;
+    item.label = name;
+    items.push_back(std::move(item));
+    return *this;
+}
+
+/**
+ * @brief Continues at a label.
+ *
+ * @param name The label.
+ * @return This recipe.
+ */
+Recipe& Recipe::jump(const std::string& name) {
+    RecipeItem item;
+    item.type = RecipeItemType::Goto;
+    item.label = name;
+    items.push_back(std::move(item));
+    return *this;
+}
+
+/**
+ * @brief Compiles a recipe.
+ *
+ * Labels are resolved in a second pass, so a branch or goto may name a
+ * label defined later. A loop body must contain a step, so that running
+ * the program always reaches a step or the end.
+ *
+ * @param recipe The recipe.
+ * @param program Receives the compiled program.
+ * @param error Receives the reason on failure.
+ * @return True on success, false if the recipe is invalid.
+ */
+bool RecipeProgram::compile(const Recipe& recipe, RecipeProgram& program, std::string& error) {
+    struct OpenLoop {
+        uint32_t bodyStart;
+        uint32_t count;
+        uint32_t slot;
+        size_t stepCount;
+    };
+    struct Fixup {
+        std::string label;
+        bool branch;    // Patch branches[index] instead of instructions[index]
+        uint32_t index;
+    };
+
+    program = RecipeProgram();
+    std::map<std::string, uint32_t> labels;
+    std::vector<OpenLoop> loops;
+    std::vector<Fixup> fixups;
+
+    for (const RecipeItem& item : recipe.getItems()) {
+        RecipeInstruction instruction;
+        uint32_t next = static_cast<uint32_t>(program.instructions.size());
+
+        switch (item.type) {
+            case RecipeItemType::Step: {
+                StepLimitEvaluator evaluator;
+                std::string unknownField;
+                if (!StepLimitEvaluator::compile(item.step.limits, evaluator, unknownField)) {
+                    error = "unknown step limit field \"" + unknownField + "\" in step " +
+                        std::to_string(program.steps.size());
+                    return false;
+                }
+                instruction.op = RecipeOp::Step;
+                instruction.step = static_cast<uint32_t>(program.steps.size());
+                instruction.firstBranch = static_cast<uint32_t>(program.branches.size());
+                instruction.branchCount = static_cast<uint32_t>(item.branches.size());
+                for (const RecipeBranch& branch : item.branches) {
+                    fixups.push_back({branch.label, true, static_cast<uint32_t>(program.branches.size())});
+                    program.branches.push_back({branch.group, 0});
+                }
+
+                StepDefinition definition = item.step;
+                definition.limits.clear();
+                program.steps.push_back(std::move(definition));
+                program.limits.push_back(std::move(evaluator));
+                break;
+            }
+            case RecipeItemType::Loop:
+                if (item.count == 0) {
+                    error = "loop with a count of 0";
+                    return false;
+                }
+                instruction.op = RecipeOp::LoopStart;
+                instruction.slot = program.loopCount++;
+                loops.push_back({next + 1, item.count, instruction.slot, program.steps.size()});
+                break;
+            case RecipeItemType::EndLoop:
+                if (loops.empty()) {
+                    error = "endLoop without loop";
+                    return false;
+                }
+                if (loops.back().stepCount == program.steps.size()) {
+                    error = "loop without a step";
+                    return false;
+                }
+                instruction.op = RecipeOp::Repeat;
+                instruction.target = loops.back().bodyStart;
+                instruction.count = loops.back().count;
+                instruction.slot = loops.back().slot;
+                loops.pop_back();
+                break;
+            case RecipeItemType::Label:
+                if (!labels.emplace(item.label, next).second) {
+                    error = "duplicate label \"" + item.label + "\"";
+                    return false;
+                }
+                continue;
+            case RecipeItemType::Goto:
+                instruction.op = RecipeOp::Jump;
+                fixups.push_back({item.label, false, next});
+                break;
+        }
+        program.instructions.push_back(instruction);
+    }
+
+    if (!loops.empty()) {
+        error = "loop without endLoop";
+        return false;
+    }
+    program.instructions.push_back(RecipeInstruction());
+
+    for (const Fixup& fixup : fixups) {
+        auto label = labels.find(fixup.label);
+        if (label == labels.end()) {
+            error = "unknown label \"" + fixup.label + "\"";
+            return false;
+        }
+        if (fixup.branch) {
+            program.branches[fixup.index].target = label->second;
+        } else {
+            program.instructions[fixup.index].target = label->second;
+        }
+    }
+    program.fingerprint = fingerprintProgram(program);
+    return true;
+}
+
+/**
+ * @brief Compiles a recipe into a program that can be shared between channels.
+ *
+ * @param recipe The recipe.
+ * @param error Receives the reason on failure.
+ * @return The program, or nullptr if the recipe is invalid.
+ */
+std::shared_ptr<const RecipeProgram> RecipeProgram::compile(const Recipe& recipe, std::string& error) {
+    auto program = std::make_shared<RecipeProgram>();
+    if (!compile(recipe, *program, error)) {
+        return nullptr;
+    }
+    return program;
+}
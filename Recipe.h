@@ -0,0 +1,235 @@
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "StepEngine.h"
+#include "StepLimitEvaluator.h"
+
+/**
+ * @brief Jump taken when a given group of step limits ends a step.
+ */
+typedef struct
+{
+    uint32_t group;    // StepLimit::group that must be met
+    std::string label; // Label to continue at
+} RecipeBranch;
+
+/**
+ * @brief Kind of entry of a recipe.
+ */
+enum class RecipeItemType : uint8_t {
+    Step,    // Run step; branches select the next item by the limit group that ended it
+    Loop,    // Start of a loop body run count times
+    EndLoop, // End of the innermost loop body
+    Label,   // Jump target named label
+    Goto     // Continue at label
+};
+
+/**
+ * @brief One entry of a recipe.
+ */
+struct RecipeItem {
+    RecipeItemType type = RecipeItemType::Step;
+    StepDefinition step;
+    std::vector<RecipeBranch> branches;
+    uint32_t count = 0;
+    std::string label;
+};
+
+/**
+ * @brief A test plan: a sequence of steps with loops, labels and branches.
+ *
+ * The builder methods append items and return the recipe, so a formation
+ * schedule reads top to bottom:
+ *
+ *     Recipe recipe;
+ *     recipe.loop(100)
+ *               .cccv(2.0f, 4.2f, {{"current", 0.05f, LimitComparison::LessOrEqual}})
+ *               .rest({{"time", 600.0f}})
+ *               .cc(-2.0f, {{"voltage", 2.8f, LimitComparison::LessOrEqual},
+ *                           {"temperature", 45.0f, LimitComparison::GreaterOrEqual, 0.0f, 1}},
+ *                   {{1, "overheat"}})
+ *               .rest({{"time", 600.0f}})
+ *           .endLoop()
+ *           .jump("done")
+ *           .label("overheat")
+ *           .rest({{"temperature", 30.0f, LimitComparison::LessOrEqual}})
+ *           .label("done");
+ *
+ * A recipe is only a description; RecipeProgram::compile() turns it into the
+ * table the step engine runs.
+ */
+class Recipe {
+public:
+    /**
+     * @brief Appends a Constant Current Constant Voltage step.
+     *
+     * @param current The CC current.
+     * @param targetVoltage The CV voltage.
+     * @param limits The step limits.
+     * @param branches The branches taken by limit group.
+     * @return This recipe.
+     */
+    Recipe& cccv(float current, float targetVoltage, const std::vector<StepLimit>& limits,
+        const std::vector<RecipeBranch>& branches = {});
+
+    /**
+     * @brief Appends a Constant Current step, e.g. a discharge.
+     *
+     * This is a current ramp with no ramp: the current is set at once.
+     *
+     * @param current The current.
+     * @param limits The step limits.
+     * @param branches The branches taken by limit group.
+     * @return This recipe.
+     */
+    Recipe& cc(float current, const std::vector<StepLimit>& limits,
+        const std::vector<RecipeBranch>& branches = {});
+
+    /**
+     * @brief Appends a Current Ramp step.
+     *
+     * @param current The final current.
+     * @param rampRate The ramp slope in A per second of step time.
+     * @param limits The step limits.
+     * @param branches The branches taken by limit group.
+     * @return This recipe.
+     */
+    Recipe& currentRamp(float current, float rampRate, const std::vector<StepLimit>& limits,
+        const std::vector<RecipeBranch>& branches = {});
+
+    /**
+     * @brief Appends a Rest step.
+     *
+     * @param limits The step limits.
+     * @param branches The branches taken by limit group.
+     * @return This recipe.
+     */
+    Recipe& rest(const std::vector<StepLimit>& limits, const std::vector<RecipeBranch>& branches = {});
+
+    /**
+     * @brief Appends any step.
+     *
+     * @param step The step.
+     * @param branches The branches taken by limit group.
+     * @return This recipe.
+     */
+    Recipe& step(const StepDefinition& step, const std::vector<RecipeBranch>& branches = {});
+
+    /**
+     * @brief Starts a loop body, closed by endLoop().
+     *
+     * @param count The number of times the body runs.
+     * @return This recipe.
+     */
+    Recipe& loop(uint32_t count);
+
+    /**
+     * @brief Closes the innermost loop body.
+     *
+     * @return This recipe.
+     */
+    Recipe& endLoop();
+
+    /**
+     * @brief Names the position of the next item.
+     *
+     * @param name The label.
+     * @return This recipe.
+     */
+    Recipe& label(const std::string& name);
+
+    /**
+     * @brief Continues at a label.
+     *
+     * @param name The label.
+     * @return This recipe.
+     */
+    Recipe& jump(const std::string& name);
+
+    /**
+     * @brief Gets the items of the recipe.
+     *
+     * @return The items, in order.
+     */
+    const std::vector<RecipeItem>& getItems() const { return items; }
+
+private:
+    std::vector<RecipeItem> items;
+};
+
+/**
+ * @brief Operation of a compiled recipe instruction.
+ */
+enum class RecipeOp : uint8_t {
+    Step,      // Run steps[step], then continue at the matching branch or the next instruction
+    LoopStart, // Clear counter slot
+    Repeat,    // Increment counter slot and continue at target while it is less than count
+    Jump,      // Continue at target
+    End        // Set the channel to rest and finish
+};
+
+/**
+ * @brief One instruction of a compiled recipe.
+ */
+struct RecipeInstruction {
+    RecipeOp op = RecipeOp::End;
+    uint32_t step = 0;        // Step: index in steps and limits
+    uint32_t target = 0;      // Repeat, Jump: instruction index
+    uint32_t count = 0;       // Repeat: number of runs of the body
+    uint32_t slot = 0;        // LoopStart, Repeat: loop counter index
+    uint32_t firstBranch = 0; // Step: index of the first branch
+    uint32_t branchCount = 0; // Step: number of branches
+};
+
+/**
+ * @brief Branch of a compiled step: limit group and instruction index.
+ */
+struct RecipeJump {
+    uint32_t group;
+    uint32_t target;
+};
+
+/**
+ * @brief A recipe compiled into a flat instruction table.
+ *
+ * Labels are resolved to instruction indices and step limits are compiled
+ * into evaluators once, so walking from one step to the next is a few
+ * array lookups. A program is immutable after compile() and is shared by
+ * every channel that runs it; each channel keeps its own program counter
+ * and loop counters in the step engine.
+ */
+class RecipeProgram {
+public:
+    /**
+     * @brief Compiles a recipe.
+     *
+     * @param recipe The recipe.
+     * @param program Receives the compiled program.
+     * @param error Receives the reason on failure.
+     * @return True on success, false if the recipe is invalid.
+     */
+    static bool compile(const Recipe& recipe, RecipeProgram& program, std::string& error);
+
+    /**
+     * @brief Compiles a recipe into a program that can be shared between channels.
+     *
+     * @param recipe The recipe.
+     * @param error Receives the reason on failure.
+     * @return The program, or nullptr if the recipe is invalid.
+     */
+    static std::shared_ptr<const RecipeProgram> compile(const Recipe& recipe, std::string& error);
+
+    std::vector<RecipeInstruction> instructions; // Always ends with End
+    std::vector<StepDefinition> steps;           // Steps, without their limits
+    std::vector<StepLimitEvaluator> limits;      // Compiled limits of each step
+    std::vector<RecipeJump> branches;
+    uint32_t loopCount = 0;                      // Number of loop counter slots
+    uint64_t fingerprint = 0;                    // Hash of the compiled program, identifies it in checkpoints
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "RpmsgChannelCtrlService.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor for the RpmsgChannelCtrlService class.
+ *
+ * @param device The path of the RPMsg device, e.g. "/dev/ttyRPMSG1".
+ */
+RpmsgChannelCtrlService::RpmsgChannelCtrlService(const std::string& device) :
+    device(device),
+    deviceFd(-1),
+    sequence(0),
+    profileId(0),
+    unavailableReported(false),
+    droppedFrames(0) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    openDevice();
+}
+
+/**
+ * @brief Destructor for the RpmsgChannelCtrlService class.
+ */
+RpmsgChannelCtrlService::~RpmsgChannelCtrlService() {
+    if (deviceFd >= 0) {
+        close(deviceFd);
+    }
+}
+
+/**
+ * @brief Opens the device; a tty device is switched to raw mode.
+ *
+ * A failure is reported to the ErrorEventRing once, until the device is
+ * open again, so commands sent to a missing device do not flood the log.
+ *
+ * @return True if the device is open.
+ */
+bool RpmsgChannelCtrlService::openDevice() {
+    int fd = ::open(device.c_str(), O_WRONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        if (!unavailableReported) {
+            ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+                "Cannot open M4 control device, dropping commands", ERROR_EVENT_NO_CHANNEL, device.c_str(), errno);
+            unavailableReported = true;
+        }
+        return false;
+    }
+
+    if (isatty(fd)) {
+        termios attributes;
+        if (tcgetattr(fd, &attributes) == 0) {
+            cfmakeraw(&attributes);
+            tcsetattr(fd, TCSANOW, &attributes);
+        }
+    }
+    deviceFd = fd;
+    unavailableReported = false;
+    return true;
+}
+
+/**
+ * @brief Performs constant current control on a channel.
+ *
+ * @param channel The channel number.
+ * @param current The target current value.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the command was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doConstantCurrent(uint32_t channel, float current) {
+    ChannelCommandBatch batch;
+    batch.set(channel, ChannelCommandMode::ConstantCurrent, current);
+    return send(batch);
+}
+
+/**
+ * @brief Performs constant voltage control on a channel.
+ *
+ * @param channel The channel number.
+ * @param voltage The target voltage value.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the command was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doConstantVoltage(uint32_t channel, float voltage) {
+    ChannelCommandBatch batch;
+    batch.set(channel, ChannelCommandMode::ConstantVoltage, voltage);
+    return send(batch);
+}
+
+/**
+ * @brief Sets the channel to a rest state (open circuit).
+ *
+ * @param channel The channel number.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the command was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doRest(uint32_t channel) {
+    ChannelCommandBatch batch;
+    batch.set(channel, ChannelCommandMode::Rest);
+    return send(batch);
+}
+
+/**
+ * @brief Turns off the channel.
+ *
+ * @param channel The channel number.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the command was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doOFF(uint32_t channel) {
+    ChannelCommandBatch batch;
+    batch.set(channel, ChannelCommandMode::Off);
+    return send(batch);
+}
+
+/**
+ * @brief Applies commands to a group of channels at the same time.
+ *
+ * @param batch The commands, one per channel set in the channel mask.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the batch was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doBatch(const ChannelCommandBatch& batch) {
+    if (batch.channelMask == 0) {
+        return {};
+    }
+    return send(batch);
+}
+
+/**
+ * @brief Runs a setpoint profile on a group of channels.
+ *
+ * The profile is split into frames of M4_PROFILE_POINTS_PER_FRAME points,
+ * written back to back under the write lock. If a frame is dropped, the
+ * rest of the upload is not sent; the M4 discards an incomplete profile.
+ *
+ * @param channelMask The channels, bit n for channel n.
+ * @param profile The profile, validated by the caller.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if the upload was cut short.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::doProfile(uint64_t channelMask,
+    const std::shared_ptr<const SetpointProfile>& profile) {
+    if (channelMask == 0 || profile->points.empty()) {
+        return {};
+    }
+    uint8_t frame[M4_MAX_PROFILE_FRAME_SIZE];
+    std::lock_guard<std::mutex> lock(writeMutex);
+    uint32_t id = profileId++;
+    for (size_t point = 0; point < profile->points.size(); point += M4_PROFILE_POINTS_PER_FRAME) {
+        size_t size = encodeProfileFrame(channelMask, *profile, id, point, sequence++, frame);
+        if (!write(frame, size)) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR);
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief Encodes the next commands of a batch as an M4Command frame.
+ *
+ * Takes the lowest M4_COMMAND_CHANNELS_PER_FRAME channels of the mask. The
+ * frame is addressed from the lowest of them, one record per bit of its
+ * mask in ascending channel order.
+ *
+ * @param batch The commands, one per channel set in the channel mask.
+ * @param channelMask The channels still to send; the channels of the frame are cleared from it.
+ * @param sequence The sequence number of the frame.
+ * @param buffer Receives the frame, at least M4_MAX_COMMAND_FRAME_SIZE bytes.
+ * @return The size of the frame in bytes.
+ */
+size_t RpmsgChannelCtrlService::encodeFrame(const ChannelCommandBatch& batch, uint64_t& channelMask, uint32_t sequence,
+    uint8_t* buffer) {
+    static const uint8_t modes[] = {
+        M4_COMMAND_MODE_CC, M4_COMMAND_MODE_CV, M4_COMMAND_MODE_REST, M4_COMMAND_MODE_OFF
+    };
+
+    uint64_t frameMask = channelMask;
+    for (int extra = __builtin_popcountll(frameMask) - M4_COMMAND_CHANNELS_PER_FRAME; extra > 0; --extra) {
+        frameMask &= ~(1ULL << (63 - __builtin_clzll(frameMask)));
+    }
+    channelMask &= ~frameMask;
+    uint32_t firstChannel = static_cast<uint32_t>(__builtin_ctzll(frameMask));
+    size_t size = sizeof(M4CommandHeader) + __builtin_popcountll(frameMask) * sizeof(M4ChannelCommand);
+
+    M4CommandHeader header{};
+    header.magic = M4_COMMAND_MAGIC;
+    header.version = M4_COMMAND_VERSION;
+    header.recordSize = sizeof(M4ChannelCommand);
+    header.frameSize = static_cast<uint16_t>(size);
+    header.firstChannel = static_cast<uint16_t>(firstChannel);
+    header.sequence = sequence;
+    header.channelMask = frameMask >> firstChannel;
+    std::memcpy(buffer, &header, sizeof(header));
+
+    uint8_t* record = buffer + sizeof(header);
+    for (uint64_t mask = frameMask; mask != 0; mask &= mask - 1) {
+        const ChannelCommand& command = batch.commands[__builtin_ctzll(mask)];
+        M4ChannelCommand wire{};
+        wire.mode = modes[static_cast<size_t>(command.mode)];
+        wire.setpoint = command.setpoint;
+        std::memcpy(record, &wire, sizeof(wire));
+        record += sizeof(wire);
+    }
+    return size;
+}
+
+/**
+ * @brief Encodes one frame of a setpoint profile upload.
+ *
+ * @param channelMask The channels running the profile.
+ * @param profile The profile.
+ * @param profileId The identifier shared by the frames of the upload.
+ * @param firstPoint The index of the first point of the frame.
+ * @param sequence The sequence number of the frame.
+ * @param buffer Receives the frame, at least M4_MAX_PROFILE_FRAME_SIZE bytes.
+ * @return The size of the frame in bytes.
+ */
+size_t RpmsgChannelCtrlService::encodeProfileFrame(uint64_t channelMask, const SetpointProfile& profile,
+    uint32_t profileId, size_t firstPoint, uint32_t sequence, uint8_t* buffer) {
+    static const uint8_t modes[] = {M4_PROFILE_MODE_CURRENT, M4_PROFILE_MODE_VOLTAGE, M4_PROFILE_MODE_POWER};
+
+    size_t pointCount = std::min<size_t>(profile.points.size() - firstPoint, M4_PROFILE_POINTS_PER_FRAME);
+    size_t size = sizeof(M4ProfileHeader) + pointCount * sizeof(M4ProfilePoint);
+
+    M4ProfileHeader header{};
+    header.magic = M4_PROFILE_MAGIC;
+    header.version = M4_PROFILE_VERSION;
+    header.mode = modes[static_cast<size_t>(profile.mode)];
+    header.frameSize = static_cast<uint16_t>(size);
+    header.firstChannel = 0;
+    header.sequence = sequence;
+    header.channelMask = channelMask;
+    header.profileId = profileId;
+    header.totalPoints = static_cast<uint32_t>(profile.points.size());
+    header.firstPoint = static_cast<uint32_t>(firstPoint);
+    header.repeatCount = profile.repeatCount;
+    header.minVoltage = profile.minVoltage;
+    header.maxVoltage = profile.maxVoltage;
+    std::memcpy(buffer, &header, sizeof(header));
+
+    uint8_t* record = buffer + sizeof(header);
+    for (size_t i = 0; i < pointCount; ++i) {
+        M4ProfilePoint wire;
+        wire.time = profile.points[firstPoint + i].time;
+        wire.value = profile.points[firstPoint + i].value;
+        std::memcpy(record, &wire, sizeof(wire));
+        record += sizeof(wire);
+    }
+    return size;
+}
+
+/**
+ * @brief Sends a batch as command frames, one write() each.
+ *
+ * A batch of up to M4_COMMAND_CHANNELS_PER_FRAME channels is one frame.
+ * Larger batches are written as consecutive frames under the write lock,
+ * so no other frame comes in between. A failed write closes the device,
+ * which is reopened by the next command, and the rest of the batch is not
+ * sent. Sequence numbers are consumed by dropped frames too, so the M4 can
+ * count the commands it missed.
+ *
+ * @param batch The commands to send.
+ * @return Success, or CHANNEL_COMMUNICATION_ERROR if a frame was dropped.
+ */
+ErrorLogging::Status RpmsgChannelCtrlService::send(const ChannelCommandBatch& batch) {
+    uint8_t frame[M4_MAX_COMMAND_FRAME_SIZE];
+    std::lock_guard<std::mutex> lock(writeMutex);
+    uint64_t channelMask = batch.channelMask;
+    while (channelMask != 0) {
+        size_t size = encodeFrame(batch, channelMask, sequence++, frame);
+        if (!write(frame, size)) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR);
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief Writes one encoded frame with a single write().
+ *
+ * @param frame The frame.
+ * @param size The size of the frame in bytes.
+ * @return True if the frame was written, false if it was dropped and counted.
+ */
+bool RpmsgChannelCtrlService::write(const uint8_t* frame, size_t size) {
+    if (deviceFd < 0 && !openDevice()) {
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    ssize_t written;
+    do {
+        written = ::write(deviceFd, frame, size);
+    } while (written < 0 && errno == EINTR);
+
+    if (written != static_cast<ssize_t>(size)) {
+        ErrorEventRing::instance().report(ErrorLogging::ErrorCode::CHANNEL_COMMUNICATION_ERROR,
+            written < 0 ? "Cannot send M4 command" : "Short write of M4 command", ERROR_EVENT_NO_CHANNEL,
+            device.c_str(), written < 0 ? errno : 0);
+        close(deviceFd);
+        deviceFd = -1;
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef RPMSGCHANNELCTRLSERVICE_H
+#define RPMSGCHANNELCTRLSERVICE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "ChannelService.h"
+#include "M4Command.h"
+
+// Largest command frame, a header and M4_COMMAND_CHANNELS_PER_FRAME commands
+#define M4_MAX_COMMAND_FRAME_SIZE (sizeof(M4CommandHeader) + M4_COMMAND_CHANNELS_PER_FRAME * sizeof(M4ChannelCommand))
+// Largest profile frame, a header and M4_PROFILE_POINTS_PER_FRAME points
+#define M4_MAX_PROFILE_FRAME_SIZE (sizeof(M4ProfileHeader) + M4_PROFILE_POINTS_PER_FRAME * sizeof(M4ProfilePoint))
+
+/**
+ * @brief Channel control service sending M4Command frames to an RPMsg device.
+ *
+ * Every call, batched or not, becomes one command frame written with a
+ * single write(), so the M4 receives the commands of a batch in one RPMsg
+ * transaction and applies them at the same tick. A batch of more than
+ * M4_COMMAND_CHANNELS_PER_FRAME channels does not fit one RPMsg buffer and
+ * is split into consecutive frames, written back to back; it is then no
+ * longer applied atomically, only each of its frames is. Per-channel calls
+ * are sent as a batch of one channel. A setpoint profile is sent as consecutive
+ * profile frames, with no other frame in between. If the device is missing
+ * or a write fails, the device is reopened on the next command; commands
+ * sent while it is unavailable are dropped, counted and fail with
+ * CHANNEL_COMMUNICATION_ERROR. The failed write and the first failed
+ * open are reported to the ErrorEventRing with their errno.
+ */
+class RpmsgChannelCtrlService : public ChannelCtrlService {
+public:
+    /**
+     * @brief Constructor for the RpmsgChannelCtrlService class.
+     *
+     * @param device The path of the RPMsg device, e.g. "/dev/ttyRPMSG1".
+     */
+    explicit RpmsgChannelCtrlService(const std::string& device);
+
+    /**
+     * @brief Destructor for the RpmsgChannelCtrlService class.
+     */
+    ~RpmsgChannelCtrlService() override;
+
+    RpmsgChannelCtrlService(const RpmsgChannelCtrlService&) = delete;
+    RpmsgChannelCtrlService& operator=(const RpmsgChannelCtrlService&) = delete;
+
+    ErrorLogging::Status doConstantCurrent(uint32_t channel, float current) override;
+    ErrorLogging::Status doConstantVoltage(uint32_t channel, float voltage) override;
+    ErrorLogging::Status doRest(uint32_t channel) override;
+    ErrorLogging::Status doOFF(uint32_t channel) override;
+    ErrorLogging::Status doBatch(const ChannelCommandBatch& batch) override;
+    ErrorLogging::Status doProfile(uint64_t channelMask, const std::shared_ptr<const SetpointProfile>& profile) override;
+
+    /**
+     * @brief Encodes the next commands of a batch as an M4Command frame.
+     *
+     * @param batch The commands, one per channel set in the channel mask.
+     * @param channelMask The channels still to send; the channels of the frame are cleared from it.
+     * @param sequence The sequence number of the frame.
+     * @param buffer Receives the frame, at least M4_MAX_COMMAND_FRAME_SIZE bytes.
+     * @return The size of the frame in bytes.
+     */
+    static size_t encodeFrame(const ChannelCommandBatch& batch, uint64_t& channelMask, uint32_t sequence,
+        uint8_t* buffer);
+
+    /**
+     * @brief Encodes one frame of a setpoint profile upload.
+     *
+     * @param channelMask The channels running the profile.
+     * @param profile The profile.
+     * @param profileId The identifier shared by the frames of the upload.
+     * @param firstPoint The index of the first point of the frame.
+     * @param sequence The sequence number of the frame.
+     * @param buffer Receives the frame, at least M4_MAX_PROFILE_FRAME_SIZE bytes.
+     * @return The size of the frame in bytes.
+     */
+    static size_t encodeProfileFrame(uint64_t channelMask, const SetpointProfile& profile, uint32_t profileId,
+        size_t firstPoint, uint32_t sequence, uint8_t* buffer);
+
+    /**
+     * @brief Gets the number of command frames that could not be sent.
+     *
+     * @return The number of dropped frames since construction.
+     */
+    uint64_t getDroppedFrameCount() const { return droppedFrames.load(std::memory_order_relaxed); }
+
+private:
+    // Opens the device, must be called with writeMutex held
+    bool openDevice();
+
+    // Sends a batch as one frame, or consecutive frames beyond M4_COMMAND_CHANNELS_PER_FRAME channels
+    ErrorLogging::Status send(const ChannelCommandBatch& batch);
+
+    // Writes one encoded frame, must be called with writeMutex held; false if it was dropped
+    bool write(const uint8_t* frame, size_t size);
+
+    std::string device;
+    int deviceFd;
+    uint32_t sequence;
+    uint32_t profileId;
+    // Set once a failed open is reported, so a missing device is reported once until it is back
+    bool unavailableReported;
+    // Serializes the frames of concurrent callers and owns deviceFd, sequence and profileId
+    std::mutex writeMutex;
+    std::atomic<uint64_t> droppedFrames;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "Platform.h"
+
+/**
+ * @brief Reader side of the seqlocks guarding the channel table and the checkpoint slots.
+ *
+ * A writer moves the version word from even to odd with a relaxed store or
+ * exchange, issues a release fence, changes the data, then stores the next
+ * even version with release ordering. A reader that sees the same even
+ * version before and after its copy has copied data from no write:
+ *
+ * - The acquire load of the first version synchronizes with the release
+ *   store that ended the last write, so the copy sees at least that write.
+ * - The acquire fence after the copy orders the copy before the second load.
+ *   If the copy saw any value of a later write, the release fence of that
+ *   write makes its odd version visible to the second load, which then fails.
+ *
+ * The data may change while it is copied, so the copy must only read words
+ * no larger than the CPU writes atomically and must not act on the values
+ * before the attempt succeeds.
+ */
+namespace Seqlock {
+
+/**
+ * @brief Makes one attempt at copying the data guarded by a seqlock.
+ *
+ * @param version The version word of the seqlock.
+ * @param copy Called without arguments to copy the data out.
+ * @return True if no write overlapped the copy, false if the copy must be retried.
+ */
+template <typename Copy>
+inline bool tryCopy(const std::atomic<uint32_t>& version, Copy&& copy) {
+    uint32_t before = version.load(std::memory_order_acquire);
+    if ((before & 1) != 0) {
+        cpuRelax();
+        return false;
+    }
+    copy();
+    // Order the copy before re-checking the version
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version.load(std::memory_order_relaxed) == before;
+}
+
+/**
+ * @brief Copies the data guarded by a seqlock, retrying until no write overlaps the copy.
+ *
+ * Only for writers that always finish their write, i.e. within the process.
+ *
+ * @param version The version word of the seqlock.
+ * @param copy Called without arguments to copy the data out, once per attempt.
+ */
+template <typename Copy>
+inline void read(const std::atomic<uint32_t>& version, Copy&& copy) {
+    while (!tryCopy(version, copy)) {
+    }
+}
+
+/**
+ * @brief Copies the data guarded by a seqlock, giving up after a number of attempts.
+ *
+ * For writers that may never finish, e.g. another process that died inside
+ * a write or a file left by a crash.
+ *
+ * @param version The version word of the seqlock.
+ * @param copy Called without arguments to copy the data out, once per attempt.
+ * @param maxAttempts The number of copies to try.
+ * @return True if a consistent copy was made.
+ */
+template <typename Copy>
+inline bool tryRead(const std::atomic<uint32_t>& version, Copy&& copy, uint32_t maxAttempts) {
+    for (uint32_t attempt = 0; attempt < maxAttempts; ++attempt) {
+        if (tryCopy(version, copy)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace Seqlock
+
+#endif
@@ -0,0 +1,239 @@
+#include "ServiceMetrics.h"
+
+#include <cstdio>
+
+namespace {
+
+/**
+ * @brief Appends the samples of a latency summary.
+ *
+ * @param out The text to append to.
+ * @param name The metric name.
+ * @param labels The labels of the metric, without braces.
+ * @param summary The summary.
+ */
+void appendSummary(std::string& out, const char* name, const std::string& labels, const LatencySummary& summary) {
+    static const char* const quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+    const uint64_t values[] = {summary.p50Ns, summary.p90Ns, summary.p99Ns, summary.p999Ns};
+    char line[256];
+    for (size_t i = 0; i < 4; ++i) {
+        std::snprintf(line, sizeof(line), "%s{%s,quantile=\"%s\"} %.9f\n", name, labels.c_str(), quantiles[i],
+            static_cast<double>(values[i]) * 1e-9);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%s_sum{%s} %.9f\n%s_count{%s} %llu\n", name, labels.c_str(),
+        static_cast<double>(summary.totalNs) * 1e-9, name, labels.c_str(),
+        static_cast<unsigned long long>(summary.count));
+    out += line;
+}
+
+/**
+ * @brief Appends a sample with a single label.
+ *
+ * @param out The text to append to.
+ * @param name The metric name.
+ * @param label The label name, or nullptr for none.
+ * @param labelValue The label value.
+ * @param value The sample value.
+ */
+void appendSample(std::string& out, const char* name, const char* label, const std::string& labelValue,
+    double value) {
+    char line[256];
+    if (label) {
+        std::snprintf(line, sizeof(line), "%s{%s=\"%s\"} %.17g\n", name, label, labelValue.c_str(), value);
+    } else {
+        std::snprintf(line, sizeof(line), "%s %.17g\n", name, value);
+    }
+    out += line;
+}
+
+} // namespace
+
+/**
+ * @brief Adds the histograms of a thread to the snapshot.
+ *
+ * @param shard The histograms of the thread.
+ */
+void TaskMetricsSnapshot::add(const TaskMetricsShard& shard) {
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+            TaskType taskType = static_cast<TaskType>(type);
+            TaskPriority taskPriority = static_cast<TaskPriority>(priority);
+            Counts& wait = queueWait[type][priority];
+            Counts& run = execution[type][priority];
+            shard.getQueueWait(taskType, taskPriority).addTo(wait.buckets, wait.total);
+            shard.getExecution(taskType, taskPriority).addTo(run.buckets, run.total);
+        }
+        failures[type] += shard.getFailureCount(static_cast<TaskType>(type));
+    }
+}
+
+/**
+ * @brief Computes the summaries of every task type and priority.
+ *
+ * @param metrics Receives the summaries in its tasks table and the failure counts.
+ */
+void TaskMetricsSnapshot::summarize(ServiceMetrics& metrics) const {
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+            const Counts& wait = queueWait[type][priority];
+            const Counts& run = execution[type][priority];
+            metrics.tasks[type][priority].queueWait = LatencyHistogram::summarize(wait.buckets, wait.total);
+            metrics.tasks[type][priority].execution = LatencyHistogram::summarize(run.buckets, run.total);
+        }
+        metrics.taskFailures[type] = failures[type];
+    }
+}
+
+/**
+ * @brief Formats metrics in the Prometheus text exposition format.
+ *
+ * @param metrics The metrics.
+ * @return The text, one sample per line.
+ */
+std::string formatPrometheusMetrics(const ServiceMetrics& metrics) {
+    std::string out;
+    out.reserve(16384);
+
+    out += "# HELP bts_task_queue_wait_seconds Time from queueing a task to the start of its execution.\n";
+    out += "# TYPE bts_task_queue_wait_seconds summary\n";
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+            const TaskLatencyMetrics& task = metrics.tasks[type][priority];
+            if (task.queueWait.count != 0) {
+                std::string labels = std::string("type=\"") + taskTypeName(static_cast<TaskType>(type)) +
+                    "\",priority=\"" + taskPriorityName(static_cast<TaskPriority>(priority)) + "\"";
+                appendSummary(out, "bts_task_queue_wait_seconds", labels, task.queueWait);
+            }
+        }
+    }
+
+    out += "# HELP bts_task_execution_seconds Time spent executing a task.\n";
+    out += "# TYPE bts_task_execution_seconds summary\n";
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+            const TaskLatencyMetrics& task = metrics.tasks[type][priority];
+            if (task.execution.count != 0) {
+                std::string labels = std::string("type=\"") + taskTypeName(static_cast<TaskType>(type)) +
+                    "\",priority=\"" + taskPriorityName(static_cast<TaskPriority>(priority)) + "\"";
+                appendSummary(out, "bts_task_execution_seconds", labels, task.execution);
+            }
+        }
+    }
+
+    out += "# HELP bts_task_queue_depth Tasks waiting in a scheduler lane.\n";
+    out += "# TYPE bts_task_queue_depth gauge\n";
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        appendSample(out, "bts_task_queue_depth", "priority", taskPriorityName(static_cast<TaskPriority>(priority)),
+            static_cast<double>(metrics.queueDepth[priority]));
+    }
+    out += "# TYPE bts_control_queue_depth gauge\n";
+    appendSample(out, "bts_control_queue_depth", nullptr, "", static_cast<double>(metrics.controlQueueDepth));
+    out += "# TYPE bts_worker_threads gauge\n";
+    appendSample(out, "bts_worker_threads", nullptr, "", static_cast<double>(metrics.workerCount));
+    out += "# TYPE bts_control_tasks_over_budget_total counter\n";
+    appendSample(out, "bts_control_tasks_over_budget_total", nullptr, "", static_cast<double>(metrics.control.overBudget));
+
+    out += "# HELP bts_tasks_coalesced_total Tasks not queued because one of the same type and channels was pending.\n";
+    out += "# TYPE bts_tasks_coalesced_total counter\n";
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        if (TaskCoalescer::isCoalesced(static_cast<TaskType>(type))) {
+            appendSample(out, "bts_tasks_coalesced_total", "type", taskTypeName(static_cast<TaskType>(type)),
+                static_cast<double>(metrics.overload.coalesced[type]));
+        }
+    }
+    out += "# HELP bts_tasks_dropped_total Tasks dropped on a full scheduler lane.\n";
+    out += "# TYPE bts_tasks_dropped_total counter\n";
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        appendSample(out, "bts_tasks_dropped_total", "priority", taskPriorityName(static_cast<TaskPriority>(priority)),
+            static_cast<double>(metrics.overload.dropped[priority]));
+    }
+    out += "# HELP bts_tasks_blocked_total Tasks whose producer waited on a full scheduler lane.\n";
+    out += "# TYPE bts_tasks_blocked_total counter\n";
+    for (size_t priority = 0; priority < TASK_PRIORITY_COUNT; ++priority) {
+        appendSample(out, "bts_tasks_blocked_total", "priority", taskPriorityName(static_cast<TaskPriority>(priority)),
+            static_cast<double>(metrics.overload.blocked[priority]));
+    }
+
+    out += "# HELP bts_task_failures_total Tasks whose execution returned an error.\n";
+    out += "# TYPE bts_task_failures_total counter\n";
+    for (size_t type = 0; type < TASK_TYPE_COUNT; ++type) {
+        if (metrics.taskFailures[type] != 0) {
+            appendSample(out, "bts_task_failures_total", "type", taskTypeName(static_cast<TaskType>(type)),
+                static_cast<double>(metrics.taskFailures[type]));
+        }
+    }
+    out += "# HELP bts_error_events_total Errors reported by the ingest, worker and control threads.\n";
+    out += "# TYPE bts_error_events_total counter\n";
+    appendSample(out, "bts_error_events_total", nullptr, "", static_cast<double>(metrics.errorEvents));
+    out += "# TYPE bts_error_events_dropped_total counter\n";
+    appendSample(out, "bts_error_events_dropped_total", nullptr, "", static_cast<double>(metrics.errorEventsDropped));
+
+    out += "# HELP bts_control_reaction_seconds Time from the sample causing a step transition to its control task.\n";
+    out += "# TYPE bts_control_reaction_seconds summary\n";
+    if (metrics.controlReaction.count != 0) {
+        appendSummary(out, "bts_control_reaction_seconds", "lane=\"control\"", metrics.controlReaction);
+    }
+
+    out += "# HELP bts_m4_frames_total Frames published to the data table.\n";
+    out += "# TYPE bts_m4_frames_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_m4_frames_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].frames.framesParsed));
+    }
+    out += "# HELP bts_m4_frames_dropped_total Frames missing from the sequence numbers.\n";
+    out += "# TYPE bts_m4_frames_dropped_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_m4_frames_dropped_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].frames.framesDropped));
+    }
+    out += "# TYPE bts_m4_frames_rejected_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_m4_frames_rejected_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].frames.framesRejected));
+    }
+    out += "# HELP bts_m4_frames_out_of_order_total Frames rejected for repeating or going back in the sequence.\n";
+    out += "# TYPE bts_m4_frames_out_of_order_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_m4_frames_out_of_order_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].frames.framesOutOfOrder));
+    }
+    out += "# TYPE bts_m4_frame_rate gauge\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_m4_frame_rate", "endpoint", std::to_string(i), metrics.ingest[i].frameRate);
+    }
+    out += "# HELP bts_ingest_batch_seconds Time from receiving a batch of frames to queueing its last task.\n";
+    out += "# TYPE bts_ingest_batch_seconds summary\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        if (metrics.ingest[i].batchLatency.count != 0) {
+            appendSummary(out, "bts_ingest_batch_seconds", "endpoint=\"" + std::to_string(i) + "\"",
+                metrics.ingest[i].batchLatency);
+        }
+    }
+
+    out += "# HELP bts_cv_switches_total Steps that reached their target voltage and switched to CV.\n";
+    out += "# TYPE bts_cv_switches_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_cv_switches_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].cvSwitches));
+    }
+    out += "# HELP bts_steps_completed_total Steps and control routines that ended.\n";
+    out += "# TYPE bts_steps_completed_total counter\n";
+    for (size_t i = 0; i < metrics.ingest.size(); ++i) {
+        appendSample(out, "bts_steps_completed_total", "endpoint", std::to_string(i),
+            static_cast<double>(metrics.ingest[i].stepsCompleted));
+    }
+
+    out += "# HELP bts_channel_callbacks_total Callback tasks queued for a channel.\n";
+    out += "# TYPE bts_channel_callbacks_total counter\n";
+    for (size_t channel = 0; channel < metrics.callbackCounts.size(); ++channel) {
+        if (metrics.callbackCounts[channel] != 0) {
+            appendSample(out, "bts_channel_callbacks_total", "channel", std::to_string(channel),
+                static_cast<double>(metrics.callbackCounts[channel]));
+        }
+    }
+    out += "# HELP bts_channel_samples_suppressed_total Samples of subscribed channels that triggered no callbacks.\n";
+    out += "# TYPE bts_channel_samples_suppressed_total counter\n";
+    appendSample(out, "bts_channel_samples_suppressed_total", nullptr, "", static_cast<double>(metrics.callbacksSuppressed));
+    return out;
+}
@@ -0,0 +1,95 @@
+#ifndef SERVICEMETRICS_H
+#define SERVICEMETRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ControlExecutor.h"
+#include "M4FrameParser.h"
+#include "Task.h"
+#include "TaskCoalescer.h"
+#include "TaskMetrics.h"
+
+/**
+ * @brief Latencies of one task type and priority, over all threads.
+ */
+struct TaskLatencyMetrics {
+    LatencySummary queueWait;   // From addTask() or the control ring push to the start of execute()
+    LatencySummary execution;   // Time spent in execute()
+};
+
+/**
+ * @brief Ingest metrics of one M4 endpoint.
+ */
+struct IngestMetrics {
+    M4FrameStatistics frames;   // Parsed, dropped and rejected frames
+    double frameRate = 0.0;     // Frames per second over the last measurement window
+    LatencySummary batchLatency;// From the reception of a batch's first frame to its last task being queued
+    uint64_t cvSwitches = 0;    // Steps of the endpoint's channels that switched from CC to CV
+    uint64_t stepsCompleted = 0;// Steps and control routines of the endpoint's channels that ended
+};
+
+/**
+ * @brief Runtime metrics of a BatteryTestingService, see BatteryTestingService::getMetrics().
+ */
+struct ServiceMetrics {
+    uint64_t timestampNs = 0;   // Monotonic time of the snapshot
+    TaskLatencyMetrics tasks[TASK_TYPE_COUNT][TASK_PRIORITY_COUNT];
+    size_t queueDepth[TASK_PRIORITY_COUNT] = {};   // Tasks waiting in each scheduler lane
+    size_t controlQueueDepth = 0;                  // Tasks waiting in the control lane
+    size_t workerCount = 0;
+    ControlExecutorStatistics control;
+    TaskOverloadStatistics overload;               // Coalesced, dropped and blocked tasks
+    uint64_t taskFailures[TASK_TYPE_COUNT] = {};   // Tasks whose execute() returned an error
+    uint64_t errorEvents = 0;                      // Events queued to the ErrorEventRing
+    uint64_t errorEventsDropped = 0;               // Events dropped on a full ErrorEventRing
+    LatencySummary controlReaction;                // From the sample causing a step transition to its control task
+    std::vector<IngestMetrics> ingest;             // One per endpoint, in topology order
+    std::vector<uint64_t> callbackCounts;          // Callback tasks queued per global channel
+    uint64_t callbacksSuppressed = 0;              // Samples of subscribed channels within their rate and deadbands
+};
+
+/**
+ * @brief Adds up the task histograms of several threads.
+ */
+class TaskMetricsSnapshot {
+public:
+    /**
+     * @brief Adds the histograms of a thread to the snapshot.
+     *
+     * @param shard The histograms of the thread.
+     */
+    void add(const TaskMetricsShard& shard);
+
+    /**
+     * @brief Computes the summaries of every task type and priority.
+     *
+     * @param metrics Receives the summaries in its tasks table and the failure counts.
+     */
+    void summarize(ServiceMetrics& metrics) const;
+
+private:
+    struct Counts {
+        uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS] = {};
+        uint64_t total = 0;
+    };
+
+    Counts queueWait[TASK_TYPE_COUNT][TASK_PRIORITY_COUNT];
+    Counts execution[TASK_TYPE_COUNT][TASK_PRIORITY_COUNT];
+    uint64_t failures[TASK_TYPE_COUNT] = {};
+};
+
+/**
+ * @brief Formats metrics in the Prometheus text exposition format.
+ *
+ * Latencies are exported as summaries in seconds; task types and
+ * priorities that never ran and channels without callbacks are left out.
+ *
+ * @param metrics The metrics.
+ * @return The text, one sample per line.
+ */
+std::string formatPrometheusMetrics(const ServiceMetrics& metrics);
+
+#endif
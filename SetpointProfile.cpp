@@ -0,0 +1,116 @@
+#include "SetpointProfile.h"
+
+#include <cmath>
+
+/**
+ * @brief Builds a current ramp from 0 to a final current.
+ *
+ * @param current The final current, held once reached.
+ * @param rampRate The ramp slope in A per second, must not be 0.
+ * @return The profile.
+ */
+SetpointProfile SetpointProfile::currentRamp(float current, float rampRate) {
+    SetpointProfile profile;
+    profile.setCurrentRamp(current, rampRate);
+    return profile;
+}
+
+/**
+ * @brief Makes this profile a current ramp from 0 to a final current, in place.
+ *
+ * @param current The final current, held once reached.
+ * @param rampRate The ramp slope in A per second, must not be 0.
+ */
+void SetpointProfile::setCurrentRamp(float current, float rampRate) {
+    mode = ProfileMode::Current;
+    points.assign({{0.0f, 0.0f}, {std::fabs(current / rampRate), current}});
+    repeatCount = 1;
+    minVoltage = -std::numeric_limits<float>::max();
+    maxVoltage = std::numeric_limits<float>::max();
+}
+
+/**
+ * @brief Builds a train of rectangular pulses.
+ *
+ * @param mode The quantity of the pulses.
+ * @param high The value during a pulse.
+ * @param low The value between pulses.
+ * @param highTime The duration of a pulse in seconds.
+ * @param lowTime The time between pulses in seconds.
+ * @param count The number of pulses, 0 until the next command.
+ * @return The profile.
+ */
+SetpointProfile SetpointProfile::pulses(ProfileMode mode, float high, float low, float highTime, float lowTime,
+    uint32_t count) {
+    SetpointProfile profile;
+    profile.mode = mode;
+    profile.points = {{0.0f, high}, {highTime, high}, {highTime, low}, {highTime + lowTime, low}};
+    profile.repeatCount = count;
+    return profile;
+}
+
+/**
+ * @brief Checks that the M4 can run the profile.
+ *
+ * @param error Receives the reason if it cannot.
+ * @return True if the profile is valid.
+ */
+bool SetpointProfile::validate(std::string& error) const {
+    if (points.empty()) {
+        error = "Setpoint profile has no points";
+        return false;
+    }
+    if (points.size() > SETPOINT_PROFILE_MAX_POINTS) {
+        error = "Setpoint profile has " + std::to_string(points.size()) + " points, at most " +
+            std::to_string(SETPOINT_PROFILE_MAX_POINTS) + " fit the M4";
+        return false;
+    }
+    if (points.front().time != 0.0f) {
+        error = "Setpoint profile must start at time 0";
+        return false;
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (!std::isfinite(points[i].time) || !std::isfinite(points[i].value) ||
+            (i > 0 && points[i].time < points[i - 1].time)) {
+            error = "Setpoint profile point " + std::to_string(i) + " is not finite or goes back in time";
+            return false;
+        }
+    }
+    if (repeatCount != 1 && duration() <= 0.0f) {
+        error = "Repeated setpoint profile must last longer than 0 s";
+        return false;
+    }
+    if (!(minVoltage < maxVoltage)) {
+        error = "Setpoint profile voltage window is empty";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Interpolates the profile, the way the M4 does.
+ *
+ * Of two points with the same time, the later one applies from that time on.
+ *
+ * @param time Seconds from the start of the repetition, at most duration().
+ * @param segment Index of the last point at or before the time, kept by the caller to walk the points in order.
+ * @return The setpoint.
+ */
+float SetpointProfile::valueAt(float time, size_t& segment) const {
+    if (points.empty()) {
+        return 0.0f;
+    }
+    if (segment >= points.size() || points[segment].time > time) {
+        segment = 0;
+    }
+    // Walk to the last point at or before the time
+    while (segment + 1 < points.size() && points[segment + 1].time <= time) {
+        ++segment;
+    }
+    const ProfilePoint& from = points[segment];
+    if (segment + 1 == points.size() || time < from.time) {
+        return from.value;
+    }
+    const ProfilePoint& to = points[segment + 1];
+    return from.value + (to.value - from.value) * (time - from.time) / (to.time - from.time);
+}
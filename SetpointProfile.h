@@ -0,0 +1,111 @@
+#ifndef SETPOINTPROFILE_H
+#define SETPOINTPROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Largest profile, the number of points the M4 can hold
+#define SETPOINT_PROFILE_MAX_POINTS 8192
+
+/**
+ * @brief Quantity a setpoint profile controls.
+ */
+enum class ProfileMode : uint8_t {
+    Current, // Values in A
+    Voltage, // Values in V
+    Power    // Values in W
+};
+
+/**
+ * @brief One point of a setpoint profile.
+ */
+struct ProfilePoint {
+    float time;  // Seconds from the start of the repetition
+    float value; // Setpoint in the unit of the mode
+};
+
+/**
+ * @brief Piecewise-linear setpoint trajectory executed by the M4 core.
+ *
+ * The profile is uploaded once with ChannelCtrlService::doProfile(), and
+ * the M4 interpolates it at every control tick, so a ramp, a pulse train or
+ * a drive cycle of thousands of points costs the host one command instead
+ * of one command per tick. The M4 reports the state of the profile in the
+ * ProfileState field of the channel records: running, completed (the last
+ * value is then held) or stopped by the voltage window.
+ *
+ * Immutable once uploaded; services share it through a shared_ptr.
+ */
+struct SetpointProfile {
+    ProfileMode mode = ProfileMode::Current;
+    // Times must not decrease; two points with the same time make a step
+    std::vector<ProfilePoint> points;
+    // Repetitions of the points, 0 repeats until the next command
+    uint32_t repeatCount = 1;
+    // Voltage window; leaving it sets the channel to rest on the M4, without a host round trip
+    float minVoltage = -std::numeric_limits<float>::max();
+    float maxVoltage = std::numeric_limits<float>::max();
+
+    /**
+     * @brief Builds a current ramp from 0 to a final current.
+     *
+     * @param current The final current, held once reached.
+     * @param rampRate The ramp slope in A per second, must not be 0.
+     * @return The profile.
+     */
+    static SetpointProfile currentRamp(float current, float rampRate);
+
+    /**
+     * @brief Makes this profile a current ramp from 0 to a final current, in place.
+     *
+     * Reuses the storage of the points, so it does not allocate once the
+     * profile has held a ramp.
+     *
+     * @param current The final current, held once reached.
+     * @param rampRate The ramp slope in A per second, must not be 0.
+     */
+    void setCurrentRamp(float current, float rampRate);
+
+    /**
+     * @brief Builds a train of rectangular pulses.
+     *
+     * @param mode The quantity of the pulses.
+     * @param high The value during a pulse.
+     * @param low The value between pulses.
+     * @param highTime The duration of a pulse in seconds.
+     * @param lowTime The time between pulses in seconds.
+     * @param count The number of pulses, 0 until the next command.
+     * @return The profile.
+     */
+    static SetpointProfile pulses(ProfileMode mode, float high, float low, float highTime, float lowTime,
+        uint32_t count);
+
+    /**
+     * @brief Checks that the M4 can run the profile.
+     *
+     * @param error Receives the reason if it cannot.
+     * @return True if the profile is valid.
+     */
+    bool validate(std::string& error) const;
+
+    /**
+     * @brief Gets the duration of one repetition.
+     *
+     * @return The time of the last point, in seconds.
+     */
+    float duration() const { return points.empty() ? 0.0f : points.back().time; }
+
+    /**
+     * @brief Interpolates the profile, the way the M4 does.
+     *
+     * @param time Seconds from the start of the repetition, at most duration().
+     * @param segment Index of the last point at or before the time, kept by the caller to walk the points in order.
+     * @return The setpoint.
+     */
+    float valueAt(float time, size_t& segment) const;
+};
+
+#endif
@@ -0,0 +1,282 @@
+#include "SharedChannelTable.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "The seqlocks of a shared table must be lock-free to work across processes");
+static_assert(CHANNEL_FIELD_COUNT <= SHARED_TABLE_MAX_FIELDS, "The header lists every field of the schema");
+
+// Offset of the table in the segment: the header rounded up to a page, so the table is page-aligned
+constexpr size_t TABLE_OFFSET = (sizeof(SharedTableHeader) + 4095) / 4096 * 4096;
+
+/**
+ * @brief Checks that a header describes the table layout of this build.
+ *
+ * @param header The header of the segment.
+ * @param segmentSize The size of the mapping.
+ * @param error Receives the mismatch.
+ * @return True if the table can be read with this build's ChannelDataTable.
+ */
+bool checkHeader(const SharedTableHeader& header, size_t segmentSize, std::string& error) {
+    if (header.magic != SHARED_TABLE_MAGIC) {
+        error = "not a channel table segment";
+        return false;
+    }
+    if (header.layoutVersion != SHARED_TABLE_LAYOUT_VERSION || header.headerSize != sizeof(SharedTableHeader)) {
+        error = "layout version " + std::to_string(header.layoutVersion) + ", expected " +
+            std::to_string(SHARED_TABLE_LAYOUT_VERSION);
+        return false;
+    }
+    if (header.fieldCount != CHANNEL_FIELD_COUNT || header.rawFieldCount != CHANNEL_RAW_FIELD_COUNT) {
+        error = "the schema has " + std::to_string(header.fieldCount) + " fields, expected " +
+            std::to_string(CHANNEL_FIELD_COUNT);
+        return false;
+    }
+    for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+        const char* expected = channelFieldName(static_cast<ChannelField>(i));
+        if (std::strncmp(header.fieldNames[i], expected, SHARED_TABLE_FIELD_NAME_SIZE) != 0) {
+            error = "field " + std::to_string(i) + " is not \"" + expected + "\"";
+            return false;
+        }
+    }
+
+    ChannelDataTable::MemoryLayout layout = ChannelDataTable::getMemoryLayout(header.channelCount);
+    if (header.versionsOffset != TABLE_OFFSET + layout.versionsOffset ||
+        header.versionStride != layout.versionStride ||
+        header.versionWordOffset != layout.versionWordOffset ||
+        header.sequenceOffset != layout.sequenceOffset ||
+        header.receiveTimeOffset != layout.receiveTimeOffset ||
+        header.sampleTimeOffset != layout.sampleTimeOffset ||
+        header.storageOffset != TABLE_OFFSET + layout.storageOffset ||
+        header.columnStride != layout.columnStride) {
+        error = "the table layout differs from this build";
+        return false;
+    }
+    if (header.segmentSize != TABLE_OFFSET + layout.totalSize || segmentSize < header.segmentSize) {
+        error = "the segment is truncated";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Destructor for the SharedChannelTable class. Closes the segment.
+ */
+SharedChannelTable::~SharedChannelTable() {
+    close();
+}
+
+/**
+ * @brief Creates the segment of a table, replacing a stale one of the same name.
+ *
+ * A segment left by a publisher that did not exit cleanly is unlinked
+ * first; its readers keep their mapping until they reopen the name.
+ *
+ * @param config The name and permissions of the segment.
+ * @param channelCount The number of channels of the table.
+ * @param error Receives the reason on failure.
+ * @return True if the segment was created; its state is Initializing until markLive().
+ */
+bool SharedChannelTable::create(const SharedTableConfig& config, size_t channelCount, std::string& error) {
+    close();
+    if (config.name.size() < 2 || config.name[0] != '/' || config.name.find('/', 1) != std::string::npos) {
+        error = "invalid shared memory name \"" + config.name + "\", expected \"/name\"";
+        return false;
+    }
+
+    ChannelDataTable::MemoryLayout layout = ChannelDataTable::getMemoryLayout(channelCount);
+    size_t size = TABLE_OFFSET + layout.totalSize;
+
+    shm_unlink(config.name.c_str());
+    int segment = shm_open(config.name.c_str(), O_CREAT | O_EXCL | O_RDWR, static_cast<mode_t>(config.permissions));
+    if (segment < 0) {
+        error = "cannot create " + config.name + ": " + std::strerror(errno);
+        return false;
+    }
+    // The permissions are not subject to the umask, so readers of other users can map the segment
+    fchmod(segment, static_cast<mode_t>(config.permissions));
+    if (ftruncate(segment, static_cast<off_t>(size)) != 0) {
+        error = "cannot size " + config.name + ": " + std::strerror(errno);
+        ::close(segment);
+        shm_unlink(config.name.c_str());
+        return false;
+    }
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+    if (memory == MAP_FAILED) {
+        error = "cannot map " + config.name + ": " + std::strerror(errno);
+        ::close(segment);
+        shm_unlink(config.name.c_str());
+        return false;
+    }
+
+    // The segment is zero-filled, so state already reads Initializing
+    SharedTableHeader* created = static_cast<SharedTableHeader*>(memory);
+    created->magic = SHARED_TABLE_MAGIC;
+    created->layoutVersion = SHARED_TABLE_LAYOUT_VERSION;
+    created->headerSize = sizeof(SharedTableHeader);
+    created->segmentSize = size;
+    created->createdAt = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    created->publisherPid = static_cast<uint32_t>(getpid());
+    created->channelCount = static_cast<uint32_t>(channelCount);
+    created->fieldCount = CHANNEL_FIELD_COUNT;
+    created->rawFieldCount = CHANNEL_RAW_FIELD_COUNT;
+    created->versionsOffset = TABLE_OFFSET + layout.versionsOffset;
+    created->versionStride = static_cast<uint32_t>(layout.versionStride);
+    created->versionWordOffset = static_cast<uint32_t>(layout.versionWordOffset);
+    created->sequenceOffset = static_cast<uint32_t>(layout.sequenceOffset);
+    created->receiveTimeOffset = static_cast<uint32_t>(layout.receiveTimeOffset);
+    created->storageOffset = TABLE_OFFSET + layout.storageOffset;
+    created->columnStride = static_cast<uint32_t>(layout.columnStride);
+    created->sampleTimeOffset = static_cast<uint32_t>(layout.sampleTimeOffset);
+    for (size_t i = 0; i < CHANNEL_FIELD_COUNT; ++i) {
+        std::strncpy(created->fieldNames[i], channelFieldName(static_cast<ChannelField>(i)),
+            SHARED_TABLE_FIELD_NAME_SIZE - 1);
+    }
+
+    name = config.name;
+    fd = segment;
+    header = created;
+    segmentSize = size;
+    return true;
+}
+
+/**
+ * @brief Gets the memory of the table, to be passed to the ChannelDataTable constructor.
+ *
+ * @return The memory, nullptr if no segment is open.
+ */
+void* SharedChannelTable::getTableMemory() const {
+    return header ? reinterpret_cast<unsigned char*>(header) + TABLE_OFFSET : nullptr;
+}
+
+/**
+ * @brief Marks the table as initialized, so readers may use it.
+ */
+void SharedChannelTable::markLive() {
+    if (header) {
+        header->state.store(static_cast<uint32_t>(SharedTableState::Live), std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Marks the segment closed for its readers, unmaps and unlinks it.
+ *
+ * The name is only unlinked if it still refers to this segment, so a newer
+ * publisher of the same name is left alone.
+ */
+void SharedChannelTable::close() {
+    if (!header) {
+        return;
+    }
+    header->state.store(static_cast<uint32_t>(SharedTableState::Closed), std::memory_order_release);
+    munmap(header, segmentSize);
+    header = nullptr;
+
+    struct stat mine;
+    struct stat current;
+    int named = shm_open(name.c_str(), O_RDONLY, 0);
+    if (named >= 0) {
+        if (fstat(fd, &mine) == 0 && fstat(named, &current) == 0 &&
+            mine.st_dev == current.st_dev && mine.st_ino == current.st_ino) {
+            shm_unlink(name.c_str());
+        }
+        ::close(named);
+    }
+    ::close(fd);
+    fd = -1;
+    name.clear();
+    segmentSize = 0;
+}
+
+/**
+ * @brief Destructor for the SharedChannelTableReader class. Unmaps the segment.
+ */
+SharedChannelTableReader::~SharedChannelTableReader() {
+    close();
+}
+
+/**
+ * @brief Maps a published table, replacing the one mapped before.
+ *
+ * The mapping is read-only, so a reader can never disturb the publisher.
+ *
+ * @param name The POSIX shared-memory name of the segment.
+ * @param error Receives the reason on failure.
+ * @return True on success, false if the segment is missing, not live or has another layout or schema.
+ */
+bool SharedChannelTableReader::open(const std::string& name, std::string& error) {
+    close();
+    int segment = shm_open(name.c_str(), O_RDONLY, 0);
+    if (segment < 0) {
+        error = "cannot open " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(segment, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(SharedTableHeader)) {
+        error = name + " is not a channel table segment";
+        ::close(segment);
+        return false;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, segment, 0);
+    // The mapping stays valid without the descriptor
+    ::close(segment);
+    if (memory == MAP_FAILED) {
+        error = "cannot map " + name + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const SharedTableHeader* mapped = static_cast<const SharedTableHeader*>(memory);
+    if (!checkHeader(*mapped, size, error) ||
+        mapped->state.load(std::memory_order_acquire) != static_cast<uint32_t>(SharedTableState::Live)) {
+        if (error.empty()) {
+            error = name + " is not live";
+        }
+        munmap(memory, size);
+        return false;
+    }
+
+    header = mapped;
+    segmentSize = size;
+    // Attached without initializing; the table is only read through its const interface
+    table = std::make_unique<ChannelDataTable>(mapped->channelCount,
+        static_cast<unsigned char*>(memory) + TABLE_OFFSET, false);
+    return true;
+}
+
+/**
+ * @brief Unmaps the segment.
+ */
+void SharedChannelTableReader::close() {
+    table.reset();
+    if (header) {
+        munmap(const_cast<SharedTableHeader*>(header), segmentSize);
+        header = nullptr;
+        segmentSize = 0;
+    }
+}
+
+/**
+ * @brief Copies out a consistent snapshot of a channel.
+ *
+ * @param channel The channel number.
+ * @param snapshot Receives the channel's values, their sequence number and reception time.
+ * @return True on success, false for an unknown channel or a writer that did not finish a write.
+ */
+bool SharedChannelTableReader::read(uint32_t channel, ChannelSnapshot& snapshot) const {
+    if (!table || !table->contains(channel)) {
+        return false;
+    }
+    return table->tryRead(channel, snapshot, SHARED_TABLE_READ_ATTEMPTS);
+}
@@ -0,0 +1,228 @@
+#ifndef SHAREDCHANNELTABLE_H
+#define SHAREDCHANNELTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "ChannelDataTable.h"
+
+// Identifies a shared channel table segment ("BTSC")
+#define SHARED_TABLE_MAGIC 0x43535442u
+// Version of the segment layout, bumped on any change readers must know about
+#define SHARED_TABLE_LAYOUT_VERSION 2
+// Capacity of the field name list of the header
+#define SHARED_TABLE_MAX_FIELDS 32
+// Size of one field name in the header, including the terminating zero
+#define SHARED_TABLE_FIELD_NAME_SIZE 32
+// Copies a reader tries before giving up on a channel whose writer does not finish
+#define SHARED_TABLE_READ_ATTEMPTS 4096
+
+/**
+ * @brief Where the channel table is published for other processes.
+ */
+struct SharedTableConfig {
+    // POSIX shared-memory name, e.g. "/bts_channels"; empty to keep the table private
+    std::string name;
+    // Permissions of the segment; readers only need read access
+    uint32_t permissions = 0644;
+};
+
+/**
+ * @brief Life cycle of a segment, in SharedTableHeader::state.
+ */
+enum class SharedTableState : uint32_t {
+    Initializing,   // The publisher is setting up the table
+    Live,           // The publisher writes the table
+    Closed          // The publisher stopped; reopen the name to find its successor
+};
+
+/**
+ * @brief Versioned header at the start of a shared channel table segment.
+ *
+ * Describes the schema and the ChannelDataTable::MemoryLayout of the table
+ * that follows it, so readers in other processes and other languages can
+ * find every seqlock and column without sharing the C++ definitions. All
+ * offsets are in bytes from the start of the segment. A reader must check
+ * magic, layoutVersion and the field names before using the offsets.
+ *
+ * To read channel n: load the version word at versionsOffset + n *
+ * versionStride with acquire ordering and retry while it is odd, copy the
+ * values at storageOffset + (field * columnStride + n) * 4 and the
+ * sequence, receive time and sample time, then load the version word again; the copy is
+ * consistent if it is unchanged. Seqlock.h explains the memory ordering.
+ */
+struct SharedTableHeader {
+    uint32_t magic;
+    uint32_t layoutVersion;
+    uint32_t headerSize;
+    std::atomic<uint32_t> state;        // SharedTableState
+    uint64_t segmentSize;
+    uint64_t createdAt;                 // CLOCK_REALTIME in nanoseconds, unique per publisher start
+    uint32_t publisherPid;
+    uint32_t channelCount;
+    uint32_t fieldCount;
+    uint32_t rawFieldCount;             // Fields measured by the M4, which come first
+    uint64_t versionsOffset;
+    uint32_t versionStride;
+    uint32_t versionWordOffset;         // uint32_t seqlock version within a channel's seqlock
+    uint32_t sequenceOffset;            // uint64_t samples published
+    uint32_t receiveTimeOffset;         // uint64_t CLOCK_MONOTONIC nanoseconds of the latest sample
+    uint64_t storageOffset;             // float columns
+    uint32_t columnStride;              // Floats from one column to the next
+    uint32_t sampleTimeOffset;          // uint64_t M4 microseconds of the latest sample, 0 if unknown
+    char fieldNames[SHARED_TABLE_MAX_FIELDS][SHARED_TABLE_FIELD_NAME_SIZE];
+};
+
+/**
+ * @brief POSIX shared-memory segment holding the live channel table.
+ *
+ * The publisher creates the segment and constructs the data service's
+ * ChannelDataTable in it, so the ingest and worker threads write the
+ * shared table directly: publishing costs no copy and no thread.
+ * Readers map the segment read-only and use the same lock-free seqlock
+ * reads as the in-process readers, with no system call per read. The
+ * segment is unlinked when the publisher closes it.
+ */
+class SharedChannelTable {
+public:
+    SharedChannelTable() = default;
+
+    /**
+     * @brief Destructor for the SharedChannelTable class. Closes the segment.
+     */
+    ~SharedChannelTable();
+
+    SharedChannelTable(const SharedChannelTable&) = delete;
+    SharedChannelTable& operator=(const SharedChannelTable&) = delete;
+
+    /**
+     * @brief Creates the segment of a table, replacing a stale one of the same name.
+     *
+     * @param config The name and permissions of the segment.
+     * @param channelCount The number of channels of the table.
+     * @param error Receives the reason on failure.
+     * @return True if the segment was created; its state is Initializing until markLive().
+     */
+    bool create(const SharedTableConfig& config, size_t channelCount, std::string& error);
+
+    /**
+     * @brief Gets the memory of the table, to be passed to the ChannelDataTable constructor.
+     *
+     * @return The memory, nullptr if no segment is open.
+     */
+    void* getTableMemory() const;
+
+    /**
+     * @brief Marks the table as initialized, so readers may use it.
+     */
+    void markLive();
+
+    /**
+     * @brief Marks the segment closed for its readers, unmaps and unlinks it.
+     */
+    void close();
+
+    /**
+     * @brief Checks if a segment is open.
+     *
+     * @return True between create() and close().
+     */
+    bool isOpen() const { return header != nullptr; }
+
+    /**
+     * @brief Gets the name of the segment.
+     *
+     * @return The POSIX shared-memory name, empty if no segment is open.
+     */
+    const std::string& getName() const { return name; }
+
+private:
+    std::string name;
+    int fd = -1;
+    SharedTableHeader* header = nullptr;
+    size_t segmentSize = 0;
+};
+
+/**
+ * @brief Read-only view of a channel table published by another process.
+ *
+ * Maps the segment read-only, checks its header against the schema of
+ * this build and reads channels in place. Polling a channel costs one
+ * seqlock copy and no system call. When isLive() turns false, the
+ * publisher stopped: open() the name again to find the next one.
+ */
+class SharedChannelTableReader {
+public:
+    SharedChannelTableReader() = default;
+
+    /**
+     * @brief Destructor for the SharedChannelTableReader class. Unmaps the segment.
+     */
+    ~SharedChannelTableReader();
+
+    SharedChannelTableReader(const SharedChannelTableReader&) = delete;
+    SharedChannelTableReader& operator=(const SharedChannelTableReader&) = delete;
+
+    /**
+     * @brief Maps a published table, replacing the one mapped before.
+     *
+     * @param name The POSIX shared-memory name of the segment.
+     * @param error Receives the reason on failure.
+     * @return True on success, false if the segment is missing, not live or has another layout or schema.
+     */
+    bool open(const std::string& name, std::string& error);
+
+    /**
+     * @brief Unmaps the segment.
+     */
+    void close();
+
+    /**
+     * @brief Checks if the publisher still writes the table.
+     *
+     * @return True if a segment is mapped and its state is Live.
+     */
+    bool isLive() const {
+        return header && header->state.load(std::memory_order_acquire) == static_cast<uint32_t>(SharedTableState::Live);
+    }
+
+    /**
+     * @brief Gets the number of channels of the table.
+     *
+     * @return The number of channels, 0 if no segment is mapped.
+     */
+    size_t getChannelCount() const { return table ? table->getChannelCount() : 0; }
+
+    /**
+     * @brief Copies out a consistent snapshot of a channel.
+     *
+     * @param channel The channel number.
+     * @param snapshot Receives the channel's values, their sequence number and reception time.
+     * @return True on success, false for an unknown channel or a writer that did not finish a write.
+     */
+    bool read(uint32_t channel, ChannelSnapshot& snapshot) const;
+
+    /**
+     * @brief Gets the mapped table, for reads of single values or blocks.
+     *
+     * @return The table, nullptr if no segment is mapped.
+     */
+    const ChannelDataTable* getTable() const { return table.get(); }
+
+    /**
+     * @brief Gets the header of the mapped segment.
+     *
+     * @return The header, nullptr if no segment is mapped.
+     */
+    const SharedTableHeader* getHeader() const { return header; }
+
+private:
+    const SharedTableHeader* header = nullptr;
+    size_t segmentSize = 0;
+    std::unique_ptr<ChannelDataTable> table;
+};
+
+#endif
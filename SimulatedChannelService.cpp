@@ -0,0 +1,110 @@
+#include "SimulatedChannelService.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor for the SimulatedM4Endpoint class. Starts the sample timer.
+ *
+ * @param simulator The simulated channels of the endpoint.
+ * @param sampleRate The number of frames per second.
+ */
+SimulatedM4Endpoint::SimulatedM4Endpoint(std::shared_ptr<ChannelSimulator> simulator, double sampleRate) :
+    simulator(std::move(simulator)),
+    period(1.0 / std::max(sampleRate, 1.0)),
+    timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    sequence(0),
+    sampleCount(0),
+    skippedFrames(0) {
+    if (timerFd < 0 || wakeFd < 0) {
+        std::cerr << "Cannot create simulated M4 endpoint: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    timespec interval;
+    uint64_t periodNs = static_cast<uint64_t>(period * 1e9);
+    interval.tv_sec = static_cast<time_t>(periodNs / 1000000000);
+    interval.tv_nsec = static_cast<long>(periodNs % 1000000000);
+    itimerspec timer;
+    timer.it_interval = interval;
+    timer.it_value = interval;
+    timerfd_settime(timerFd, 0, &timer, nullptr);
+}
+
+/**
+ * @brief Destructor for the SimulatedM4Endpoint class.
+ */
+SimulatedM4Endpoint::~SimulatedM4Endpoint() {
+    if (timerFd >= 0) {
+        close(timerFd);
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+/**
+ * @brief Blocks until the next sample is due, then simulates and frames the due samples.
+ *
+ * @param frames Receives the frames, each with its reception time.
+ * @param maxFrames The capacity of frames.
+ * @param timeoutMs The longest wait in milliseconds, -1 to wait for a sample or wake() only.
+ * @return The number of frames, 0 if woken up or timed out before a sample was due.
+ */
+size_t SimulatedM4Endpoint::waitForFrames(M4FrameBuffer* frames, size_t maxFrames, int timeoutMs) {
+    if (timerFd < 0 || wakeFd < 0) {
+        return 0;
+    }
+
+    pollfd fds[2] = {{timerFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+    if (poll(fds, 2, timeoutMs) < 0) {
+        return 0;
+    }
+    if (fds[1].revents & POLLIN) {
+        uint64_t value;
+        ssize_t ignored = read(wakeFd, &value, sizeof(value));
+        (void)ignored;
+    }
+
+    uint64_t due = 0;
+    if (!(fds[0].revents & POLLIN) || read(timerFd, &due, sizeof(due)) != sizeof(due)) {
+        return 0;
+    }
+
+    // Simulate the samples whose frames cannot be delivered in this call
+    size_t count = static_cast<size_t>(std::min<uint64_t>(due, maxFrames));
+    if (due > count) {
+        uint64_t skipped = due - count;
+        simulator->step(period * static_cast<double>(skipped));
+        sampleCount += skipped;
+        sequence += static_cast<uint32_t>(skipped);
+        skippedFrames.store(skippedFrames.load(std::memory_order_relaxed) + skipped, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        simulator->step(period);
+        ++sampleCount;
+        uint64_t timestamp = static_cast<uint64_t>(static_cast<double>(sampleCount) * period * 1e6);
+        frames[i].size = static_cast<uint32_t>(simulator->encodeFrame(sequence++, timestamp, frames[i].data));
+        frames[i].receiveTime = monotonicNanoseconds();
+    }
+    return count;
+}
+
+/**
+ * @brief Interrupts a waitForFrames() call in progress, or the next one.
+ */
+void SimulatedM4Endpoint::wake() {
+    uint64_t value = 1;
+    ssize_t ignored = write(wakeFd, &value, sizeof(value));
+    (void)ignored;
+}
@@ -0,0 +1,172 @@
+#ifndef SIMULATEDCHANNELSERVICE_H
+#define SIMULATEDCHANNELSERVICE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "ChannelService.h"
+#include "ChannelSimulator.h"
+#include "M4Endpoint.h"
+
+/**
+ * @brief Channel control service driving a ChannelSimulator instead of an M4 core.
+ *
+ * Commands are queued to the simulator of the endpoint and take effect at
+ * its next sample. Makes no console output, so it can run at full load.
+ */
+class SimulatedChannelCtrlService : public ChannelCtrlService {
+public:
+    /**
+     * @brief Constructor for the SimulatedChannelCtrlService class.
+     *
+     * @param simulator The simulated channels of the endpoint, shared with its SimulatedM4Endpoint.
+     */
+    explicit SimulatedChannelCtrlService(std::shared_ptr<ChannelSimulator> simulator) :
+        simulator(std::move(simulator)) {}
+
+    /**
+     * @brief Performs constant current control on a channel.
+     *
+     * @param channel The channel number.
+     * @param current The target current value.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel the simulator does not have.
+     */
+    ErrorLogging::Status doConstantCurrent(uint32_t channel, float current) override {
+        if (channel >= simulator->getChannelCount()) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
+        }
+        simulator->command(channel, ChannelCommandMode::ConstantCurrent, current);
+        return {};
+    }
+
+    /**
+     * @brief Performs constant voltage control on a channel.
+     *
+     * @param channel The channel number.
+     * @param voltage The target voltage value.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel the simulator does not have.
+     */
+    ErrorLogging::Status doConstantVoltage(uint32_t channel, float voltage) override {
+        if (channel >= simulator->getChannelCount()) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
+        }
+        simulator->command(channel, ChannelCommandMode::ConstantVoltage, voltage);
+        return {};
+    }
+
+    /**
+     * @brief Sets the channel to a rest state (open circuit).
+     *
+     * @param channel The channel number.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel the simulator does not have.
+     */
+    ErrorLogging::Status doRest(uint32_t channel) override {
+        if (channel >= simulator->getChannelCount()) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
+        }
+        simulator->command(channel, ChannelCommandMode::Rest);
+        return {};
+    }
+
+    /**
+     * @brief Turns off the channel.
+     *
+     * @param channel The channel number.
+     * @return Success, or CHANNEL_NOT_FOUND for a channel the simulator does not have.
+     */
+    ErrorLogging::Status doOFF(uint32_t channel) override {
+        if (channel >= simulator->getChannelCount()) {
+            return ErrorLogging::makeError(ErrorLogging::ErrorCode::CHANNEL_NOT_FOUND);
+        }
+        simulator->command(channel, ChannelCommandMode::Off);
+        return {};
+    }
+
+    /**
+     * @brief Applies commands to a group of channels at the same simulated sample.
+     *
+     * @param batch The commands, one per channel set in the channel mask.
+     * @return Success.
+     */
+    ErrorLogging::Status doBatch(const ChannelCommandBatch& batch) override {
+        simulator->command(batch);
+        return {};
+    }
+
+    /**
+     * @brief Runs a setpoint profile on a group of channels from the same simulated sample.
+     *
+     * @param channelMask The channels, bit n for channel n.
+     * @param profile The profile.
+     * @return Success.
+     */
+    ErrorLogging::Status doProfile(uint64_t channelMask, const std::shared_ptr<const SetpointProfile>& profile) override {
+        simulator->profile(channelMask, profile);
+        return {};
+    }
+
+private:
+    std::shared_ptr<ChannelSimulator> simulator;
+};
+
+/**
+ * @brief Channel data service for simulated runs.
+ *
+ * The data table of the production ingest path, fed by the simulated M4
+ * cores.
+ */
+class SimulatedChannelDataService : public TableChannelDataService {
+public:
+    using TableChannelDataService::TableChannelDataService;
+};
+
+/**
+ * @brief M4 endpoint producing the frames of a ChannelSimulator at a fixed rate.
+ *
+ * A periodic timerfd paces the samples, so the ingest thread reacts to
+ * each frame just as it would to a frame from the M4 core. If the ingest
+ * thread falls behind by more frames than one waitForFrames() call can
+ * return, the simulation still advances by the missed samples but their
+ * frames are skipped, and the sequence gap shows up as dropped frames in
+ * the parser statistics.
+ */
+class SimulatedM4Endpoint : public M4Endpoint {
+public:
+    /**
+     * @brief Constructor for the SimulatedM4Endpoint class. Starts the sample timer.
+     *
+     * @param simulator The simulated channels of the endpoint.
+     * @param sampleRate The number of frames per second.
+     */
+    SimulatedM4Endpoint(std::shared_ptr<ChannelSimulator> simulator, double sampleRate);
+
+    /**
+     * @brief Destructor for the SimulatedM4Endpoint class.
+     */
+    ~SimulatedM4Endpoint() override;
+
+    SimulatedM4Endpoint(const SimulatedM4Endpoint&) = delete;
+    SimulatedM4Endpoint& operator=(const SimulatedM4Endpoint&) = delete;
+
+    size_t waitForFrames(M4FrameBuffer* frames, size_t maxFrames, int timeoutMs) override;
+    void wake() override;
+
+    /**
+     * @brief Gets the number of samples simulated without delivering their frame.
+     *
+     * @return The number of skipped frames since construction.
+     */
+    uint64_t getSkippedFrameCount() const { return skippedFrames.load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<ChannelSimulator> simulator;
+    double period;          // Seconds between samples
+    int timerFd;
+    int wakeFd;
+    uint32_t sequence;
+    uint64_t sampleCount;   // Samples simulated, the M4 time is sampleCount * period
+    std::atomic<uint64_t> skippedFrames;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Platform.h"
+
+/**
+ * @brief Bounded lock-free single-producer single-consumer FIFO ring.
+ *
+ * The producer only writes the tail and the consumer only writes the head,
+ * each on its own cache line. Both sides keep a cached copy of the other
+ * side's index, so in steady state a push or pop touches no shared cache
+ * line but the element itself. The capacity is rounded up to a power of two
+ * and all storage is allocated once at construction.
+ *
+ * push() must only be called from one thread and pop() from one other thread.
+ *
+ * @tparam T The element type. Must be default constructible and copyable.
+ */
+template <typename T>
+class SpscRing {
+public:
+    /**
+     * @brief Constructor for the SpscRing class.
+     *
+     * @param capacity The minimum number of elements the ring can hold.
+     */
+    explicit SpscRing(size_t capacity) :
+        mask(roundUpToPowerOfTwo(capacity) - 1),
+        elements(new T[mask + 1]) {}
+
+    /**
+     * @brief Destructor for the SpscRing class.
+     */
+    ~SpscRing() {
+        delete[] elements;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Appends an element to the ring. Producer side only.
+     *
+     * @param value The element to append.
+     * @return True on success, false if the ring is full.
+     */
+    bool push(const T& value) {
+        size_t tail = producer.index.load(std::memory_order_relaxed);
+        if (tail - producer.cachedOther > mask) {
+            producer.cachedOther = consumer.index.load(std::memory_order_acquire);
+            if (tail - producer.cachedOther > mask) {
+                return false;
+            }
+        }
+        elements[tail & mask] = value;
+        producer.index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element of the ring. Consumer side only.
+     *
+     * @param value Receives the element.
+     * @return True on success, false if the ring is empty.
+     */
+    bool pop(T& value) {
+        size_t head = consumer.index.load(std::memory_order_relaxed);
+        if (head == consumer.cachedOther) {
+            consumer.cachedOther = producer.index.load(std::memory_order_acquire);
+            if (head == consumer.cachedOther) {
+                return false;
+            }
+        }
+        value = elements[head & mask];
+        consumer.index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Gets the number of elements the ring can hold.
+     *
+     * @return The capacity, a power of two.
+     */
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    /**
+     * @brief The index written by one side, and its copy of the other side's index.
+     */
+    struct alignas(CACHE_LINE_SIZE) Side {
+        std::atomic<size_t> index{0};
+        size_t cachedOther = 0;
+    };
+
+    const size_t mask;
+    T* const elements;
+    Side producer;  // Tail, and the head last seen by the producer
+    Side consumer;  // Head, and the tail last seen by the consumer
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "StateCheckpoint.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+#include "Seqlock.h"
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<CheckpointRecord>, "Records are copied into the file as is");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The seqlock of a slot lives in the file");
+
+// Copies read() tries before reporting a record whose write did not finish
+constexpr uint32_t READ_ATTEMPTS = 64;
+
+/**
+ * @brief Rounds a size up to whole pages.
+ *
+ * @param size The size in bytes.
+ * @return The rounded size.
+ */
+constexpr uint64_t pageAlign(uint64_t size) {
+    return (size + 4095) / 4096 * 4096;
+}
+
+} // namespace
+
+/**
+ * @brief Destructor for the StateCheckpoint class. Closes the file.
+ */
+StateCheckpoint::~StateCheckpoint() {
+    close();
+}
+
+/**
+ * @brief Opens or creates the checkpoint file of a service.
+ *
+ * The file is locked for the lifetime of the mapping, so two services
+ * cannot share it. Its content is kept only if resuming is enabled and its
+ * header matches the layout of this build, the channel count and the
+ * engine state sizes; otherwise the file is cleared.
+ *
+ * @param config The file and whether to resume it.
+ * @param channelCount The number of channels of the service.
+ * @param filterStateSize FilterEngine::getStateSize(), 0 to keep no filter state.
+ * @param fittingStateSize FittingEngine::getStateSize(), 0 to keep no fitting state.
+ * @param error Receives the reason on failure.
+ * @return True if the file is open; isRestored() tells if it holds an earlier state.
+ */
+bool StateCheckpoint::open(const CheckpointConfig& config, size_t channelCount, size_t filterStateSize,
+    size_t fittingStateSize, std::string& error) {
+    close();
+    if (config.path.empty()) {
+        error = "no checkpoint file";
+        return false;
+    }
+
+    // Header, slots, filter state, fitting state, each starting on a page
+    CheckpointHeader expected = {};
+    expected.magic = CHECKPOINT_MAGIC;
+    expected.layoutVersion = CHECKPOINT_LAYOUT_VERSION;
+    expected.headerSize = sizeof(CheckpointHeader);
+    expected.recordSize = sizeof(Slot);
+    expected.channelCount = static_cast<uint32_t>(channelCount);
+    expected.recordsOffset = pageAlign(sizeof(CheckpointHeader));
+    expected.filterStateOffset = expected.recordsOffset + pageAlign(channelCount * sizeof(Slot));
+    expected.filterStateSize = filterStateSize;
+    expected.fittingStateOffset = expected.filterStateOffset + pageAlign(filterStateSize);
+    expected.fittingStateSize = fittingStateSize;
+    expected.fileSize = expected.fittingStateOffset + pageAlign(fittingStateSize);
+    size_t size = static_cast<size_t>(expected.fileSize);
+
+    int file = ::open(config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (file < 0) {
+        error = "cannot open " + config.path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+        error = config.path + " is used by another process";
+        ::close(file);
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+        error = "cannot stat " + config.path + ": " + std::strerror(errno);
+        ::close(file);
+        return false;
+    }
+    bool reuse = config.resume && static_cast<size_t>(status.st_size) == size;
+    if (!reuse && (ftruncate(file, 0) != 0 || ftruncate(file, static_cast<off_t>(size)) != 0)) {
+        error = "cannot size " + config.path + ": " + std::strerror(errno);
+        ::close(file);
+        return false;
+    }
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (memory == MAP_FAILED) {
+        error = "cannot map " + config.path + ": " + std::strerror(errno);
+        ::close(file);
+        return false;
+    }
+
+    CheckpointHeader* mapped = static_cast<CheckpointHeader*>(memory);
+    restored = reuse &&
+        mapped->magic == expected.magic &&
+        mapped->layoutVersion == expected.layoutVersion &&
+        mapped->headerSize == expected.headerSize &&
+        mapped->recordSize == expected.recordSize &&
+        mapped->channelCount == expected.channelCount &&
+        mapped->fileSize == expected.fileSize &&
+        mapped->recordsOffset == expected.recordsOffset &&
+        mapped->filterStateOffset == expected.filterStateOffset &&
+        mapped->filterStateSize == expected.filterStateSize &&
+        mapped->fittingStateOffset == expected.fittingStateOffset &&
+        mapped->fittingStateSize == expected.fittingStateSize;
+    if (!restored) {
+        // A cleared file reads as all channels idle and all seqlocks even
+        if (reuse) {
+            std::memset(memory, 0, size);
+        }
+        expected.createdAt = realtimeNanoseconds();
+        *mapped = expected;
+    }
+    mapped->writerPid = static_cast<uint32_t>(getpid());
+
+    path = config.path;
+    fd = file;
+    header = mapped;
+    slots = reinterpret_cast<Slot*>(static_cast<unsigned char*>(memory) + expected.recordsOffset);
+    this->channelCount = channelCount;
+    fileSize = size;
+    return true;
+}
+
+/**
+ * @brief Flushes, unmaps and closes the file.
+ */
+void StateCheckpoint::close() {
+    if (!header) {
+        return;
+    }
+    msync(header, fileSize, MS_SYNC);
+    munmap(header, fileSize);
+    ::close(fd);
+    header = nullptr;
+    slots = nullptr;
+    fd = -1;
+    path.clear();
+    channelCount = 0;
+    fileSize = 0;
+    restored = false;
+}
+
+/**
+ * @brief Writes the record of a channel. Called by the channel's ingest thread only.
+ *
+ * The version is made odd whatever it was, so a slot left odd by a
+ * process that died while writing it is written correctly.
+ *
+ * @param channel The channel number.
+ * @param record The record.
+ */
+void StateCheckpoint::write(uint32_t channel, const CheckpointRecord& record) {
+    if (!header || channel >= channelCount) {
+        return;
+    }
+    Slot& slot = slots[channel];
+    uint32_t version = slot.version.load(std::memory_order_relaxed) | 1;
+    slot.version.store(version, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.record, &record, sizeof(CheckpointRecord));
+    slot.version.store(version + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Copies out the record of a channel.
+ *
+ * @param channel The channel number.
+ * @param record Receives the record.
+ * @return True on success, false for an unknown channel or a record whose write did not finish.
+ */
+bool StateCheckpoint::read(uint32_t channel, CheckpointRecord& record) const {
+    if (!header || channel >= channelCount) {
+        return false;
+    }
+    const Slot& slot = slots[channel];
+    return Seqlock::tryRead(slot.version,
+        [&] { std::memcpy(&record, &slot.record, sizeof(CheckpointRecord)); }, READ_ATTEMPTS);
+}
+
+/**
+ * @brief Gets the filter state in the file, for FilterEngine::moveState().
+ *
+ * @return The state, nullptr if the file holds none.
+ */
+void* StateCheckpoint::getFilterState() const {
+    if (!header || header->filterStateSize == 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<unsigned char*>(header) + header->filterStateOffset;
+}
+
+/**
+ * @brief Gets the fitting state in the file, for FittingEngine::moveState().
+ *
+ * @return The state, nullptr if the file holds none.
+ */
+void* StateCheckpoint::getFittingState() const {
+    if (!header || header->fittingStateSize == 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<unsigned char*>(header) + header->fittingStateOffset;
+}
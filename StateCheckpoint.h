@@ -0,0 +1,210 @@
+#ifndef STATECHECKPOINT_H
+#define STATECHECKPOINT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+#include "StepEngine.h"
+
+class RecipeProgram;
+
+// Identifies a state checkpoint file ("BTCP")
+#define CHECKPOINT_MAGIC 0x50435442u
+// Version of the file layout, bumped on any change to CheckpointRecord or the state of the engines
+#define CHECKPOINT_LAYOUT_VERSION 2
+
+/**
+ * @brief Where the per-channel execution state is checkpointed, and how it is resumed.
+ */
+struct CheckpointConfig {
+    // File holding the checkpoint, e.g. "/var/lib/bts/state.ckpt"; empty to keep no checkpoint
+    std::string path;
+    // Resume the channels found in the file at startup; false starts from a clean file
+    bool resume = true;
+    // Also keep the filter and fitting state in the file, so derived fields continue without a warm-up
+    bool engineState = true;
+    // Recipes a resumed channel may be running, matched by RecipeProgram::fingerprint
+    std::vector<std::shared_ptr<const RecipeProgram>> programs;
+};
+
+/**
+ * @brief What a checkpointed channel runs.
+ */
+enum class CheckpointKind : uint8_t {
+    None,       // Nothing to resume
+    Step,       // A single step of the step engine, e.g. runCCCVGroup()
+    Recipe,     // A recipe on the step engine
+    CCCV,       // runCCCV() routine
+    CurrentRamp,// runCurrentRamp() routine
+    Rest,       // runRest() routine
+    Profile,    // runProfile() routine
+    Opaque      // State that cannot be checkpointed, e.g. a custom routine; set to rest on resume
+};
+
+/**
+ * @brief Checkpointed execution state of one channel.
+ *
+ * A plain struct with no pointer, written as is into the checkpoint file.
+ * For the step engine, state is its StepSnapshot; for a routine, state
+ * holds the phase the routine reached, its setpoints (current,
+ * targetVoltage, rampRate) and its compiled limits.
+ */
+struct CheckpointRecord {
+    CheckpointKind kind = CheckpointKind::None;
+    uint8_t reserved[3] = {};
+    uint32_t resumeCount = 0;       // Times the channel was resumed from this record
+    double duration = 0.0;          // Rest duration in seconds, 0 for none
+    uint64_t startedAt = 0;         // CLOCK_REALTIME nanoseconds the control type started
+    uint64_t updatedAt = 0;         // CLOCK_REALTIME nanoseconds of the last transition
+    // Values of the sample of the last transition
+    float stepCapacity = 0.0f;
+    float stepEnergy = 0.0f;
+    float stepTime = 0.0f;
+    // Capacity and energy of the steps completed since the control type started
+    float completedCapacity = 0.0f;
+    float completedEnergy = 0.0f;
+    StepSnapshot state;
+};
+
+/**
+ * @brief Versioned header at the start of a checkpoint file.
+ *
+ * All offsets are in bytes from the start of the file and page-aligned.
+ */
+struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t layoutVersion;
+    uint32_t headerSize;
+    uint32_t recordSize;        // Bytes per channel slot
+    uint32_t channelCount;
+    uint32_t writerPid;         // Process that last opened the file
+    uint64_t fileSize;
+    uint64_t createdAt;         // CLOCK_REALTIME nanoseconds
+    uint64_t recordsOffset;
+    uint64_t filterStateOffset;
+    uint64_t filterStateSize;   // 0 if the file holds no filter state
+    uint64_t fittingStateOffset;
+    uint64_t fittingStateSize;  // 0 if the file holds no fitting state
+};
+
+/**
+ * @brief Memory-mapped file holding the execution state of every channel.
+ *
+ * Each channel has a fixed slot with a CheckpointRecord behind a seqlock.
+ * The ingest thread of the channel rewrites the slot on its transitions
+ * only (start, phase change, step change, stop), with a plain copy into
+ * the mapping and no system call, so checkpointing costs a few hundred
+ * bytes of memory writes per transition. The kernel writes the pages
+ * back; they survive a crash or restart of the process, and close()
+ * flushes them for a clean shutdown. A slot whose seqlock is odd was
+ * being written when the process died and is not resumed.
+ *
+ * The file can also hold the state of the filter and fitting engines,
+ * which they then update in place on every sample.
+ */
+class StateCheckpoint {
+public:
+    StateCheckpoint() = default;
+
+    /**
+     * @brief Destructor for the StateCheckpoint class. Closes the file.
+     */
+    ~StateCheckpoint();
+
+    StateCheckpoint(const StateCheckpoint&) = delete;
+    StateCheckpoint& operator=(const StateCheckpoint&) = delete;
+
+    /**
+     * @brief Opens or creates the checkpoint file of a service.
+     *
+     * @param config The file and whether to resume it.
+     * @param channelCount The number of channels of the service.
+     * @param filterStateSize FilterEngine::getStateSize(), 0 to keep no filter state.
+     * @param fittingStateSize FittingEngine::getStateSize(), 0 to keep no fitting state.
+     * @param error Receives the reason on failure.
+     * @return True if the file is open; isRestored() tells if it holds an earlier state.
+     */
+    bool open(const CheckpointConfig& config, size_t channelCount, size_t filterStateSize, size_t fittingStateSize,
+        std::string& error);
+
+    /**
+     * @brief Flushes, unmaps and closes the file.
+     */
+    void close();
+
+    /**
+     * @brief Checks if a file is open.
+     *
+     * @return True between open() and close().
+     */
+    bool isOpen() const { return header != nullptr; }
+
+    /**
+     * @brief Checks if the file holds the state of an earlier process with the same layout.
+     *
+     * @return True if the records and engine state can be resumed.
+     */
+    bool isRestored() const { return restored; }
+
+    /**
+     * @brief Gets the path of the file.
+     *
+     * @return The path, empty if no file is open.
+     */
+    const std::string& getPath() const { return path; }
+
+    /**
+     * @brief Writes the record of a channel. Called by the channel's ingest thread only.
+     *
+     * @param channel The channel number.
+     * @param record The record.
+     */
+    void write(uint32_t channel, const CheckpointRecord& record);
+
+    /**
+     * @brief Copies out the record of a channel.
+     *
+     * @param channel The channel number.
+     * @param record Receives the record.
+     * @return True on success, false for an unknown channel or a record whose write did not finish.
+     */
+    bool read(uint32_t channel, CheckpointRecord& record) const;
+
+    /**
+     * @brief Gets the filter state in the file, for FilterEngine::moveState().
+     *
+     * @return The state, nullptr if the file holds none.
+     */
+    void* getFilterState() const;
+
+    /**
+     * @brief Gets the fitting state in the file, for FittingEngine::moveState().
+     *
+     * @return The state, nullptr if the file holds none.
+     */
+    void* getFittingState() const;
+
+private:
+    /**
+     * @brief Slot of one channel, on its own cache lines.
+     */
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        std::atomic<uint32_t> version;  // Odd while the record is written
+        CheckpointRecord record;
+    };
+
+    std::string path;
+    int fd = -1;
+    CheckpointHeader* header = nullptr;
+    Slot* slots = nullptr;
+    size_t channelCount = 0;
+    size_t fileSize = 0;
+    bool restored = false;
+};
+
+#endif
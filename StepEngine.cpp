@@ -0,0 +1,447 @@
+#include "StepEngine.h"
+#include "Recipe.h"
+
+#include <cmath>
+#include <string>
+
+/**
+ * @brief Constructor for the StepEngine class.
+ *
+ * @param channelCount The number of channels.
+ */
+StepEngine::StepEngine(size_t channelCount) : channelCount(channelCount) {
+    steps = new ChannelStep[channelCount];
+}
+
+/**
+ * @brief Destructor for the StepEngine class.
+ */
+StepEngine::~StepEngine() {
+    delete[] steps;
+}
+
+/**
+ * @brief Starts a step on a channel, replacing the running one.
+ *
+ * Copying the compiled limits reuses the capacity of the channel's
+ * evaluator, as between the steps of a recipe.
+ *
+ * @param channel The channel number.
+ * @param step The step to run; its limits are taken from the limits parameter.
+ * @param limits The step limits, compiled by StepLimitEvaluator::compile().
+ * @param transition Receives the initial control action.
+ * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+ * @return True if the step was started, false for an unknown channel.
+ */
+bool StepEngine::start(uint32_t channel, const StepDefinition& step, const StepLimitEvaluator& limits,
+    StepTransition& transition, float stepTime) {
+    transition = StepTransition();
+    if (channel >= channelCount) {
+        return false;
+    }
+
+    ChannelStep& state = steps[channel];
+    state.limits = limits;
+    state.program.reset();
+    holdOffLimits(state, stepTime);
+    enterStep(state, step, transition);
+    return true;
+}
+
+/**
+ * @brief Starts a recipe on a channel, replacing the running step or recipe.
+ *
+ * @param channel The channel number.
+ * @param program The compiled recipe, shared with other channels.
+ * @param transition Receives the initial control action of the first step.
+ * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+ * @return True if the recipe was started.
+ */
+bool StepEngine::startRecipe(uint32_t channel, std::shared_ptr<const RecipeProgram> program,
+    StepTransition& transition, float stepTime) {
+    transition = StepTransition();
+    if (channel >= channelCount || !program) {
+        return false;
+    }
+
+    ChannelStep& state = steps[channel];
+    state.program = std::move(program);
+    state.programCounter = 0;
+    state.loopCounters.assign(state.program->loopCount, 0);
+    holdOffLimits(state, stepTime);
+    runProgram(state, false, transition);
+    return true;
+}
+
+/**
+ * @brief Sets the phase and returns the initial control action of a step.
+ *
+ * The step limits must already be in state.limits.
+ *
+ * @param state The step state of the channel.
+ * @param step The step to run.
+ * @param transition Receives the initial control action.
+ */
+void StepEngine::enterStep(ChannelStep& state, const StepDefinition& step, StepTransition& transition) {
+    state.current = step.current;
+    state.targetVoltage = step.targetVoltage;
+    state.rampRate = std::fabs(step.rampRate);
+    state.rampIncrement = std::fabs(step.current) / STEP_RAMP_INCREMENTS;
+    state.rampStarted = false;
+
+    switch (step.type) {
+        case StepType::CCCV:
+            state.phase.store(StepPhase::ConstantCurrent, std::memory_order_relaxed);
+            transition.action = StepAction::SetConstantCurrent;
+            transition.setpoint = step.current;
+            break;
+        case StepType::Rest:
+            state.phase.store(StepPhase::Resting, std::memory_order_relaxed);
+            transition.action = StepAction::SetRest;
+            break;
+        case StepType::CurrentRamp:
+            if (state.rampRate > 0.0f && state.rampIncrement > 0.0f) {
+                state.phase.store(StepPhase::Ramping, std::memory_order_relaxed);
+                state.issuedCurrent = 0.0f;
+            } else {
+                state.phase.store(StepPhase::Holding, std::memory_order_relaxed);
+                state.issuedCurrent = step.current;
+            }
+            transition.action = StepAction::SetConstantCurrent;
+            transition.setpoint = state.issuedCurrent;
+            break;
+    }
+}
+
+/**
+ * @brief Holds the limits of a new step off until the M4 restarts the step time.
+ *
+ * The samples that arrive before the M4 applies the step's first command
+ * still carry the step time, capacity and energy of the previous step, and
+ * would meet a time or capacity limit at once. The hold-off ends on the
+ * first sample whose step time is below stepTime, or after
+ * STEP_RESTART_MAX_SAMPLES samples.
+ *
+ * @param state The step state of the channel.
+ * @param stepTime The StepTime of the channel's latest sample, 0 for no hold-off.
+ */
+void StepEngine::holdOffLimits(ChannelStep& state, float stepTime) {
+    state.awaitingRestart = stepTime > 0.0f;
+    state.restartStepTime = stepTime;
+    state.restartSamples = 0;
+}
+
+/**
+ * @brief Walks the recipe from the program counter to the next step or the end.
+ *
+ * Loop and jump instructions cost one table lookup each. Copying the
+ * compiled limits of the next step reuses the capacity of the channel's
+ * evaluator, so it allocates only for a step with more conditions than
+ * any earlier step of the channel.
+ *
+ * @param state The step state of the channel.
+ * @param resting True if the channel is already at rest.
+ * @param transition Receives the initial control action of the next step,
+ *        or SetRest and completed at the end of the recipe.
+ */
+void StepEngine::runProgram(ChannelStep& state, bool resting, StepTransition& transition) {
+    const RecipeProgram& program = *state.program;
+
+    // Compiled loops always contain a step, so only a cycle of jumps can exceed this
+    for (size_t walked = 0; walked < program.instructions.size(); ++walked) {
+        const RecipeInstruction& instruction = program.instructions[state.programCounter];
+        switch (instruction.op) {
+            case RecipeOp::Step:
+                state.limits = program.limits[instruction.step];
+                state.recipeStep.store(instruction.step, std::memory_order_relaxed);
+                enterStep(state, program.steps[instruction.step], transition);
+                return;
+            case RecipeOp::LoopStart:
+                state.loopCounters[instruction.slot] = 0;
+                ++state.programCounter;
+                break;
+            case RecipeOp::Repeat:
+                if (++state.loopCounters[instruction.slot] < instruction.count) {
+                    state.programCounter = instruction.target;
+                } else {
+                    ++state.programCounter;
+                }
+                break;
+            case RecipeOp::Jump:
+                state.programCounter = instruction.target;
+                break;
+            case RecipeOp::End:
+                walked = program.instructions.size();
+                break;
+        }
+    }
+
+    state.phase.store(StepPhase::Done, std::memory_order_relaxed);
+    transition.action = resting ? StepAction::None : StepAction::SetRest;
+    transition.completed = true;
+}
+
+/**
+ * @brief Advances the state machine of a channel with a new sample.
+ *
+ * The step limits are checked first in every phase; then the phase-specific
+ * transition, if any, is taken. After a recipe moves to a new step, its
+ * limits are held off until the M4 restarts the step time, i.e. until a
+ * sample's step time is not above the one that ended the previous step (or
+ * for at most STEP_RESTART_MAX_SAMPLES samples), so values left over from
+ * the previous step cannot end it.
+ *
+ * @param channel The channel number.
+ * @param sample The latest values of the channel.
+ * @return The transition, with action None if nothing changes.
+ */
+StepTransition StepEngine::advance(uint32_t channel, const ChannelSample& sample) {
+    StepTransition transition;
+    ChannelStep& state = steps[channel];
+    StepPhase phase = state.phase.load(std::memory_order_relaxed);
+    if (phase == StepPhase::Idle || phase == StepPhase::Done) {
+        return transition;
+    }
+
+    if (state.awaitingRestart) {
+        if (sample[ChannelField::StepTime] >= state.restartStepTime &&
+            ++state.restartSamples < STEP_RESTART_MAX_SAMPLES) {
+            return transition;
+        }
+        state.awaitingRestart = false;
+    }
+
+    uint32_t group = 0;
+    if (!state.limits.empty() && state.limits.evaluate(sample, group)) {
+        if (state.program) {
+            // Continue at the branch of the group that was met, or at the next instruction
+            const RecipeProgram& program = *state.program;
+            const RecipeInstruction& instruction = program.instructions[state.programCounter];
+            uint32_t next = state.programCounter + 1;
+            for (uint32_t i = 0; i < instruction.branchCount; ++i) {
+                const RecipeJump& branch = program.branches[instruction.firstBranch + i];
+                if (branch.group == group) {
+                    next = branch.target;
+                    break;
+                }
+            }
+            state.programCounter = next;
+            holdOffLimits(state, sample[ChannelField::StepTime]);
+            runProgram(state, phase == StepPhase::Resting, transition);
+            return transition;
+        }
+
+        state.phase.store(StepPhase::Done, std::memory_order_relaxed);
+        // A rest step is already at rest
+        transition.action = phase == StepPhase::Resting ? StepAction::None : StepAction::SetRest;
+        transition.completed = true;
+        return transition;
+    }
+
+    switch (phase) {
+        case StepPhase::ConstantCurrent: {
+            // A discharge (negative current) reaches its target voltage from above
+            float voltage = sample[ChannelField::Voltage];
+            if (state.current < 0.0f ? voltage <= state.targetVoltage : voltage >= state.targetVoltage) {
+                state.phase.store(StepPhase::ConstantVoltage, std::memory_order_relaxed);
+                transition.action = StepAction::SetConstantVoltage;
+                transition.setpoint = state.targetVoltage;
+            }
+            break;
+        }
+        case StepPhase::Ramping:
+            transition = advanceRamp(state, sample);
+            break;
+        default:
+            break;
+    }
+    return transition;
+}
+
+/**
+ * @brief Advances a ramp and returns the new setpoint when it moved by one increment.
+ *
+ * The ramp starts at the step time of the first sample after start().
+ *
+ * @param state The step state of the channel.
+ * @param sample The latest values of the channel.
+ * @return SetConstantCurrent with the new setpoint, or None.
+ */
+StepTransition StepEngine::advanceRamp(ChannelStep& state, const ChannelSample& sample) {
+    StepTransition transition;
+    float time = sample[ChannelField::StepTime];
+    if (!state.rampStarted) {
+        state.rampStarted = true;
+        state.rampStartTime = time;
+        return transition;
+    }
+
+    float magnitude = std::fabs(state.current);
+    float ramped = std::fmin(magnitude, state.rampRate * (time - state.rampStartTime));
+    if (ramped < magnitude && ramped - std::fabs(state.issuedCurrent) < state.rampIncrement) {
+        return transition;
+    }
+
+    // Quantize to whole increments, so at most STEP_RAMP_INCREMENTS setpoints are sent
+    float setpoint = ramped >= magnitude ? magnitude : std::floor(ramped / state.rampIncrement) * state.rampIncrement;
+    state.issuedCurrent = std::copysign(setpoint, state.current);
+    if (setpoint >= magnitude) {
+        state.phase.store(StepPhase::Holding, std::memory_order_relaxed);
+    }
+    transition.action = StepAction::SetConstantCurrent;
+    transition.setpoint = state.issuedCurrent;
+    return transition;
+}
+
+/**
+ * @brief Aborts the step of a channel.
+ *
+ * @param channel The channel number.
+ * @return SetRest if a step was running, None otherwise.
+ */
+StepTransition StepEngine::stop(uint32_t channel) {
+    StepTransition transition;
+    if (channel < channelCount && isRunning(channel)) {
+        steps[channel].phase.store(StepPhase::Idle, std::memory_order_relaxed);
+        steps[channel].program.reset();
+        transition.action = StepAction::SetRest;
+        transition.completed = true;
+    }
+    return transition;
+}
+
+/**
+ * @brief Checks if a step is running on a channel.
+ *
+ * @param channel The channel number.
+ * @return True if the channel is in a phase other than Idle and Done.
+ */
+bool StepEngine::isRunning(uint32_t channel) const {
+    StepPhase phase = getPhase(channel);
+    return phase != StepPhase::Idle && phase != StepPhase::Done;
+}
+
+/**
+ * @brief Gets the current phase of a channel.
+ *
+ * @param channel The channel number.
+ * @return The phase, Idle for an unknown channel.
+ */
+StepPhase StepEngine::getPhase(uint32_t channel) const {
+    if (channel >= channelCount) {
+        return StepPhase::Idle;
+    }
+    return steps[channel].phase.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the index of the recipe step a channel runs or ran last.
+ *
+ * @param channel The channel number.
+ * @return The index of the step in the recipe, counting steps only.
+ */
+uint32_t StepEngine::getRecipeStep(uint32_t channel) const {
+    if (channel >= channelCount) {
+        return 0;
+    }
+    return steps[channel].recipeStep.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Copies the step state of a channel out, for a checkpoint.
+ *
+ * Does not allocate, so it can run on every transition.
+ *
+ * @param channel The channel number.
+ * @param snapshot Receives the state.
+ * @return True on success, false for an unknown channel or more loops or limits than a snapshot holds.
+ */
+bool StepEngine::save(uint32_t channel, StepSnapshot& snapshot) const {
+    if (channel >= channelCount) {
+        return false;
+    }
+    const ChannelStep& state = steps[channel];
+    snapshot.phase = state.phase.load(std::memory_order_relaxed);
+    snapshot.rampStarted = state.rampStarted;
+    snapshot.awaitingRestart = state.awaitingRestart;
+    snapshot.current = state.current;
+    snapshot.targetVoltage = state.targetVoltage;
+    snapshot.rampRate = state.rampRate;
+    snapshot.rampIncrement = state.rampIncrement;
+    snapshot.issuedCurrent = state.issuedCurrent;
+    snapshot.rampStartTime = state.rampStartTime;
+    snapshot.restartStepTime = state.restartStepTime;
+    snapshot.restartSamples = state.restartSamples;
+    snapshot.programFingerprint = state.program ? state.program->fingerprint : 0;
+    snapshot.programCounter = state.programCounter;
+    snapshot.recipeStep = state.recipeStep.load(std::memory_order_relaxed);
+    snapshot.loopCount = state.program ? static_cast<uint32_t>(state.loopCounters.size()) : 0;
+    if (snapshot.loopCount > STEP_SNAPSHOT_MAX_LOOPS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < snapshot.loopCount; ++i) {
+        snapshot.loopCounters[i] = state.loopCounters[i];
+    }
+    return state.limits.save(snapshot.limits, STEP_SNAPSHOT_MAX_LIMITS, snapshot.limitCount);
+}
+
+/**
+ * @brief Restores the step state of a channel saved by an earlier process.
+ *
+ * The program must be the one the snapshot was taken from, as identified
+ * by its fingerprint, and the program counter must point at the step the
+ * channel ran. The limits are restored with their armed state.
+ *
+ * @param channel The channel number.
+ * @param snapshot The saved state.
+ * @param program The recipe the channel ran, null for a single step.
+ * @param error Receives the reason on failure.
+ * @return True if the channel runs the saved step again.
+ */
+bool StepEngine::restore(uint32_t channel, const StepSnapshot& snapshot, std::shared_ptr<const RecipeProgram> program,
+    std::string& error) {
+    if (channel >= channelCount) {
+        error = "unknown channel";
+        return false;
+    }
+    if ((snapshot.programFingerprint != 0) != static_cast<bool>(program) ||
+        (program && program->fingerprint != snapshot.programFingerprint)) {
+        error = "the recipe differs from the one the channel ran";
+        return false;
+    }
+    if (program) {
+        if (snapshot.programCounter >= program->instructions.size() ||
+            program->instructions[snapshot.programCounter].op != RecipeOp::Step ||
+            program->instructions[snapshot.programCounter].step != snapshot.recipeStep ||
+            snapshot.loopCount != program->loopCount) {
+            error = "the recipe state does not match the recipe";
+            return false;
+        }
+    }
+    if (snapshot.loopCount > STEP_SNAPSHOT_MAX_LOOPS || snapshot.limitCount > STEP_SNAPSHOT_MAX_LIMITS) {
+        error = "the step state is corrupt";
+        return false;
+    }
+
+    ChannelStep& state = steps[channel];
+    if (!state.limits.restore(snapshot.limits, snapshot.limitCount)) {
+        error = "a step limit names an unknown field";
+        return false;
+    }
+    state.current = snapshot.current;
+    state.targetVoltage = snapshot.targetVoltage;
+    state.rampRate = snapshot.rampRate;
+    state.rampIncrement = snapshot.rampIncrement;
+    state.issuedCurrent = snapshot.issuedCurrent;
+    state.rampStartTime = snapshot.rampStartTime;
+    state.rampStarted = snapshot.rampStarted;
+    state.program = std::move(program);
+    state.programCounter = snapshot.programCounter;
+    state.loopCounters.assign(snapshot.loopCounters, snapshot.loopCounters + snapshot.loopCount);
+    state.recipeStep.store(snapshot.recipeStep, std::memory_order_relaxed);
+    state.awaitingRestart = snapshot.awaitingRestart;
+    state.restartStepTime = snapshot.restartStepTime;
+    state.restartSamples = snapshot.restartSamples;
+    state.phase.store(snapshot.phase, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,281 @@
+#ifndef STEPENGINE_H
+#define STEPENGINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ChannelDataTable.h"
+#include "StepLimitEvaluator.h"
+
+// Number of setpoint increments of a current ramp
+#define STEP_RAMP_INCREMENTS 20
+// Samples a new step waits at most for the M4 to restart the step time
+#define STEP_RESTART_MAX_SAMPLES 64
+// Loop counters a StepSnapshot can hold, i.e. loops of a recipe that can be checkpointed
+#define STEP_SNAPSHOT_MAX_LOOPS 8
+// Limit conditions a StepSnapshot can hold
+#define STEP_SNAPSHOT_MAX_LIMITS 8
+
+class RecipeProgram;
+
+/**
+ * @brief Kind of step a channel can run.
+ */
+enum class StepType : uint8_t {
+    CCCV,       // Constant current until targetVoltage (from below, or from above if current < 0), then constant voltage
+    Rest,       // Open circuit
+    CurrentRamp // Current rising at rampRate up to current, then held
+};
+
+/**
+ * @brief Phase of the step state machine of a channel.
+ */
+enum class StepPhase : uint8_t {
+    Idle,            // No step running
+    ConstantCurrent, // CCCV before the target voltage is reached
+    ConstantVoltage, // CCCV after the target voltage is reached
+    Resting,         // Rest step
+    Ramping,         // Current ramp, setpoint still rising
+    Holding,         // Current ramp, final current reached
+    Profile,         // Setpoint profile executing on the M4
+    Done             // Step limits met or recipe finished, channel set to rest
+};
+
+/**
+ * @brief Definition of one step; the limits end the step.
+ */
+struct StepDefinition {
+    StepType type = StepType::Rest;
+    float current = 0.0f;       // CC current, or final current of a ramp
+    float targetVoltage = 0.0f; // CV voltage of a CCCV step
+    float rampRate = 0.0f;      // Ramp slope in A per unit of StepTime, 0 jumps to current
+    std::vector<StepLimit> limits;
+};
+
+/**
+ * @brief Control action the engine asks for on a transition.
+ */
+enum class StepAction : uint8_t {
+    None,
+    SetConstantCurrent, // setpoint is the current
+    SetConstantVoltage, // setpoint is the voltage
+    SetRest
+};
+
+/**
+ * @brief Result of starting or advancing the step of a channel.
+ */
+struct StepTransition {
+    StepAction action = StepAction::None;
+    float setpoint = 0.0f;
+    bool completed = false; // The step, or the whole recipe, ended on this transition
+};
+
+/**
+ * @brief Plain copy of the step state of one channel, see StepEngine::save().
+ *
+ * Holds no pointer, so it can be written to a file as is; the recipe is
+ * identified by the fingerprint of its program.
+ */
+struct StepSnapshot {
+    StepPhase phase = StepPhase::Idle;
+    bool rampStarted = false;
+    bool awaitingRestart = false;
+    uint8_t reserved = 0;
+    float current = 0.0f;
+    float targetVoltage = 0.0f;
+    float rampRate = 0.0f;
+    float rampIncrement = 0.0f;
+    float issuedCurrent = 0.0f;
+    float rampStartTime = 0.0f;
+    float restartStepTime = 0.0f;
+    uint32_t restartSamples = 0;
+    uint64_t programFingerprint = 0;    // RecipeProgram::fingerprint, 0 for a single step
+    uint32_t programCounter = 0;
+    uint32_t recipeStep = 0;
+    uint32_t loopCount = 0;
+    uint32_t limitCount = 0;
+    uint32_t loopCounters[STEP_SNAPSHOT_MAX_LOOPS] = {};
+    LimitConditionState limits[STEP_SNAPSHOT_MAX_LIMITS] = {};
+};
+
+/**
+ * @brief Per-channel step state machines, advanced on every sample.
+ *
+ * Each channel owns a compact state machine, for example CC -> CV -> Done
+ * for a CCCV step. The engine has no threads and calls no services:
+ * advance() is called by the M4 data thread for each new sample, never
+ * allocates, and returns a transition only when the control mode or setpoint
+ * must change. The caller turns transitions into control tasks, so a step
+ * produces work only when something actually changes.
+ *
+ * A channel can also run a compiled recipe. When the limits of a recipe
+ * step are met, the engine walks the instruction table to the next step
+ * (following the branch of the limit group that was met, loops and jumps)
+ * and returns that step's initial control action in the same call, so the
+ * next step starts without a round trip to the host.
+ *
+ * start(), startRecipe(), stop() and advance() must all be called from the
+ * same thread for a given channel; channels of different M4 endpoints are
+ * driven by different ingest threads, and so must save() and restore().
+ * getPhase() and getRecipeStep() can be called from any thread.
+ */
+class StepEngine {
+public:
+    /**
+     * @brief Constructor for the StepEngine class.
+     *
+     * @param channelCount The number of channels.
+     */
+    explicit StepEngine(size_t channelCount);
+
+    /**
+     * @brief Destructor for the StepEngine class.
+     */
+    ~StepEngine();
+
+    StepEngine(const StepEngine&) = delete;
+    StepEngine& operator=(const StepEngine&) = delete;
+
+    /**
+     * @brief Starts a step on a channel, replacing the running one.
+     *
+     * The limits are compiled by the caller, on its own thread, so that an
+     * unknown field is reported there; copying them is the only part that
+     * may allocate. Until the M4 restarts the step time, the samples still
+     * belong to the previous step, so the limits are held off as on a recipe
+     * transition.
+     *
+     * @param channel The channel number.
+     * @param step The step to run; its limits are taken from the limits parameter.
+     * @param limits The step limits, compiled by StepLimitEvaluator::compile().
+     * @param transition Receives the initial control action.
+     * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+     * @return True if the step was started, false for an unknown channel.
+     */
+    bool start(uint32_t channel, const StepDefinition& step, const StepLimitEvaluator& limits,
+        StepTransition& transition, float stepTime = 0.0f);
+
+    /**
+     * @brief Starts a recipe on a channel, replacing the running step or recipe.
+     *
+     * @param channel The channel number.
+     * @param program The compiled recipe, shared with other channels.
+     * @param transition Receives the initial control action of the first step.
+     * @param stepTime The StepTime of the channel's latest sample, 0 if the step time already restarted.
+     * @return True if the recipe was started.
+     */
+    bool startRecipe(uint32_t channel, std::shared_ptr<const RecipeProgram> program,
+        StepTransition& transition, float stepTime = 0.0f);
+
+    /**
+     * @brief Advances the state machine of a channel with a new sample.
+     *
+     * @param channel The channel number.
+     * @param sample The latest values of the channel.
+     * @return The transition, with action None if nothing changes.
+     */
+    StepTransition advance(uint32_t channel, const ChannelSample& sample);
+
+    /**
+     * @brief Aborts the step of a channel.
+     *
+     * @param channel The channel number.
+     * @return SetRest if a step was running, None otherwise.
+     */
+    StepTransition stop(uint32_t channel);
+
+    /**
+     * @brief Checks if a step is running on a channel.
+     *
+     * @param channel The channel number.
+     * @return True if the channel is in a phase other than Idle and Done.
+     */
+    bool isRunning(uint32_t channel) const;
+
+    /**
+     * @brief Gets the current phase of a channel.
+     *
+     * @param channel The channel number.
+     * @return The phase, Idle for an unknown channel.
+     */
+    StepPhase getPhase(uint32_t channel) const;
+
+    /**
+     * @brief Gets the index of the recipe step a channel runs or ran last.
+     *
+     * @param channel The channel number.
+     * @return The index of the step in the recipe, counting steps only.
+     */
+    uint32_t getRecipeStep(uint32_t channel) const;
+
+    /**
+     * @brief Copies the step state of a channel out, for a checkpoint.
+     *
+     * @param channel The channel number.
+     * @param snapshot Receives the state.
+     * @return True on success, false for an unknown channel or more loops or limits than a snapshot holds.
+     */
+    bool save(uint32_t channel, StepSnapshot& snapshot) const;
+
+    /**
+     * @brief Restores the step state of a channel saved by an earlier process.
+     *
+     * The M4 kept running the step, so no control action is returned.
+     *
+     * @param channel The channel number.
+     * @param snapshot The saved state.
+     * @param program The recipe the channel ran, null for a single step.
+     * @param error Receives the reason on failure.
+     * @return True if the channel runs the saved step again.
+     */
+    bool restore(uint32_t channel, const StepSnapshot& snapshot, std::shared_ptr<const RecipeProgram> program,
+        std::string& error);
+
+private:
+    /**
+     * @brief Step state of one channel.
+     */
+    struct ChannelStep {
+        std::atomic<StepPhase> phase{StepPhase::Idle};
+        float current = 0.0f;
+        float targetVoltage = 0.0f;
+        float rampRate = 0.0f;
+        float rampIncrement = 0.0f;
+        float issuedCurrent = 0.0f; // Last current setpoint sent
+        float rampStartTime = 0.0f;
+        bool rampStarted = false;
+        StepLimitEvaluator limits;
+
+        // Recipe state, program is null for a single step
+        std::shared_ptr<const RecipeProgram> program;
+        uint32_t programCounter = 0;
+        std::vector<uint32_t> loopCounters;
+        std::atomic<uint32_t> recipeStep{0};
+        // Limits are held off until the M4 restarts the step time
+        bool awaitingRestart = false;
+        float restartStepTime = 0.0f;
+        uint32_t restartSamples = 0;
+    };
+
+    // Sets the phase and returns the initial control action of a step
+    static void enterStep(ChannelStep& state, const StepDefinition& step, StepTransition& transition);
+
+    // Walks the recipe from the program counter to the next step or the end
+    static void runProgram(ChannelStep& state, bool resting, StepTransition& transition);
+
+    // Holds the limits off until the step time drops below stepTime, if it is not 0
+    static void holdOffLimits(ChannelStep& state, float stepTime);
+
+    // Advances a ramp and returns the new setpoint when it moved by one increment
+    static StepTransition advanceRamp(ChannelStep& step, const ChannelSample& sample);
+
+    size_t channelCount;
+    ChannelStep* steps;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "StepLimitEvaluator.h"
+
+#include <algorithm>
+
+/**
+ * @brief Compiles a set of step limits.
+ *
+ * @param limits The step limits.
+ * @param evaluator Receives the compiled evaluator.
+ * @param unknownField Receives the name of the first limit field that is not part of the schema.
+ * @return True on success, false if a limit names an unknown field.
+ */
+bool StepLimitEvaluator::compile(const std::vector<StepLimit>& limits, StepLimitEvaluator& evaluator,
+    std::string& unknownField) {
+    std::vector<const StepLimit*> sorted;
+    for (const auto& limit : limits) {
+        sorted.push_back(&limit);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const StepLimit* a, const StepLimit* b) {
+        return a->group < b->group;
+    });
+
+    evaluator.conditions.clear();
+    evaluator.groupEnds.clear();
+    evaluator.groupIds.clear();
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const StepLimit& limit = *sorted[i];
+        ChannelField field;
+        if (!channelFieldFromName(limit.var_type, field)) {
+            unknownField = limit.var_type;
+            evaluator.conditions.clear();
+            evaluator.groupEnds.clear();
+            evaluator.groupIds.clear();
+            return false;
+        }
+
+        Condition condition;
+        condition.field = static_cast<uint32_t>(field);
+        condition.comparison = limit.comparison;
+        condition.armed = false;
+        condition.target = limit.target_value;
+        condition.hysteresis = std::max(limit.hysteresis, 0.0f);
+        evaluator.conditions.push_back(condition);
+
+        if (i + 1 == sorted.size() || sorted[i + 1]->group != limit.group) {
+            evaluator.groupEnds.push_back(static_cast<uint32_t>(evaluator.conditions.size()));
+            evaluator.groupIds.push_back(limit.group);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Evaluates the limits on a new sample and reports which group was met.
+ *
+ * Every condition is evaluated, even after a group is known to be met, so
+ * that crossing conditions keep tracking the signal.
+ *
+ * @param sample The latest values of the channel.
+ * @param group Receives the StepLimit::group of the first group met.
+ * @return True if any group of limits is met.
+ */
+bool StepLimitEvaluator::evaluate(const ChannelSample& sample, uint32_t& group) {
+    bool reached = false;
+    uint32_t begin = 0;
+
+    for (size_t g = 0; g < groupEnds.size(); ++g) {
+        uint32_t end = groupEnds[g];
+        bool groupMet = true;
+        for (uint32_t i = begin; i < end; ++i) {
+            Condition& condition = conditions[i];
+            float value = sample.values[condition.field];
+            bool met = false;
+
+            switch (condition.comparison) {
+                case LimitComparison::GreaterOrEqual:
+                    met = value >= condition.target;
+                    break;
+                case LimitComparison::LessOrEqual:
+                    met = value <= condition.target;
+                    break;
+                case LimitComparison::CrossingUp:
+                    met = condition.armed && value >= condition.target;
+                    if (value <= condition.target - condition.hysteresis) {
+                        condition.armed = true;
+                    }
+                    break;
+                case LimitComparison::CrossingDown:
+                    met = condition.armed && value <= condition.target;
+                    if (value >= condition.target + condition.hysteresis) {
+                        condition.armed = true;
+                    }
+                    break;
+            }
+            groupMet = groupMet && met;
+        }
+        if (groupMet && !reached) {
+            group = groupIds[g];
+            reached = true;
+        }
+        begin = end;
+    }
+    return reached;
+}
+
+/**
+ * @brief Disarms all crossing conditions, e.g. at the start of a new step.
+ */
+void StepLimitEvaluator::reset() {
+    for (Condition& condition : conditions) {
+        condition.armed = false;
+    }
+}
+
+/**
+ * @brief Copies the compiled conditions out, in evaluation order.
+ *
+ * Does not allocate, so it can run on the ingest path.
+ *
+ * @param states Receives the conditions.
+ * @param capacity The number of entries of states.
+ * @param count Receives the number of conditions.
+ * @return True if all conditions fit in states.
+ */
+bool StepLimitEvaluator::save(LimitConditionState* states, size_t capacity, uint32_t& count) const {
+    count = static_cast<uint32_t>(conditions.size());
+    if (conditions.size() > capacity) {
+        return false;
+    }
+    uint32_t begin = 0;
+    for (size_t g = 0; g < groupEnds.size(); ++g) {
+        for (uint32_t i = begin; i < groupEnds[g]; ++i) {
+            const Condition& condition = conditions[i];
+            LimitConditionState& state = states[i];
+            state = LimitConditionState();
+            state.field = condition.field;
+            state.group = groupIds[g];
+            state.target = condition.target;
+            state.hysteresis = condition.hysteresis;
+            state.comparison = condition.comparison;
+            state.armed = condition.armed;
+        }
+        begin = groupEnds[g];
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces the conditions with ones copied out by save().
+ *
+ * @param states The conditions, sorted by group as save() wrote them.
+ * @param count The number of conditions.
+ * @return True on success, false if a condition names an unknown field.
+ */
+bool StepLimitEvaluator::restore(const LimitConditionState* states, uint32_t count) {
+    conditions.clear();
+    groupEnds.clear();
+    groupIds.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        const LimitConditionState& state = states[i];
+        if (state.field >= CHANNEL_FIELD_COUNT || state.comparison > LimitComparison::CrossingDown) {
+            conditions.clear();
+            groupEnds.clear();
+            groupIds.clear();
+            return false;
+        }
+        conditions.push_back({state.field, state.comparison, state.armed, state.target, state.hysteresis});
+        if (i + 1 == count || states[i + 1].group != state.group) {
+            groupEnds.push_back(static_cast<uint32_t>(conditions.size()));
+            groupIds.push_back(state.group);
+        }
+    }
+    return true;
+}
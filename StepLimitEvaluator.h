@@ -0,0 +1,140 @@
+#ifndef STEPLIMITEVALUATOR_H
+#define STEPLIMITEVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ChannelDataTable.h"
+
+/**
+ * @brief How a step limit compares a field with its target.
+ */
+enum class LimitComparison : uint8_t {
+    GreaterOrEqual, // value >= target
+    LessOrEqual,    // value <= target
+    CrossingUp,     // value rises to target after having been at or below target - hysteresis
+    CrossingDown    // value falls to target after having been at or above target + hysteresis
+};
+
+/**
+ * @brief One condition ending a step.
+ *
+ * Limits with the same group must all be met together (AND); the step ends
+ * as soon as any group is met (OR). With the defaults, a list of limits ends
+ * the step when any of them reaches its target, as before.
+ */
+typedef struct
+{
+    std::string var_type;
+    float target_value;
+    LimitComparison comparison = LimitComparison::GreaterOrEqual;
+    float hysteresis = 0.0f;
+    uint32_t group = 0;
+} StepLimit; // Define the StepLimit struct
+
+/**
+ * @brief Plain copy of one compiled condition, including its armed state, for checkpoints.
+ */
+struct LimitConditionState {
+    uint32_t field;     // ChannelField index
+    uint32_t group;     // StepLimit::group
+    float target;
+    float hysteresis;
+    LimitComparison comparison;
+    bool armed;
+    uint8_t reserved[2];
+};
+
+/**
+ * @brief Step limits compiled into a flat list of conditions.
+ *
+ * Compiling resolves the field names to ChannelField indices and sorts the
+ * conditions by group once, so evaluating a sample is a tight loop over
+ * plain structs with no string compares and no allocation. Crossing
+ * conditions keep their armed state in the evaluator, so an evaluator
+ * belongs to one channel and must be evaluated from a single thread.
+ */
+class StepLimitEvaluator {
+public:
+    /**
+     * @brief Compiles a set of step limits.
+     *
+     * @param limits The step limits.
+     * @param evaluator Receives the compiled evaluator.
+     * @param unknownField Receives the name of the first limit field that is not part of the schema.
+     * @return True on success, false if a limit names an unknown field.
+     */
+    static bool compile(const std::vector<StepLimit>& limits, StepLimitEvaluator& evaluator,
+        std::string& unknownField);
+
+    /**
+     * @brief Evaluates the limits on a new sample.
+     *
+     * @param sample The latest values of the channel.
+     * @return True if any group of limits is met.
+     */
+    bool evaluate(const ChannelSample& sample) {
+        uint32_t group;
+        return evaluate(sample, group);
+    }
+
+    /**
+     * @brief Evaluates the limits on a new sample and reports which group was met.
+     *
+     * @param sample The latest values of the channel.
+     * @param group Receives the StepLimit::group of the first group met.
+     * @return True if any group of limits is met.
+     */
+    bool evaluate(const ChannelSample& sample, uint32_t& group);
+
+    /**
+     * @brief Checks if the evaluator has any condition.
+     *
+     * @return True if no limit was compiled.
+     */
+    bool empty() const { return conditions.empty(); }
+
+    /**
+     * @brief Disarms all crossing conditions, e.g. at the start of a new step.
+     */
+    void reset();
+
+    /**
+     * @brief Copies the compiled conditions out, in evaluation order.
+     *
+     * @param states Receives the conditions.
+     * @param capacity The number of entries of states.
+     * @param count Receives the number of conditions.
+     * @return True if all conditions fit in states.
+     */
+    bool save(LimitConditionState* states, size_t capacity, uint32_t& count) const;
+
+    /**
+     * @brief Replaces the conditions with ones copied out by save().
+     *
+     * @param states The conditions, sorted by group as save() wrote them.
+     * @param count The number of conditions.
+     * @return True on success, false if a condition names an unknown field.
+     */
+    bool restore(const LimitConditionState* states, uint32_t count);
+
+private:
+    struct Condition {
+        uint32_t field;
+        LimitComparison comparison;
+        bool armed;
+        float target;
+        float hysteresis;
+    };
+
+    // Conditions sorted by group
+    std::vector<Condition> conditions;
+    // Index one past the last condition of each group
+    std::vector<uint32_t> groupEnds;
+    // StepLimit::group of each group
+    std::vector<uint32_t> groupIds;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef STRIPELOCKS_H
+#define STRIPELOCKS_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "Platform.h"
+
+// Channels per lock stripe, one cache line of a float column
+#define STRIPE_CHANNELS 16
+
+/**
+ * @brief Spin locks over fixed stripes of channels.
+ *
+ * Used by the engines that keep per-channel state updated by data tasks:
+ * tasks for overlapping channel ranges may run on different workers, and
+ * the stripes covering a range are always taken in ascending order, so two
+ * tasks can never deadlock. Hold times are a few hundred nanoseconds, so a
+ * waiting worker spins instead of parking.
+ */
+class StripeLocks {
+public:
+    /**
+     * @brief Constructor for the StripeLocks class.
+     *
+     * @param channelCount The number of channels covered.
+     */
+    explicit StripeLocks(size_t channelCount) :
+        stripeCount((channelCount + STRIPE_CHANNELS - 1) / STRIPE_CHANNELS),
+        locks(new std::atomic_flag[stripeCount]) {
+        for (size_t i = 0; i < stripeCount; ++i) {
+            locks[i].clear();
+        }
+    }
+
+    /**
+     * @brief Destructor for the StripeLocks class.
+     */
+    ~StripeLocks() {
+        delete[] locks;
+    }
+
+    StripeLocks(const StripeLocks&) = delete;
+    StripeLocks& operator=(const StripeLocks&) = delete;
+
+    /**
+     * @brief Locks the stripes covering a channel range, in ascending order.
+     *
+     * @param firstChannel The first channel of the range.
+     * @param count The number of channels, at least 1.
+     */
+    void lock(size_t firstChannel, size_t count) {
+        for (size_t stripe = firstChannel / STRIPE_CHANNELS; stripe <= (firstChannel + count - 1) / STRIPE_CHANNELS; ++stripe) {
+            while (locks[stripe].test_and_set(std::memory_order_acquire)) {
+                cpuRelax();
+            }
+        }
+    }
+
+    /**
+     * @brief Unlocks the stripes covering a channel range.
+     *
+     * @param firstChannel The first channel of the range.
+     * @param count The number of channels, at least 1.
+     */
+    void unlock(size_t firstChannel, size_t count) {
+        for (size_t stripe = firstChannel / STRIPE_CHANNELS; stripe <= (firstChannel + count - 1) / STRIPE_CHANNELS; ++stripe) {
+            locks[stripe].clear(std::memory_order_release);
+        }
+    }
+
+private:
+    size_t stripeCount;
+    std::atomic_flag* locks;
+};
+
+#endif
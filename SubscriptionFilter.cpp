@@ -0,0 +1,102 @@
+#include "SubscriptionFilter.h"
+
+#include <cmath>
+
+/**
+ * @brief Constructor for the SubscriptionFilter class.
+ *
+ * @param channelCount The number of channels, none subscribed.
+ */
+SubscriptionFilter::SubscriptionFilter(size_t channelCount) :
+    channelCount(channelCount), channels(new Channel[channelCount]), stripeLocks(channelCount) {}
+
+/**
+ * @brief Subscribes a channel, or changes its subscription.
+ *
+ * @param channel The channel number.
+ * @param subscription The rate and deadbands; the next sample always triggers the callbacks.
+ */
+void SubscriptionFilter::subscribe(uint32_t channel, const ChannelSubscription& subscription) {
+    if (channel >= channelCount) {
+        return;
+    }
+    Channel& state = channels[channel];
+    stripeLocks.lock(channel, 1);
+    state.pending = subscription;
+    state.version.fetch_add(1, std::memory_order_release);
+    stripeLocks.unlock(channel, 1);
+    state.subscribed.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Unsubscribes a channel.
+ *
+ * @param channel The channel number.
+ */
+void SubscriptionFilter::unsubscribe(uint32_t channel) {
+    if (channel < channelCount) {
+        channels[channel].subscribed.store(false, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Decides whether the latest sample of a channel triggers its callbacks.
+ *
+ * @param channel The channel number.
+ * @param table The data table holding the sample.
+ * @param time Monotonic time in nanoseconds at which the sample was received.
+ * @return True if the channel is subscribed and the sample passes its rate and deadbands.
+ */
+bool SubscriptionFilter::accept(uint32_t channel, const ChannelDataTable& table, uint64_t time) {
+    if (!isSubscribed(channel)) {
+        return false;
+    }
+    Channel& state = channels[channel];
+
+    uint32_t version = state.version.load(std::memory_order_acquire);
+    if (version != state.activeVersion) {
+        stripeLocks.lock(channel, 1);
+        state.active = state.pending;
+        state.activeVersion = state.version.load(std::memory_order_relaxed);
+        stripeLocks.unlock(channel, 1);
+        state.periodNs = state.active.rate > 0.0 ? static_cast<uint64_t>(1e9 / state.active.rate) : 0;
+        state.primed = false;
+    }
+    const ChannelSubscription& subscription = state.active;
+    if (state.periodNs == 0 && subscription.deadbandMask == 0) {
+        return true;
+    }
+
+    bool notify = !state.primed || (state.periodNs != 0 && time - state.lastCallbackTime >= state.periodNs);
+    for (uint32_t bits = subscription.deadbandMask; bits != 0 && !notify; bits &= bits - 1) {
+        uint32_t field = static_cast<uint32_t>(__builtin_ctz(bits));
+        float value = table.get(channel, static_cast<ChannelField>(field));
+        notify = std::fabs(value - state.lastValues[field]) > subscription.deadbands[field];
+    }
+    if (!notify) {
+        state.suppressed.store(state.suppressed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // The deadbands are measured from the values seen by the last callback
+    for (uint32_t bits = subscription.deadbandMask; bits != 0; bits &= bits - 1) {
+        uint32_t field = static_cast<uint32_t>(__builtin_ctz(bits));
+        state.lastValues[field] = table.get(channel, static_cast<ChannelField>(field));
+    }
+    state.lastCallbackTime = time;
+    state.primed = true;
+    return true;
+}
+
+/**
+ * @brief Gets the number of samples of subscribed channels that did not trigger callbacks.
+ *
+ * @return The count over all channels since construction.
+ */
+uint64_t SubscriptionFilter::getSuppressedCount() const {
+    uint64_t count = 0;
+    for (size_t i = 0; i < channelCount; ++i) {
+        count += channels[i].suppressed.load(std::memory_order_relaxed);
+    }
+    return count;
+}
@@ -0,0 +1,132 @@
+#ifndef SUBSCRIPTIONFILTER_H
+#define SUBSCRIPTIONFILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "ChannelDataTable.h"
+#include "StripeLocks.h"
+
+/**
+ * @brief Rate and per-field deadbands of a channel subscription.
+ *
+ * The callbacks of a channel run when a field with a deadband has moved
+ * by more than its deadband since the last callback, or when the rate
+ * timer elapses. Without either, they run on every sample.
+ */
+struct ChannelSubscription {
+    // Callbacks per second when no field moves beyond its deadband, 0 for no timer
+    double rate = 0.0;
+    // Bit n is set if field n has a deadband
+    uint32_t deadbandMask = 0;
+    // Absolute deadband of each field in deadbandMask
+    float deadbands[CHANNEL_FIELD_COUNT] = {};
+
+    /**
+     * @brief Sets the deadband of a field.
+     *
+     * @param field The field to watch.
+     * @param deadband The change since the last callback that triggers one, 0 for any change.
+     * @return The subscription, to chain calls.
+     */
+    ChannelSubscription& setDeadband(ChannelField field, float deadband) {
+        deadbandMask |= 1u << static_cast<uint32_t>(field);
+        deadbands[static_cast<size_t>(field)] = deadband;
+        return *this;
+    }
+};
+
+/**
+ * @brief Decides which samples of the subscribed channels trigger callbacks.
+ *
+ * Subscriptions may change from any thread; accept() is called by the
+ * ingest thread of the channel only, which owns the rate timer and the
+ * values of the last callback. A changed subscription is handed over
+ * under the channel's stripe lock and picked up on the next sample, so a
+ * sample of an unchanged subscription costs one atomic load, and the
+ * field reads only if the subscription has deadbands.
+ */
+class SubscriptionFilter {
+public:
+    /**
+     * @brief Constructor for the SubscriptionFilter class.
+     *
+     * @param channelCount The number of channels, none subscribed.
+     */
+    explicit SubscriptionFilter(size_t channelCount);
+
+    SubscriptionFilter(const SubscriptionFilter&) = delete;
+    SubscriptionFilter& operator=(const SubscriptionFilter&) = delete;
+
+    /**
+     * @brief Subscribes a channel, or changes its subscription.
+     *
+     * @param channel The channel number.
+     * @param subscription The rate and deadbands; the next sample always triggers the callbacks.
+     */
+    void subscribe(uint32_t channel, const ChannelSubscription& subscription);
+
+    /**
+     * @brief Unsubscribes a channel.
+     *
+     * @param channel The channel number.
+     */
+    void unsubscribe(uint32_t channel);
+
+    /**
+     * @brief Checks if a channel is subscribed.
+     *
+     * @param channel The channel number.
+     * @return True if subscribed, false otherwise.
+     */
+    bool isSubscribed(uint32_t channel) const {
+        return channel < channelCount && channels[channel].subscribed.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Decides whether the latest sample of a channel triggers its callbacks.
+     *
+     * @param channel The channel number.
+     * @param table The data table holding the sample.
+     * @param time Monotonic time in nanoseconds at which the sample was received.
+     * @return True if the channel is subscribed and the sample passes its rate and deadbands.
+     */
+    bool accept(uint32_t channel, const ChannelDataTable& table, uint64_t time);
+
+    /**
+     * @brief Gets the number of samples of subscribed channels that did not trigger callbacks.
+     *
+     * @return The count over all channels since construction.
+     */
+    uint64_t getSuppressedCount() const;
+
+private:
+    /**
+     * @brief Subscription state of a channel.
+     */
+    struct Channel {
+        std::atomic<bool> subscribed{false};
+        // Bumped by subscribe() once pending is written
+        std::atomic<uint32_t> version{0};
+        // Written under the stripe lock
+        ChannelSubscription pending;
+
+        // Written by the ingest thread only
+        std::atomic<uint64_t> suppressed{0};
+
+        // Owned by the ingest thread
+        uint32_t activeVersion = 0;
+        ChannelSubscription active;
+        uint64_t periodNs = 0;
+        uint64_t lastCallbackTime = 0;
+        bool primed = false;
+        float lastValues[CHANNEL_FIELD_COUNT] = {};
+    };
+
+    size_t channelCount;
+    std::unique_ptr<Channel[]> channels;
+    StripeLocks stripeLocks;
+};
+
+#endif
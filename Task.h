@@ -1,34 +1,80 @@
 #ifndef TASK_H
 #define TASK_H
 
+#include <atomic>
+#include <cstdint>
 #include <queue>
 #include <functional>
+#include <memory>
 #include <vector>
-#include <map>
-#include <string>
+
+#include "ChannelDataTable.h"
+#include "ChannelService.h"
 
 class ChannelCtrlService;
 class ChannelDataService;
+class FilterEngine;
+class FittingEngine;
+class TaskPoolBase;
 
 // Forward declaration
 class Task;
 class ControlTask;
 class DataTask;
 
-// Enum for task priority
+// Enum for task priority, also the index of the task's scheduler lane
 enum class TaskPriority {
     HIGH,
     NORMAL,
     LOW
 };
 
-// Structure for comparing task priorities in the priority queue
-struct TaskComparator {
-    bool operator()(const Task* a, const Task* b) {
-        return a->priority > b->priority; // Higher priority tasks come first
-    }
+// Number of task priorities (and scheduler lanes)
+constexpr size_t TASK_PRIORITY_COUNT = 3;
+
+// Affinity of a task that is not tied to a channel
+constexpr uint32_t NO_CHANNEL_AFFINITY = UINT32_MAX;
+
+// Enum for the concrete type of a task, the index of its latency histograms
+enum class TaskType {
+    Generic,
+    ConstantCurrent,
+    ConstantVoltage,
+    Rest,
+    Batch,
+    Profile,
+    Callback,
+    Fitting,
+    Filtering,
+    Other
 };
 
+// Number of task types
+constexpr size_t TASK_TYPE_COUNT = 10;
+
+/**
+ * @brief Gets the name of a task type, as used in the exported metrics.
+ *
+ * @param type The task type.
+ * @return The name, e.g. "cc".
+ */
+inline const char* taskTypeName(TaskType type) {
+    static const char* const names[TASK_TYPE_COUNT] = {
+        "generic", "cc", "cv", "rest", "batch", "profile", "callback", "fitting", "filtering", "other"};
+    return names[static_cast<size_t>(type)];
+}
+
+/**
+ * @brief Gets the name of a task priority, as used in the exported metrics.
+ *
+ * @param priority The task priority.
+ * @return The name, e.g. "high".
+ */
+inline const char* taskPriorityName(TaskPriority priority) {
+    static const char* const names[TASK_PRIORITY_COUNT] = {"high", "normal", "low"};
+    return names[static_cast<size_t>(priority)];
+}
+
 /**
  * @brief Base class for all tasks.
  *
@@ -40,8 +86,9 @@ public:
      * @brief Constructor for the Task class.
      *
      * @param priority The priority of the task.
+     * @param affinity The channel the task works on, or NO_CHANNEL_AFFINITY.
      */
-    Task(TaskPriority priority) : priority(priority) {}
+    Task(TaskPriority priority, uint32_t affinity = NO_CHANNEL_AFFINITY) : priority(priority), affinity(affinity) {}
 
     /**
      * @brief Virtual destructor for the Task class.
@@ -52,13 +99,49 @@ public:
      * @brief Executes the task.
      *
      * This is a pure virtual function that must be implemented by derived classes.
+     * Tasks run on the worker and control threads and do not throw; a failure is
+     * returned, and reported and counted by the thread that ran the task.
+     *
+     * @return Success, or the error code of the failure.
+     */
+    virtual ErrorLogging::Status execute() = 0;
+
+    /**
+     * @brief Gets the concrete type of the task, which selects its latency histograms.
+     *
+     * @return The task type, TaskType::Other unless overridden.
      */
-    virtual void execute() = 0;
+    virtual TaskType getType() const { return TaskType::Other; }
 
     /**
      * @brief The priority of the task.
      */
     TaskPriority priority;
+
+    /**
+     * @brief The channel the task works on; tasks of the same channel never run concurrently.
+     */
+    uint32_t affinity;
+
+    /**
+     * @brief The pool the task was acquired from, or nullptr if it was allocated with new.
+     */
+    TaskPoolBase* ownerPool = nullptr;
+
+    /**
+     * @brief The time the task was queued, in monotonic nanoseconds, or 0 if unknown.
+     */
+    uint64_t enqueueTime = 0;
+
+    /**
+     * @brief The reception time of the sample that caused the task, in monotonic nanoseconds, or 0 if none.
+     */
+    uint64_t triggerTime = 0;
+
+    /**
+     * @brief The coalescing slot counting the task as pending, released when it starts, or nullptr.
+     */
+    std::atomic<uint32_t>* coalesceSlot = nullptr;
 };
 
 /**
@@ -72,8 +155,9 @@ public:
      * @brief Constructor for the ControlTask class.
      *
      * @param priority The priority of the task.
+     * @param affinity The channel the task works on, or NO_CHANNEL_AFFINITY.
      */
-    ControlTask(TaskPriority priority) : Task(priority) {}
+    ControlTask(TaskPriority priority, uint32_t affinity = NO_CHANNEL_AFFINITY) : Task(priority, affinity) {}
 
     /**
      * @brief Virtual destructor for the ControlTask class.
@@ -92,8 +176,9 @@ public:
      * @brief Constructor for the DataTask class.
      *
      * @param priority The priority of the task.
+     * @param affinity The first channel the task works on, or NO_CHANNEL_AFFINITY.
      */
-    DataTask(TaskPriority priority) : Task(priority) {}
+    DataTask(TaskPriority priority, uint32_t affinity = NO_CHANNEL_AFFINITY) : Task(priority, affinity) {}
 
     /**
      * @brief Virtual destructor for the DataTask class.
@@ -120,8 +205,12 @@ public:
 
     /**
      * @brief Executes the generic control task.
+     *
+     * @return Success.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Generic; }
 
     /**
      * @brief Adds a ChannelCtrlService to the queue.
@@ -152,12 +241,16 @@ public:
      * @param ctrlService Pointer to the channel control service.
      */
     CCTask(uint32_t channel, float current, ChannelCtrlService* ctrlService)
-        : ControlTask(TaskPriority::NORMAL), channel(channel), current(current), ctrlService(ctrlService) {}
+        : ControlTask(TaskPriority::NORMAL, channel), channel(channel), current(current), ctrlService(ctrlService) {}
     
     /**
      * @brief Executes the constant current task.
+     *
+     * @return The status of the control service.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::ConstantCurrent; }
 
 private:
     uint32_t channel;
@@ -180,12 +273,16 @@ public:
      * @param ctrlService Pointer to the channel control service.
      */
     CVTask(uint32_t channel, float targetVoltage, ChannelCtrlService* ctrlService)
-        : ControlTask(TaskPriority::NORMAL), channel(channel), targetVoltage(targetVoltage), ctrlService(ctrlService) {}
+        : ControlTask(TaskPriority::NORMAL, channel), channel(channel), targetVoltage(targetVoltage), ctrlService(ctrlService) {}
     
     /**
      * @brief Executes the constant voltage task.
+     *
+     * @return The status of the control service.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::ConstantVoltage; }
 
 private:
     uint32_t channel;
@@ -193,16 +290,117 @@ private:
     ChannelCtrlService* ctrlService;
 };
 
+/**
+ * @brief Rest Task
+ *
+ * Sets a channel to rest (open circuit)
+ */
+class RestTask : public ControlTask {
+public:
+    /**
+     * @brief Constructor for the RestTask class.
+     *
+     * @param channel The channel number.
+     * @param ctrlService Pointer to the channel control service.
+     */
+    RestTask(uint32_t channel, ChannelCtrlService* ctrlService)
+        : ControlTask(TaskPriority::NORMAL, channel), channel(channel), ctrlService(ctrlService) {}
+
+    /**
+     * @brief Executes the rest task.
+     *
+     * @return The status of the control service.
+     */
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Rest; }
+
+private:
+    uint32_t channel;
+    ChannelCtrlService* ctrlService;
+};
+
+/**
+ * @brief Batch Control Task
+ *
+ * Applies commands to a group of channels in one call to the control
+ * service, so that they change mode at the same tick.
+ */
+class BatchControlTask : public ControlTask {
+public:
+    /**
+     * @brief Constructor for the BatchControlTask class.
+     *
+     * @param batch The commands, one per channel set in the channel mask.
+     * @param ctrlService Pointer to the channel control service.
+     */
+    BatchControlTask(const ChannelCommandBatch& batch, ChannelCtrlService* ctrlService)
+        : ControlTask(TaskPriority::HIGH), batch(batch), ctrlService(ctrlService) {}
+
+    /**
+     * @brief Executes the batch control task.
+     *
+     * @return The status of the control service.
+     */
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Batch; }
+
+private:
+    ChannelCommandBatch batch;
+    ChannelCtrlService* ctrlService;
+};
+
+/**
+ * @brief Profile Control Task to start a setpoint profile on a group of channels.
+ *
+ * Uploads the profile once; the M4 then runs it on every channel of the
+ * mask from the same control tick, with no further host commands.
+ */
+class ProfileControlTask : public ControlTask {
+public:
+    /**
+     * @brief Constructor for the ProfileControlTask class.
+     *
+     * @param channelMask The channels, local to the endpoint, bit n for channel n.
+     * @param profile The profile, shared with the routines waiting on it.
+     * @param ctrlService Pointer to the channel control service.
+     */
+    ProfileControlTask(uint64_t channelMask, std::shared_ptr<const SetpointProfile> profile,
+        ChannelCtrlService* ctrlService)
+        : ControlTask(TaskPriority::HIGH), channelMask(channelMask), profile(std::move(profile)),
+          ctrlService(ctrlService) {}
+
+    /**
+     * @brief Executes the profile control task.
+     *
+     * @return The status of the control service.
+     */
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Profile; }
+
+private:
+    uint64_t channelMask;
+    std::shared_ptr<const SetpointProfile> profile;
+    ChannelCtrlService* ctrlService;
+};
+
 /**
  * @brief Callback Control Task to handle callback functions for subscribed channels.
  *
  * This class handles callback functions in the control plane instead of the data plane.
- * It reads data from the channel data table and executes callback logic based on the data.
+ * It reads a consistent snapshot from the channel data table and executes callback logic
+ * based on the data. The snapshot's sequence number lets a callback detect samples it has
+ * already seen or samples that were published while it was waiting to run.
  */
 class CallbackControlTask : public ControlTask {
 public:
     // Define callback function type
-    using CallbackFunction = std::function<void(uint32_t channel, const std::map<std::string, float>& data)>;
+    using CallbackFunction = std::function<void(uint32_t channel, const ChannelSnapshot& snapshot)>;
+
+    // Shared, immutable callback; copying it never allocates
+    using CallbackPtr = std::shared_ptr<const CallbackFunction>;
     
     /**
      * @brief Constructor for the CallbackControlTask class.
@@ -211,69 +409,101 @@ public:
      * @param callback The callback function to execute.
      * @param dataService Pointer to the channel data service to read data from.
      */
-    CallbackControlTask(uint32_t channel, CallbackFunction callback, ChannelDataService* dataService)
-        : ControlTask(TaskPriority::HIGH), channel(channel), callback(callback), dataService(dataService) {}
+    CallbackControlTask(uint32_t channel, CallbackPtr callback, ChannelDataService* dataService)
+        : ControlTask(TaskPriority::HIGH, channel), channel(channel), callback(std::move(callback)), dataService(dataService) {}
     
     /**
      * @brief Executes the callback task.
      *
-     * Reads current data for the channel from the data table and executes the callback.
+     * Copies a consistent snapshot of the channel from the data table and executes the callback.
+     *
+     * @return Success.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Callback; }
 
 private:
     uint32_t channel;
-    CallbackFunction callback;
+    CallbackPtr callback;
     ChannelDataService* dataService;
 };
 
 
 /**
  * @brief Fitting data task for processing raw data
+ *
+ * Covers a contiguous range of channels, normally a whole block of an M4
+ * frame, and processes all of them in one pass over the data table. A range
+ * of a single channel is the fallback for irregular data.
  */
 class FittingDataTask : public DataTask {
 public:
     /**
      * @brief Constructor for the FittingDataTask class.
      *
-     * @param channel The channel number.
-     * @param data The raw data to process.
+     * @param firstChannel The first channel of the range.
+     * @param channelCount The number of channels, at most MAX_BLOCK_CHANNELS.
+     * @param dataService Pointer to the channel data service to read data from.
+     * @param fittingEngine Pointer to the fitting engine holding the fitting state of all channels.
      */
-    FittingDataTask(uint32_t channel, const std::map<std::string, float> &data)
-        : DataTask(TaskPriority::NORMAL), channel(channel), rawData(data) {}
+    FittingDataTask(uint32_t firstChannel, uint32_t channelCount, ChannelDataService* dataService,
+        FittingEngine* fittingEngine)
+        : DataTask(TaskPriority::NORMAL, firstChannel), firstChannel(firstChannel), channelCount(channelCount),
+          dataService(dataService), fittingEngine(fittingEngine) {}
 
     /**
      * @brief Executes the fitting algorithm on the raw data.
+     *
+     * @return The status of storing the derived values.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Fitting; }
 
 private:
-    uint32_t channel;
-    std::map<std::string, float> rawData;
+    uint32_t firstChannel;
+    uint32_t channelCount;
+    ChannelDataService* dataService;
+    FittingEngine* fittingEngine;
 };
 
 /**
  * @brief Filtering data task for cleaning noisy data
+ *
+ * Covers a contiguous range of channels, normally a whole block of an M4
+ * frame, and processes all of them in one pass over the data table. A range
+ * of a single channel is the fallback for irregular data.
  */
 class FilteringDataTask : public DataTask {
 public:
     /**
      * @brief Constructor for the FilteringDataTask class.
      *
-     * @param channel The channel number.
-     * @param data The data to filter.
+     * @param firstChannel The first channel of the range.
+     * @param channelCount The number of channels, at most MAX_BLOCK_CHANNELS.
+     * @param dataService Pointer to the channel data service to read data from.
+     * @param filterEngine Pointer to the filter engine holding the filter state of all channels.
      */
-    FilteringDataTask(uint32_t channel, const std::map<std::string, float>& data)
-        : DataTask(TaskPriority::NORMAL), channel(channel), rawData(data) {}
+    FilteringDataTask(uint32_t firstChannel, uint32_t channelCount, ChannelDataService* dataService,
+        FilterEngine* filterEngine)
+        : DataTask(TaskPriority::NORMAL, firstChannel), firstChannel(firstChannel), channelCount(channelCount),
+          dataService(dataService), filterEngine(filterEngine) {}
     
     /**
      * @brief Executes the filtering algorithm on the raw data.
+     *
+     * @return The status of storing the derived values.
      */
-    void execute() override;
+    ErrorLogging::Status execute() override;
+
+    TaskType getType() const override { return TaskType::Filtering; }
 
 private:
-    uint32_t channel;
-    std::map<std::string, float> rawData;
+    uint32_t firstChannel;
+    uint32_t channelCount;
+    ChannelDataService* dataService;
+    FilterEngine* filterEngine;
 };
 
 
@@ -0,0 +1,46 @@
+#include "TaskCoalescer.h"
+
+/**
+ * @brief Constructor for the TaskCoalescer class.
+ *
+ * @param channelCount The number of channels.
+ */
+TaskCoalescer::TaskCoalescer(size_t channelCount) :
+    channelCount(channelCount), slots(new std::atomic<uint32_t>[channelCount * SLOTS_PER_CHANNEL]) {
+    for (size_t i = 0; i < channelCount * SLOTS_PER_CHANNEL; ++i) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint64_t>& count : coalesced) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Claims the slot of new tasks, unless the pending ones already cover them.
+ *
+ * @param channel The first channel of the tasks.
+ * @param channelCount The number of channels the tasks cover.
+ * @param type The type of the tasks.
+ * @param taskCount The number of tasks, e.g. the callbacks of a channel.
+ * @param slot Receives the slot to set on the tasks, nullptr for a type without slots.
+ * @return True to queue the tasks, false if at least taskCount equal tasks are still pending.
+ */
+bool TaskCoalescer::claim(uint32_t channel, uint32_t channelCount, TaskType type, uint32_t taskCount,
+    std::atomic<uint32_t>*& slot) {
+    slot = nullptr;
+    if (!isCoalesced(type) || channel >= this->channelCount) {
+        return true;
+    }
+    size_t index = type == TaskType::Filtering ? 0 : type == TaskType::Fitting ? 2 : 4;
+    std::atomic<uint32_t>& pending = slots[channel * SLOTS_PER_CHANNEL + index + (channelCount > 1 ? 1 : 0)];
+
+    // Only the owning ingest thread adds to the slot, so the check cannot race with another claim
+    if (pending.load(std::memory_order_acquire) >= taskCount) {
+        std::atomic<uint64_t>& count = coalesced[static_cast<size_t>(type)];
+        count.fetch_add(taskCount, std::memory_order_relaxed);
+        return false;
+    }
+    pending.fetch_add(taskCount, std::memory_order_relaxed);
+    slot = &pending;
+    return true;
+}
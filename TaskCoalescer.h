@@ -0,0 +1,124 @@
+#ifndef TASKCOALESCER_H
+#define TASKCOALESCER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Task.h"
+
+// Default longest wait of addTask on a full Block lane, in nanoseconds (a fifth of a sample at 1 kHz)
+#define DEFAULT_TASK_BLOCK_TIMEOUT_NS 200000
+
+/**
+ * @brief What addTask does with a task whose scheduler lane is full.
+ */
+enum class OverloadPolicy : uint8_t {
+    Block,    // The producer waits for room, up to blockTimeoutNs; the task is dropped and counted after that
+    Drop      // The task is dropped and counted
+};
+
+/**
+ * @brief Coalescing and overload policies of the worker task queue.
+ */
+struct TaskOverloadConfig {
+    // Latest-wins coalescing of the data and callback tasks of a channel
+    bool coalescing = true;
+    // Policy of each priority lane when full, indexed by TaskPriority; HIGH must be Block
+    OverloadPolicy policies[TASK_PRIORITY_COUNT] = {OverloadPolicy::Block, OverloadPolicy::Block, OverloadPolicy::Drop};
+    // Longest wait of a Block lane; the producer is the ingest thread, which runs the steps and limits meanwhile
+    uint64_t blockTimeoutNs = DEFAULT_TASK_BLOCK_TIMEOUT_NS;
+};
+
+/**
+ * @brief Counters of the coalescing and overload actions.
+ */
+struct TaskOverloadStatistics {
+    uint64_t coalesced[TASK_TYPE_COUNT] = {};      // Tasks not queued because an equal one was pending
+    uint64_t dropped[TASK_PRIORITY_COUNT] = {};    // Tasks dropped on a full lane, including Block lanes that timed out
+    uint64_t blocked[TASK_PRIORITY_COUNT] = {};    // Tasks whose producer waited on a full lane
+};
+
+/**
+ * @brief Latest-wins coalescing slots of the data and callback tasks.
+ *
+ * Filtering, fitting and callback tasks read the data table when they run,
+ * not when they are queued, so a task that is queued but not yet started
+ * already covers every newer sample of its channels. Each channel has one
+ * slot per coalesced task type, counting the queued tasks that have not
+ * started; a new task finding its slot pending is not queued. Whole-block
+ * and single-channel data tasks have separate slots, so one never hides
+ * the other. The worker releases the slot right before running the task,
+ * so a sample arriving while it runs queues a new one.
+ *
+ * claim() is called by the ingest thread that owns the channel, release()
+ * by any worker.
+ */
+class TaskCoalescer {
+public:
+    /**
+     * @brief Constructor for the TaskCoalescer class.
+     *
+     * @param channelCount The number of channels.
+     */
+    explicit TaskCoalescer(size_t channelCount);
+
+    TaskCoalescer(const TaskCoalescer&) = delete;
+    TaskCoalescer& operator=(const TaskCoalescer&) = delete;
+
+    /**
+     * @brief Checks whether tasks of a type have coalescing slots.
+     *
+     * @param type The task type.
+     * @return True for the filtering, fitting and callback tasks.
+     */
+    static bool isCoalesced(TaskType type) {
+        return type == TaskType::Filtering || type == TaskType::Fitting || type == TaskType::Callback;
+    }
+
+    /**
+     * @brief Claims the slot of new tasks, unless the pending ones already cover them.
+     *
+     * @param channel The first channel of the tasks.
+     * @param channelCount The number of channels the tasks cover.
+     * @param type The type of the tasks.
+     * @param taskCount The number of tasks, e.g. the callbacks of a channel.
+     * @param slot Receives the slot to set on the tasks, nullptr for a type without slots.
+     * @return True to queue the tasks, false if at least taskCount equal tasks are still pending.
+     */
+    bool claim(uint32_t channel, uint32_t channelCount, TaskType type, uint32_t taskCount,
+        std::atomic<uint32_t>*& slot);
+
+    /**
+     * @brief Releases the slot of a task that starts or is dropped.
+     *
+     * @param task The task.
+     */
+    static void release(Task& task) {
+        if (task.coalesceSlot) {
+            task.coalesceSlot->fetch_sub(1, std::memory_order_release);
+            task.coalesceSlot = nullptr;
+        }
+    }
+
+    /**
+     * @brief Gets the number of tasks of a type that were not queued.
+     *
+     * @param type The task type.
+     * @return The count since construction.
+     */
+    uint64_t getCoalescedCount(TaskType type) const {
+        return coalesced[static_cast<size_t>(type)].load(std::memory_order_relaxed);
+    }
+
+private:
+    // Slots per channel: filtering, fitting and callback, each single-channel and whole-block
+    static constexpr size_t SLOTS_PER_CHANNEL = 6;
+
+    size_t channelCount;
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    std::atomic<uint64_t> coalesced[TASK_TYPE_COUNT];
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "TaskMetrics.h"
+
+namespace {
+
+/**
+ * @brief Gets the value below which a fraction of the counted latencies lie.
+ *
+ * @param counts The bucket counts.
+ * @param count The sum of the bucket counts, non-zero.
+ * @param fraction The fraction, 0 to 1.
+ * @return The upper bound of the bucket of the percentile.
+ */
+uint64_t percentile(const uint64_t* counts, uint64_t count, double fraction) {
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return LatencyHistogram::bucketUpperBound(i);
+        }
+    }
+    return LatencyHistogram::bucketUpperBound(LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the LatencyHistogram class. All buckets start empty.
+ */
+LatencyHistogram::LatencyHistogram() : totalNs(0) {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Adds the counts of this histogram to the counts of a snapshot.
+ *
+ * @param counts The bucket counts, LATENCY_HISTOGRAM_BUCKETS entries.
+ * @param total The sum of the latencies, incremented by the sum of this histogram.
+ */
+void LatencyHistogram::addTo(uint64_t* counts, uint64_t& total) const {
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        counts[i] += buckets[i].load(std::memory_order_relaxed);
+    }
+    total += totalNs.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the largest latency counted in a bucket.
+ *
+ * @param index The bucket index.
+ * @return The upper bound of the bucket, in nanoseconds.
+ */
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    constexpr size_t linearBuckets = 2 << LATENCY_HISTOGRAM_SUB_BITS;
+    if (index < linearBuckets) {
+        return index;
+    }
+    size_t shift = (index >> LATENCY_HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (index & ((1 << LATENCY_HISTOGRAM_SUB_BITS) - 1)) + (1 << LATENCY_HISTOGRAM_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Computes the count, mean and percentiles of a snapshot.
+ *
+ * @param counts The bucket counts, LATENCY_HISTOGRAM_BUCKETS entries.
+ * @param total The sum of the latencies.
+ * @return The summary.
+ */
+LatencySummary LatencyHistogram::summarize(const uint64_t* counts, uint64_t total) {
+    LatencySummary summary;
+    size_t highest = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        if (counts[i] != 0) {
+            summary.count += counts[i];
+            highest = i;
+        }
+    }
+    if (summary.count == 0) {
+        return summary;
+    }
+
+    summary.totalNs = total;
+    summary.meanNs = total / summary.count;
+    summary.p50Ns = percentile(counts, summary.count, 0.5);
+    summary.p90Ns = percentile(counts, summary.count, 0.9);
+    summary.p99Ns = percentile(counts, summary.count, 0.99);
+    summary.p999Ns = percentile(counts, summary.count, 0.999);
+    summary.maxNs = bucketUpperBound(highest);
+    return summary;
+}
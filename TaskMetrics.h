@@ -0,0 +1,193 @@
+#ifndef TASKMETRICS_H
+#define TASKMETRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Task.h"
+
+// Sub-buckets per power of two of a latency histogram; the relative error is below 2^-bits
+#define LATENCY_HISTOGRAM_SUB_BITS 3
+
+// Latencies up to 2^bits nanoseconds (about 36 minutes) are resolved; longer ones count as the largest
+#define LATENCY_HISTOGRAM_RANGE_BITS 41
+
+// Number of buckets of a latency histogram
+#define LATENCY_HISTOGRAM_BUCKETS \
+    ((LATENCY_HISTOGRAM_RANGE_BITS - LATENCY_HISTOGRAM_SUB_BITS + 1) << LATENCY_HISTOGRAM_SUB_BITS)
+
+/**
+ * @brief Count, mean and percentiles of a latency histogram, in nanoseconds.
+ *
+ * The percentiles are the upper bounds of their buckets, so they overstate
+ * the true value by less than the histogram's relative error.
+ */
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t meanNs = 0;
+    uint64_t p50Ns = 0;
+    uint64_t p90Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;       // Upper bound of the highest non-empty bucket
+    uint64_t totalNs = 0;     // Sum of all recorded latencies
+};
+
+/**
+ * @brief Lock-free log-linear latency histogram, in the style of HdrHistogram.
+ *
+ * Values below 2 * 2^LATENCY_HISTOGRAM_SUB_BITS nanoseconds have a bucket
+ * each; above that, every power of two is split into 2^SUB_BITS buckets, so
+ * the bucket width grows with the value and the relative error stays
+ * constant over the whole range.
+ *
+ * record() has a single writer: it is a bucket lookup and two plain
+ * increments, without atomic read-modify-write. Each thread records into
+ * histograms of its own, which readers add up with addTo().
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Constructor for the LatencyHistogram class. All buckets start empty.
+     */
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * @brief Counts a latency. Must only be called from the histogram's writer thread.
+     *
+     * @param valueNs The latency in nanoseconds.
+     */
+    void record(uint64_t valueNs) {
+        std::atomic<uint64_t>& bucket = buckets[bucketIndex(valueNs)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalNs.store(totalNs.load(std::memory_order_relaxed) + valueNs, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Adds the counts of this histogram to the counts of a snapshot.
+     *
+     * Can be called from any thread; a concurrent record() may or may not be included.
+     *
+     * @param counts The bucket counts, LATENCY_HISTOGRAM_BUCKETS entries.
+     * @param total The sum of the latencies, incremented by the sum of this histogram.
+     */
+    void addTo(uint64_t* counts, uint64_t& total) const;
+
+    /**
+     * @brief Gets the bucket of a latency.
+     *
+     * @param valueNs The latency in nanoseconds.
+     * @return The bucket index, below LATENCY_HISTOGRAM_BUCKETS.
+     */
+    static size_t bucketIndex(uint64_t valueNs) {
+        constexpr uint64_t maxValue = (1ULL << LATENCY_HISTOGRAM_RANGE_BITS) - 1;
+        if (valueNs > maxValue) {
+            valueNs = maxValue;
+        }
+        int msb = 63 - __builtin_clzll(valueNs | 1);
+        int shift = msb > LATENCY_HISTOGRAM_SUB_BITS ? msb - LATENCY_HISTOGRAM_SUB_BITS : 0;
+        return (static_cast<size_t>(shift) << LATENCY_HISTOGRAM_SUB_BITS) + (valueNs >> shift);
+    }
+
+    /**
+     * @brief Gets the largest latency counted in a bucket.
+     *
+     * @param index The bucket index.
+     * @return The upper bound of the bucket, in nanoseconds.
+     */
+    static uint64_t bucketUpperBound(size_t index);
+
+    /**
+     * @brief Computes the count, mean and percentiles of a snapshot.
+     *
+     * @param counts The bucket counts, LATENCY_HISTOGRAM_BUCKETS entries.
+     * @param total The sum of the latencies.
+     * @return The summary.
+     */
+    static LatencySummary summarize(const uint64_t* counts, uint64_t total);
+
+private:
+    std::atomic<uint64_t> buckets[LATENCY_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> totalNs;
+};
+
+/**
+ * @brief Queue wait and execution time histograms of every task type and priority, for one thread.
+ *
+ * Each worker thread and the control executor record into a shard of
+ * their own, so recording never contends; TaskMetricsSnapshot adds the
+ * shards up.
+ */
+class TaskMetricsShard {
+public:
+    /**
+     * @brief Records the latencies of a task that just ran.
+     *
+     * @param type The type of the task.
+     * @param priority The priority of the task.
+     * @param queueWaitNs The time from enqueue to the start of execute().
+     * @param executionNs The time spent in execute().
+     */
+    void record(TaskType type, TaskPriority priority, uint64_t queueWaitNs, uint64_t executionNs) {
+        Histograms& histograms = shard[static_cast<size_t>(type)][static_cast<size_t>(priority)];
+        histograms.queueWait.record(queueWaitNs);
+        histograms.execution.record(executionNs);
+    }
+
+    /**
+     * @brief Gets the queue wait histogram of a task type and priority.
+     *
+     * @param type The task type.
+     * @param priority The task priority.
+     * @return The histogram.
+     */
+    const LatencyHistogram& getQueueWait(TaskType type, TaskPriority priority) const {
+        return shard[static_cast<size_t>(type)][static_cast<size_t>(priority)].queueWait;
+    }
+
+    /**
+     * @brief Gets the execution time histogram of a task type and priority.
+     *
+     * @param type The task type.
+     * @param priority The task priority.
+     * @return The histogram.
+     */
+    const LatencyHistogram& getExecution(TaskType type, TaskPriority priority) const {
+        return shard[static_cast<size_t>(type)][static_cast<size_t>(priority)].execution;
+    }
+
+    /**
+     * @brief Counts a task whose execute() returned an error.
+     *
+     * @param type The type of the task.
+     */
+    void recordFailure(TaskType type) {
+        std::atomic<uint64_t>& count = failures[static_cast<size_t>(type)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gets the number of failed tasks of a type.
+     *
+     * @param type The task type.
+     * @return The number of tasks whose execute() returned an error.
+     */
+    uint64_t getFailureCount(TaskType type) const {
+        return failures[static_cast<size_t>(type)].load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Histograms {
+        LatencyHistogram queueWait;
+        LatencyHistogram execution;
+    };
+
+    Histograms shard[TASK_TYPE_COUNT][TASK_PRIORITY_COUNT];
+    std::atomic<uint64_t> failures[TASK_TYPE_COUNT] = {};
+};
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "Platform.h"
+#include "Task.h"
+
+/**
+ * @brief Interface through which a pooled task is returned to its pool.
+ */
+class TaskPoolBase {
+public:
+    /**
+     * @brief Virtual destructor for the TaskPoolBase class.
+     */
+    virtual ~TaskPoolBase() {}
+
+    /**
+     * @brief Destroys a task and returns its storage to the pool.
+     *
+     * @param task The task to release. Must have been acquired from this pool.
+     */
+    virtual void release(Task* task) = 0;
+};
+
+/**
+ * @brief Owning handle to a task.
+ *
+ * Move-only. When the handle goes out of scope the task is destroyed and its
+ * storage goes back to the pool it came from, or is deleted if it was
+ * allocated on the heap.
+ */
+class TaskHandle {
+public:
+    TaskHandle() : task(nullptr) {}
+
+    /**
+     * @brief Takes ownership of a task.
+     *
+     * @param task The task, either pooled or allocated with new.
+     */
+    explicit TaskHandle(Task* task) : task(task) {}
+
+    TaskHandle(TaskHandle&& other) noexcept : task(other.task) {
+        other.task = nullptr;
+    }
+
+    TaskHandle& operator=(TaskHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            task = other.task;
+            other.task = nullptr;
+        }
+        return *this;
+    }
+
+    TaskHandle(const TaskHandle&) = delete;
+    TaskHandle& operator=(const TaskHandle&) = delete;
+
+    ~TaskHandle() {
+        reset();
+    }
+
+    Task* operator->() const { return task; }
+    Task& operator*() const { return *task; }
+    Task* get() const { return task; }
+    explicit operator bool() const { return task != nullptr; }
+
+    /**
+     * @brief Gives up ownership without destroying the task.
+     *
+     * Used to hand the task to the scheduler, which stores raw pointers.
+     *
+     * @return The task.
+     */
+    Task* release() {
+        Task* released = task;
+        task = nullptr;
+        return released;
+    }
+
+    /**
+     * @brief Destroys the owned task, if any.
+     */
+    void reset() {
+        if (task) {
+            if (task->ownerPool) {
+                task->ownerPool->release(task);
+            } else {
+                delete task;
+            }
+            task = nullptr;
+        }
+    }
+
+private:
+    Task* task;
+};
+
+/**
+ * @brief Allocates a task on the heap and wraps it in a handle.
+ *
+ * For control-plane tasks created outside the per-sample path.
+ */
+template <typename T, typename... Args>
+TaskHandle makeTask(Args&&... args) {
+    return TaskHandle(new T(std::forward<Args>(args)...));
+}
+
+/**
+ * @brief Fixed-capacity slab of recyclable tasks of one type.
+ *
+ * All slots are allocated once at construction and linked into a lock-free
+ * free list, so acquiring and releasing tasks never touches the heap and is
+ * safe from any number of threads. If the slab is exhausted, acquire() falls
+ * back to the heap and counts the fallback, so an undersized pool shows up
+ * in the statistics instead of failing.
+ *
+ * @tparam T The Task-derived type held by the pool.
+ */
+template <typename T>
+class TaskPool : public TaskPoolBase {
+public:
+    /**
+     * @brief Constructor for the TaskPool class.
+     *
+     * @param slotCount The number of tasks that can be live at the same time without heap allocation.
+     */
+    explicit TaskPool(size_t slotCount) : capacity(static_cast<uint32_t>(slotCount)) {
+        slots = new Slot[capacity];
+        for (uint32_t i = 0; i < capacity; ++i) {
+            slots[i].next.store(i + 1 < capacity ? i + 1 : NO_SLOT, std::memory_order_relaxed);
+        }
+        freeHead.store(capacity > 0 ? 0 : NO_SLOT, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Destructor for the TaskPool class.
+     *
+     * All tasks acquired from the pool must have been released.
+     */
+    ~TaskPool() override {
+        delete[] slots;
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * @brief Constructs a task in a free slot.
+     *
+     * @param args The arguments of the task's constructor.
+     * @return A handle owning the task.
+     */
+    template <typename... Args>
+    TaskHandle acquire(Args&&... args) {
+        uint32_t index = popFreeSlot();
+        if (index == NO_SLOT) {
+            heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+            return TaskHandle(new T(std::forward<Args>(args)...));
+        }
+        T* task = new (slots[index].storage) T(std::forward<Args>(args)...);
+        task->ownerPool = this;
+        return TaskHandle(task);
+    }
+
+    /**
+     * @brief Destroys a task and returns its slot to the free list.
+     *
+     * @param task The task to release.
+     */
+    void release(Task* task) override {
+        T* typed = static_cast<T*>(task);
+        typed->~T();
+        Slot* slot = reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(typed) - offsetof(Slot, storage));
+        pushFreeSlot(static_cast<uint32_t>(slot - slots));
+    }
+
+    /**
+     * @brief Gets the number of slots in the pool.
+     *
+     * @return The capacity.
+     */
+    size_t getCapacity() const { return capacity; }
+
+    /**
+     * @brief Gets the number of acquisitions that had to fall back to the heap.
+     *
+     * @return The number of heap fallbacks since construction.
+     */
+    uint64_t getHeapFallbackCount() const {
+        return heapFallbacks.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        std::atomic<uint32_t> next;
+    };
+
+    // The free list head packs a slot index with a tag that defeats ABA
+    static uint32_t indexOf(uint64_t head) { return static_cast<uint32_t>(head); }
+    static uint64_t pack(uint64_t previous, uint32_t index) {
+        return ((previous >> 32) + 1) << 32 | index;
+    }
+
+    uint32_t popFreeSlot() {
+        uint64_t head = freeHead.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t index = indexOf(head);
+            if (index == NO_SLOT) {
+                return NO_SLOT;
+            }
+            uint32_t next = slots[index].next.load(std::memory_order_relaxed);
+            if (freeHead.compare_exchange_weak(head, pack(head, next),
+                    std::memory_order_acquire, std::memory_order_acquire)) {
+                return index;
+            }
+        }
+    }
+
+    void pushFreeSlot(uint32_t index) {
+        uint64_t head = freeHead.load(std::memory_order_relaxed);
+        for (;;) {
+            slots[index].next.store(indexOf(head), std::memory_order_relaxed);
+            if (freeHead.compare_exchange_weak(head, pack(head, index),
+                    std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    const uint32_t capacity;
+    Slot* slots;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> freeHead;
+    std::atomic<uint64_t> heapFallbacks{0};
+};
+
+#endif
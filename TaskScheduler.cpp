@@ -0,0 +1,341 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// Number of empty polls before a worker parks
+constexpr int SPIN_BEFORE_PARK = 64;
+
+} // namespace
+
+/**
+ * @brief Constructor for the TaskScheduler class.
+ *
+ * @param channelCount The number of channels.
+ * @param laneCapacity The number of tasks each priority lane of a shard can hold.
+ * @param agingLimit How many times a non-empty lane may be passed over before it is served.
+ */
+TaskScheduler::TaskScheduler(size_t channelCount, size_t laneCapacity, uint32_t agingLimit) :
+    shardCount(static_cast<uint32_t>((channelCount + TASK_SHARD_CHANNELS - 1) / TASK_SHARD_CHANNELS)),
+    agingLimit(agingLimit),
+    markWords((shardCount + 63) / 64),
+    markedShards(new std::atomic<uint64_t>[static_cast<size_t>(markWords) * TASK_PRIORITY_COUNT]()) {
+    // One shard per channel group, plus the shared shard
+    for (uint32_t shard = 0; shard <= shardCount; ++shard) {
+        shards.push_back(std::make_unique<Shard>(laneCapacity));
+    }
+    setWorkerCount(1);
+}
+
+/**
+ * @brief Adds a task to its shard and lane and wakes a worker.
+ *
+ * A channel shard is marked in the lane's bitmap after the push, so a
+ * worker that sees the mark also sees the task. The mark and the scan are
+ * sequentially consistent, like the EventCount, so a worker about to park
+ * either sees the mark or is seen waiting by notifyShard().
+ *
+ * @param task The task to add.
+ * @return True on success, false if the lane is full.
+ */
+bool TaskScheduler::push(Task* task) {
+    uint32_t shard = task->affinity / TASK_SHARD_CHANNELS;
+    if (task->affinity == NO_CHANNEL_AFFINITY || shard >= shardCount) {
+        shard = shardCount;
+    }
+    size_t lane = static_cast<size_t>(task->priority);
+    if (!shards[shard]->lanes[lane].queue.push(task)) {
+        return false;
+    }
+    if (shard < shardCount) {
+        markedShards[lane * markWords + shard / 64].fetch_or(1ULL << (shard % 64), std::memory_order_seq_cst);
+    }
+    notifyShard(shard);
+    return true;
+}
+
+/**
+ * @brief Pops from a lane of a shard, serving a starving lane first.
+ *
+ * Every lower lane that still has work waiting ages by one. The caller
+ * holds the claim of the shard, or the shard is the shared one.
+ *
+ * @param shard The shard.
+ * @param lane The lane to serve unless a lower lane is starving.
+ * @return The task, or nullptr if the lanes are empty.
+ */
+Task* TaskScheduler::popShard(Shard& shard, size_t lane) {
+    Task* task = nullptr;
+
+    // Anti-starvation: a lane passed over too often goes first
+    for (size_t lower = TASK_PRIORITY_COUNT - 1; lower > lane; --lower) {
+        if (shard.lanes[lower].skipped.load(std::memory_order_relaxed) >= agingLimit) {
+            shard.lanes[lower].skipped.store(0, std::memory_order_relaxed);
+            if (shard.lanes[lower].queue.pop(task)) {
+                return task;
+            }
+        }
+    }
+
+    if (!shard.lanes[lane].queue.pop(task)) {
+        return nullptr;
+    }
+    for (size_t lower = lane + 1; lower < TASK_PRIORITY_COUNT; ++lower) {
+        if (!shard.lanes[lower].queue.emptyApprox()) {
+            shard.lanes[lower].skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return task;
+}
+
+/**
+ * @brief Claims a channel shard and pops from one of its lanes.
+ *
+ * A lane found empty is unmarked, so later scans skip the shard.
+ *
+ * @param shard The index of the shard.
+ * @param lane The lane to serve.
+ * @return The task with the claim held, or nullptr with the claim released.
+ */
+Task* TaskScheduler::tryPopClaimed(uint32_t shard, size_t lane) {
+    Shard& target = *shards[shard];
+    if (target.lanes[lane].queue.emptyApprox()) {
+        unmarkShard(shard, lane);
+        return nullptr;
+    }
+    if (target.claimed.test_and_set(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    Task* task = popShard(target, lane);
+    if (!task) {
+        target.claimed.clear(std::memory_order_release);
+    }
+    if (target.lanes[lane].queue.emptyApprox()) {
+        unmarkShard(shard, lane);
+    }
+    return task;
+}
+
+/**
+ * @brief Pops from the marked shards of a lane within a range.
+ *
+ * Visits only the shards whose bit is set, in increasing order, so an
+ * empty lane costs one load per 64 shards.
+ *
+ * @param lane The lane to serve.
+ * @param begin The first shard of the range.
+ * @param end One past the last shard of the range.
+ * @param worker The index of the calling worker.
+ * @param steal False to visit the shards the worker owns, true for the shards it does not own.
+ * @param shard Receives the shard of the task.
+ * @return The task with the claim held, or nullptr if no shard of the range had one.
+ */
+Task* TaskScheduler::tryPopMarked(size_t lane, uint32_t begin, uint32_t end, size_t worker, bool steal,
+    uint32_t& shard) {
+    const std::atomic<uint64_t>* marks = &markedShards[lane * markWords];
+    for (uint32_t word = begin / 64; word * 64 < end; ++word) {
+        uint64_t bits = marks[word].load(std::memory_order_seq_cst);
+        // Drop the shards outside the range
+        if (word == begin / 64) {
+            bits &= ~0ULL << (begin % 64);
+        }
+        if ((word + 1) * 64 > end) {
+            bits &= ~0ULL >> ((word + 1) * 64 - end);
+        }
+        while (bits != 0) {
+            uint32_t candidate = word * 64 + static_cast<uint32_t>(std::countr_zero(bits));
+            bits &= bits - 1;
+            bool owned = shards[candidate]->owner.load(std::memory_order_relaxed) == worker;
+            if (owned != steal) {
+                if (Task* task = tryPopClaimed(candidate, lane)) {
+                    shard = candidate;
+                    return task;
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Clears the mark of a lane that looks empty.
+ *
+ * The clear reads the mark of every push it follows, so the re-check then
+ * sees the tasks of those pushes; a push that follows the clear marks the
+ * shard itself. A mark is therefore never cleared while its lane holds a
+ * task, and a stale mark only costs one visit.
+ *
+ * @param shard The index of the channel shard.
+ * @param lane The lane.
+ */
+void TaskScheduler::unmarkShard(uint32_t shard, size_t lane) {
+    std::atomic<uint64_t>& word = markedShards[lane * markWords + shard / 64];
+    uint64_t bit = 1ULL << (shard % 64);
+    if ((word.fetch_and(~bit, std::memory_order_acq_rel) & bit) != 0 &&
+        !shards[shard]->lanes[lane].queue.emptyApprox()) {
+        word.fetch_or(bit, std::memory_order_acq_rel);
+    }
+}
+
+/**
+ * @brief Takes the next task for a worker without waiting.
+ *
+ * Serves each priority over the worker's own shards and then the shared
+ * shard; only when all of them are empty does it steal from the shards of
+ * other workers, highest priority first. Both scans visit only the shards
+ * marked in the lane's bitmap.
+ *
+ * @param worker The index of the calling worker.
+ * @param shard Receives the shard to pass to finish() after running the task.
+ * @return The next task, or nullptr if no task can be run.
+ */
+Task* TaskScheduler::tryPop(size_t worker, uint32_t& shard) {
+    Task* task = nullptr;
+
+    for (size_t lane = 0; lane < TASK_PRIORITY_COUNT; ++lane) {
+        if ((task = tryPopMarked(lane, 0, shardCount, worker, false, shard))) {
+            return task;
+        }
+        if ((task = popShard(*shards[shardCount], lane))) {
+            shard = NO_TASK_SHARD;
+            return task;
+        }
+    }
+
+    // Steal from the shards of other workers, starting after our own
+    size_t count = std::max<size_t>(workerCount.load(std::memory_order_relaxed), 1);
+    uint32_t start = static_cast<uint32_t>(((worker + 1) % count) * shardCount / count);
+    for (size_t lane = 0; lane < TASK_PRIORITY_COUNT; ++lane) {
+        if ((task = tryPopMarked(lane, start, shardCount, worker, true, shard)) ||
+            (task = tryPopMarked(lane, 0, start, worker, true, shard))) {
+            stolenCount.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Takes the next task for a worker, parking the caller while there is none.
+ *
+ * @param worker The index of the calling worker.
+ * @param stop Flag that makes the call return nullptr once set and no task is found.
+ * @param shard Receives the shard to pass to finish() after running the task.
+ * @return The next task, or nullptr if stop was set.
+ */
+Task* TaskScheduler::waitPop(size_t worker, const std::atomic<bool>& stop, uint32_t& shard) {
+    EventCount& eventCount = eventCounts[worker % MAX_WORKER_THREADS];
+
+    for (;;) {
+        for (int spin = 0; spin < SPIN_BEFORE_PARK; ++spin) {
+            if (Task* task = tryPop(worker, shard)) {
+                return task;
+            }
+            cpuRelax();
+        }
+
+        uint32_t key = eventCount.prepareWait();
+        if (Task* task = tryPop(worker, shard)) {
+            eventCount.cancelWait();
+            return task;
+        }
+        if (stop.load()) {
+            eventCount.cancelWait();
+            return nullptr;
+        }
+        eventCount.commitWait(key);
+    }
+}
+
+/**
+ * @brief Releases the claim taken by tryPop() or waitPop() once the task has run.
+ *
+ * Tasks pushed while the shard was claimed may have found no worker able to
+ * run them; they are not lost, since the caller scans the shard again on
+ * its next tryPop() before it can park.
+ *
+ * @param shard The shard returned with the task.
+ */
+void TaskScheduler::finish(uint32_t shard) {
+    if (shard < shardCount) {
+        shards[shard]->claimed.clear(std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Wakes the owner of a shard, or any parked worker if the owner is busy.
+ *
+ * @param shard The index of the shard; the shared shard has no owner.
+ */
+void TaskScheduler::notifyShard(uint32_t shard) {
+    size_t count = std::min<size_t>(workerCount.load(std::memory_order_relaxed), MAX_WORKER_THREADS);
+    size_t owner = shard < shardCount ? shards[shard]->owner.load(std::memory_order_relaxed) : 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (eventCounts[(owner + i) % count].notifyOne()) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Splits the shards across a new number of workers.
+ *
+ * Worker w owns a contiguous range of shards, so neighbouring channels stay
+ * on the same worker. Queued tasks stay in their shards and are served by
+ * the new owner.
+ *
+ * @param workerCount The number of workers, clamped to MAX_WORKER_THREADS.
+ */
+void TaskScheduler::setWorkerCount(size_t workerCount) {
+    size_t count = std::clamp<size_t>(workerCount, 1, MAX_WORKER_THREADS);
+    for (uint32_t shard = 0; shard < shardCount; ++shard) {
+        shards[shard]->owner.store(static_cast<uint32_t>(shard * count / shardCount), std::memory_order_relaxed);
+    }
+    this->workerCount.store(count, std::memory_order_relaxed);
+    wakeAll();
+}
+
+/**
+ * @brief Gets the worker that owns the shard of a channel.
+ *
+ * @param channel The channel number.
+ * @return The index of the worker.
+ */
+size_t TaskScheduler::getChannelWorker(uint32_t channel) const {
+    uint32_t shard = channel / TASK_SHARD_CHANNELS;
+    return shard < shardCount ? shards[shard]->owner.load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief Wakes one worker if it is parked.
+ *
+ * @param worker The index of the worker.
+ */
+void TaskScheduler::wakeWorker(size_t worker) {
+    eventCounts[worker % MAX_WORKER_THREADS].notifyAll();
+}
+
+/**
+ * @brief Wakes all parked workers.
+ */
+void TaskScheduler::wakeAll() {
+    for (EventCount& eventCount : eventCounts) {
+        eventCount.notifyAll();
+    }
+}
+
+/**
+ * @brief Gets the approximate number of queued tasks of a priority.
+ *
+ * @param priority The priority lane.
+ * @return The number of tasks waiting in the lane of every shard.
+ */
+size_t TaskScheduler::getQueueDepth(TaskPriority priority) const {
+    size_t depth = 0;
+    for (const auto& shard : shards) {
+        depth += shard->lanes[static_cast<size_t>(priority)].queue.sizeApprox();
+    }
+    return depth;
+}
@@ -0,0 +1,240 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "MpmcQueue.h"
+#include "Platform.h"
+#include "Task.h"
+
+// Number of channels per scheduler shard; tasks of a shard never run concurrently
+#define TASK_SHARD_CHANNELS 4
+
+// Maximum number of worker threads of a scheduler
+#define MAX_WORKER_THREADS 32
+
+// Shard returned by the scheduler for a task of the shared shard
+#define NO_TASK_SHARD UINT32_MAX
+
+/**
+ * @brief Lets threads sleep until an event is signalled, without a mutex.
+ *
+ * A waiter announces itself with prepareWait(), re-checks its condition and
+ * then either cancels or commits the wait. Notifiers only touch the kernel
+ * (futex via std::atomic::wait) when a thread is actually waiting.
+ */
+class EventCount {
+public:
+    /**
+     * @brief Announces that the calling thread is about to wait.
+     *
+     * @return The key to pass to commitWait().
+     */
+    uint32_t prepareWait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Withdraws a wait announced by prepareWait().
+     */
+    void cancelWait() {
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Sleeps until notified after the given key was taken.
+     *
+     * @param key The key returned by prepareWait().
+     */
+    void commitWait(uint32_t key) {
+        epoch.wait(key, std::memory_order_seq_cst);
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Wakes one waiting thread, if any.
+     *
+     * @return True if a thread was waiting.
+     */
+    bool notifyOne() {
+        if (waiters.load(std::memory_order_seq_cst) != 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_one();
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Wakes all waiting threads.
+     */
+    void notifyAll() {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        epoch.notify_all();
+    }
+
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> waiters{0};
+};
+
+/**
+ * @brief Lock-free, channel-affine task scheduler with work stealing.
+ *
+ * Channels are grouped in shards of TASK_SHARD_CHANNELS channels, and each
+ * shard has one bounded MPMC lane per TaskPriority. A task goes to the shard
+ * of its affinity channel; tasks without affinity go to a shared shard.
+ * Shards are split in contiguous ranges across the workers, so a worker
+ * keeps serving the same channels and their data stays in its cache.
+ *
+ * A worker runs a task of a channel shard only while it holds the shard's
+ * claim, so tasks of the same channel never run concurrently, without
+ * locks. A worker serves HIGH before NORMAL before LOW over its own shards
+ * and the shared shard; when they are empty it steals from the shards of
+ * other workers that are not claimed. Each priority keeps a bitmap of the
+ * channel shards that may hold work, so a scan visits only those shards
+ * rather than every shard of the ring. Within a shard, a lane that has been
+ * passed over agingLimit times while it had work waiting is served next.
+ * Workers spin briefly and then park on their own EventCount; a push wakes
+ * the owner of the shard, or another parked worker if the owner is busy.
+ */
+class TaskScheduler {
+public:
+    /**
+     * @brief Constructor for the TaskScheduler class.
+     *
+     * @param channelCount The number of channels.
+     * @param laneCapacity The number of tasks each priority lane of a shard can hold.
+     * @param agingLimit How many times a non-empty lane may be passed over before it is served.
+     */
+    explicit TaskScheduler(size_t channelCount, size_t laneCapacity = 1024, uint32_t agingLimit = 64);
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+     * @brief Adds a task to its shard and lane and wakes a worker.
+     *
+     * @param task The task to add.
+     * @return True on success, false if the lane is full.
+     */
+    bool push(Task* task);
+
+    /**
+     * @brief Takes the next task for a worker without waiting.
+     *
+     * @param worker The index of the calling worker.
+     * @param shard Receives the shard to pass to finish() after running the task.
+     * @return The next task, or nullptr if no task can be run.
+     */
+    Task* tryPop(size_t worker, uint32_t& shard);
+
+    /**
+     * @brief Takes the next task for a worker, parking the caller while there is none.
+     *
+     * @param worker The index of the calling worker.
+     * @param stop Flag that makes the call return nullptr once set and no task is found.
+     * @param shard Receives the shard to pass to finish() after running the task.
+     * @return The next task, or nullptr if stop was set.
+     */
+    Task* waitPop(size_t worker, const std::atomic<bool>& stop, uint32_t& shard);
+
+    /**
+     * @brief Releases the claim taken by tryPop() or waitPop() once the task has run.
+     *
+     * @param shard The shard returned with the task.
+     */
+    void finish(uint32_t shard);
+
+    /**
+     * @brief Splits the shards across a new number of workers.
+     *
+     * @param workerCount The number of workers, clamped to MAX_WORKER_THREADS.
+     */
+    void setWorkerCount(size_t workerCount);
+
+    /**
+     * @brief Gets the worker that owns the shard of a channel.
+     *
+     * @param channel The channel number.
+     * @return The index of the worker.
+     */
+    size_t getChannelWorker(uint32_t channel) const;
+
+    /**
+     * @brief Wakes one worker if it is parked, e.g. after setting its stop flag.
+     *
+     * @param worker The index of the worker.
+     */
+    void wakeWorker(size_t worker);
+
+    /**
+     * @brief Wakes all parked workers, e.g. after setting their stop flag.
+     */
+    void wakeAll();
+
+    /**
+     * @brief Gets the approximate number of queued tasks of a priority.
+     *
+     * @param priority The priority lane.
+     * @return The number of tasks waiting in the lane of every shard.
+     */
+    size_t getQueueDepth(TaskPriority priority) const;
+
+    /**
+     * @brief Gets the number of tasks run by a worker that does not own their shard.
+     *
+     * @return The number of stolen tasks.
+     */
+    uint64_t getStolenCount() const { return stolenCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Lane {
+        explicit Lane(size_t capacity) : queue(capacity) {}
+
+        MpmcQueue<Task*> queue;
+        // Times the lane was passed over while it had work waiting
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> skipped{0};
+    };
+
+    struct Shard {
+        explicit Shard(size_t capacity) : lanes{Lane(capacity), Lane(capacity), Lane(capacity)} {}
+
+        Lane lanes[TASK_PRIORITY_COUNT];
+        // Held by the worker running a task of the shard
+        alignas(CACHE_LINE_SIZE) std::atomic_flag claimed = ATOMIC_FLAG_INIT;
+        std::atomic<uint32_t> owner{0};
+    };
+
+    // Pops from a lane of a shard, serving a starving lane first; the caller holds the claim
+    Task* popShard(Shard& shard, size_t lane);
+
+    // Claims a channel shard and pops from one of its lanes
+    Task* tryPopClaimed(uint32_t shard, size_t lane);
+
+    // Pops from the marked shards in [begin, end) of a lane, owned by the worker or, to steal, not owned
+    Task* tryPopMarked(size_t lane, uint32_t begin, uint32_t end, size_t worker, bool steal, uint32_t& shard);
+
+    // Clears the mark of a lane that looks empty, marking it again if a push raced the clear
+    void unmarkShard(uint32_t shard, size_t lane);
+
+    // Wakes the owner of a shard, or any parked worker if the owner is busy
+    void notifyShard(uint32_t shard);
+
+    const uint32_t shardCount;    // Channel shards; index shardCount is the shared shard
+    const uint32_t agingLimit;
+    const uint32_t markWords;     // Words of each lane's bitmap
+    std::vector<std::unique_ptr<Shard>> shards;
+    // Bit s of lane l is set from a push to the lane of shard s until the lane is found empty
+    std::unique_ptr<std::atomic<uint64_t>[]> markedShards;
+    std::atomic<size_t> workerCount{0};
+    std::atomic<uint64_t> stolenCount{0};
+    EventCount eventCounts[MAX_WORKER_THREADS];
+};
+
+#endif
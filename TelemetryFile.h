@@ -0,0 +1,82 @@
+#ifndef TELEMETRYFILE_H
+#define TELEMETRYFILE_H
+
+/*
+ * Layout of the telemetry files written by the TelemetryRecorder.
+ *
+ * Read by the analysis tools, so this header is plain C. All integers and
+ * floats are little-endian and every structure is packed.
+ *
+ *   TelemetryFileHeader
+ *   chunk, repeated until the end of the file:
+ *     TelemetryChunkHeader
+ *     TelemetryChannelIndex[channelCount], in ascending channel order
+ *     payload of payloadSize bytes
+ *
+ * The payload holds the samples of the chunk grouped by channel, in the
+ * order of the index, and stored in columns of sampleCount values:
+ *
+ *   uint64_t receiveTime[sampleCount]   host monotonic time in nanoseconds
+ *   uint64_t m4Timestamp[sampleCount]   M4 time of the measurement in microseconds
+ *   float    field[fieldCount][sampleCount]
+ *
+ * The fields are the measured fields of the M4 channel records, in order
+ * (voltage, current, temperature, capacity, energy, stepTime). If the
+ * chunk has TELEMETRY_CHUNK_LZ4 set, the payload is one LZ4 block that
+ * decompresses to rawSize bytes; otherwise payloadSize equals rawSize.
+ * The channel index is never compressed, so a reader can find the samples
+ * of a channel and the time span of a chunk without decoding its payload.
+ *
+ * A file that was not closed cleanly ends with zero bytes after the last
+ * chunk; a reader stops at the first chunk without the magic or extending
+ * past the end of the file.
+ */
+
+#include <stdint.h>
+
+/* "TLMF" in little-endian */
+#define TELEMETRY_FILE_MAGIC 0x464D4C54
+
+/* "TLMC" in little-endian */
+#define TELEMETRY_CHUNK_MAGIC 0x434D4C54
+
+/* Version of the file layout */
+#define TELEMETRY_FILE_VERSION 1
+
+/* Chunk flags */
+#define TELEMETRY_CHUNK_LZ4 0x1 /* payload is LZ4 compressed */
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;        /* TELEMETRY_FILE_MAGIC */
+    uint16_t version;      /* TELEMETRY_FILE_VERSION */
+    uint16_t fieldCount;   /* Float columns per sample */
+    uint32_t fileIndex;    /* Position of the file in the recording, from 0 */
+    uint32_t channelCount; /* Channels of the rack, global channel numbers are below it */
+    uint64_t startTime;    /* Host monotonic time at which the recording started, in nanoseconds */
+} TelemetryFileHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;        /* TELEMETRY_CHUNK_MAGIC */
+    uint32_t flags;        /* TELEMETRY_CHUNK_* */
+    uint32_t sampleCount;  /* Samples in the chunk */
+    uint32_t channelCount; /* Entries of the channel index */
+    uint32_t payloadSize;  /* Bytes stored after the channel index */
+    uint32_t rawSize;      /* Bytes of the uncompressed payload */
+    uint64_t firstTime;    /* Earliest receiveTime of the chunk */
+    uint64_t lastTime;     /* Latest receiveTime of the chunk */
+} TelemetryChunkHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t channel;      /* Global channel number */
+    uint32_t firstSample;  /* Row of the channel's first sample in the columns */
+    uint32_t sampleCount;  /* Consecutive rows of the channel, in reception order */
+    uint32_t reserved;
+} TelemetryChannelIndex;
+
+#ifdef __cplusplus
+static_assert(sizeof(TelemetryFileHeader) == 24, "TelemetryFileHeader layout changed");
+static_assert(sizeof(TelemetryChunkHeader) == 40, "TelemetryChunkHeader layout changed");
+static_assert(sizeof(TelemetryChannelIndex) == 16, "TelemetryChannelIndex layout changed");
+#endif
+
+#endif
@@ -0,0 +1,387 @@
+#include "TelemetryRecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef TELEMETRY_WITH_LZ4
+#include <lz4.h>
+#endif
+
+// Size of the file range mapped at a time, a multiple of the page size
+#define TELEMETRY_MAP_WINDOW_SIZE (8ULL << 20)
+
+// Largest number of samples per chunk, keeps the chunk sizes in 32 bits
+#define TELEMETRY_MAX_CHUNK_SAMPLES (1u << 20)
+
+// Time the writer sleeps when all rings are empty, in microseconds
+#define TELEMETRY_IDLE_SLEEP_US 1000
+
+namespace {
+
+// Bytes of one sample in the payload columns
+constexpr size_t SAMPLE_PAYLOAD_SIZE = 2 * sizeof(uint64_t) + CHANNEL_RAW_FIELD_COUNT * sizeof(float);
+
+} // namespace
+
+/**
+ * @brief Constructor for the TelemetryRecorder class. Allocates the rings.
+ *
+ * @param sourceCount The number of producer threads, one per ingest lane.
+ * @param channelCount The number of global channels.
+ * @param ringCapacity The number of samples each source can queue.
+ */
+TelemetryRecorder::TelemetryRecorder(size_t sourceCount, uint32_t channelCount, size_t ringCapacity) :
+    channelCount(channelCount),
+    recording(false),
+    running(false),
+    channelRows(channelCount, 0) {
+    for (size_t i = 0; i < sourceCount; ++i) {
+        sources.push_back(std::make_unique<Source>(ringCapacity));
+    }
+}
+
+/**
+ * @brief Destructor for the TelemetryRecorder class. Stops the recording.
+ */
+TelemetryRecorder::~TelemetryRecorder() {
+    stop();
+}
+
+/**
+ * @brief Opens the first file and starts recording.
+ *
+ * The chunk buffers are allocated here, so the writer does not allocate
+ * while recording.
+ *
+ * @param newConfig The files and chunking.
+ * @param error Receives the reason if the recording cannot be started.
+ * @return True if the recording started, false if it is already running or the file cannot be opened.
+ */
+bool TelemetryRecorder::start(const TelemetryRecorderConfig& newConfig, std::string& error) {
+    std::lock_guard<std::mutex> lock(controlMutex);
+    if (running.load()) {
+        error = "Telemetry recording already running";
+        return false;
+    }
+    if (newConfig.path.empty()) {
+        error = "No telemetry file path";
+        return false;
+    }
+#ifndef TELEMETRY_WITH_LZ4
+    if (newConfig.compress) {
+        error = "Telemetry compression needs a build with TELEMETRY_WITH_LZ4";
+        return false;
+    }
+#endif
+
+    config = newConfig;
+    config.chunkSamples = std::clamp<uint32_t>(config.chunkSamples, 1, TELEMETRY_MAX_CHUNK_SAMPLES);
+    staged.resize(config.chunkSamples);
+    stagedCount = 0;
+    channelIndex.reserve(std::min<size_t>(channelCount, config.chunkSamples));
+    payload.resize((config.chunkSamples * SAMPLE_PAYLOAD_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+#ifdef TELEMETRY_WITH_LZ4
+    if (config.compress) {
+        compressed.resize(LZ4_compressBound(static_cast<int>(config.chunkSamples * SAMPLE_PAYLOAD_SIZE)));
+    }
+#endif
+
+    startTime = monotonicNanoseconds();
+    fileIndex = 0;
+    if (!openFile(error)) {
+        return false;
+    }
+
+    running = true;
+    recording = true;
+    thread = std::thread(&TelemetryRecorder::threadFunction, this);
+    return true;
+}
+
+/**
+ * @brief Stops recording, writes the samples already queued and closes the file.
+ */
+void TelemetryRecorder::stop() {
+    std::lock_guard<std::mutex> lock(controlMutex);
+    recording = false;
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Gets a copy of the counters.
+ *
+ * @return The counters, summed over the sources.
+ */
+TelemetryStatistics TelemetryRecorder::getStatistics() const {
+    TelemetryStatistics statistics;
+    for (const auto& source : sources) {
+        statistics.samplesDropped += source->dropped.load(std::memory_order_relaxed);
+    }
+    statistics.samplesRecorded = samplesRecorded.load(std::memory_order_relaxed);
+    statistics.samplesLost = samplesLost.load(std::memory_order_relaxed);
+    statistics.chunksWritten = chunksWritten.load(std::memory_order_relaxed);
+    statistics.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+    statistics.filesWritten = filesWritten.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+/**
+ * @brief Writer thread function: drains the rings and writes full or expired chunks.
+ *
+ * Polls the rings, so the producers never pay for a wakeup. After stop()
+ * the rings are drained once more, so every sample queued before the
+ * recording stopped is written.
+ */
+void TelemetryRecorder::threadFunction() {
+    while (running.load(std::memory_order_relaxed)) {
+        size_t moved = drain();
+        if (stagedCount == staged.size() ||
+            (stagedCount > 0 && monotonicNanoseconds() - chunkStartTime >= config.flushIntervalNs)) {
+            writeChunk();
+        }
+        if (moved == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(TELEMETRY_IDLE_SLEEP_US));
+        }
+    }
+
+    size_t moved;
+    do {
+        moved = drain();
+        if (stagedCount == staged.size()) {
+            writeChunk();
+        }
+    } while (moved > 0);
+    if (stagedCount > 0) {
+        writeChunk();
+    }
+    closeFile();
+}
+
+/**
+ * @brief Moves queued samples into the current chunk until it is full.
+ *
+ * Samples received before the recording started are left over from the
+ * previous recording and are discarded.
+ *
+ * @return The number of samples taken from the rings.
+ */
+size_t TelemetryRecorder::drain() {
+    size_t moved = 0;
+    for (auto& source : sources) {
+        TelemetrySample sample;
+        while (stagedCount < staged.size() && source->ring.pop(sample)) {
+            ++moved;
+            if (sample.receiveTime < startTime || sample.channel >= channelCount) {
+                continue;
+            }
+            if (stagedCount == 0) {
+                chunkStartTime = monotonicNanoseconds();
+            }
+            staged[stagedCount++] = sample;
+        }
+    }
+    return moved;
+}
+
+/**
+ * @brief Groups the current chunk by channel and appends it to the file.
+ *
+ * A counting sort over the channel numbers builds the channel index and
+ * places each sample at its row in the columns, keeping the reception
+ * order of each channel. The recording moves to a new file first if the
+ * chunk would take the file past its maximum size.
+ */
+void TelemetryRecorder::writeChunk() {
+    uint32_t sampleCount = static_cast<uint32_t>(stagedCount);
+    stagedCount = 0;
+
+    TelemetryChunkHeader header{};
+    header.magic = TELEMETRY_CHUNK_MAGIC;
+    header.sampleCount = sampleCount;
+    uint64_t firstTime = UINT64_MAX;
+    uint64_t lastTime = 0;
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        ++channelRows[staged[i].channel];
+        firstTime = std::min(firstTime, staged[i].receiveTime);
+        lastTime = std::max(lastTime, staged[i].receiveTime);
+    }
+    header.firstTime = firstTime;
+    header.lastTime = lastTime;
+
+    channelIndex.clear();
+    uint32_t row = 0;
+    for (uint32_t channel = 0; channel < channelCount; ++channel) {
+        uint32_t count = channelRows[channel];
+        if (count != 0) {
+            channelIndex.push_back(TelemetryChannelIndex{channel, row, count, 0});
+            channelRows[channel] = row;
+            row += count;
+        }
+    }
+    header.channelCount = static_cast<uint32_t>(channelIndex.size());
+
+    uint64_t* receiveTimes = payload.data();
+    uint64_t* m4Timestamps = receiveTimes + sampleCount;
+    float* fields = reinterpret_cast<float*>(m4Timestamps + sampleCount);
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        const TelemetrySample& sample = staged[i];
+        uint32_t target = channelRows[sample.channel]++;
+        receiveTimes[target] = sample.receiveTime;
+        m4Timestamps[target] = sample.m4Timestamp;
+        for (size_t f = 0; f < CHANNEL_RAW_FIELD_COUNT; ++f) {
+            fields[f * sampleCount + target] = sample.values[f];
+        }
+    }
+    for (const TelemetryChannelIndex& entry : channelIndex) {
+        channelRows[entry.channel] = 0;
+    }
+
+    header.rawSize = static_cast<uint32_t>(sampleCount * SAMPLE_PAYLOAD_SIZE);
+    header.payloadSize = header.rawSize;
+    const void* data = payload.data();
+#ifdef TELEMETRY_WITH_LZ4
+    if (config.compress) {
+        int size = LZ4_compress_default(reinterpret_cast<const char*>(payload.data()), compressed.data(),
+            static_cast<int>(header.rawSize), static_cast<int>(compressed.size()));
+        if (size > 0 && static_cast<uint32_t>(size) < header.rawSize) {
+            header.flags |= TELEMETRY_CHUNK_LZ4;
+            header.payloadSize = static_cast<uint32_t>(size);
+            data = compressed.data();
+        }
+    }
+#endif
+
+    size_t indexSize = channelIndex.size() * sizeof(TelemetryChannelIndex);
+    uint64_t chunkSize = sizeof(header) + indexSize + header.payloadSize;
+    std::string error;
+    if (fd >= 0 && fileSize > sizeof(TelemetryFileHeader) && fileSize + chunkSize > config.maxFileSize) {
+        closeFile();
+        ++fileIndex;
+        if (!openFile(error)) {
+            std::cerr << error << std::endl;
+        }
+    }
+
+    // A chunk that cannot be written completely is overwritten by the next one
+    uint64_t chunkOffset = fileSize;
+    if (fd < 0 || !append(&header, sizeof(header)) || !append(channelIndex.data(), indexSize) ||
+        !append(data, header.payloadSize)) {
+        fileSize = chunkOffset;
+        increment(samplesLost, sampleCount);
+        return;
+    }
+    increment(samplesRecorded, sampleCount);
+    increment(chunksWritten, 1);
+    increment(bytesWritten, chunkSize);
+}
+
+/**
+ * @brief Creates file fileIndex of the recording and writes its header.
+ *
+ * @param error Receives the reason if the file cannot be created.
+ * @return True on success.
+ */
+bool TelemetryRecorder::openFile(std::string& error) {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%04u.tlm", fileIndex);
+    std::string name = config.path + suffix;
+
+    fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "Cannot create telemetry file " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    fileSize = 0;
+
+    TelemetryFileHeader header{};
+    header.magic = TELEMETRY_FILE_MAGIC;
+    header.version = TELEMETRY_FILE_VERSION;
+    header.fieldCount = CHANNEL_RAW_FIELD_COUNT;
+    header.fileIndex = fileIndex;
+    header.channelCount = channelCount;
+    header.startTime = startTime;
+    if (!append(&header, sizeof(header))) {
+        error = "Cannot write telemetry file " + name;
+        closeFile();
+        return false;
+    }
+    increment(filesWritten, 1);
+    increment(bytesWritten, sizeof(header));
+    return true;
+}
+
+/**
+ * @brief Unmaps the window and truncates the file to the bytes written.
+ */
+void TelemetryRecorder::closeFile() {
+    if (window) {
+        munmap(window, TELEMETRY_MAP_WINDOW_SIZE);
+        window = nullptr;
+    }
+    if (fd >= 0) {
+        if (ftruncate(fd, static_cast<off_t>(fileSize)) != 0 || fdatasync(fd) != 0) {
+            std::cerr << "Cannot finish telemetry file: " << std::strerror(errno) << std::endl;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+/**
+ * @brief Appends bytes to the file through the mapped window.
+ *
+ * When the window is full, the next range of the file is allocated with
+ * posix_fallocate, so a full disk is reported here rather than by a
+ * SIGBUS on a store, and mapped.
+ *
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return True on success, false if the file cannot grow.
+ */
+bool TelemetryRecorder::append(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        if (!window || fileSize < windowOffset || fileSize >= windowOffset + TELEMETRY_MAP_WINDOW_SIZE) {
+            if (window) {
+                munmap(window, TELEMETRY_MAP_WINDOW_SIZE);
+                window = nullptr;
+            }
+            windowOffset = fileSize - fileSize % TELEMETRY_MAP_WINDOW_SIZE;
+            int error = posix_fallocate(fd, static_cast<off_t>(windowOffset), TELEMETRY_MAP_WINDOW_SIZE);
+            if (error != 0) {
+                if (samplesLost.load(std::memory_order_relaxed) == 0) {
+                    std::cerr << "Cannot extend telemetry file: " << std::strerror(error) << std::endl;
+                }
+                return false;
+            }
+            void* mapped = mmap(nullptr, TELEMETRY_MAP_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                static_cast<off_t>(windowOffset));
+            if (mapped == MAP_FAILED) {
+                if (samplesLost.load(std::memory_order_relaxed) == 0) {
+                    std::cerr << "Cannot map telemetry file: " << std::strerror(errno) << std::endl;
+                }
+                return false;
+            }
+            window = static_cast<uint8_t*>(mapped);
+        }
+
+        size_t offset = static_cast<size_t>(fileSize - windowOffset);
+        size_t count = std::min<size_t>(size, TELEMETRY_MAP_WINDOW_SIZE - offset);
+        std::memcpy(window + offset, bytes, count);
+        fileSize += count;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
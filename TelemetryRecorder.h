@@ -0,0 +1,223 @@
+#ifndef TELEMETRYRECORDER_H
+#define TELEMETRYRECORDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChannelDataTable.h"
+#include "Platform.h"
+#include "SpscRing.h"
+#include "TelemetryFile.h"
+
+// Samples each ingest thread can queue ahead of the writer before samples are dropped
+#define TELEMETRY_RING_CAPACITY 65536
+
+// Default number of samples per chunk
+#define DEFAULT_TELEMETRY_CHUNK_SAMPLES 8192
+
+// Default longest time a sample waits in a partial chunk, in nanoseconds
+#define DEFAULT_TELEMETRY_FLUSH_INTERVAL_NS 200000000ULL
+
+// Default size after which the recording continues in a new file
+#define DEFAULT_TELEMETRY_MAX_FILE_SIZE (1ULL << 30)
+
+/**
+ * @brief Where and how the TelemetryRecorder writes.
+ */
+struct TelemetryRecorderConfig {
+    // Prefix of the files; file n of the recording is "<path>.<n>.tlm", n on 4 digits
+    std::string path;
+    uint32_t chunkSamples = DEFAULT_TELEMETRY_CHUNK_SAMPLES;
+    uint64_t flushIntervalNs = DEFAULT_TELEMETRY_FLUSH_INTERVAL_NS;
+    uint64_t maxFileSize = DEFAULT_TELEMETRY_MAX_FILE_SIZE;
+    // LZ4-compress the chunk payloads; needs a build with TELEMETRY_WITH_LZ4
+    bool compress = false;
+};
+
+/**
+ * @brief Counters of the TelemetryRecorder, since construction.
+ */
+struct TelemetryStatistics {
+    uint64_t samplesRecorded = 0;  // Samples written to the files
+    uint64_t samplesDropped = 0;   // Samples lost because a ring was full
+    uint64_t samplesLost = 0;      // Samples lost because a chunk could not be written
+    uint64_t chunksWritten = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t filesWritten = 0;
+};
+
+/**
+ * @brief One measured sample of a channel, as queued by an ingest thread.
+ */
+struct TelemetrySample {
+    uint64_t receiveTime;  // Host monotonic time in nanoseconds
+    uint64_t m4Timestamp;  // M4 time of the measurement in microseconds
+    uint32_t channel;      // Global channel number
+    float values[CHANNEL_RAW_FIELD_COUNT];
+};
+
+/**
+ * @brief Streams every sample received from the M4 cores to telemetry files.
+ *
+ * Each ingest thread is a source with its own lock-free SPSC ring, so
+ * recording costs the ingest path one copy of the measured fields per
+ * sample and never blocks it: when a ring is full the sample is dropped
+ * and counted. A writer thread drains the rings into chunks, groups the
+ * samples of each chunk by channel into columns (see TelemetryFile.h) and
+ * appends them through a memory-mapped window of the file, optionally
+ * LZ4-compressed. Files are rotated at the configured size.
+ *
+ * record() may only be called by the thread of its source; start(), stop()
+ * and getStatistics() may be called from any thread.
+ */
+class TelemetryRecorder {
+public:
+    /**
+     * @brief Constructor for the TelemetryRecorder class. Allocates the rings.
+     *
+     * @param sourceCount The number of producer threads, one per ingest lane.
+     * @param channelCount The number of global channels.
+     * @param ringCapacity The number of samples each source can queue.
+     */
+    TelemetryRecorder(size_t sourceCount, uint32_t channelCount, size_t ringCapacity = TELEMETRY_RING_CAPACITY);
+
+    /**
+     * @brief Destructor for the TelemetryRecorder class. Stops the recording.
+     */
+    ~TelemetryRecorder();
+
+    TelemetryRecorder(const TelemetryRecorder&) = delete;
+    TelemetryRecorder& operator=(const TelemetryRecorder&) = delete;
+
+    /**
+     * @brief Opens the first file and starts recording.
+     *
+     * @param config The files and chunking.
+     * @param error Receives the reason if the recording cannot be started.
+     * @return True if the recording started, false if it is already running or the file cannot be opened.
+     */
+    bool start(const TelemetryRecorderConfig& config, std::string& error);
+
+    /**
+     * @brief Stops recording, writes the samples already queued and closes the file.
+     */
+    void stop();
+
+    /**
+     * @brief Checks if a recording is running.
+     *
+     * @return True between start() and stop().
+     */
+    bool isRecording() const {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Queues a sample for the writer. Never blocks, does nothing if not recording.
+     *
+     * @param source The source of the calling thread.
+     * @param channel The global channel number.
+     * @param m4Timestamp The M4 time of the measurement in microseconds.
+     * @param receiveTime The host monotonic time in nanoseconds at which the sample was received.
+     * @param sample The sample; its measured fields are recorded.
+     */
+    void record(size_t source, uint32_t channel, uint64_t m4Timestamp, uint64_t receiveTime,
+        const ChannelSample& sample) {
+        if (!recording.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Source& queue = *sources[source];
+        TelemetrySample entry;
+        entry.receiveTime = receiveTime;
+        entry.m4Timestamp = m4Timestamp;
+        entry.channel = channel;
+        for (size_t i = 0; i < CHANNEL_RAW_FIELD_COUNT; ++i) {
+            entry.values[i] = sample.values[i];
+        }
+        if (!queue.ring.push(entry)) {
+            queue.dropped.store(queue.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Gets a copy of the counters.
+     *
+     * @return The counters, summed over the sources.
+     */
+    TelemetryStatistics getStatistics() const;
+
+private:
+    /**
+     * @brief The ring of one producer thread, and its drop counter.
+     */
+    struct Source {
+        explicit Source(size_t capacity) : ring(capacity) {}
+
+        SpscRing<TelemetrySample> ring;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dropped{0};  // Written by the producer only
+    };
+
+    // Writer thread function: drains the rings and writes full or expired chunks
+    void threadFunction();
+
+    // Moves queued samples into the current chunk until it is full, returns the number moved
+    size_t drain();
+
+    // Groups the current chunk by channel and appends it to the file
+    void writeChunk();
+
+    // Creates file fileIndex and writes its header
+    bool openFile(std::string& error);
+
+    // Unmaps the window and truncates the file to the bytes written
+    void closeFile();
+
+    // Appends bytes to the file through the mapped window
+    bool append(const void* data, size_t size);
+
+    // Adds to a counter written by the writer thread only
+    static void increment(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    const uint32_t channelCount;
+    std::vector<std::unique_ptr<Source>> sources;
+
+    std::atomic<bool> recording;  // Checked by the producers
+    std::atomic<bool> running;    // Checked by the writer thread
+    std::mutex controlMutex;      // Serializes start() and stop()
+    std::thread thread;
+
+    // State of the writer thread
+    TelemetryRecorderConfig config;
+    uint64_t startTime = 0;
+    uint64_t chunkStartTime = 0;
+    std::vector<TelemetrySample> staged;
+    size_t stagedCount = 0;
+    std::vector<uint32_t> channelRows;               // Per channel: sample count, then next row
+    std::vector<TelemetryChannelIndex> channelIndex;
+    std::vector<uint64_t> payload;                   // Columns of the chunk, 8-byte aligned
+    std::vector<char> compressed;
+
+    // File being written
+    int fd = -1;
+    uint32_t fileIndex = 0;
+    uint64_t fileSize = 0;         // Bytes written to the file
+    uint8_t* window = nullptr;     // Mapped range [windowOffset, windowOffset + TELEMETRY_MAP_WINDOW_SIZE)
+    uint64_t windowOffset = 0;
+
+    // Counters written by the writer thread
+    std::atomic<uint64_t> samplesRecorded{0};
+    std::atomic<uint64_t> samplesLost{0};
+    std::atomic<uint64_t> chunksWritten{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> filesWritten{0};
+};
+
+#endif
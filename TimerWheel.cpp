@@ -0,0 +1,163 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+namespace {
+
+// Bits of the tick consumed by each level
+constexpr uint32_t LEVEL_BITS = 6;
+static_assert(TIMER_WHEEL_SLOTS == 1 << LEVEL_BITS, "The occupancy bitmaps hold one bit per slot");
+
+// Number of ticks covered by the whole wheel
+constexpr uint64_t WHEEL_SPAN = 1ULL << (LEVEL_BITS * TIMER_WHEEL_LEVELS);
+
+} // namespace
+
+/**
+ * @brief Constructor for the TimerWheel class.
+ *
+ * @param timerCount The number of timers, none armed.
+ * @param now Monotonic time in nanoseconds the wheel starts at.
+ */
+TimerWheel::TimerWheel(size_t timerCount, uint64_t now) :
+    timerCount(timerCount), nodes(new Node[timerCount]), currentTick(now / TIMER_WHEEL_TICK_NS) {
+    std::fill(std::begin(heads), std::end(heads), NO_TIMER);
+}
+
+/**
+ * @brief Arms a timer, or moves it if it is already armed.
+ *
+ * @param timer The timer index.
+ * @param deadline Monotonic time in nanoseconds; a past deadline fires on the next advance().
+ */
+void TimerWheel::arm(uint32_t timer, uint64_t deadline) {
+    if (timer >= timerCount) {
+        return;
+    }
+    if (nodes[timer].slot != NO_SLOT) {
+        unlink(timer);
+    }
+    nodes[timer].deadlineTick = (deadline + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+    insert(timer, currentTick + 1);
+}
+
+/**
+ * @brief Disarms a timer.
+ *
+ * @param timer The timer index.
+ * @return True if the timer was armed.
+ */
+bool TimerWheel::cancel(uint32_t timer) {
+    if (!isArmed(timer)) {
+        return false;
+    }
+    unlink(timer);
+    return true;
+}
+
+/**
+ * @brief Gets how long the driving thread may sleep before the next advance() is due.
+ *
+ * The timeout ends at the next occupied level-0 slot, or at the next
+ * cascade, so a wheel holding only distant timers is advanced once every
+ * TIMER_WHEEL_SLOTS ticks.
+ *
+ * @param now Monotonic time in nanoseconds.
+ * @return The timeout in milliseconds, -1 if no timer is armed.
+ */
+int TimerWheel::getTimeoutMs(uint64_t now) const {
+    if (armedCount == 0) {
+        return -1;
+    }
+    uint64_t nextTick = (currentTick | (TIMER_WHEEL_SLOTS - 1)) + 1;
+    if (occupied[0] != 0) {
+        // Rotate the bitmap so that bit 0 is the slot of currentTick + 1
+        uint32_t shift = static_cast<uint32_t>((currentTick + 1) & (TIMER_WHEEL_SLOTS - 1));
+        uint64_t rotated = shift == 0 ? occupied[0] : (occupied[0] >> shift) | (occupied[0] << (64 - shift));
+        nextTick = std::min(nextTick, currentTick + 1 + static_cast<uint64_t>(__builtin_ctzll(rotated)));
+    }
+    uint64_t due = nextTick * TIMER_WHEEL_TICK_NS;
+    if (due <= now) {
+        return 0;
+    }
+    return static_cast<int>((due - now + 999999) / 1000000);
+}
+
+/**
+ * @brief Links an armed timer into the slot of its deadline.
+ *
+ * The level is chosen by the distance from currentTick; a deadline beyond
+ * the span of the wheel is parked in the last slot of the top level and
+ * placed again when that slot is cascaded.
+ *
+ * @param timer The timer index.
+ * @param earliestTick The first tick the timer may fire at.
+ */
+void TimerWheel::insert(uint32_t timer, uint64_t earliestTick) {
+    Node& node = nodes[timer];
+    uint64_t tick = std::max(node.deadlineTick, earliestTick);
+    tick = std::min(tick, currentTick + WHEEL_SPAN - 1);
+
+    uint64_t distance = tick - currentTick;
+    uint32_t level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && distance >= (1ULL << (LEVEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    uint32_t index = static_cast<uint32_t>((tick >> (LEVEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    uint16_t slot = static_cast<uint16_t>(level * TIMER_WHEEL_SLOTS + index);
+
+    node.slot = slot;
+    node.prev = NO_TIMER;
+    node.next = heads[slot];
+    if (node.next != NO_TIMER) {
+        nodes[node.next].prev = timer;
+    }
+    heads[slot] = timer;
+    occupied[level] |= 1ULL << index;
+    ++armedCount;
+}
+
+/**
+ * @brief Removes a timer from its slot.
+ *
+ * @param timer The timer index, which must be armed.
+ */
+void TimerWheel::unlink(uint32_t timer) {
+    Node& node = nodes[timer];
+    if (node.prev != NO_TIMER) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.slot] = node.next;
+    }
+    if (node.next != NO_TIMER) {
+        nodes[node.next].prev = node.prev;
+    }
+    if (heads[node.slot] == NO_TIMER) {
+        occupied[node.slot / TIMER_WHEEL_SLOTS] &= ~(1ULL << (node.slot % TIMER_WHEEL_SLOTS));
+    }
+    node.slot = NO_SLOT;
+    node.next = NO_TIMER;
+    node.prev = NO_TIMER;
+    --armedCount;
+}
+
+/**
+ * @brief Moves the timers of the higher-level slots that start at currentTick down the wheel.
+ *
+ * Level n is cascaded each time the levels below it wrap; its timers are
+ * then due within the span of level n - 1 and land in a lower level.
+ */
+void TimerWheel::cascade() {
+    for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        if ((currentTick & ((1ULL << (LEVEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        uint32_t index = static_cast<uint32_t>((currentTick >> (LEVEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        uint32_t& head = heads[level * TIMER_WHEEL_SLOTS + index];
+        while (head != NO_TIMER) {
+            uint32_t timer = head;
+            unlink(timer);
+            insert(timer, currentTick);
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Resolution of the timer wheels in nanoseconds
+#define TIMER_WHEEL_TICK_NS 1000000ULL
+// Slots per level of a timer wheel
+#define TIMER_WHEEL_SLOTS 64
+// Levels of a timer wheel; 5 levels of 64 slots span 2^30 ticks, about 12 days
+#define TIMER_WHEEL_LEVELS 5
+
+/**
+ * @brief Hierarchical timer wheel of a fixed set of timers.
+ *
+ * Every timer is a preallocated node identified by its index, linked into
+ * the slot of its deadline, so arm() and cancel() are O(1) and never
+ * allocate. Level 0 holds the timers due within TIMER_WHEEL_SLOTS ticks,
+ * one slot per tick; each higher level covers TIMER_WHEEL_SLOTS times the
+ * span of the one below and is cascaded down when the lower level wraps.
+ * Deadlines are rounded up to the next tick, so a timer never fires early.
+ *
+ * The wheel is not thread-safe: it belongs to the thread that drives it
+ * with advance().
+ */
+class TimerWheel {
+public:
+    /**
+     * @brief Constructor for the TimerWheel class.
+     *
+     * @param timerCount The number of timers, none armed.
+     * @param now Monotonic time in nanoseconds the wheel starts at.
+     */
+    TimerWheel(size_t timerCount, uint64_t now);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * @brief Arms a timer, or moves it if it is already armed.
+     *
+     * @param timer The timer index.
+     * @param deadline Monotonic time in nanoseconds; a past deadline fires on the next advance().
+     */
+    void arm(uint32_t timer, uint64_t deadline);
+
+    /**
+     * @brief Disarms a timer.
+     *
+     * @param timer The timer index.
+     * @return True if the timer was armed.
+     */
+    bool cancel(uint32_t timer);
+
+    /**
+     * @brief Checks if a timer is armed.
+     *
+     * @param timer The timer index.
+     * @return True if the timer is armed.
+     */
+    bool isArmed(uint32_t timer) const {
+        return timer < timerCount && nodes[timer].slot != NO_SLOT;
+    }
+
+    /**
+     * @brief Gets the number of armed timers.
+     *
+     * @return The count.
+     */
+    size_t getArmedCount() const { return armedCount; }
+
+    /**
+     * @brief Gets how long the driving thread may sleep before the next advance() is due.
+     *
+     * @param now Monotonic time in nanoseconds.
+     * @return The timeout in milliseconds, -1 if no timer is armed.
+     */
+    int getTimeoutMs(uint64_t now) const;
+
+    /**
+     * @brief Advances the wheel to the given time and fires the timers that are due.
+     *
+     * A fired timer is disarmed before onExpire is called with its index, so
+     * the callback may arm or cancel any timer, including the one that fired.
+     *
+     * @param now Monotonic time in nanoseconds.
+     * @param onExpire Called with the index of each timer that fired.
+     * @return The number of timers that fired.
+     */
+    template <typename OnExpire>
+    size_t advance(uint64_t now, OnExpire&& onExpire) {
+        uint64_t target = now / TIMER_WHEEL_TICK_NS;
+        size_t fired = 0;
+        while (currentTick < target) {
+            if (armedCount == 0) {
+                currentTick = target;
+                break;
+            }
+            if (occupied[0] == 0) {
+                // Nothing is due before the next cascade: skip to the tick before it
+                uint64_t lastTick = currentTick | (TIMER_WHEEL_SLOTS - 1);
+                if (lastTick >= target) {
+                    currentTick = target;
+                    break;
+                }
+                currentTick = lastTick;
+            }
+            ++currentTick;
+            cascade();
+
+            uint32_t& head = heads[currentTick & (TIMER_WHEEL_SLOTS - 1)];
+            while (head != NO_TIMER) {
+                uint32_t timer = head;
+                unlink(timer);
+                onExpire(timer);
+                ++fired;
+            }
+        }
+        return fired;
+    }
+
+private:
+    static constexpr uint32_t NO_TIMER = 0xFFFFFFFFu;
+    static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+    struct Node {
+        uint32_t next = NO_TIMER;
+        uint32_t prev = NO_TIMER;
+        uint64_t deadlineTick = 0;
+        uint16_t slot = NO_SLOT;    // Index into heads, NO_SLOT when disarmed
+    };
+
+    // Links an armed timer into the slot of its deadline, which must be at least earliestTick
+    void insert(uint32_t timer, uint64_t earliestTick);
+    // Removes a timer from its slot
+    void unlink(uint32_t timer);
+    // Moves the timers of the higher-level slots that start at currentTick down the wheel
+    void cascade();
+
+    size_t timerCount;
+    std::unique_ptr<Node[]> nodes;
+    uint32_t heads[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS] = {};    // Bit n is set if slot n of the level holds timers
+    uint64_t currentTick;                           // Last tick processed by advance()
+    size_t armedCount = 0;
+};
+
+#endif
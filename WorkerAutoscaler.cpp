@@ -0,0 +1,42 @@
+#include "WorkerAutoscaler.h"
+
+#include <algorithm>
+
+/**
+ * @brief Constructor for the WorkerAutoscaler class.
+ *
+ * @param config The bounds and thresholds; maxWorkers is raised to minWorkers if lower.
+ */
+WorkerAutoscaler::WorkerAutoscaler(const WorkerAutoscalerConfig& config) : config(config), calmIntervals(0) {
+    this->config.minWorkers = std::max<size_t>(this->config.minWorkers, 1);
+    this->config.maxWorkers = std::max(this->config.maxWorkers, this->config.minWorkers);
+}
+
+/**
+ * @brief Decides the number of workers for the next interval.
+ *
+ * @param currentWorkers The number of workers during the interval.
+ * @param queueDepth The number of queued tasks at the end of the interval.
+ * @param maxLatencyNs The worst time a task waited in the queue during the interval.
+ * @return The number of workers to run, within [minWorkers, maxWorkers].
+ */
+size_t WorkerAutoscaler::decide(size_t currentWorkers, size_t queueDepth, uint64_t maxLatencyNs) {
+    size_t workers = std::clamp(currentWorkers, config.minWorkers, config.maxWorkers);
+    uint64_t latencyUs = maxLatencyNs / 1000;
+
+    if (queueDepth >= config.scaleUpQueueDepth || latencyUs >= config.scaleUpLatencyUs) {
+        calmIntervals = 0;
+        return std::min(workers + 1, config.maxWorkers);
+    }
+
+    if (latencyUs > config.scaleDownLatencyUs) {
+        calmIntervals = 0;
+        return workers;
+    }
+
+    if (++calmIntervals >= config.scaleDownIntervals) {
+        calmIntervals = 0;
+        return std::max(workers - 1, config.minWorkers);
+    }
+    return workers;
+}
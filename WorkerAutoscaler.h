@@ -0,0 +1,59 @@
+#ifndef WORKERAUTOSCALER_H
+#define WORKERAUTOSCALER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Bounds and thresholds of the worker autoscaler.
+ */
+struct WorkerAutoscalerConfig {
+    size_t minWorkers = 1;
+    size_t maxWorkers = 8;
+    uint32_t intervalMs = 100;          // Sampling interval
+    size_t scaleUpQueueDepth = 64;      // Queued tasks that add a worker
+    uint64_t scaleUpLatencyUs = 1000;   // Worst queueing latency of an interval that adds a worker
+    uint64_t scaleDownLatencyUs = 100;  // Worst queueing latency of a calm interval
+    uint32_t scaleDownIntervals = 10;   // Consecutive calm intervals that remove a worker
+};
+
+/**
+ * @brief Decides the number of worker threads from queue depth and task latency.
+ *
+ * The autoscaler only decides; the caller samples the scheduler once per
+ * interval and applies the result. A worker is added as soon as one
+ * interval is overloaded, and removed only after scaleDownIntervals calm
+ * intervals in a row, so the pool does not oscillate around a threshold.
+ */
+class WorkerAutoscaler {
+public:
+    /**
+     * @brief Constructor for the WorkerAutoscaler class.
+     *
+     * @param config The bounds and thresholds; maxWorkers is raised to minWorkers if lower.
+     */
+    explicit WorkerAutoscaler(const WorkerAutoscalerConfig& config);
+
+    /**
+     * @brief Decides the number of workers for the next interval.
+     *
+     * @param currentWorkers The number of workers during the interval.
+     * @param queueDepth The number of queued tasks at the end of the interval.
+     * @param maxLatencyNs The worst time a task waited in the queue during the interval.
+     * @return The number of workers to run, within [minWorkers, maxWorkers].
+     */
+    size_t decide(size_t currentWorkers, size_t queueDepth, uint64_t maxLatencyNs);
+
+    /**
+     * @brief Gets the configuration.
+     *
+     * @return The bounds and thresholds.
+     */
+    const WorkerAutoscalerConfig& getConfig() const { return config; }
+
+private:
+    WorkerAutoscalerConfig config;
+    uint32_t calmIntervals;
+};
+
+#endif
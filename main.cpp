@@ -11,7 +11,8 @@ int main() {
     BatteryTestingService service;
 
     // Example usage:
-    service.runCCCV(1, 2.0f, 4.2f); // Channel 1, 2.0A, target 4.2V
+    std::vector<StepLimit> limits = {{"capacity", 2.5f}}; // Stop after 2.5Ah
+    service.runCCCV(1, 2.0f, 4.2f, limits); // Channel 1, 2.0A, target 4.2V
 
     return 0;
 }
\ No newline at end of file